@@ -14,15 +14,28 @@
 #include "unit_tests.h"
 #include "util.h"
 
-bool action_run_unit_tests(Editor_State *state)
+void _action_show_test_log(Editor_State *state, Text_Buffer log_buffer)
 {
     v2 mouse_canvas_pos = screen_pos_to_canvas_pos(state->mouse_state.pos, state->canvas_viewport);;
-    Text_Buffer log_buffer = {0};
-    unit_tests_run(&log_buffer, true);
     View *view = create_buffer_view_generic((Rect){mouse_canvas_pos.x, mouse_canvas_pos.y, 800, 400}, state);
     buffer_replace_text_buffer(view->bv.buffer, log_buffer);
     view->bv.cursor.pos = cursor_pos_to_end_of_buffer(log_buffer, view->bv.cursor.pos);
     viewport_snap_to_cursor(log_buffer, view->bv.cursor.pos, &view->bv.viewport, &state->render_state);
+}
+
+bool action_run_unit_tests(Editor_State *state)
+{
+    Text_Buffer log_buffer = {0};
+    unit_tests_run(&log_buffer, true);
+    _action_show_test_log(state, log_buffer);
+    return true;
+}
+
+bool action_run_benchmarks(Editor_State *state)
+{
+    Text_Buffer log_buffer = {0};
+    unit_tests_run_benchmarks(&log_buffer, true);
+    _action_show_test_log(state, log_buffer);
     return true;
 }
 
@@ -166,6 +179,23 @@ bool action_prompt_new_file(Editor_State *state)
     return true;
 }
 
+bool action_prompt_search_everywhere(Editor_State *state)
+{
+    v2 mouse_canvas_pos = screen_pos_to_canvas_pos(state->mouse_state.pos, state->canvas_viewport);
+    View *prompt_view = create_buffer_view_prompt(
+        "Search everywhere:",
+        prompt_create_context_search_everywhere(),
+        (Rect){mouse_canvas_pos.x, mouse_canvas_pos.y, 400, 100},
+        state);
+    if (state->prev_search && !state->prev_search_is_regex)
+    {
+        Text_Line current_path_line = text_line_make_f("%s", state->prev_search);
+        text_buffer_insert_line(&prompt_view->bv.buffer->text_buffer, current_path_line, 1);
+        prompt_view->bv.cursor.pos = cursor_pos_to_end_of_line(prompt_view->bv.buffer->text_buffer, (Cursor_Pos){1, 0});
+    }
+    return true;
+}
+
 const char *_action_save_workspace_get_view_kind_str(View_Kind kind)
 {
     switch (kind)
@@ -187,20 +217,82 @@ const char *_action_save_workspace_get_view_kind_str(View_Kind kind)
     }
 }
 
-void _action_save_workspace_save_text_buffer_to_temp_loc(Text_Buffer tb, String_Builder *sb)
+uint64_t _action_save_workspace_hash_text_buffer(Text_Buffer tb)
+{
+    uint64_t hash = MODULE_HASH_SEED;
+    for (int i = 0; i < tb.line_count; i++)
+    {
+        hash = module_hash(hash, tb.lines[i].str, tb.lines[i].len);
+    }
+    return hash;
+}
+
+char *_action_save_workspace_get_snapshot_path(uint64_t hash)
 {
-    time_t now = time(NULL);
-    int r = rand() % 100000;
-    char *temp_path = strf(E2_TEMP_FILES "/%ld_%d.tmp", now, r);
-    text_buffer_write_to_file(tb, temp_path);
-    string_builder_append_f(sb, "  TEMP_PATH='%s'\n", temp_path);
-    free(temp_path);
+    return strf(E2_TEMP_FILES "/%016llx.snapshot", (unsigned long long)hash);
 }
 
-bool action_save_workspace(Editor_State *state)
+// Snapshots are named by the hash of their text, so a buffer that hasn't changed since the
+// last save keeps pointing at the file it already has, and equal texts share one file
+void _action_save_workspace_save_buffer_snapshot(Buffer *b, String_Builder *sb)
+{
+    if (!b->has_snapshot || b->snapshot_generation != b->text_buffer.generation)
+    {
+        b->snapshot_hash = _action_save_workspace_hash_text_buffer(b->text_buffer);
+        b->snapshot_generation = b->text_buffer.generation;
+        b->has_snapshot = true;
+    }
+
+    char *snapshot_path = _action_save_workspace_get_snapshot_path(b->snapshot_hash);
+    if (!os_file_exists(snapshot_path))
+    {
+        // Written under another name first, a crash mid-write must not leave a snapshot with the wrong text
+        char *temp_path = strf("%s.tmp", snapshot_path);
+        text_buffer_write_to_file(b->text_buffer, temp_path);
+        if (rename(temp_path, snapshot_path) != 0) log_warning("Failed to move snapshot to %s", snapshot_path);
+        free(temp_path);
+    }
+    string_builder_append_f(sb, "  TEMP_PATH='%s'\n", snapshot_path);
+    free(snapshot_path);
+}
+
+// Anything in the temp files dir the workspace no longer points at is garbage,
+// including snapshots of text that has since been edited again
+void _action_save_workspace_remove_unreferenced_snapshots(Editor_State *state)
 {
-    clear_dir(E2_TEMP_FILES);
+    DIR *d = opendir(E2_TEMP_FILES);
+    if (!d)
+    {
+        log_warning("Failed to open dir at %s", E2_TEMP_FILES);
+        return;
+    }
 
+    struct dirent *entry;
+    char filepath[1024];
+    while ((entry = readdir(d)))
+    {
+        if (entry->d_type != DT_REG) continue;
+        unsigned long long hash;
+        int name_len = 0;
+        bool is_referenced = false;
+        if (sscanf(entry->d_name, "%16llx.snapshot%n", &hash, &name_len) == 1 && entry->d_name[name_len] == '\0')
+        {
+            for (int i = 0; i < state->buffer_count && !is_referenced; i++)
+            {
+                Buffer *b = state->buffers[i];
+                is_referenced = b->has_snapshot && b->snapshot_hash == hash;
+            }
+        }
+        if (is_referenced) continue;
+        snprintf(filepath, sizeof(filepath), "%s/%s", E2_TEMP_FILES, entry->d_name);
+        unlink(filepath);
+    }
+
+    closedir(d);
+}
+
+bool action_save_workspace(Editor_State *state)
+{
     String_Builder sb = {0};
 
     string_builder_append_f(&sb, "WORK_DIR='%s'\n", state->working_dir);
@@ -232,7 +324,12 @@ bool action_save_workspace(Editor_State *state)
                     Buffer *b = bv->buffer;
                     if (b->prompt_context.kind == PROMPT_NONE) // Don't save prompt views
                     {
-                        _action_save_workspace_save_text_buffer_to_temp_loc(b->text_buffer, &sb);
+                        // Read-only large files, and files without unsaved edits, are reopened from their path
+                        bool is_in_sync_with_file = b->file_path && b->text_buffer.generation == b->disk_generation && os_file_exists(b->file_path);
+                        if (!b->large_file && !is_in_sync_with_file)
+                        {
+                            _action_save_workspace_save_buffer_snapshot(b, &sb);
+                        }
                         if (b->file_path)
                         {
                             string_builder_append_f(&sb, "  FILE_PATH='%s'\n", b->file_path);
@@ -243,7 +340,7 @@ bool action_save_workspace(Editor_State *state)
                 case VIEW_KIND_LIVE_SCENE:
                 {
                     Live_Scene *ls = view->lsv.live_scene;
-                    string_builder_append_f(&sb, "  DL_PATH='%s'\n", ls->dylib.original_path);
+                    string_builder_append_f(&sb, "  DL_PATH='%s'\n", ls->dylib.module.original_path);
                     // TODO: Save live scene state?!!
                 } break;
 
@@ -260,6 +357,8 @@ bool action_save_workspace(Editor_State *state)
     file_write(E2_WORKSPACE, content);
     free(content);
 
+    _action_save_workspace_remove_unreferenced_snapshots(state);
+
     return true;
 }
 
@@ -476,7 +575,12 @@ bool _action_load_workspace_parse_view_kvs(Parser_State *ps, Editor_State *state
                 bool read_success = text_buffer_read_from_file(temp_path, &content);
                 if (read_success)
                 {
-                    buffer_replace_text_buffer(view->bv.buffer, content);
+                    Buffer *buffer = view->bv.buffer;
+                    buffer_replace_text_buffer(buffer, content);
+                    // Restored text is what the snapshot holds, the next save can keep referencing it
+                    buffer->snapshot_hash = _action_save_workspace_hash_text_buffer(buffer->text_buffer);
+                    buffer->snapshot_generation = buffer->text_buffer.generation;
+                    buffer->has_snapshot = true;
                 }
                 else
                 {
@@ -491,20 +595,15 @@ bool _action_load_workspace_parse_view_kvs(Parser_State *ps, Editor_State *state
             {
                 if (!has_temp_path)
                 {
-                    Text_Buffer content;
-                    bool read_success = text_buffer_read_from_file(file_path, &content);
-                    if (read_success)
-                    {
-                        buffer_replace_text_buffer(view->bv.buffer, content);
-                    }
-                    else
+                    bool read_success = buffer_load_file(view->bv.buffer, file_path);
+                    if (!read_success)
                     {
                         log_warning("Failed to read from file at %s", file_path);
                         return false;
                     }
                 }
 
-                view->bv.buffer->file_path = xstrdup(file_path);
+                buffer_replace_file(view->bv.buffer, file_path, state);
                 free(file_path);
             }
 
@@ -676,6 +775,16 @@ bool action_buffer_view_prompt_submit(Editor_State *state, Buffer_View *buffer_v
     return true;
 }
 
+bool action_buffer_view_jump_to_grep_hit(Editor_State *state, Buffer_View *buffer_view)
+{
+    const Text_Line *line = &buffer_view->buffer->text_buffer.lines[buffer_view->cursor.pos.line];
+    char hit_line[MAX_CHARS_PER_LINE];
+    if (line->len > MAX_CHARS_PER_LINE) return false;
+    memcpy(hit_line, line->str, line->len - 1);
+    hit_line[line->len - 1] = '\0';
+    return editor_jump_to_grep_hit(state, hit_line);
+}
+
 bool action_buffer_view_input_char(Editor_State *state, Buffer_View *buffer_view, char c)
 {
     Command *last_uncommitted_command = history_get_last_uncommitted_command(&buffer_view->buffer->history);
@@ -978,16 +1087,21 @@ bool action_buffer_view_delete_current_line(Editor_State *state, Buffer_View *bu
 
 bool action_buffer_view_reload_file(Editor_State *state, Buffer_View *buffer_view)
 {
-    if (buffer_view->buffer->file_path)
+    if (buffer_view->buffer->file_path && buffer_load_file(buffer_view->buffer, buffer_view->buffer->file_path))
     {
-        Text_Buffer tb;
-        text_buffer_read_from_file(buffer_view->buffer->file_path, &tb);
-        buffer_replace_text_buffer(buffer_view->buffer, tb);
-        buffer_view->cursor.pos = cursor_pos_clamp(tb, buffer_view->cursor.pos);
+        buffer_view->cursor.pos = cursor_pos_clamp(buffer_view->buffer->text_buffer, buffer_view->cursor.pos);
     }
     return true;
 }
 
+bool action_buffer_view_promote_large_file(Editor_State *state, Buffer_View *buffer_view)
+{
+    if (!buffer_view->buffer->large_file) return false;
+    buffer_promote_large_file(buffer_view->buffer);
+    buffer_view->cursor.pos = cursor_pos_clamp(buffer_view->buffer->text_buffer, buffer_view->cursor.pos);
+    return true;
+}
+
 bool action_buffer_view_prompt_save_file_as(Editor_State *state, Buffer_View *buffer_view)
 {
     v2 mouse_canvas_pos = screen_pos_to_canvas_pos(state->mouse_state.pos, state->canvas_viewport);;
@@ -1005,7 +1119,7 @@ bool action_buffer_view_save_file(Editor_State *state, Buffer_View *buffer_view)
     {
         text_buffer_history_whitespace_cleanup(&buffer_view->buffer->text_buffer, &buffer_view->buffer->history);
         buffer_view->cursor.pos = cursor_pos_clamp(buffer_view->buffer->text_buffer, buffer_view->cursor.pos);
-        text_buffer_write_to_file(buffer_view->buffer->text_buffer, buffer_view->buffer->file_path);
+        buffer_write_to_file(buffer_view->buffer, state);
         action_save_workspace(state);
     }
     else
@@ -1038,7 +1152,7 @@ bool action_buffer_view_prompt_search_next(Editor_State *state, Buffer_View *buf
     v2 mouse_canvas_pos = screen_pos_to_canvas_pos(state->mouse_state.pos, state->canvas_viewport);;
     View *prompt_view = create_buffer_view_prompt(
         "Search next:",
-        prompt_create_context_search_next(buffer_view),
+        prompt_create_context_search_next(buffer_view, false),
         (Rect){mouse_canvas_pos.x, mouse_canvas_pos.y, 300, 100},
         state);
     if (state->prev_search)
@@ -1050,22 +1164,35 @@ bool action_buffer_view_prompt_search_next(Editor_State *state, Buffer_View *buf
     return true;
 }
 
-bool action_buffer_view_repeat_search(Editor_State *state, Buffer_View *buffer_view)
+bool action_buffer_view_prompt_regex_search_next(Editor_State *state, Buffer_View *buffer_view)
 {
-    if (state->prev_search)
+    v2 mouse_canvas_pos = screen_pos_to_canvas_pos(state->mouse_state.pos, state->canvas_viewport);
+    View *prompt_view = create_buffer_view_prompt(
+        "Regex search next:",
+        prompt_create_context_search_next(buffer_view, true),
+        (Rect){mouse_canvas_pos.x, mouse_canvas_pos.y, 300, 100},
+        state);
+    if (state->prev_search && state->prev_search_is_regex)
     {
-        Cursor_Pos found_pos;
-        bool found = text_buffer_search_next(&buffer_view->buffer->text_buffer, state->prev_search, buffer_view->cursor.pos, &found_pos);
-        if (found)
-        {
-            buffer_view->cursor.pos = cursor_pos_clamp(buffer_view->buffer->text_buffer, found_pos);
-            viewport_snap_to_cursor(buffer_view->buffer->text_buffer, buffer_view->cursor.pos, &buffer_view->viewport, &state->render_state);
-            buffer_view->cursor.blink_time = 0.0f;
-        }
+        Text_Line current_path_line = text_line_make_f("%s", state->prev_search);
+        text_buffer_insert_line(&prompt_view->bv.buffer->text_buffer, current_path_line, 1);
+        prompt_view->bv.cursor.pos = cursor_pos_to_end_of_line(prompt_view->bv.buffer->text_buffer, (Cursor_Pos){1, 0});
     }
     return true;
 }
 
+bool action_buffer_view_repeat_search(Editor_State *state, Buffer_View *buffer_view)
+{
+    if (state->prev_search) buffer_view_jump_to_search_match(state, buffer_view, false);
+    return true;
+}
+
+bool action_buffer_view_repeat_search_backward(Editor_State *state, Buffer_View *buffer_view)
+{
+    if (state->prev_search) buffer_view_jump_to_search_match(state, buffer_view, true);
+    return true;
+}
+
 bool action_buffer_view_whitespace_cleanup(Editor_State *state, Buffer_View *buffer_view)
 {
     bool new_command = history_begin_command(&buffer_view->buffer->history, buffer_view->cursor.pos, buffer_view->mark, "Whitespace cleanup");
@@ -1197,54 +1324,84 @@ bool action_buffer_view_undo_command(Editor_State *state, Buffer_View *buffer_vi
 
 bool action_run_scratch_for_buffer(Editor_State *state, Buffer *buffer)
 {
-    char *src_name = strf("scratch_%ld", time(NULL));
-    char *src_path = strf(".e2/scratch/%s.c", src_name);
-    char *dylib_path = strf(".e2/scratch/%s.dylib", src_name);
-
-    text_buffer_write_to_file(buffer->text_buffer, src_path);
+    // Output of an older build is of no use once the source changed again
+    editor_discard_scratch_build(state);
 
     const char *cc = "clang";
     const char *cflags = "-I/opt/homebrew/include -I/Users/struc/dev/jects/edi2tor/third_party -I/Users/struc/dev/jects/edi2tor/share -DGL_SILENCE_DEPRECATION";
     const char *lflags = "-L/opt/homebrew/lib -lglfw -framework OpenGL";
     const char *editor_o = "/Users/struc/dev/jects/edi2tor/share/e.o";
-    char *compile_command = strf("%s -dynamiclib %s %s %s %s -o %s", cc, cflags, lflags, src_path, editor_o, dylib_path);
-
-    printf("Compiling scratch script: %s\n\n", compile_command);
+    const char *editor_h = "/Users/struc/dev/jects/edi2tor/share/e.h";
+
+    // e.o is rebuilt whenever an editor header changes, so its timestamp stands in for all of them
+    time_t editor_o_timestamp = scratch_runner__get_file_timestamp(editor_o);
+    uint64_t pch_key = MODULE_HASH_SEED;
+    pch_key = module_hash(pch_key, cc, strlen(cc) + 1);
+    pch_key = module_hash(pch_key, cflags, strlen(cflags) + 1);
+    pch_key = module_hash(pch_key, &editor_o_timestamp, sizeof(editor_o_timestamp));
+    uint64_t dylib_key = module_hash(pch_key, lflags, strlen(lflags) + 1);
+    for (int i = 0; i < buffer->text_buffer.line_count; i++)
+    {
+        dylib_key = module_hash(dylib_key, buffer->text_buffer.lines[i].str, buffer->text_buffer.lines[i].len);
+    }
 
-    int result = system(compile_command);
+    mkdir(".e2/scratch", 0755);
+    mkdir(SCRATCH_CACHE_DIR, 0755);
+    char *dylib_path = strf("%s/scratch_%016llx.dylib", SCRATCH_CACHE_DIR, (unsigned long long)dylib_key);
+    if (os_file_exists(dylib_path))
+    {
+        printf("Running cached scratch dylib: %s\n\n", dylib_path);
+        bool run_success = editor_run_scratch_dylib(state, dylib_path);
+        free(dylib_path);
+        return run_success;
+    }
 
-    printf("\nCompilation status: %d\n\n", result);
+    char *src_path = strf(".e2/scratch/scratch_%016llx.c", (unsigned long long)dylib_key);
+    char *out_path = strf("%s.tmp", dylib_path);
+    char *pch_path = strf("%s/e_%016llx.pch", SCRATCH_CACHE_DIR, (unsigned long long)pch_key);
+    text_buffer_write_to_file(buffer->text_buffer, src_path);
 
-    if (result == 0)
+    char *compile_command = strf("%s -dynamiclib %s -include-pch %s %s %s %s -o %s", cc, cflags, pch_path, lflags, src_path, editor_o, out_path);
+    if (!os_file_exists(pch_path))
     {
-        Scratch_Dylib dylib = scratch_runner_dylib_open(dylib_path);
-        if (dylib.handle)
-        {
-            dylib.on_run(state);
-
-            scratch_runner_dylib_close(&dylib);
+        // Header is parsed once per key, later builds only compile the scratch source itself
+        char *full_command = strf("%s -x c-header %s %s -o %s.tmp && mv %s.tmp %s && %s",
+            cc, cflags, editor_h, pch_path, pch_path, pch_path, compile_command);
+        free(compile_command);
+        compile_command = full_command;
+    }
 
-            file_delete(dylib_path);
-            file_delete(src_path);
+    printf("Compiling scratch script: %s\n\n", compile_command);
 
-            return true;
-        }
-        else
-        {
-            log_warning("Failed to open dylib at %s", dylib_path);
-            file_delete(dylib_path);
-            file_delete(src_path);
-        }
+    Buffer *log_buffer = buffer_get_by_id(state, state->scratch_log_buffer_id);
+    if (log_buffer)
+    {
+        buffer_replace_text_buffer(log_buffer, text_buffer_create_empty());
     }
     else
     {
-        log_warning("Build failed with code %d for scratch dylib. Compile command:\n%s\n", result, compile_command);
+        // Keep typing in the scratch buffer while the log fills up next to it
+        View *prev_active_view = state->active_view;
+        v2 mouse_canvas_pos = screen_pos_to_canvas_pos(state->mouse_state.pos, state->canvas_viewport);
+        View *view = create_buffer_view_generic((Rect){mouse_canvas_pos.x, mouse_canvas_pos.y, 800, 400}, state);
+        state->scratch_log_buffer_id = view->bv.buffer->id;
+        if (prev_active_view) view_set_active(prev_active_view, state);
+    }
+    char *log_header = strf("%s\n\n", compile_command);
+    editor_append_scratch_log(state, log_header);
+    free(log_header);
+
+    state->scratch_build = scratch_build_start(compile_command, src_path, out_path, dylib_path);
+    if (!state->scratch_build)
+    {
+        log_warning("Failed to start scratch build. Compile command:\n%s\n", compile_command);
         file_delete(src_path);
     }
 
+    free(pch_path);
+    free(out_path);
     free(dylib_path);
     free(src_path);
-    free(src_name);
     free(compile_command);
-    return false;
+    return state->scratch_build != NULL;
 }
@@ -4,6 +4,9 @@
 #include "common.h"
 #include "text_buffer.h"
 
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,14 +20,23 @@
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb_truetype.h>
 
+#include "grep.h"
 #include "input.h"
 #include "history.h"
+#include "journal.h"
+#include "match_index.h"
 #include "misc.h"
+#include "module_loader.h"
 #include "os.h"
 #include "platform_types.h"
 #include "renderer.h"
 #include "scene_loader.h"
+#include "scratch_runner.h"
+#include "search.h"
+#include "search_regex.h"
+#include "search_scanner.h"
 #include "shaders.h"
+#include "string_builder.h"
 #include "text_buffer.h"
 #include "util.h"
 
@@ -44,6 +56,8 @@ void on_init(Editor_State *state, GLFWwindow *window, float window_w, float wind
 
     state->buffer_seed = 1;
 
+    state->file_watch = file_watch_create(FILE_WATCH_POLL_INTERVAL);
+
     // Working dir can be passed as the third arg to platform
     // e.g. bin/platform bin/editor.dylib /Users/user/project
     if (argc > 2)
@@ -56,11 +70,18 @@ void on_init(Editor_State *state, GLFWwindow *window, float window_w, float wind
     }
 
     action_load_workspace(state);
+
+    // Journals left behind mean the last session didn't get to save the workspace
+    editor_recover_from_journal(state);
 }
 
 void on_reload(Editor_State *state)
 {
-    (void)state;
+    // New code may draw views differently
+    for (int i = 0; i < state->view_count; i++)
+    {
+        state->views[i]->cache.is_valid = false;
+    }
 }
 
 void on_frame(Editor_State *state, const Platform_Timing *t)
@@ -71,15 +92,29 @@ void on_frame(Editor_State *state, const Platform_Timing *t)
         state->should_break = false;
     }
 
+    // Anything below that still needs frames asks for them again
+    state->next_frame_time = HUGE_VAL;
+
+    editor_handle_file_events(state);
+    editor_update_scratch_build(state);
+    editor_update_grep(state);
+    editor_autosave(state);
+
     input_mouse_update(state, t->prev_delta_time);
 
+    editor_update_incremental_search(state);
+    editor_update_match_indexes(state);
     editor_render(state, t);
+
+    editor_schedule_next_frame(state);
 }
 
 void on_platform_event(Editor_State *state, const Platform_Event *e)
 {
     (void)state; (void)e;
 
+    editor_request_frame(state);
+
     if (state->input_capture_live_scene_view)
     {
         if (e->kind == PLATFORM_EVENT_KEY && e->key.key == GLFW_KEY_F10 && e->key.action == GLFW_PRESS)
@@ -140,14 +175,322 @@ void on_destroy(Editor_State *state)
 {
     action_save_workspace(state);
 
+    editor_discard_scratch_build(state);
+    module_cache_destroy(&state->scratch_modules);
+
+    search_scanner_stop(&state->search_scanner);
+    editor_discard_grep(state);
+
+    // Workspace has everything now, a journal found at startup means a crash
+    journal_writer_stop(&state->journal_writer);
+    clear_dir(E2_JOURNAL_DIR);
+
     for (int i = 0; i < state->live_scene_count; i++)
     {
         live_scene_destroy(state->live_scenes[i], state);
     }
+
+    file_watch_destroy(&state->file_watch);
+}
+
+void on_unload(Editor_State *state)
+{
+    // Worker threads run this dylib's code, they can't outlive it
+    journal_writer_stop(&state->journal_writer);
+    search_scanner_stop(&state->search_scanner);
+    editor_discard_grep(state);
+    editor_discard_scratch_build(state);
 }
 
 // ------------------------------------------------------------------------------------------------------------------------
 
+double get_next_frame_time(Editor_State *state)
+{
+    // Platform asks every time around its loop, so changed files are noticed while idle
+    file_watch_update(&state->file_watch, glfwGetTime());
+    if (file_watch_has_events(&state->file_watch)) return 0.0;
+    return state->next_frame_time;
+}
+
+void editor_request_frame(Editor_State *state)
+{
+    state->next_frame_time = 0.0;
+}
+
+void editor_request_frame_at(Editor_State *state, double time)
+{
+    if (time < state->next_frame_time)
+    {
+        state->next_frame_time = time;
+    }
+}
+
+void editor_schedule_next_frame(Editor_State *state)
+{
+    double now = glfwGetTime();
+
+    // Live scenes animate on their own, so they get every frame
+    if (state->live_scene_count > 0)
+    {
+        editor_request_frame(state);
+    }
+
+    if (state->scratch_build)
+    {
+        editor_request_frame_at(state, now + SCRATCH_BUILD_POLL_INTERVAL);
+    }
+
+    if (state->grep)
+    {
+        editor_request_frame_at(state, now + GREP_POLL_INTERVAL);
+    }
+
+    for (int i = 0; i < state->buffer_count; i++)
+    {
+        if (buffer_is_journal_stale(state->buffers[i]))
+        {
+            editor_request_frame_at(state, state->next_autosave_time);
+            break;
+        }
+    }
+
+    if (state->mouse_state.scroll_timeout > 0.0f)
+    {
+        editor_request_frame_at(state, now + state->mouse_state.scroll_timeout);
+    }
+
+    View *active_view = state->active_view;
+    if (active_view && active_view->kind == VIEW_KIND_BUFFER && !active_view->bv.buffer->large_file)
+    {
+        float blink_time = active_view->bv.cursor.blink_time;
+        float next_blink_time = blink_time < 0.5f ? 0.5f : 1.0f;
+        editor_request_frame_at(state, now + (next_blink_time - blink_time));
+    }
+}
+
+static int view__compare_index_desc(const void *a, const void *b)
+{
+    const View *view_a = *(View * const *)a;
+    const View *view_b = *(View * const *)b;
+    return view_b->index - view_a->index;
+}
+
+void editor_handle_file_events(Editor_State *state)
+{
+    file_watch_update(&state->file_watch, glfwGetTime());
+    int watch_id;
+    while (file_watch_next_event(&state->file_watch, &watch_id))
+    {
+        for (int i = 0; i < state->live_scene_count; i++)
+        {
+            if (state->live_scenes[i]->file_watch_id == watch_id) live_scene_reload(state->live_scenes[i]);
+        }
+        for (int i = 0; i < state->view_count; i++)
+        {
+            View *view = state->views[i];
+            if (view->kind == VIEW_KIND_BUFFER && view->bv.buffer->file_watch_id == watch_id)
+            {
+                buffer_view_handle_file_changed(state, &view->bv);
+            }
+        }
+    }
+}
+
+void editor_autosave(Editor_State *state)
+{
+    double now = glfwGetTime();
+    if (now < state->next_autosave_time) return;
+    state->next_autosave_time = now + AUTOSAVE_INTERVAL;
+
+    for (int i = 0; i < state->buffer_count; i++)
+    {
+        Buffer *buffer = state->buffers[i];
+        if (!buffer_is_journal_stale(buffer)) continue;
+
+        // Started on demand, on_unload stops it before the code goes away
+        if (!state->journal_writer.is_running)
+        {
+            mkdir(".e2", 0755);
+            mkdir(E2_JOURNAL_DIR, 0755);
+            if (!journal_writer_start(&state->journal_writer, E2_JOURNAL_DIR)) return;
+        }
+
+        if (buffer_needs_journal(buffer))
+        {
+            buffer_write_journal(buffer, &state->journal_writer);
+        }
+        else
+        {
+            journal_writer_push(&state->journal_writer, JOURNAL_JOB_REMOVE, buffer->id, NULL, 0);
+            buffer->is_journaled = false;
+        }
+    }
+}
+
+void editor_update_match_indexes(Editor_State *state)
+{
+    for (int i = 0; i < state->buffer_count; i++)
+    {
+        Buffer *buffer = state->buffers[i];
+        if (!state->prev_search || state->prev_search_is_regex || buffer->prompt_context.kind != PROMPT_NONE || buffer->large_file)
+        {
+            match_index_clear(&buffer->match_index);
+            continue;
+        }
+        match_index_sync(&buffer->match_index, &buffer->text_buffer, &buffer->history, &state->prev_search_pattern, state->search_seed);
+    }
+}
+
+void editor_recover_from_journal(Editor_State *state)
+{
+    DIR *d = opendir(E2_JOURNAL_DIR);
+    if (!d) return;
+
+    struct dirent *entry;
+    char path[1024];
+    while ((entry = readdir(d)))
+    {
+        int buffer_id;
+        int name_len = 0;
+        if (sscanf(entry->d_name, "%d.journal%n", &buffer_id, &name_len) != 1 || entry->d_name[name_len] != '\0') continue;
+        snprintf(path, sizeof(path), "%s/%s", E2_JOURNAL_DIR, entry->d_name);
+
+        Text_Buffer text_buffer;
+        char *file_path;
+        if (!journal_replay_file(path, &text_buffer, &file_path))
+        {
+            log_warning("Failed to recover anything from journal at %s", path);
+            continue;
+        }
+
+        Buffer *buffer = buffer_get_by_id(state, buffer_id);
+        if (!buffer || buffer->prompt_context.kind != PROMPT_NONE || buffer->large_file)
+        {
+            // Opened after the workspace was last saved
+            Rect rect = {state->canvas_viewport.rect.x + 50, state->canvas_viewport.rect.y + 50, 800, 600};
+            View *view = create_buffer_view_generic(rect, state);
+            buffer = view->bv.buffer;
+            if (file_path) buffer_replace_file(buffer, file_path, state);
+            if (!buffer_get_by_id(state, buffer_id))
+            {
+                buffer->id = buffer_id;
+                if (state->buffer_seed <= buffer_id) state->buffer_seed = buffer_id + 1;
+            }
+        }
+        buffer_replace_text_buffer(buffer, text_buffer);
+        for (int i = 0; i < state->view_count; i++)
+        {
+            View *view = state->views[i];
+            if (view->kind == VIEW_KIND_BUFFER && view->bv.buffer == buffer)
+            {
+                view->bv.cursor.pos = cursor_pos_clamp(buffer->text_buffer, view->bv.cursor.pos);
+                view->bv.mark.active = false;
+            }
+        }
+        log_warning("Recovered unsaved edits of %s from %s", file_path ? file_path : "an unnamed buffer", path);
+        free(file_path);
+    }
+    closedir(d);
+
+    // Recovered buffers differ from their files, so the next autosave journals them again
+    clear_dir(E2_JOURNAL_DIR);
+}
+
+void editor_update_scratch_build(Editor_State *state)
+{
+    Scratch_Build *build = state->scratch_build;
+    if (!build) return;
+
+    // Checked before taking the output, the worker has read everything by the time it's finished
+    int exit_code;
+    bool is_finished = scratch_build_is_finished(build, &exit_code);
+    char *output = scratch_build_take_output(build);
+    if (output)
+    {
+        editor_append_scratch_log(state, output);
+        free(output);
+    }
+    if (!is_finished) return;
+
+    state->scratch_build = NULL;
+    if (exit_code == 0)
+    {
+        editor_append_scratch_log(state, "Build succeeded\n");
+        editor_run_scratch_dylib(state, build->dylib_path);
+    }
+    else
+    {
+        log_warning("Build failed with code %d for scratch dylib. Compile command:\n%s\n", exit_code, build->command);
+        char *message = strf("Build failed with code %d\n", exit_code);
+        editor_append_scratch_log(state, message);
+        free(message);
+    }
+    scratch_build_destroy(build);
+}
+
+bool editor_run_scratch_dylib(Editor_State *state, const char *dylib_path)
+{
+    bool was_cached;
+    Module *module = module_cache_get(&state->scratch_modules, dylib_path, &was_cached);
+    if (!module)
+    {
+        log_warning("Failed to open dylib at %s", dylib_path);
+        return false;
+    }
+    scratch_on_run_t on_run = module_get_symbol(module, "on_run");
+    if (!on_run)
+    {
+        log_warning("No on_run in scratch dylib at %s", dylib_path);
+        module_cache_release(&state->scratch_modules, module);
+        return false;
+    }
+
+    // Same bytes as an earlier run, the module stays loaded and its globals keep their values
+    char *message = was_cached ?
+        strf("Reusing loaded module\n") :
+        strf("Loaded in %.2f ms (copy %.2f ms, dlopen %.2f ms)\n", module->copy_ms + module->load_ms, module->copy_ms, module->load_ms);
+    editor_append_scratch_log(state, message);
+    free(message);
+
+    double run_start_ms = module_get_time_ms();
+    on_run(state);
+    message = strf("on_run took %.2f ms\n", module_get_time_ms() - run_start_ms);
+    editor_append_scratch_log(state, message);
+    free(message);
+
+    module_cache_release(&state->scratch_modules, module);
+    return true;
+}
+
+void editor_discard_scratch_build(Editor_State *state)
+{
+    Scratch_Build *build = state->scratch_build;
+    if (!build) return;
+
+    scratch_build_destroy(build);
+    state->scratch_build = NULL;
+}
+
+void editor_append_scratch_log(Editor_State *state, const char *text)
+{
+    Buffer *buffer = buffer_get_by_id(state, state->scratch_log_buffer_id);
+    if (!buffer) return; // Log view was closed, the output is still in the terminal
+
+    Text_Buffer *text_buffer = &buffer->text_buffer;
+    text_buffer_insert_range(text_buffer, text, cursor_pos_to_end_of_buffer(*text_buffer, (Cursor_Pos){0}));
+
+    // Views of the log follow the output
+    for (int i = 0; i < state->view_count; i++)
+    {
+        View *view = state->views[i];
+        if (view->kind == VIEW_KIND_BUFFER && view->bv.buffer == buffer)
+        {
+            view->bv.cursor.pos = cursor_pos_to_end_of_buffer(*text_buffer, view->bv.cursor.pos);
+            viewport_snap_to_cursor(*text_buffer, view->bv.cursor.pos, &view->bv.viewport, &state->render_state);
+        }
+    }
+}
+
 void editor_render(Editor_State *state, const Platform_Timing *t)
 {
     glViewport(0, 0, (GLsizei)state->render_state.framebuffer_dim.x, (GLsizei)state->render_state.framebuffer_dim.y);
@@ -155,8 +498,6 @@ void editor_render(Editor_State *state, const Platform_Timing *t)
     glClearColor(0.4f, 0.3f, 0.1f, 1.0f);
     glDisable(GL_SCISSOR_TEST);
     glClear(GL_COLOR_BUFFER_BIT);
-    glBindVertexArray(state->render_state.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, state->render_state.vbo);
 
     mat_stack_push(&state->render_state.mat_stack_proj);
     {
@@ -176,12 +517,26 @@ void editor_render(Editor_State *state, const Platform_Timing *t)
 
             mvp_update_from_stacks(&state->render_state);
 
-            // Render backwards for correct z ordering
-            for (int i = state->view_count - 1; i >= 0; i--)
+            View *active_view = state->active_view;
+            if (active_view && active_view->kind == VIEW_KIND_BUFFER)
             {
-                View *view = state->views[i];
+                display_cursor_advance_blink(&active_view->bv.cursor, t->prev_delta_time);
+            }
+
+            // Only views that reach into the window, rendered backwards for correct z ordering
+            Rect visible_rect = {
+                .x = state->canvas_viewport.rect.x,
+                .y = state->canvas_viewport.rect.y,
+                .w = state->render_state.window_dim.x / state->canvas_viewport.zoom,
+                .h = state->render_state.window_dim.y / state->canvas_viewport.zoom};
+            View **visible_views;
+            int visible_view_count = view_grid_query_rect(&state->view_grid, visible_rect, &visible_views);
+            qsort(visible_views, visible_view_count, sizeof(visible_views[0]), view__compare_index_desc);
+            for (int i = 0; i < visible_view_count; i++)
+            {
+                View *view = visible_views[i];
                 bool is_active = view == state->active_view;
-                render_view(view, is_active, state->canvas_viewport, &state->render_state, t);
+                render_view_cached(view, is_active, state->canvas_viewport, &state->render_state, t);
             }
         }
         mat_stack_pop(&state->render_state.mat_stack_model_view);
@@ -192,6 +547,8 @@ void editor_render(Editor_State *state, const Platform_Timing *t)
     mat_stack_pop(&state->render_state.mat_stack_proj);
     mvp_update_from_stacks(&state->render_state);
 
+    render_batch_end_frame(state->render_state.batch, &state->render_state);
+
     bassert(state->render_state.mat_stack_proj.size == 0);
     bassert(state->render_state.mat_stack_model_view.size == 0);
     // TODO: Can I query GL scissor state, for validation? and other glEnable things...
@@ -208,7 +565,7 @@ void render_view(View *view, bool is_active, Viewport canvas_viewport, Render_St
     {
         case VIEW_KIND_BUFFER:
         {
-            render_view_buffer(&view->bv, is_active, canvas_viewport, render_state, t->prev_delta_time);
+            render_view_buffer(&view->bv, is_active, canvas_viewport, render_state);
         } break;
 
         case VIEW_KIND_IMAGE:
@@ -223,7 +580,93 @@ void render_view(View *view, bool is_active, Viewport canvas_viewport, Render_St
     }
 }
 
-void render_view_buffer(Buffer_View *buffer_view, bool is_active, Viewport canvas_viewport, Render_State *render_state, float delta_time)
+void render_view_cached(View *view, bool is_active, Viewport canvas_viewport, Render_State *render_state, const Platform_Timing *t)
+{
+    View_Cache_Key key = view_cache_make_key(view, is_active, canvas_viewport, render_state);
+    if (view->kind != VIEW_KIND_BUFFER ||
+        key.px_w <= 0 || key.px_h <= 0 ||
+        key.px_w > VIEW_CACHE_MAX_DIM || key.px_h > VIEW_CACHE_MAX_DIM)
+    {
+        render_view(view, is_active, canvas_viewport, render_state, t);
+        return;
+    }
+
+    View_Cache *cache = &view->cache;
+    if (!cache->is_valid || memcmp(&cache->key, &key, sizeof(key)) != 0)
+    {
+        if (cache->framebuffer.w != key.px_w || cache->framebuffer.h != key.px_h)
+        {
+            if (cache->framebuffer.fbo) gl_destroy_framebuffer(&cache->framebuffer);
+            cache->framebuffer = gl_create_framebuffer(key.px_w, key.px_h);
+        }
+        render_view_to_cache(view, is_active, canvas_viewport, render_state, t);
+        cache->key = key;
+        cache->is_valid = true;
+        render_state->batch->frame_stats.view_redraw_count++;
+    }
+
+    // Put texels exactly on pixels, so cached text is as sharp as text drawn directly
+    float px_scale = render_state->dpi_scale * canvas_viewport.zoom;
+    Rect q = view->outer_rect;
+    q.x = (roundf((q.x * canvas_viewport.zoom - canvas_viewport.rect.x) * render_state->dpi_scale) / render_state->dpi_scale + canvas_viewport.rect.x) / canvas_viewport.zoom;
+    q.y = (roundf((q.y * canvas_viewport.zoom - canvas_viewport.rect.y) * render_state->dpi_scale) / render_state->dpi_scale + canvas_viewport.rect.y) / canvas_viewport.zoom;
+    q.w = cache->framebuffer.w / px_scale;
+    q.h = cache->framebuffer.h / px_scale;
+    draw_flipped_texture(cache->framebuffer.tex, q, (Color){255, 255, 255, 255}, render_state);
+}
+
+void render_view_to_cache(View *view, bool is_active, Viewport canvas_viewport, Render_State *render_state, const Platform_Timing *t)
+{
+    Gl_Framebuffer *framebuffer = &view->cache.framebuffer;
+
+    // Whatever is queued so far belongs to the screen
+    render_batch_flush(render_state->batch, render_state);
+
+    // Scissor rects are flipped against the window height, so the framebuffer stands in for the window
+    v2 window_dim = render_state->window_dim;
+    v2 framebuffer_dim = render_state->framebuffer_dim;
+    render_state->framebuffer_dim = V2((float)framebuffer->w, (float)framebuffer->h);
+    render_state->window_dim = V2(framebuffer->w / render_state->dpi_scale, framebuffer->h / render_state->dpi_scale);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer->fbo);
+    glViewport(0, 0, framebuffer->w, framebuffer->h);
+    glClearColor(0, 0, 0, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // Same transforms as the canvas, with the view's top left corner at the origin
+    Viewport view_canvas_viewport = canvas_viewport;
+    view_canvas_viewport.rect.x = view->outer_rect.x * canvas_viewport.zoom;
+    view_canvas_viewport.rect.y = view->outer_rect.y * canvas_viewport.zoom;
+
+    mat_stack_push(&render_state->mat_stack_proj);
+    mat_stack_push(&render_state->mat_stack_model_view);
+    {
+        mat_stack_load(&render_state->mat_stack_proj,
+            mat4_proj_ortho(0, render_state->window_dim.x, render_state->window_dim.y, 0, -1, 1));
+        mat_stack_load(&render_state->mat_stack_model_view,
+            mat4_translate(-view_canvas_viewport.rect.x, -view_canvas_viewport.rect.y, 0));
+        mat_stack_mul_r(&render_state->mat_stack_model_view,
+            mat4_scale(canvas_viewport.zoom, canvas_viewport.zoom, 1));
+
+        mvp_update_from_stacks(render_state);
+
+        render_view(view, is_active, view_canvas_viewport, render_state, t);
+
+        render_batch_flush(render_state->batch, render_state);
+    }
+    mat_stack_pop(&render_state->mat_stack_model_view);
+    mat_stack_pop(&render_state->mat_stack_proj);
+
+    render_state->window_dim = window_dim;
+    render_state->framebuffer_dim = framebuffer_dim;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, render_state->default_fbo);
+    glViewport(0, 0, (GLsizei)render_state->framebuffer_dim.x, (GLsizei)render_state->framebuffer_dim.y);
+
+    mvp_update_from_stacks(render_state);
+}
+
+void render_view_buffer(Buffer_View *buffer_view, bool is_active, Viewport canvas_viewport, Render_State *render_state)
 {
     Text_Buffer *text_buffer = &buffer_view->buffer->text_buffer;
     Display_Cursor *display_cursor = &buffer_view->cursor;
@@ -244,16 +687,24 @@ void render_view_buffer(Buffer_View *buffer_view, bool is_active, Viewport canva
         mvp_update_from_stacks(render_state);
 
         Rect text_area_screen_rect = canvas_rect_to_screen_rect(text_area_rect, canvas_viewport);
-        gl_enable_scissor(text_area_screen_rect, render_state);
+        render_batch_set_scissor(render_state->batch, text_area_screen_rect);
         {
-            render_view_buffer_text(*text_buffer, *buffer_viewport, render_state);
-            if (is_active)
+            if (buffer_view->buffer->large_file)
             {
-                render_view_buffer_cursor(*text_buffer, display_cursor, *buffer_viewport, render_state, delta_time);
+                render_view_buffer_large_file_text(buffer_view->buffer->large_file, *buffer_viewport, render_state);
+            }
+            else
+            {
+                render_view_buffer_matches(buffer_view, render_state);
+                render_view_buffer_text(*text_buffer, *buffer_viewport, render_state);
+                if (is_active)
+                {
+                    render_view_buffer_cursor(*text_buffer, display_cursor, *buffer_viewport, render_state);
+                }
+                render_view_buffer_selection(buffer_view, render_state);
             }
-            render_view_buffer_selection(buffer_view, render_state);
         }
-        gl_disable_scissor();
+        render_batch_clear_scissor(render_state->batch);
     }
     mat_stack_pop(&render_state->mat_stack_model_view);
 
@@ -271,12 +722,12 @@ void render_view_buffer(Buffer_View *buffer_view, bool is_active, Viewport canva
         mvp_update_from_stacks(render_state);
 
         Rect line_num_col_screen_rect = canvas_rect_to_screen_rect(line_num_col_rect, canvas_viewport);
-        gl_enable_scissor(line_num_col_screen_rect, render_state);
+        render_batch_set_scissor(render_state->batch, line_num_col_screen_rect);
         {
 
             render_view_buffer_line_numbers(buffer_view, canvas_viewport, render_state);
         }
-        gl_disable_scissor();
+        render_batch_clear_scissor(render_state->batch);
     }
     mat_stack_pop(&render_state->mat_stack_model_view);
 
@@ -301,33 +752,71 @@ void render_view_buffer(Buffer_View *buffer_view, bool is_active, Viewport canva
 
 void render_view_buffer_text(Text_Buffer text_buffer, Viewport viewport, const Render_State *render_state)
 {
-    glUseProgram(render_state->font_shader);
-
-    float x = 0, y = 0;
+    float x = 0;
     float line_height = get_font_line_height(render_state->font);
 
-    for (int i = 0; i < text_buffer.line_count; i++)
+    int first_line, end_line;
+    viewport_get_visible_lines(viewport, line_height, text_buffer.line_count, &first_line, &end_line);
+    for (int i = first_line; i < end_line; i++)
     {
+        float y = i * line_height;
         Rect string_rect = get_string_rect(text_buffer.lines[i].str, render_state->font, 0, y);
         bool is_seen = rect_intersect(string_rect, viewport.rect);
         if (is_seen)
             draw_string(text_buffer.lines[i].str, render_state->font, x, y, render_state->text_color, render_state);
-        y += line_height;
     }
 }
 
-void render_view_buffer_cursor(Text_Buffer text_buffer, Display_Cursor *cursor, Viewport viewport,  const Render_State *render_state, float delta_time)
+void render_view_buffer_large_file_text(Large_File *large_file, Viewport viewport, const Render_State *render_state)
+{
+    // Only visible lines are looked up, so only their pages of the mapping get touched
+    float line_height = get_font_line_height(render_state->font);
+    int first_line, end_line;
+    viewport_get_visible_lines(viewport, line_height, INT_MAX, &first_line, &end_line);
+
+    // Keep the index a bit ahead of the viewport, so scrolling can continue past what's been seen
+    large_file_index_to_line(large_file, end_line + LARGE_FILE_INDEX_STRIDE);
+
+    // Lines are drawn straight from the mapping, cut off where they leave the viewport on the right
+    float right = viewport.rect.x + viewport.rect.w;
+    for (int i = first_line; i < end_line; i++)
+    {
+        const char *str;
+        int len;
+        if (!large_file_get_line(large_file, i, &str, &len)) break;
+        int visible_len = 0;
+        float x = 0;
+        while (visible_len < len && x < right)
+        {
+            if (str[visible_len] >= 32) x += get_char_width(str[visible_len], render_state->font);
+            visible_len++;
+        }
+        draw_string_len(str, visible_len, render_state->font, 0, i * line_height, render_state->text_color, render_state);
+    }
+}
+
+void render_view_buffer_cursor(Text_Buffer text_buffer, Display_Cursor *cursor, Viewport viewport,  const Render_State *render_state)
 {
-    cursor->blink_time += delta_time;
     if (cursor->blink_time < 0.5f)
     {
         Rect cursor_rect = get_cursor_rect(text_buffer, cursor->pos, render_state);
         bool is_seen = rect_intersect(cursor_rect, viewport.rect);
         if (is_seen)
             draw_quad(cursor_rect, (Color){100, 100, 255, 180}, render_state);
-    } else if (cursor->blink_time > 1.0f)
+    }
+}
+
+void display_cursor_advance_blink(Display_Cursor *cursor, float delta_time)
+{
+    // A freshly reset cursor starts its blink on this frame, since after
+    // an idle period the delta also covers the time before the reset
+    if (cursor->blink_time > 0.0f)
     {
-        cursor->blink_time -= 1.0f;
+        cursor->blink_time = fmodf(cursor->blink_time + delta_time, 1.0f);
+    }
+    else
+    {
+        cursor->blink_time = 0.0001f;
     }
 }
 
@@ -336,7 +825,11 @@ void render_view_buffer_selection(Buffer_View *buffer_view, const Render_State *
     if (buffer_view->mark.active && !cursor_pos_eq(buffer_view->mark.pos, buffer_view->cursor.pos)) {
         Cursor_Pos start = cursor_pos_min(buffer_view->mark.pos, buffer_view->cursor.pos);
         Cursor_Pos end = cursor_pos_max(buffer_view->mark.pos, buffer_view->cursor.pos);
-        for (int i = start.line; i <= end.line; i++)
+        int first_visible_line, end_visible_line;
+        viewport_get_visible_lines(buffer_view->viewport, get_font_line_height(render_state->font), buffer_view->buffer->text_buffer.line_count, &first_visible_line, &end_visible_line);
+        int first_line = start.line > first_visible_line ? start.line : first_visible_line;
+        int last_line = end.line < end_visible_line - 1 ? end.line : end_visible_line - 1;
+        for (int i = first_line; i <= last_line; i++)
         {
             Text_Line *line = &buffer_view->buffer->text_buffer.lines[i];
             int h_start, h_end;
@@ -355,7 +848,7 @@ void render_view_buffer_selection(Buffer_View *buffer_view, const Render_State *
             }
             if (h_end > h_start)
             {
-                Rect selected_rect = get_string_range_rect(line->str, render_state->font, h_start, h_end);
+                Rect selected_rect = get_line_range_rect(line, render_state->font, h_start, h_end);
                 selected_rect.y += i * get_font_line_height(render_state->font);
                 if (rect_intersect(selected_rect, buffer_view->viewport.rect))
                     draw_quad(selected_rect, (Color){200, 200, 200, 130}, render_state);
@@ -364,40 +857,66 @@ void render_view_buffer_selection(Buffer_View *buffer_view, const Render_State *
     }
 }
 
+void render_view_buffer_matches(Buffer_View *buffer_view, const Render_State *render_state)
+{
+    const Match_Index *index = &buffer_view->buffer->match_index;
+    if (index->match_count == 0) return;
+
+    const Text_Buffer *text_buffer = &buffer_view->buffer->text_buffer;
+    float line_height = get_font_line_height(render_state->font);
+    int first_visible_line, end_visible_line;
+    viewport_get_visible_lines(buffer_view->viewport, line_height, text_buffer->line_count, &first_visible_line, &end_visible_line);
+
+    // Matches starting above the viewport can still reach into it
+    int first = match_index_lower_bound(index, (Cursor_Pos){first_visible_line - index->match_line_span, 0});
+    for (int i = first; i < index->match_count && index->matches[i].line < end_visible_line; i++)
+    {
+        int line = index->matches[i].line;
+        int col = index->matches[i].col;
+        int remaining = index->match_len;
+        while (remaining > 0 && line < text_buffer->line_count)
+        {
+            Text_Line *text_line = &text_buffer->lines[line];
+            int end_col = col + remaining < text_line->len ? col + remaining : text_line->len;
+            if (line >= first_visible_line && line < end_visible_line && end_col > col)
+            {
+                Rect match_rect = get_line_range_rect(text_line, render_state->font, col, end_col);
+                match_rect.y += line * line_height;
+                draw_quad(match_rect, (Color){200, 160, 40, 90}, render_state);
+            }
+            remaining -= end_col - col;
+            line++;
+            col = 0;
+        }
+    }
+}
+
 void render_view_buffer_line_numbers(Buffer_View *buffer_view, Viewport canvas_viewport, const Render_State *render_state)
 {
     const float font_line_height = get_font_line_height(render_state->font);
-    const float viewport_min_y = buffer_view->viewport.rect.y;
-    const float viewport_max_y = viewport_min_y + buffer_view->viewport.rect.h;
-
-    glUseProgram(render_state->font_shader);
 
     char line_i_str_buf[256];
-    for (int line_i = 0; line_i < buffer_view->buffer->text_buffer.line_count; line_i++)
+    int first_line, end_line;
+    viewport_get_visible_lines(buffer_view->viewport, font_line_height, buffer_get_line_count(buffer_view->buffer), &first_line, &end_line);
+    for (int line_i = first_line; line_i < end_line; line_i++)
     {
         const float min_y = font_line_height * line_i;
-        const float max_y = min_y + font_line_height;
-        if (min_y < viewport_max_y && max_y > viewport_min_y)
+        snprintf(line_i_str_buf, sizeof(line_i_str_buf), "%3d", line_i + 1);
+        Color c;
+        if (line_i != buffer_view->cursor.pos.line)
         {
-            snprintf(line_i_str_buf, sizeof(line_i_str_buf), "%3d", line_i + 1);
-            Color c;
-            if (line_i != buffer_view->cursor.pos.line)
-            {
-                c = (Color){150, 150, 150, 255};
-            }
-            else
-            {
-                c = (Color){230, 230, 230, 255};
-            }
-            draw_string(line_i_str_buf, render_state->font, 0, min_y, c, render_state);
+            c = (Color){150, 150, 150, 255};
+        }
+        else
+        {
+            c = (Color){230, 230, 230, 255};
         }
+        draw_string(line_i_str_buf, render_state->font, 0, min_y, c, render_state);
     }
 }
 
 void render_view_buffer_name(Buffer_View *buffer_view, const char *name, bool is_active, Viewport canvas_viewport, const Render_State *render_state)
 {
-    glUseProgram(render_state->font_shader);
-
     if (is_active)
         draw_string(name, render_state->font, 0, 0, (Color){140, 140, 140, 255}, render_state);
     else
@@ -406,15 +925,12 @@ void render_view_buffer_name(Buffer_View *buffer_view, const char *name, bool is
 
 void render_view_image(Image_View *image_view, const Render_State *render_state)
 {
-    glUseProgram(render_state->tex_shader);
     draw_texture(image_view->image.texture, image_view->image_rect, (Color){255, 255, 255, 255}, render_state);
 }
 
 void render_view_live_scene(Live_Scene_View *ls_view, const Render_State *render_state, const Platform_Timing *t)
 {
     // TODO: Keep pointers to live scenes in an array and run live scene updates separately, before rendering
-    live_scene_check_hot_reload(ls_view->live_scene);
-
     glBindFramebuffer(GL_FRAMEBUFFER, ls_view->framebuffer.fbo);
 
     ls_view->live_scene->dylib.on_frame(ls_view->live_scene->state, t);
@@ -422,24 +938,10 @@ void render_view_live_scene(Live_Scene_View *ls_view, const Render_State *render
     glBindFramebuffer(GL_FRAMEBUFFER, render_state->default_fbo);
     glViewport(0, 0, (int)render_state->framebuffer_dim.x, (int)render_state->framebuffer_dim.y);
     glClearColor(0, 0, 0, 1.0f);
-    glBindVertexArray(render_state->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, render_state->vbo);
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
 
-    Rect q = ls_view->framebuffer_rect;
-    Color c = {255, 255, 255, 255};
-    Vert_Buffer vert_buf = {0};
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y,       0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y + q.h, 0, 1, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y,       1, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y,       1, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y + q.h, 0, 1, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y + q.h, 1, 1, c));
-    glUseProgram(render_state->flipped_quad_shader);
-    glBindTexture(GL_TEXTURE_2D, ls_view->framebuffer.tex);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vert_buf.vert_count * sizeof(vert_buf.verts[0]), vert_buf.verts);
-    glDrawArrays((GL_TRIANGLES), 0, vert_buf.vert_count);
+    draw_flipped_texture(ls_view->framebuffer.tex, ls_view->framebuffer_rect, (Color){255, 255, 255, 255}, render_state);
 }
 
 void render_status_bar(Editor_State *state, const Render_State *render_state, const Platform_Timing *t)
@@ -463,25 +965,62 @@ void render_status_bar(Editor_State *state, const Render_State *render_state, co
     float status_str_x = status_bar_rect.x + x_padding;
     float status_str_y = status_bar_rect.y + y_padding;
 
-    glUseProgram(render_state->font_shader);
-
     View *active_view = state->active_view;
-    if (active_view && active_view->kind == VIEW_KIND_BUFFER)
+    if (active_view && active_view->kind == VIEW_KIND_BUFFER && active_view->bv.buffer->large_file)
+    {
+        Large_File *large_file = active_view->bv.buffer->large_file;
+        snprintf(status_str_buf, sizeof(status_str_buf),
+            "STATUS: Read-only large file (%.1f MB); Lines: %d%s; Super+E to edit",
+            large_file->file.size / (1024.0 * 1024.0),
+            large_file_get_line_count(large_file),
+            large_file->is_fully_indexed ? "" : "+");
+        draw_string(status_str_buf, render_state->font, status_str_x, status_str_y, status_str_color, render_state);
+        status_str_y += font_line_height;
+    }
+    else if (active_view && active_view->kind == VIEW_KIND_BUFFER)
     {
         Buffer_View *active_buffer_view = &active_view->bv;
+        char match_str_buf[64] = "";
+        const Match_Index *match_index = &active_buffer_view->buffer->match_index;
+        if (match_index->search_seed)
+        {
+            int k = match_index_lower_bound(match_index, active_buffer_view->cursor.pos);
+            if (k < match_index->match_count && cursor_pos_eq(match_index->matches[k], active_buffer_view->cursor.pos))
+                snprintf(match_str_buf, sizeof(match_str_buf), "; Match %d of %d", k + 1, match_index->match_count);
+            else
+                snprintf(match_str_buf, sizeof(match_str_buf), "; Matches: %d", match_index->match_count);
+        }
+        const Prompt_Context *prompt_context = &active_buffer_view->buffer->prompt_context;
+        if (prompt_context->kind == PROMPT_SEARCH_NEXT && prompt_context->search_next.scan_seed)
+        {
+            const Search_Scan_Result *scan_result = &prompt_context->search_next.scan_result;
+            if (scan_result->is_invalid)
+                snprintf(match_str_buf, sizeof(match_str_buf), "; Bad regex");
+            else if (scan_result->is_done)
+                snprintf(match_str_buf, sizeof(match_str_buf), "; Matches: %d%s", scan_result->match_count,
+                    scan_result->match_count > 0 && !scan_result->has_first ? ", none after cursor" : "");
+            else
+                snprintf(match_str_buf, sizeof(match_str_buf), "; Searching...");
+        }
         snprintf(status_str_buf, sizeof(status_str_buf),
-            "STATUS: Cursor: %d, %d; Line Len: %d; Lines: %d",
+            "STATUS: Cursor: %d, %d; Line Len: %d; Lines: %d%s%s",
             active_buffer_view->cursor.pos.line,
             active_buffer_view->cursor.pos.col,
             active_buffer_view->buffer->text_buffer.lines[active_buffer_view->cursor.pos.line].len,
-            active_buffer_view->buffer->text_buffer.line_count);
+            active_buffer_view->buffer->text_buffer.line_count,
+            match_str_buf,
+            active_buffer_view->buffer->is_changed_on_disk ? "; Changed on disk, Super+R to reload" : "");
         draw_string(status_str_buf, render_state->font, status_str_x, status_str_y, status_str_color, render_state);
         status_str_y += font_line_height;
     }
 
     v2 mouse_screen_pos = screen_pos_to_canvas_pos(state->mouse_state.pos, state->canvas_viewport);
 
-    snprintf(status_str_buf, sizeof(status_str_buf), "FPS: %3.0f; Delta: %.3f; Working dir: %s; M: <%.2f, %.2f>", t->fps_avg, t->prev_delta_time, state->working_dir, mouse_screen_pos.x, mouse_screen_pos.y);
+    const Render_Batch_Stats *batch_stats = &render_state->batch->last_frame_stats;
+    snprintf(status_str_buf, sizeof(status_str_buf), "FPS: %3.0f; Delta: %.3f; Skipped: %d; Draws: %d; Uploads: %d; Views redrawn: %d; Working dir: %s; M: <%.2f, %.2f>",
+        t->fps_avg, t->prev_delta_time, t->frame_skipped_count,
+        batch_stats->draw_call_count, batch_stats->vert_upload_count + batch_stats->mvp_upload_count, batch_stats->view_redraw_count,
+        state->working_dir, mouse_screen_pos.x, mouse_screen_pos.y);
     draw_string(status_str_buf, render_state->font, status_str_x, status_str_y, status_str_color, render_state);
 }
 
@@ -500,9 +1039,7 @@ void mvp_update_from_stacks(Render_State *render_state)
     {
         mvp = mat4_identity();
     }
-    glBindBuffer(GL_UNIFORM_BUFFER, render_state->mvp_ubo);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(mvp), mvp.d);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    render_batch_set_mvp(render_state->batch, mvp);
 }
 
 void initialize_render_state(Render_State *render_state, float window_w, float window_h, float window_px_w, float window_px_h, GLuint fbo)
@@ -514,6 +1051,7 @@ void initialize_render_state(Render_State *render_state, float window_w, float w
     render_state->dpi_scale = render_state->framebuffer_dim.x / render_state->window_dim.x;
 
     render_state->default_fbo = fbo;
+    render_state->batch = render_batch_create();
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -540,17 +1078,7 @@ void initialize_render_state(Render_State *render_state, float window_w, float w
     glUniformBlockBinding(render_state->tex_shader, glGetUniformBlockIndex(render_state->tex_shader, "Matrices"), mvp_ubo_binding_point);
     glUniformBlockBinding(render_state->flipped_quad_shader, glGetUniformBlockIndex(render_state->flipped_quad_shader, "Matrices"), mvp_ubo_binding_point);
 
-    glGenVertexArrays(1, &render_state->vao);
-    glGenBuffers(1, &render_state->vbo);
-    glBindVertexArray(render_state->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, render_state->vbo);
-    glBufferData(GL_ARRAY_BUFFER,  VERT_MAX * sizeof(Vert), NULL, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vert), (void *)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vert), (void *)offsetof(Vert, u));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vert), (void *)offsetof(Vert, c));
-    glEnableVertexAttribArray(2);
+    render_batch_create_chunks(render_state->batch);
 
     glActiveTexture(GL_TEXTURE0);
     render_state->font = load_font(FONT_PATH, render_state->dpi_scale);
@@ -588,29 +1116,96 @@ void buffer_free_slot(Buffer *buffer, Editor_State *state)
     state->buffers = xrealloc(state->buffers, state->buffer_count * sizeof(state->buffers[0]));
 }
 
-Buffer *buffer_create_empty(Editor_State *state)
+Buffer *buffer_create_empty(Editor_State *state)
+{
+    Buffer **new_slot = buffer_create_new_slot(state);
+
+    Buffer *buffer = xcalloc(sizeof(Buffer));
+
+    buffer->id = state->buffer_seed++;
+    buffer->text_buffer = text_buffer_create_empty();
+
+    *new_slot = buffer;
+    return *new_slot;
+}
+
+void buffer_replace_text_buffer(Buffer *buffer, Text_Buffer text_buffer)
+{
+    unsigned int generation = buffer->text_buffer.generation;
+    text_buffer_destroy(&buffer->text_buffer);
+    buffer->text_buffer = text_buffer;
+    buffer->text_buffer.generation = generation + 1;
+}
+
+static void buffer__release_large_file(Buffer *buffer)
+{
+    if (!buffer->large_file) return;
+    os_file_unmap(&buffer->large_file->file);
+    large_file_destroy(buffer->large_file);
+    free(buffer->large_file);
+    buffer->large_file = NULL;
+}
+
+// Files past LARGE_FILE_THRESHOLD stay mapped as a read-only Large_File, others become a Text_Buffer.
+// Reloads come through here too, so a file that crossed the threshold while open switches over.
+bool buffer_load_file(Buffer *buffer, const char *path)
+{
+    Mapped_File file;
+    if (!os_file_map(path, &file))
+    {
+        trace_log("Could not open file at %s", path);
+        return false;
+    }
+    buffer__release_large_file(buffer);
+    if (file.size >= LARGE_FILE_THRESHOLD)
+    {
+        buffer->large_file = xmalloc(sizeof(*buffer->large_file));
+        *buffer->large_file = large_file_create(file);
+        buffer_replace_text_buffer(buffer, text_buffer_create_empty());
+    }
+    else
+    {
+        buffer_replace_text_buffer(buffer, text_buffer_create_from_mapped_file(&file));
+        os_file_unmap(&file);
+    }
+    buffer_mark_in_sync_with_file(buffer);
+    return true;
+}
+
+void buffer_promote_large_file(Buffer *buffer)
 {
-    Buffer **new_slot = buffer_create_new_slot(state);
-
-    Buffer *buffer = xcalloc(sizeof(Buffer));
-
-    buffer->id = state->buffer_seed++;
-    buffer->text_buffer = text_buffer_create_empty();
-
-    *new_slot = buffer;
-    return *new_slot;
+    if (!buffer->large_file) return;
+    buffer_replace_text_buffer(buffer, text_buffer_create_from_mapped_file(&buffer->large_file->file));
+    buffer__release_large_file(buffer);
 }
 
-void buffer_replace_text_buffer(Buffer *buffer, Text_Buffer text_buffer)
+int buffer_get_line_count(Buffer *buffer)
 {
-    text_buffer_destroy(&buffer->text_buffer);
-    buffer->text_buffer = text_buffer;
+    if (buffer->large_file) return large_file_get_line_count(buffer->large_file);
+    return buffer->text_buffer.line_count;
 }
 
-void buffer_replace_file(Buffer *buffer, const char *path)
+void buffer_replace_file(Buffer *buffer, const char *path, Editor_State *state)
 {
     if (buffer->file_path) free(buffer->file_path);
     buffer->file_path = xstrdup(path);
+    buffer->file_path_generation++;
+    if (buffer->file_watch_id) file_watch_remove(&state->file_watch, buffer->file_watch_id);
+    buffer->file_watch_id = file_watch_add(&state->file_watch, path);
+}
+
+void buffer_mark_in_sync_with_file(Buffer *buffer)
+{
+    buffer->disk_generation = buffer->text_buffer.generation;
+    buffer->is_changed_on_disk = false;
+}
+
+// The buffer's own file watch would otherwise see the write as an outside change and reload
+void buffer_write_to_file(Buffer *buffer, Editor_State *state)
+{
+    text_buffer_write_to_file(buffer->text_buffer, buffer->file_path);
+    buffer_mark_in_sync_with_file(buffer);
+    file_watch_refresh(&state->file_watch, buffer->file_watch_id);
 }
 
 Buffer *buffer_create_prompt(const char *prompt_text, Prompt_Context context, Editor_State *state)
@@ -620,14 +1215,12 @@ Buffer *buffer_create_prompt(const char *prompt_text, Prompt_Context context, Ed
     Buffer *buffer = xcalloc(sizeof(Buffer));
     buffer->id = state->buffer_seed++;
 
-    buffer->text_buffer.line_count = 2;
-    buffer->text_buffer.lines = xmalloc(buffer->text_buffer.line_count * sizeof(buffer->text_buffer.lines[0]));
     buffer->prompt_context = context;
 
     char prompt_line_buf[MAX_CHARS_PER_LINE];
     snprintf(prompt_line_buf, sizeof(prompt_line_buf), "%s\n", prompt_text);
-    buffer->text_buffer.lines[0] = text_line_make_dup(prompt_text);
-    buffer->text_buffer.lines[1] = text_line_make_dup("\n");
+    text_buffer_append_line(&buffer->text_buffer, text_line_make_dup(prompt_text));
+    text_buffer_append_line(&buffer->text_buffer, text_line_make_dup("\n"));
 
     *new_slot = buffer;
     return *new_slot;
@@ -645,9 +1238,73 @@ int buffer_get_index(Buffer *buffer, Editor_State *state)
     return index;
 }
 
+bool buffer_needs_journal(const Buffer *buffer)
+{
+    if (buffer->prompt_context.kind != PROMPT_NONE || buffer->large_file) return false;
+    bool is_in_sync_with_file = buffer->file_path && buffer->text_buffer.generation == buffer->disk_generation;
+    return !is_in_sync_with_file;
+}
+
+bool buffer_is_journal_stale(const Buffer *buffer)
+{
+    if (!buffer_needs_journal(buffer)) return buffer->is_journaled;
+    return !buffer->is_journaled || buffer->journal_generation != buffer->text_buffer.generation;
+}
+
+void buffer_write_journal(Buffer *buffer, Journal_Writer *writer)
+{
+    History *history = &buffer->history;
+    Journal_Batch batch = {0};
+
+    // Deltas only stand in for the change if they chain from the journaled text up to the current one,
+    // edits made around the history (reloads, replaced text) need a fresh snapshot
+    bool can_append = buffer->is_journaled && buffer->journal_size < AUTOSAVE_COMPACT_SIZE;
+    unsigned int generation = buffer->journal_generation;
+    for (int c = buffer->journal_command_index; can_append && c < history->command_count; c++)
+    {
+        Command *command = &history->commands[c];
+        int first_delta = c == buffer->journal_command_index ? buffer->journal_delta_index : 0;
+        for (int d = first_delta; d < command->delta_count; d++)
+        {
+            Delta *delta = &command->deltas[d];
+            if (delta->generation_before != generation)
+            {
+                can_append = false;
+                break;
+            }
+            journal_batch_put_delta(&batch, delta);
+            generation = delta->generation_after;
+        }
+    }
+    if (generation != buffer->text_buffer.generation) can_append = false;
+
+    if (!can_append)
+    {
+        free(batch.data);
+        batch = (Journal_Batch){0};
+        journal_batch_put_snapshot(&batch, &buffer->text_buffer, buffer->file_path);
+    }
+    size_t size;
+    char *data = journal_batch_finish(&batch, &size);
+    journal_writer_push(writer, can_append ? JOURNAL_JOB_APPEND : JOURNAL_JOB_REPLACE, buffer->id, data, size);
+
+    buffer->journal_size = can_append ? buffer->journal_size + size : 0;
+    buffer->journal_generation = buffer->text_buffer.generation;
+    buffer->journal_command_index = history->command_count > 0 ? history->command_count - 1 : 0;
+    buffer->journal_delta_index = history->command_count > 0 ? history->commands[history->command_count - 1].delta_count : 0;
+    buffer->is_journaled = true;
+}
+
 void buffer_destroy(Buffer *buffer, Editor_State *state)
 {
+    if (buffer->file_watch_id) file_watch_remove(&state->file_watch, buffer->file_watch_id);
+    if (buffer->is_journaled && state->journal_writer.is_running)
+    {
+        journal_writer_push(&state->journal_writer, JOURNAL_JOB_REMOVE, buffer->id, NULL, 0);
+    }
+    buffer__release_large_file(buffer);
     text_buffer_destroy(&buffer->text_buffer);
+    match_index_destroy(&buffer->match_index);
     buffer_free_slot(buffer, state);
     free(buffer);
 }
@@ -673,12 +1330,10 @@ View *create_buffer_view_open_file(const char *path, Rect rect, Editor_State *st
 {
     Buffer *buffer = buffer_create_empty(state);
 
-    Text_Buffer tb;
-    bool read_success = text_buffer_read_from_file(path, &tb);
+    bool read_success = buffer_load_file(buffer, path);
     if (read_success)
     {
-        buffer_replace_text_buffer(buffer, tb);
-        buffer->file_path = xstrdup(path);
+        buffer_replace_file(buffer, path, state);
     }
     else
     {
@@ -719,14 +1374,8 @@ View *create_live_scene_view(const char *dylib_path, Rect rect, Editor_State *st
 
 int view_get_index(View *view, Editor_State *state)
 {
-    int index = 0;
-    View **view_c = state->views;
-    while (*view_c != view)
-    {
-        index++;
-        view_c++;
-    }
-    return index;
+    bassert(state->views[view->index] == view);
+    return view->index;
 }
 
 View **view_create_new_slot(Editor_State *state)
@@ -742,6 +1391,7 @@ void view_free_slot(View *view, Editor_State *state)
     for (int i = index_to_delete; i < state->view_count - 1; i++)
     {
         state->views[i] = state->views[i + 1];
+        state->views[i]->index = i;
     }
     state->view_count--;
     state->views = xrealloc(state->views, state->view_count * sizeof(state->views[0]));
@@ -751,16 +1401,20 @@ View *view_create(Editor_State *state)
 {
     View **new_slot = view_create_new_slot(state);
     View *view = xcalloc(sizeof(View));
+    view->index = state->view_count - 1;
     *new_slot = view;
     return *new_slot;
 }
 
 void view_destroy(View *view, Editor_State *state)
 {
+    view_grid_remove(&state->view_grid, view);
+
     switch(view->kind)
     {
         case VIEW_KIND_BUFFER:
         {
+            view_cache_destroy(&view->cache);
             buffer_destroy(view->bv.buffer, state);
             view_free_slot(view, state);
             free(view);
@@ -819,9 +1473,12 @@ Rect view_get_inner_rect(View *view, const Render_State *render_state)
     return rect;
 }
 
-void view_set_rect(View *view, Rect rect, const Render_State *render_state)
+void view_set_rect(View *view, Rect rect, Editor_State *state)
 {
+    const Render_State *render_state = &state->render_state;
     view->outer_rect = rect;
+    view_grid_remove(&state->view_grid, view);
+    view_grid_insert(&state->view_grid, view, view_get_bounds(view, render_state));
     switch (view->kind)
     {
         case VIEW_KIND_BUFFER:
@@ -877,8 +1534,10 @@ void view_set_active(View *view, Editor_State *state)
     for (int i = active_index; i > 0; i--)
     {
         state->views[i] = state->views[i - 1];
+        state->views[i]->index = i;
     }
     state->views[0] = view;
+    view->index = 0;
     state->active_view = view;
 }
 
@@ -892,20 +1551,77 @@ Rect view_get_resize_handle_rect(View *view, const Render_State *render_state)
     return r;
 }
 
+View_Cache_Key view_cache_make_key(View *view, bool is_active, Viewport canvas_viewport, const Render_State *render_state)
+{
+    View_Cache_Key key;
+    memset(&key, 0, sizeof(key)); // Keys are compared with memcmp, padding included
+    key.px_w = (int)ceilf(view->outer_rect.w * canvas_viewport.zoom * render_state->dpi_scale);
+    key.px_h = (int)ceilf(view->outer_rect.h * canvas_viewport.zoom * render_state->dpi_scale);
+    key.is_active = is_active;
+    if (view->kind == VIEW_KIND_BUFFER)
+    {
+        Buffer_View *buffer_view = &view->bv;
+        key.buffer_id = buffer_view->buffer->id;
+        key.text_generation = buffer_view->buffer->text_buffer.generation;
+        key.file_path_generation = buffer_view->buffer->file_path_generation;
+        key.viewport = buffer_view->viewport;
+        key.cursor_pos = buffer_view->cursor.pos;
+        key.mark = buffer_view->mark;
+        key.is_cursor_shown = is_active && !buffer_view->buffer->large_file && buffer_view->cursor.blink_time < 0.5f;
+        key.search_seed = buffer_view->buffer->match_index.search_seed;
+    }
+    return key;
+}
+
+void view_cache_destroy(View_Cache *cache)
+{
+    if (cache->framebuffer.fbo) gl_destroy_framebuffer(&cache->framebuffer);
+    *cache = (View_Cache){0};
+}
+
+Rect view_get_bounds(View *view, const Render_State *render_state)
+{
+    // Resize handle sticks out of the bottom right corner
+    Rect bounds = view->outer_rect;
+    bounds.w += render_state->buffer_view_resize_handle_radius;
+    bounds.h += render_state->buffer_view_resize_handle_radius;
+    return bounds;
+}
+
 View *view_at_pos(v2 pos, Editor_State *state)
 {
-    for (int i = 0; i < state->view_count; i++)
+    View **candidates;
+    int candidate_count = view_grid_query_point(&state->view_grid, pos, &candidates);
+
+    View *top_view = NULL;
+    for (int i = 0; i < candidate_count; i++)
     {
-        Rect buffer_view_rect = state->views[i]->outer_rect;
-        Rect resize_handle_rect = view_get_resize_handle_rect(state->views[i], &state->render_state);
-        bool at_buffer_view_rect = rect_contains_p(pos, buffer_view_rect);
+        View *view = candidates[i];
+        if (top_view && view->index > top_view->index) continue;
+        Rect resize_handle_rect = view_get_resize_handle_rect(view, &state->render_state);
+        bool at_buffer_view_rect = rect_contains_p(pos, view->outer_rect);
         bool at_resize_handle = rect_contains_p(pos, resize_handle_rect);
         if (at_buffer_view_rect || at_resize_handle)
         {
-            return state->views[i];
+            top_view = view;
         }
     }
-    return NULL;
+    return top_view;
+}
+
+void buffer_view_handle_file_changed(Editor_State *state, Buffer_View *buffer_view)
+{
+    Buffer *buffer = buffer_view->buffer;
+    if (!buffer->large_file && buffer->text_buffer.generation == buffer->disk_generation)
+    {
+        // Nothing to lose, pick up the new contents right away
+        action_buffer_view_reload_file(state, buffer_view);
+    }
+    else
+    {
+        buffer->is_changed_on_disk = true;
+        log_warning("%s changed on disk, Super+R reloads it", buffer->file_path);
+    }
 }
 
 Buffer_View *buffer_view_create(Buffer *buffer, Rect rect, Editor_State *state)
@@ -914,7 +1630,7 @@ Buffer_View *buffer_view_create(Buffer *buffer, Rect rect, Editor_State *state)
     view->kind = VIEW_KIND_BUFFER;
     view->bv.viewport.zoom = DEFAULT_ZOOM;
     view->bv.buffer = buffer;
-    view_set_rect(view, rect, &state->render_state);
+    view_set_rect(view, rect, state);
     return (Buffer_View *)view;
 }
 
@@ -991,7 +1707,7 @@ Image_View *image_view_create(Image image, Rect rect, Editor_State *state)
     View *view = view_create(state);
     view->kind = VIEW_KIND_IMAGE;
     view->iv.image = image;
-    view_set_rect(view, rect, &state->render_state);
+    view_set_rect(view, rect, state);
     return (Image_View *)view;
 }
 
@@ -1031,15 +1747,16 @@ Live_Scene *live_scene_create(Editor_State *state, const char *path, float w, fl
     Live_Scene *live_scene = xcalloc(sizeof(Live_Scene));
     live_scene->state = xcalloc(4096);
     live_scene->dylib = scene_loader_dylib_open(path);
+    live_scene->file_watch_id = file_watch_add(&state->file_watch, path);
     live_scene->dylib.on_init(live_scene->state, state->window, w, h, w, h, true, fbo, 0, NULL);
     live_scene->dylib.on_reload(live_scene->state);
     *new_slot = live_scene;
     return *new_slot;
 }
 
-void live_scene_check_hot_reload(Live_Scene *live_scene)
+void live_scene_reload(Live_Scene *live_scene)
 {
-    if (scene_loader_dylib_check_and_hotreload(&live_scene->dylib))
+    if (scene_loader_dylib_reload(&live_scene->dylib, live_scene->state))
     {
         live_scene->dylib.on_reload(live_scene->state);
     }
@@ -1047,6 +1764,7 @@ void live_scene_check_hot_reload(Live_Scene *live_scene)
 
 void live_scene_destroy(Live_Scene *live_scene, Editor_State *state)
 {
+    file_watch_remove(&state->file_watch, live_scene->file_watch_id);
     live_scene->dylib.on_destroy(live_scene->state);
     scene_loader_dylib_close(&live_scene->dylib);
     free(live_scene->state);
@@ -1060,7 +1778,7 @@ Live_Scene_View *live_scene_view_create(Gl_Framebuffer framebuffer, Live_Scene *
     view->kind = VIEW_KIND_LIVE_SCENE;
     view->lsv.framebuffer = framebuffer;
     view->lsv.live_scene = live_scene;
-    view_set_rect(view, rect, &state->render_state);
+    view_set_rect(view, rect, state);
     return (Live_Scene_View *)view;
 }
 
@@ -1079,11 +1797,16 @@ Prompt_Context prompt_create_context_go_to_line(Buffer_View *for_buffer_view)
     return context;
 }
 
-Prompt_Context prompt_create_context_search_next(Buffer_View *for_buffer_view)
+Prompt_Context prompt_create_context_search_next(Buffer_View *for_buffer_view, bool is_regex)
 {
     Prompt_Context context;
     context.kind = PROMPT_SEARCH_NEXT;
-    context.go_to_line.for_buffer_view = for_buffer_view;
+    context.search_next.for_buffer_view = for_buffer_view;
+    context.search_next.is_regex = is_regex;
+    context.search_next.from = for_buffer_view->cursor.pos;
+    context.search_next.query_generation = UINT_MAX; // Nothing posted for yet
+    context.search_next.scan_seed = 0;
+    context.search_next.scan_result = (Search_Scan_Result){0};
     return context;
 }
 
@@ -1102,10 +1825,17 @@ Prompt_Context prompt_create_context_change_working_dir()
     return context;
 }
 
+Prompt_Context prompt_create_context_search_everywhere()
+{
+    Prompt_Context context;
+    context.kind = PROMPT_SEARCH_EVERYWHERE;
+    return context;
+}
+
 Prompt_Result prompt_parse_result(Text_Buffer text_buffer)
 {
     bassert(text_buffer.line_count >= 2);
-    bassert(text_buffer.lines[1].buf_len < MAX_CHARS_PER_LINE);
+    bassert(text_buffer.lines[1].len < MAX_CHARS_PER_LINE);
     Prompt_Result result;
     strcpy(result.str, text_buffer.lines[1].str);
     if (result.str[text_buffer.lines[1].len - 1] == '\n')
@@ -1142,6 +1872,7 @@ bool prompt_submit(Prompt_Context context, Prompt_Result result, Rect prompt_rec
                     create_live_scene_view(result.str, new_view_rect, state);
                 } break;
                 case FILE_KIND_TEXT:
+                case FILE_KIND_BINARY: // Asked for by name, open it anyway
                 {
                     if (!create_buffer_view_open_file(result.str, new_view_rect, state))
                         return false;
@@ -1165,27 +1896,19 @@ bool prompt_submit(Prompt_Context context, Prompt_Result result, Rect prompt_rec
 
         case PROMPT_SEARCH_NEXT:
         {
-            Buffer_View *buffer_view = context.go_to_line.for_buffer_view;
+            Buffer_View *buffer_view = context.search_next.for_buffer_view;
             if (view_exists((View *)buffer_view, state))
             {
-                if (state->prev_search) free(state->prev_search);
-                state->prev_search = xstrdup(result.str);
-
-                Cursor_Pos found_pos;
-                bool found = text_buffer_search_next(&buffer_view->buffer->text_buffer, result.str, buffer_view->cursor.pos, &found_pos);
-                if (found)
-                {
-                    buffer_view->cursor.pos = cursor_pos_clamp(buffer_view->buffer->text_buffer, found_pos);
-                    viewport_snap_to_cursor(buffer_view->buffer->text_buffer, buffer_view->cursor.pos, &buffer_view->viewport, &state->render_state);
-                    buffer_view->cursor.blink_time = 0.0f;
-                }
-                else
+                if (!editor_set_search(state, result.str, context.search_next.is_regex)) return false;
+                // The cursor may be on the previewed match already, searching from where it was lands there
+                buffer_view->cursor.pos = cursor_pos_clamp(buffer_view->buffer->text_buffer, context.search_next.from);
+                if (!buffer_view_jump_to_search_match(state, buffer_view, false))
                 {
                     log_warning("prompt_submit: PROMPT_SEARCH_NEXT: Could not find \"%s\"", result.str);
                     return false;
                 }
             }
-            else log_warning("prompt_submit: PROMPT_SEARCH_NEXT: Buffer_View %p does not exist", context.go_to_line.for_buffer_view);
+            else log_warning("prompt_submit: PROMPT_SEARCH_NEXT: Buffer_View %p does not exist", context.search_next.for_buffer_view);
         } break;
 
         case PROMPT_SAVE_AS:
@@ -1195,8 +1918,8 @@ bool prompt_submit(Prompt_Context context, Prompt_Result result, Rect prompt_rec
             {
                 Buffer *b = buffer_view->buffer;
                 text_buffer_history_whitespace_cleanup(&b->text_buffer, &b->history);
-                text_buffer_write_to_file(b->text_buffer, result.str);
-                buffer_replace_file(b, result.str);
+                buffer_replace_file(b, result.str, state);
+                buffer_write_to_file(b, state);
                 action_save_workspace(state);
             }
             else log_warning("prompt_submit: PROMPT_SAVE_AS: Buffer_View %p does not exist", context.save_as.for_buffer_view);
@@ -1206,6 +1929,14 @@ bool prompt_submit(Prompt_Context context, Prompt_Result result, Rect prompt_rec
         {
             return os_change_working_dir(result.str, state);
         } break;
+
+        case PROMPT_SEARCH_EVERYWHERE:
+        {
+            if (!result.str[0]) return false;
+            // Search next and highlights pick up from there in whatever file a hit leads to
+            editor_set_search(state, result.str, false);
+            editor_start_grep(state, result.str);
+        } break;
     }
     return true;
 }
@@ -1223,16 +1954,22 @@ void viewport_set_zoom(Viewport *viewport, float new_zoom)
     viewport->zoom = new_zoom;
 }
 
-Vert make_vert(float x, float y, float u, float v, Color c)
+void viewport_get_visible_lines(Viewport viewport, float line_height, int line_count, int *out_first_line, int *out_end_line)
 {
-    Vert vert = {x, y, u, v, c};
-    return vert;
+    // Lines are laid out at i * line_height, so the visible range follows from the viewport alone
+    int first_line = (int)(viewport.rect.y / line_height);
+    int end_line = (int)((viewport.rect.y + viewport.rect.h) / line_height) + 1;
+    if (first_line < 0) first_line = 0;
+    if (end_line > line_count) end_line = line_count;
+    if (first_line > end_line) first_line = end_line;
+    *out_first_line = first_line;
+    *out_end_line = end_line;
 }
 
-void vert_buffer_add_vert(Vert_Buffer *vert_buffer, Vert vert)
+Vert make_vert(float x, float y, float u, float v, Color c)
 {
-    bassert(vert_buffer->vert_count < VERT_MAX);
-    vert_buffer->verts[vert_buffer->vert_count++] = vert;
+    Vert vert = {x, y, u, v, c};
+    return vert;
 }
 
 Render_Font load_font(const char *path, float dpi_scale)
@@ -1258,6 +1995,7 @@ Render_Font load_font(const char *path, float dpi_scale)
     stbtt_BakeFontBitmap(file_bytes, 0, font.size * dpi_scale, atlas_bitmap, font.atlas_w, font.atlas_h, 32, font.char_count, font.char_data);
     stbtt_GetScaledFontVMetrics(file_bytes, 0, font.size * dpi_scale, &font.ascent, &font.descent, &font.line_gap);
     free(file_bytes);
+    font_init_advances(&font);
 
     glGenTextures(1, &font.texture);
     glBindTexture(GL_TEXTURE_2D, font.texture);
@@ -1275,10 +2013,23 @@ float get_font_line_height(Render_Font font)
     return height;
 }
 
+void font_init_advances(Render_Font *font)
+{
+    font->advances = xmalloc(font->char_count * sizeof(font->advances[0]));
+    font->is_monospace = true;
+    for (int i = 0; i < font->char_count; i++)
+    {
+        font->advances[i] = font->char_data[i].xadvance * font->i_dpi_scale;
+        if (font->advances[i] != font->advances[0]) font->is_monospace = false;
+    }
+    font->monospace_advance = font->is_monospace ? font->advances[0] : 0.0f;
+}
+
 float get_char_width(char c, Render_Font font)
 {
-    float char_width = font.char_data[c - 32].xadvance * font.i_dpi_scale;
-    return char_width;
+    int i = (unsigned char)c - 32;
+    if (i < 0 || i >= font.char_count) i = 0; // Newlines and other unprintables measure like a space
+    return font.advances[i];
 }
 
 Rect get_string_rect(const char *str, Render_Font font, float x, float y)
@@ -1286,8 +2037,13 @@ Rect get_string_rect(const char *str, Render_Font font, float x, float y)
     Rect r;
     r.x = x;
     r.y = y;
-    r.w = 0;
     r.h = get_font_line_height(font);
+    if (font.is_monospace)
+    {
+        r.w = strlen(str) * font.monospace_advance;
+        return r;
+    }
+    r.w = 0;
     while (*str)
     {
         r.w += get_char_width(*str, font);
@@ -1296,90 +2052,72 @@ Rect get_string_rect(const char *str, Render_Font font, float x, float y)
     return r;
 }
 
-Rect get_string_range_rect(const char *str, Render_Font font, int start_char, int end_char)
+const float *get_line_x_cache(Text_Line *line, Render_Font font)
 {
-    bassert(start_char >= 0);
-    bassert(start_char < end_char);
-    Rect r;
-    r.y = 0;
-    r.h = get_font_line_height(font);
-    float x = 0, min_x = 0, max_x = 0;
-    for (int i = 0; i < end_char && str[i]; i++)
+    if (!line->x_cache)
     {
-        if (i == start_char)
-        {
-            min_x = x;
-        }
-
-        char c = str[i];
-        if (str[i + 1 == '\0'] && c == '\n')
+        line->x_cache = xmalloc((line->len + 1) * sizeof(line->x_cache[0]));
+        float x = 0;
+        for (int i = 0; i < line->len; i++)
         {
-            c = ' ';
+            line->x_cache[i] = x;
+            x += get_char_width(line->str[i], font);
         }
-        x += get_char_width(c, font);
+        line->x_cache[line->len] = x;
     }
-    // If reached end_char index, x will be max_x (end_char itself is not included)
-    // If reached null terminator, it will still be valid, highlighting the whole string.
-    max_x = x;
-    r.x = min_x;
-    r.w = max_x - min_x;
-    return r;
+    return line->x_cache;
+}
+
+float get_line_col_x(Text_Line *line, int col, Render_Font font)
+{
+    bassert(col >= 0);
+    bassert(col <= line->len);
+    if (font.is_monospace) return col * font.monospace_advance;
+    return get_line_x_cache(line, font)[col];
 }
 
-Rect get_string_char_rect(const char *str, Render_Font font, int char_i)
+Rect get_line_range_rect(Text_Line *line, Render_Font font, int start_col, int end_col)
 {
-    Rect r = {0};
+    bassert(start_col >= 0);
+    bassert(start_col < end_col);
+    if (end_col > line->len) end_col = line->len;
+    Rect r;
+    r.y = 0;
     r.h = get_font_line_height(font);
-    float x = 0, min_x = 0, max_x = 0;
-    int i = 0;
-    bool found_max = false;
-    while (*str)
-    {
-        char c = *str;
-        if (c == '\n')
-        {
-            c = ' ';
-        }
-        x += get_char_width(c, font);
-        if (i == char_i)
-        {
-            max_x = x;
-            found_max = true;
-            break;
-        }
-        else
-        {
-            min_x = x;
-        }
-        str++;
-        i++;
-    }
-    bassert(found_max);
-    r.x = min_x;
-    r.w = max_x - min_x;
+    r.x = get_line_col_x(line, start_col, font);
+    r.w = get_line_col_x(line, end_col, font) - r.x;
     return r;
 }
 
-int get_char_i_at_pos_in_string(const char *str, Render_Font font, float x)
+Rect get_line_char_rect(Text_Line *line, Render_Font font, int col)
 {
-    int char_i = 0;
-    float str_x = 0;
-    while (*str)
+    bassert(col < line->len);
+    return get_line_range_rect(line, font, col, col + 1);
+}
+
+int get_line_col_at_x(Text_Line *line, Render_Font font, float x)
+{
+    // First column whose char ends past x, or len if x is past the whole line
+    if (x < 0) return 0;
+    if (font.is_monospace)
     {
-        str_x += get_char_width(*str, font);
-        if (str_x > x)
-        {
-            return char_i;
-        }
-        char_i++;
-        str++;
+        int col = (int)(x / font.monospace_advance);
+        return col < line->len ? col : line->len;
+    }
+    const float *x_cache = get_line_x_cache(line, font);
+    int lo = 0, hi = line->len;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (x_cache[mid + 1] > x) hi = mid;
+        else lo = mid + 1;
     }
-    return char_i;
+    return lo;
 }
 
 Rect get_cursor_rect(Text_Buffer text_buffer, Cursor_Pos cursor_pos, const Render_State *render_state)
 {
-    Rect cursor_rect = get_string_char_rect(text_buffer.lines[cursor_pos.line].str, render_state->font, cursor_pos.col);
+    Rect cursor_rect = get_line_char_rect(&text_buffer.lines[cursor_pos.line], render_state->font, cursor_pos.col);
     float line_height = get_font_line_height(render_state->font);
     float x = 0;
     float y = cursor_pos.line * line_height;
@@ -1435,7 +2173,7 @@ Cursor_Pos buffer_pos_to_cursor_pos(v2 buffer_pos, Text_Buffer text_buffer, cons
     } else if (cursor.line >= text_buffer.line_count) {
         cursor.line = text_buffer.line_count - 1;
     }
-    cursor.col = get_char_i_at_pos_in_string(text_buffer.lines[cursor.line].str, render_state->font, buffer_pos.x);
+    cursor.col = get_line_col_at_x(&text_buffer.lines[cursor.line], render_state->font, buffer_pos.x);
     return cursor;
 }
 
@@ -1479,6 +2217,7 @@ void viewport_snap_to_cursor(Text_Buffer text_buffer, Cursor_Pos cursor_pos, Vie
 void text_buffer_history_insert_char(Text_Buffer *text_buffer, History *history, char c, Cursor_Pos pos)
 {
     bool will_add_history = history_get_last_uncommitted_command(history) != NULL;
+    unsigned int generation_before = text_buffer->generation;
 
     text_buffer_insert_char(text_buffer, c, pos);
 
@@ -1487,7 +2226,9 @@ void text_buffer_history_insert_char(Text_Buffer *text_buffer, History *history,
         history_add_delta(history, &(Delta){
             .kind = DELTA_INSERT_CHAR,
             .insert_char.pos = pos,
-            .insert_char.c = c
+            .insert_char.c = c,
+            .generation_before = generation_before,
+            .generation_after = text_buffer->generation
         });
     }
 }
@@ -1495,6 +2236,7 @@ void text_buffer_history_insert_char(Text_Buffer *text_buffer, History *history,
 void text_buffer_history_remove_char(Text_Buffer *text_buffer, History *history, Cursor_Pos pos)
 {
     bool will_add_history = history_get_last_uncommitted_command(history) != NULL;
+    unsigned int generation_before = text_buffer->generation;
 
     char removed_char = text_buffer_remove_char(text_buffer, pos);
 
@@ -1503,7 +2245,9 @@ void text_buffer_history_remove_char(Text_Buffer *text_buffer, History *history,
         history_add_delta(history, &(Delta){
             .kind = DELTA_REMOVE_CHAR,
             .insert_char.pos = pos,
-            .insert_char.c = removed_char
+            .insert_char.c = removed_char,
+            .generation_before = generation_before,
+            .generation_after = text_buffer->generation
         });
     }
 }
@@ -1511,6 +2255,7 @@ void text_buffer_history_remove_char(Text_Buffer *text_buffer, History *history,
 Cursor_Pos text_buffer_history_insert_range(Text_Buffer *text_buffer, History *history, const char *range, Cursor_Pos pos)
 {
     bool will_add_history = history_get_last_uncommitted_command(history) != NULL;
+    unsigned int generation_before = text_buffer->generation;
 
     Cursor_Pos end = text_buffer_insert_range(text_buffer, range, pos);
 
@@ -1520,7 +2265,9 @@ Cursor_Pos text_buffer_history_insert_range(Text_Buffer *text_buffer, History *h
             .kind = DELTA_INSERT_RANGE,
             .insert_range.start = pos,
             .insert_range.end = end,
-            .insert_range.range = xstrdup(range)
+            .insert_range.range = xstrdup(range),
+            .generation_before = generation_before,
+            .generation_after = text_buffer->generation
         });
     }
 
@@ -1530,6 +2277,10 @@ Cursor_Pos text_buffer_history_insert_range(Text_Buffer *text_buffer, History *h
 void text_buffer_history_remove_range(Text_Buffer *text_buffer, History *history, Cursor_Pos start, Cursor_Pos end)
 {
     bool will_add_history = history_get_last_uncommitted_command(history) != NULL;
+    unsigned int generation_before = text_buffer->generation;
+    char *removed_range = will_add_history ? text_buffer_extract_range(text_buffer, start, end) : NULL;
+
+    text_buffer_remove_range(text_buffer, start, end);
 
     if (will_add_history)
     {
@@ -1537,11 +2288,11 @@ void text_buffer_history_remove_range(Text_Buffer *text_buffer, History *history
             .kind = DELTA_REMOVE_RANGE,
             .remove_range.start = start,
             .remove_range.end = end,
-            .remove_range.range = text_buffer_extract_range(text_buffer, start, end)
+            .remove_range.range = removed_range,
+            .generation_before = generation_before,
+            .generation_after = text_buffer->generation
         });
     }
-
-    text_buffer_remove_range(text_buffer, start, end);
 }
 
 int text_buffer_history_line_indent_increase_level(Text_Buffer *text_buffer, History *history, int line)
@@ -1637,24 +2388,345 @@ void buffer_view_set_cursor_to_pixel_position(Buffer_View *buffer_view, v2 mouse
     buffer_view->cursor.pos = cursor_pos_clamp(buffer_view->buffer->text_buffer, text_cursor_under_mouse);
 }
 
+bool buffer_view_jump_to_search_match(Editor_State *state, Buffer_View *buffer_view, bool backward)
+{
+    Text_Buffer *text_buffer = &buffer_view->buffer->text_buffer;
+    Cursor_Pos found_pos, found_end;
+    bool found;
+    if (state->prev_search_is_regex)
+    {
+        found = backward ?
+            text_buffer_regex_search_prev(text_buffer, state->prev_search_regex, buffer_view->cursor.pos, &found_pos, &found_end) :
+            text_buffer_regex_search_next(text_buffer, state->prev_search_regex, buffer_view->cursor.pos, &found_pos, &found_end);
+    }
+    else
+    {
+        found = backward ?
+            text_buffer_search_prev(text_buffer, &state->prev_search_pattern, buffer_view->cursor.pos, &found_pos) :
+            text_buffer_search_next(text_buffer, &state->prev_search_pattern, buffer_view->cursor.pos, &found_pos);
+    }
+    if (!found) return false;
+
+    buffer_view->cursor.pos = cursor_pos_clamp(*text_buffer, found_pos);
+    viewport_snap_to_cursor(*text_buffer, buffer_view->cursor.pos, &buffer_view->viewport, &state->render_state);
+    buffer_view->cursor.blink_time = 0.0f;
+    return true;
+}
+
+// What a query typed into a search prompt searches for. A regex is passed on as typed.
+// Otherwise the prompt is a single line, "\n" stands in for a line break and "\\" for a backslash.
+// Smart case: an all lowercase query matches either case, escapes like \W don't count as upper case.
+static char *editor__decode_search_query(const char *query, bool is_regex, bool *out_ignore_case)
+{
+    char *needle = xmalloc(strlen(query) + 1);
+    char *out = needle;
+    bool has_upper = false;
+    for (const char *c = query; *c; c++)
+    {
+        if (c[0] == '\\' && c[1] && (is_regex || c[1] == 'n' || c[1] == '\\'))
+        {
+            if (is_regex)
+            {
+                *out++ = c[0];
+                *out++ = c[1];
+            }
+            else *out++ = c[1] == 'n' ? '\n' : '\\';
+            c++;
+            continue;
+        }
+        if (isupper((unsigned char)*c)) has_upper = true;
+        *out++ = *c;
+    }
+    *out = '\0';
+    *out_ignore_case = !has_upper;
+    return needle;
+}
+
+// False if query is a regex that doesn't compile, the previous search is kept then
+bool editor_set_search(Editor_State *state, const char *query, bool is_regex)
+{
+    bool ignore_case;
+    char *needle = editor__decode_search_query(query, is_regex, &ignore_case);
+    Search_Regex regex = {0};
+    if (is_regex)
+    {
+        char error[128];
+        if (!search_regex_compile(&regex, needle, ignore_case, error, sizeof(error)))
+        {
+            log_warning("editor_set_search: Bad regex \"%s\": %s", query, error);
+            free(needle);
+            return false;
+        }
+    }
+
+    free(state->prev_search);
+    search_pattern_destroy(&state->prev_search_pattern);
+    if (state->prev_search_regex)
+    {
+        search_regex_destroy(state->prev_search_regex);
+        free(state->prev_search_regex);
+        state->prev_search_regex = NULL;
+    }
+    state->prev_search = xstrdup(query);
+    state->prev_search_is_regex = is_regex;
+    if (is_regex)
+    {
+        state->prev_search_regex = xmalloc(sizeof(*state->prev_search_regex));
+        *state->prev_search_regex = regex;
+    }
+    else state->prev_search_pattern = search_pattern_create(needle, ignore_case);
+    state->search_seed++;
+    free(needle);
+    return true;
+}
+
+// Search as you type: whatever is in the active search prompt is scanned for on the search
+// scanner thread, the target view's cursor goes to the first match after where it was when
+// the prompt opened. Typing more supersedes the scan still running.
+void editor_update_incremental_search(Editor_State *state)
+{
+    View *active_view = state->active_view;
+    Buffer *prompt = active_view && active_view->kind == VIEW_KIND_BUFFER ? active_view->bv.buffer : NULL;
+    if (!prompt || prompt->prompt_context.kind != PROMPT_SEARCH_NEXT)
+    {
+        search_scanner_cancel(&state->search_scanner);
+        return;
+    }
+    Prompt_Context *context = &prompt->prompt_context;
+    Buffer_View *buffer_view = context->search_next.for_buffer_view;
+    if (!view_exists((View *)buffer_view, state) || buffer_view->buffer->large_file) return;
+    Text_Buffer *text_buffer = &buffer_view->buffer->text_buffer;
+    if (!state->search_scanner.is_running && !search_scanner_start(&state->search_scanner)) return;
+
+    if (context->search_next.query_generation != prompt->text_buffer.generation)
+    {
+        context->search_next.query_generation = prompt->text_buffer.generation;
+        context->search_next.scan_result = (Search_Scan_Result){0};
+        Prompt_Result result = prompt_parse_result(prompt->text_buffer);
+        bool ignore_case;
+        char *needle = editor__decode_search_query(result.str, context->search_next.is_regex, &ignore_case);
+        if (needle[0])
+        {
+            context->search_next.scan_seed = search_scanner_post(&state->search_scanner, text_buffer, buffer_view->buffer->id,
+                needle, ignore_case, context->search_next.is_regex, context->search_next.from);
+        }
+        else
+        {
+            // Opened empty, the snapshot is taken now rather than on the first keystroke
+            search_scanner_cancel(&state->search_scanner);
+            search_scanner_prepare(&state->search_scanner, text_buffer, buffer_view->buffer->id);
+            context->search_next.scan_seed = 0;
+            Cursor_Pos from = cursor_pos_clamp(*text_buffer, context->search_next.from);
+            if (!cursor_pos_eq(buffer_view->cursor.pos, from))
+            {
+                buffer_view->cursor.pos = from;
+                viewport_snap_to_cursor(*text_buffer, buffer_view->cursor.pos, &buffer_view->viewport, &state->render_state);
+            }
+        }
+        free(needle);
+    }
+    if (!context->search_next.scan_seed) return;
+
+    Search_Scan_Result *shown = &context->search_next.scan_result;
+    Search_Scan_Result result = search_scanner_poll(&state->search_scanner);
+    if (result.seed == context->search_next.scan_seed)
+    {
+        // The first match is in before the count, without one the cursor goes back once the scan is done
+        bool should_move = (result.has_first && !shown->has_first) || (result.is_done && !result.has_first && !shown->is_done);
+        if (should_move)
+        {
+            Cursor_Pos pos = result.has_first ? result.first : context->search_next.from;
+            buffer_view->cursor.pos = cursor_pos_clamp(*text_buffer, pos);
+            viewport_snap_to_cursor(*text_buffer, buffer_view->cursor.pos, &buffer_view->viewport, &state->render_state);
+            buffer_view->cursor.blink_time = 0.0f;
+        }
+        *shown = result;
+    }
+    if (!shown->is_done)
+    {
+        editor_request_frame_at(state, glfwGetTime() + SEARCH_SCAN_POLL_INTERVAL);
+    }
+}
+
+// Search everywhere: every open buffer as it is in the editor, and the files under the working
+// dir that aren't open. Hits stream into a results buffer, Enter on one jumps to it.
+void editor_start_grep(Editor_State *state, const char *query)
+{
+    editor_discard_grep(state);
+    double start_ms = module_get_time_ms();
+
+    Buffer *results = buffer_get_by_id(state, state->grep_buffer_id);
+    if (results)
+    {
+        buffer_replace_text_buffer(results, text_buffer_create_empty());
+    }
+    else
+    {
+        v2 mouse_canvas_pos = screen_pos_to_canvas_pos(state->mouse_state.pos, state->canvas_viewport);
+        View *view = create_buffer_view_generic((Rect){mouse_canvas_pos.x, mouse_canvas_pos.y, 800, 400}, state);
+        results = view->bv.buffer;
+        state->grep_buffer_id = results->id;
+    }
+    char *header = strf("Search everywhere for \"%s\" in %s\n\n", query, state->working_dir);
+    text_buffer_insert_range(&results->text_buffer, header, (Cursor_Pos){0, 0});
+    free(header);
+
+    bool ignore_case;
+    char *needle = editor__decode_search_query(query, false, &ignore_case);
+    Grep *grep = grep_create(needle, ignore_case, (int)sysconf(_SC_NPROCESSORS_ONLN));
+    free(needle);
+
+    size_t working_dir_len = strlen(state->working_dir);
+    for (int i = 0; i < state->buffer_count; i++)
+    {
+        Buffer *buffer = state->buffers[i];
+        if (buffer == results || buffer->prompt_context.kind != PROMPT_NONE) continue;
+        char *path = buffer->file_path ? realpath(buffer->file_path, NULL) : NULL;
+        if (buffer->large_file)
+        {
+            // Same as on disk, the walk maps it like any other file unless it's outside the working dir
+            bool is_walked = path && strncmp(path, state->working_dir, working_dir_len) == 0 && path[working_dir_len] == '/';
+            if (path && !is_walked) grep_add_file(grep, path, buffer->file_path);
+        }
+        else
+        {
+            if (path) grep_skip_open_file(grep, path);
+            Text_Buffer *text_buffer = &buffer->text_buffer;
+            char *data = text_buffer_extract_range(text_buffer, (Cursor_Pos){0, 0},
+                (Cursor_Pos){text_buffer->line_count - 1, text_buffer->lines[text_buffer->line_count - 1].len});
+            char *name = buffer->file_path ? xstrdup(buffer->file_path) : strf("<buffer %d>", buffer->id);
+            grep_add_text(grep, name, buffer->id, data, strlen(data));
+            free(name);
+        }
+        free(path);
+    }
+    grep_add_dir(grep, state->working_dir);
+    grep->stats.setup_ms = module_get_time_ms() - start_ms;
+
+    if (!grep_run(grep))
+    {
+        grep_destroy(grep);
+        return;
+    }
+    state->grep = grep;
+}
+
+void editor_update_grep(Editor_State *state)
+{
+    Grep *grep = state->grep;
+    if (!grep) return;
+
+    // Done first, whatever was found before then gets taken below
+    Grep_Stats stats;
+    bool is_done = grep_is_done(grep, &stats);
+    int hit_count;
+    Grep_Hit *hits = grep_take_hits(grep, &hit_count);
+    String_Builder sb = {0};
+    for (int i = 0; i < hit_count; i++)
+    {
+        string_builder_append_f(&sb, "%s:%d:%d: %s\n", hits[i].name, hits[i].line + 1, hits[i].col + 1, hits[i].preview);
+    }
+    grep_free_hits(hits, hit_count);
+    free(hits);
+    if (is_done)
+    {
+        string_builder_append_f(&sb, "\n%d hits%s in %d files (%.1f MB), %d skipped as binary, on %d threads in %.1f ms\n",
+            stats.hit_count, stats.is_truncated ? " (stopped there)" : "", stats.file_count, stats.byte_count / (1024.0 * 1024.0),
+            stats.binary_count, stats.thread_count, stats.setup_ms + stats.wall_ms);
+        trace_log("Search everywhere: setup %.2f ms, pool %.2f ms wall (walk %.2f ms, search %.2f ms summed over threads); "
+            "%d dirs, %d files, %d open files searched as buffers, %d binaries skipped, %d steals",
+            stats.setup_ms, stats.wall_ms, stats.walk_ms, stats.search_ms,
+            stats.dir_count, stats.file_count, stats.open_count, stats.binary_count, stats.steal_count);
+        grep_destroy(grep);
+        state->grep = NULL;
+    }
+
+    char *text = string_builder_compile_and_destroy(&sb);
+    Buffer *results = buffer_get_by_id(state, state->grep_buffer_id);
+    if (results && text[0])
+    {
+        Text_Buffer *text_buffer = &results->text_buffer;
+        text_buffer_insert_range(text_buffer, text, cursor_pos_to_end_of_buffer(*text_buffer, (Cursor_Pos){0}));
+    }
+    free(text);
+}
+
+void editor_discard_grep(Editor_State *state)
+{
+    if (!state->grep) return;
+    grep_destroy(state->grep);
+    state->grep = NULL;
+}
+
+// Opens what a results line points at, in a view of its own unless the buffer has one already
+bool editor_jump_to_grep_hit(Editor_State *state, const char *hit_line)
+{
+    char name[MAX_CHARS_PER_LINE];
+    Cursor_Pos pos;
+    if (!grep_parse_hit_line(hit_line, name, sizeof(name), &pos.line, &pos.col)) return false;
+
+    Buffer *buffer = NULL;
+    int buffer_id;
+    int name_len = 0;
+    if (sscanf(name, "<buffer %d>%n", &buffer_id, &name_len) == 1 && name[name_len] == '\0')
+    {
+        buffer = buffer_get_by_id(state, buffer_id);
+        if (!buffer) return false;
+    }
+    else
+    {
+        char *path = realpath(name, NULL);
+        for (int i = 0; i < state->buffer_count && path && !buffer; i++)
+        {
+            char *buffer_path = state->buffers[i]->file_path ? realpath(state->buffers[i]->file_path, NULL) : NULL;
+            if (buffer_path && strcmp(buffer_path, path) == 0) buffer = state->buffers[i];
+            free(buffer_path);
+        }
+        free(path);
+    }
+
+    View *view = NULL;
+    for (int i = 0; i < state->view_count && buffer && !view; i++)
+    {
+        if (state->views[i]->kind == VIEW_KIND_BUFFER && state->views[i]->bv.buffer == buffer) view = state->views[i];
+    }
+    if (!view)
+    {
+        v2 mouse_canvas_pos = screen_pos_to_canvas_pos(state->mouse_state.pos, state->canvas_viewport);
+        Rect rect = {mouse_canvas_pos.x + 50, mouse_canvas_pos.y + 50, 800, 600};
+        view = buffer ? outer_view(buffer_view_create(buffer, rect, state)) : create_buffer_view_open_file(name, rect, state);
+        if (!view) return false;
+    }
+    view_set_active(view, state);
+
+    Buffer_View *buffer_view = &view->bv;
+    if (buffer_view->buffer->large_file) return true; // Read-only large files have no cursor to move
+    Text_Buffer *text_buffer = &buffer_view->buffer->text_buffer;
+    buffer_view->cursor.pos = cursor_pos_clamp(*text_buffer, pos);
+    viewport_snap_to_cursor(*text_buffer, buffer_view->cursor.pos, &buffer_view->viewport, &state->render_state);
+    buffer_view->cursor.blink_time = 0.0f;
+    return true;
+}
+
+// Every load from a mapped file goes through here, so ENABLE_PARALLEL_FILE_LOAD covers them all
+Text_Buffer text_buffer_create_from_mapped_file(const Mapped_File *file)
+{
+    int thread_count = ENABLE_PARALLEL_FILE_LOAD ? (int)sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    return text_buffer_create_from_data_threaded(file->data, file->size, thread_count);
+}
+
+// Always loads the whole file, for the editor's own snapshots of buffers it already had in memory.
+// Files the user opens go through buffer_load_file, which keeps big ones mapped.
 bool text_buffer_read_from_file(const char *path, Text_Buffer *text_buffer)
 {
-    FILE *f = fopen(path, "r");
-    if (!f)
+    Mapped_File file;
+    if (!os_file_map(path, &file))
     {
         trace_log("Could not open file at %s", path);
         return false;
     }
-    char buf[MAX_CHARS_PER_LINE];
-    memset(text_buffer, 0, sizeof(*text_buffer));
-    while (fgets(buf, sizeof(buf), f))
-    {
-        text_buffer->line_count++;
-        bassert(text_buffer->line_count <= MAX_LINES);
-        text_buffer->lines = xrealloc(text_buffer->lines, text_buffer->line_count * sizeof(text_buffer->lines[0]));
-        text_buffer->lines[text_buffer->line_count - 1] = text_line_make_dup(buf);
-    }
-    fclose(f);
+    *text_buffer = text_buffer_create_from_mapped_file(&file);
+    os_file_unmap(&file);
     return true;
 }
 
@@ -1698,7 +2770,7 @@ Image file_open_image(const char *path)
 
 void live_scene_reset(Editor_State *state, Live_Scene **live_scene, float w, float h, GLuint fbo)
 {
-    Live_Scene *new_live_scene = live_scene_create(state, (*live_scene)->dylib.original_path, w, h, fbo);
+    Live_Scene *new_live_scene = live_scene_create(state, (*live_scene)->dylib.module.original_path, w, h, fbo);
     live_scene_destroy(*live_scene, state);
     *live_scene = new_live_scene;
 }
@@ -1706,23 +2778,33 @@ void live_scene_reset(Editor_State *state, Live_Scene **live_scene, float w, flo
 void live_scene_rebuild(Live_Scene *live_scene)
 {
     char command_buf[1024];
-    snprintf(command_buf, sizeof(command_buf), "make %s", live_scene->dylib.original_path);
+    snprintf(command_buf, sizeof(command_buf), "make %s", live_scene->dylib.module.original_path);
     int result = system(command_buf);
     if (result != 0)
     {
-        log_warning("live_scene_rebuild: Build failed with code %d for dylib %s", result, live_scene->dylib.original_path);
+        log_warning("live_scene_rebuild: Build failed with code %d for dylib %s", result, live_scene->dylib.module.original_path);
     }
-    trace_log("live_scene_rebuild: Rebuilt dylib (%s)", live_scene->dylib.original_path);
+    trace_log("live_scene_rebuild: Rebuilt dylib (%s)", live_scene->dylib.module.original_path);
 }
 
 #include "actions.c"
 #include "input.c"
 #include "history.c"
+#include "journal.c"
+#include "match_index.c"
+#include "large_file.c"
 #include "misc.c"
+#include "module_loader.c"
 #include "os.c"
 #include "renderer.c"
 #include "scene_loader.c"
 #include "scratch_runner.c"
+#include "search.c"
+#include "search_regex.c"
+#include "search_scanner.c"
 #include "string_builder.c"
 #include "text_buffer.c"
 #include "unit_tests.c"
+#include "view_grid.c"
+#include "file_watch.c"
+#include "grep.c"
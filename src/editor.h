@@ -4,6 +4,7 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 #include <OpenGL/gl3.h>
@@ -12,25 +13,42 @@
 #include <stb_truetype.h>
 
 #include "color.h"
+#include "file_watch.h"
+#include "grep.h"
 #include "history.h"
+#include "journal.h"
+#include "match_index.h"
+#include "large_file.h"
 #include "misc.h"
+#include "module_loader.h"
 #include "platform_types.h"
 #include "rect.h"
 #include "scene_loader.h"
+#include "scratch_runner.h"
+#include "search_scanner.h"
 #include "text_buffer.h"
+#include "view_grid.h"
 
-#define VERT_MAX 8192
+#define RENDER_BATCH_CHUNK_VERTS 16384
+#define RENDER_BATCH_CHUNK_COUNT 3
 #define SCROLL_SENS 10.0f
 #define SCROLL_TIMEOUT 0.1f
 #define VIEWPORT_CURSOR_BOUNDARY_LINES 5
 #define VIEWPORT_CURSOR_BOUNDARY_COLUMNS 5
 #define GO_TO_LINE_CHAR_MAX 32
-#define MAX_LINES 16384
 #define INDENT_SPACES 4
 #define DEFAULT_ZOOM 1.0f
 #define FONT_PATH "res/UbuntuSansMono-Regular.ttf"
 #define FONT_SIZE 18.0f
 #define ENABLE_OS_CLIPBOARD true
+#define ENABLE_PARALLEL_FILE_LOAD true
+#define LARGE_FILE_THRESHOLD (256 * 1024 * 1024)
+#define SCRATCH_CACHE_DIR ".e2/scratch/cache" // Precompiled editor header and dylibs of earlier scratch builds, keyed by hash
+#define SCRATCH_BUILD_POLL_INTERVAL 0.05 // Seconds between checks for compile output while a scratch build runs
+#define SEARCH_SCAN_POLL_INTERVAL 0.016 // Seconds between checks for search-as-you-type results while a scan runs
+#define GREP_POLL_INTERVAL 0.05 // Seconds between takes of search everywhere hits while it runs
+#define FILE_WATCH_POLL_INTERVAL 0.5 // Seconds between stat checks of watched files where inotify isn't available
+#define VIEW_CACHE_MAX_DIM 4096 // Views that take more pixels than this on screen are drawn directly every frame
 
 #define FILE_PATH1 "res/mock7.txt"
 // #define FILE_PATH1 "res/mock4.txt"
@@ -39,6 +57,9 @@
 #define LIVE_CUBE_PATH "bin/live_cube.dylib"
 #define E2_WORKSPACE ".e2/workspace"
 #define E2_TEMP_FILES ".e2/temp_files"
+#define E2_JOURNAL_DIR ".e2/journal"
+#define AUTOSAVE_INTERVAL 1.0 // Seconds between journal writes of edited buffers
+#define AUTOSAVE_COMPACT_SIZE (1024 * 1024) // Journal bytes past the last snapshot after which a fresh snapshot is written
 
 typedef struct Vert {
     float x, y;
@@ -46,10 +67,45 @@ typedef struct Vert {
     Color c;
 } Vert;
 
-typedef struct Vert_Buffer {
-    Vert verts[VERT_MAX];
+typedef struct Render_Batch_Cmd {
+    GLuint shader;
+    GLuint texture; // Bound to the active unit for shaders that sample it, 0 otherwise
+    int mvp_index;
+    bool has_scissor;
+    Rect scissor_rect;
+    int first_vert;
     int vert_count;
-} Vert_Buffer;
+} Render_Batch_Cmd;
+
+typedef struct Render_Batch_Stats {
+    int draw_call_count;
+    int vert_upload_count;
+    int mvp_upload_count;
+    int vert_count;
+    int view_redraw_count; // Cached views that had to be drawn again
+} Render_Batch_Stats;
+
+// Collects the draws of a frame, so vertices go up in as few uploads as possible
+// and consecutive draws with the same state become one draw call.
+// Vertices are staged one chunk at a time; a full chunk is flushed into the
+// next GPU buffer of a small ring, so there is no limit on vertices per draw or frame.
+typedef struct Render_Batch {
+    Vert verts[RENDER_BATCH_CHUNK_VERTS];
+    int vert_count;
+    GLuint vaos[RENDER_BATCH_CHUNK_COUNT];
+    GLuint vbos[RENDER_BATCH_CHUNK_COUNT];
+    int next_chunk_index;
+    Render_Batch_Cmd *cmds;
+    int cmd_count;
+    int cmd_cap;
+    m4 *mvps;
+    int mvp_count;
+    int mvp_cap;
+    bool has_scissor;
+    Rect scissor_rect;
+    Render_Batch_Stats frame_stats;
+    Render_Batch_Stats last_frame_stats;
+} Render_Batch;
 
 typedef struct Image {
     GLuint texture;
@@ -76,6 +132,9 @@ typedef struct Render_Font {
     float ascent, descent, line_gap;
     int atlas_w, atlas_h;
     float i_dpi_scale;
+    float *advances; // xadvance of each baked char, already scaled by i_dpi_scale
+    bool is_monospace;
+    float monospace_advance;
 } Render_Font;
 
 typedef struct Render_State {
@@ -84,8 +143,6 @@ typedef struct Render_State {
     GLuint quad_shader;
     GLuint tex_shader;
     GLuint flipped_quad_shader;
-    GLuint vao;
-    GLuint vbo;
     GLuint mvp_ubo;
     GLuint grid_shader_offset_loc;
     GLuint grid_shader_spacing_loc;
@@ -100,6 +157,7 @@ typedef struct Render_State {
     float buffer_view_padding;
     float buffer_view_resize_handle_radius;
     GLuint default_fbo;
+    Render_Batch *batch;
 
     Mat_Stack mat_stack_proj;
     Mat_Stack mat_stack_model_view;
@@ -114,6 +172,7 @@ typedef enum Prompt_Kind{
     PROMPT_GO_TO_LINE,
     PROMPT_SEARCH_NEXT,
     PROMPT_CHANGE_WORKING_DIR,
+    PROMPT_SEARCH_EVERYWHERE,
 } Prompt_Kind;
 
 struct Buffer_View;
@@ -127,6 +186,14 @@ typedef struct {
     struct {
         struct Buffer_View *for_buffer_view;
     } save_as;
+    struct {
+        struct Buffer_View *for_buffer_view;
+        bool is_regex;
+        Cursor_Pos from; // Target cursor when the prompt opened, typed queries are previewed from there
+        unsigned int query_generation; // Prompt text generation the scan was posted for
+        unsigned int scan_seed; // 0 while no scan is posted
+        Search_Scan_Result scan_result; // Latest for scan_seed
+    } search_next;
     };
 } Prompt_Context;
 
@@ -136,10 +203,25 @@ typedef struct Prompt_Result {
 
 typedef struct Buffer {
     char *file_path;
+    unsigned int file_path_generation; // Bumped whenever file_path is replaced
     Prompt_Context prompt_context;
     History history;
     Text_Buffer text_buffer;
+    Large_File *large_file; // Read-only mode for huge files, text_buffer is unused until promoted
     int id;
+    int file_watch_id;
+    unsigned int disk_generation; // text_buffer.generation when the text last matched the file
+    bool is_changed_on_disk; // File changed while the buffer had edits of its own, so it wasn't reloaded
+    unsigned int snapshot_generation; // text_buffer.generation when the workspace snapshot was taken
+    uint64_t snapshot_hash; // Names the snapshot file, see action_save_workspace
+    bool has_snapshot;
+    // Autosave journal: deltas before this history position are written, and the journal describes journal_generation
+    int journal_command_index;
+    int journal_delta_index;
+    unsigned int journal_generation;
+    size_t journal_size; // Bytes appended since the journal's snapshot
+    bool is_journaled;
+    Match_Index match_index; // Occurrences of the last search, for highlighting
 } Buffer;
 
 typedef struct Buffer_View {
@@ -158,6 +240,7 @@ typedef struct Image_View {
 typedef struct Live_Scene {
     void *state;
     Scene_Dylib dylib;
+    int file_watch_id;
 } Live_Scene;
 
 typedef struct Live_Scene_View {
@@ -166,6 +249,27 @@ typedef struct Live_Scene_View {
     Rect framebuffer_rect;
 } Live_Scene_View;
 
+// Everything a cached buffer view texture is drawn from; the texture is reused while this stays the same
+typedef struct View_Cache_Key {
+    int px_w;
+    int px_h;
+    int buffer_id; // Not the pointer, buffer slots get reused
+    unsigned int text_generation;
+    unsigned int file_path_generation;
+    Viewport viewport;
+    Cursor_Pos cursor_pos;
+    Text_Mark mark;
+    bool is_active;
+    bool is_cursor_shown;
+    unsigned int search_seed;
+} View_Cache_Key;
+
+typedef struct View_Cache {
+    Gl_Framebuffer framebuffer;
+    View_Cache_Key key;
+    bool is_valid;
+} View_Cache;
+
 typedef enum View_Kind {
     VIEW_KIND_BUFFER,
     VIEW_KIND_IMAGE,
@@ -180,6 +284,9 @@ typedef struct View {
     };
     Rect outer_rect;
     View_Kind kind;
+    View_Cache cache; // Only used by buffer views, others are cheap to draw or have their own framebuffer
+    View_Grid_Item grid_item;
+    int index; // Position in Editor_State.views, 0 is on top
 } View;
 
 typedef struct Mouse_State {
@@ -204,9 +311,19 @@ typedef struct Editor_State {
 
     View **views;
     int view_count;
+    View_Grid view_grid;
+
+    File_Watch file_watch;
     View *active_view;
     Live_Scene_View *input_capture_live_scene_view;
     int scratch_buffer_id;
+    Scratch_Build *scratch_build;
+    Journal_Writer journal_writer;
+    double next_autosave_time;
+    Module_Cache scratch_modules; // Scratch dylibs stay loaded, running the same build again reuses them
+    int scratch_log_buffer_id;
+    Grep *grep; // Search everywhere in progress
+    int grep_buffer_id; // Where its hits go
 
     Viewport canvas_viewport;
 
@@ -215,9 +332,15 @@ typedef struct Editor_State {
     char *working_dir;
 
     char *prev_search;
+    Search_Pattern prev_search_pattern; // Compiled once per query, repeat searches reuse it
+    bool prev_search_is_regex; // Then prev_search_regex is used instead of the pattern
+    Search_Regex *prev_search_regex; // Allocated apart, it wouldn't fit in the 4096 bytes the platform gives this state
+    unsigned int search_seed; // Bumped per query, tells match indexes theirs is stale
+    Search_Scanner search_scanner; // Search as you type, started with the first search prompt
 
     GLFWwindow *window;
     bool is_live_scene;
+    double next_frame_time; // glfwGetTime() by which the next frame is needed, the platform idles until then
 
     bool should_break;
 } Editor_State;
@@ -234,13 +357,40 @@ void on_reload(Editor_State *state);
 void on_frame(Editor_State *state, const Platform_Timing *t);
 void on_platform_event(Editor_State *state, const Platform_Event *event);
 void on_destroy(Editor_State *state);
+void on_unload(Editor_State *state);
+double get_next_frame_time(Editor_State *state);
+
+void editor_request_frame(Editor_State *state);
+void editor_request_frame_at(Editor_State *state, double time);
+void editor_schedule_next_frame(Editor_State *state);
+void editor_handle_file_events(Editor_State *state);
+void editor_autosave(Editor_State *state);
+void editor_update_match_indexes(Editor_State *state);
+void editor_update_incremental_search(Editor_State *state);
+void editor_start_grep(Editor_State *state, const char *query);
+void editor_update_grep(Editor_State *state);
+void editor_discard_grep(Editor_State *state);
+bool editor_jump_to_grep_hit(Editor_State *state, const char *hit_line);
+void editor_recover_from_journal(Editor_State *state);
+bool buffer_needs_journal(const Buffer *buffer);
+bool buffer_is_journal_stale(const Buffer *buffer);
+void buffer_write_journal(Buffer *buffer, Journal_Writer *writer);
+void editor_update_scratch_build(Editor_State *state);
+bool editor_run_scratch_dylib(Editor_State *state, const char *dylib_path);
+void editor_discard_scratch_build(Editor_State *state);
+void editor_append_scratch_log(Editor_State *state, const char *text);
 
 void editor_render(Editor_State *state, const Platform_Timing *t);
 void render_view(View *view, bool is_active, Viewport canvas_viewport, Render_State *render_state, const Platform_Timing *t);
-void render_view_buffer(Buffer_View *buffer_view, bool is_active, Viewport canvas_viewport, Render_State *render_state, float delta_time);
+void render_view_cached(View *view, bool is_active, Viewport canvas_viewport, Render_State *render_state, const Platform_Timing *t);
+void render_view_to_cache(View *view, bool is_active, Viewport canvas_viewport, Render_State *render_state, const Platform_Timing *t);
+void render_view_buffer(Buffer_View *buffer_view, bool is_active, Viewport canvas_viewport, Render_State *render_state);
 void render_view_buffer_text(Text_Buffer text_buffer, Viewport viewport, const Render_State *render_state);
-void render_view_buffer_cursor(Text_Buffer text_buffer, Display_Cursor *cursor, Viewport viewport, const Render_State *render_state, float delta_time);
+void render_view_buffer_large_file_text(Large_File *large_file, Viewport viewport, const Render_State *render_state);
+void render_view_buffer_cursor(Text_Buffer text_buffer, Display_Cursor *cursor, Viewport viewport, const Render_State *render_state);
+void display_cursor_advance_blink(Display_Cursor *cursor, float delta_time);
 void render_view_buffer_selection(Buffer_View *buffer_view, const Render_State *render_state);
+void render_view_buffer_matches(Buffer_View *buffer_view, const Render_State *render_state);
 void render_view_buffer_line_numbers(Buffer_View *buffer_view, Viewport canvas_viewport, const Render_State *render_state);
 void render_view_buffer_name(Buffer_View *buffer_view, const char *name, bool is_active, Viewport canvas_viewport, const Render_State *render_state);
 void render_view_image(Image_View *image_view, const Render_State *render_state);
@@ -254,11 +404,17 @@ Buffer **buffer_create_new_slot(Editor_State *state);
 void buffer_free_slot(Buffer *buffer, Editor_State *state);
 Buffer *buffer_create_empty(Editor_State *state);
 void buffer_replace_text_buffer(Buffer *buffer, Text_Buffer text_buffer);
-void buffer_replace_file(Buffer *buffer, const char *path);
+void buffer_replace_file(Buffer *buffer, const char *path, Editor_State *state);
+bool buffer_load_file(Buffer *buffer, const char *path);
+void buffer_mark_in_sync_with_file(Buffer *buffer);
+void buffer_write_to_file(Buffer *buffer, Editor_State *state);
+void buffer_promote_large_file(Buffer *buffer);
+int buffer_get_line_count(Buffer *buffer);
 Buffer *buffer_create_prompt(const char *prompt_text, Prompt_Context context, Editor_State *state);
 int buffer_get_index(Buffer *buffer, Editor_State *state);
 void buffer_destroy(Buffer *buffer, Editor_State *state);
 Buffer *buffer_get_by_id(Editor_State *state, int id);
+void buffer_view_handle_file_changed(Editor_State *state, Buffer_View *buffer_view);
 
 View *create_buffer_view_generic(Rect rect, Editor_State *state);
 View *create_buffer_view_open_file(const char *path, Rect rect, Editor_State *state);
@@ -273,9 +429,12 @@ View *view_create(Editor_State *state);
 void view_destroy(View *view, Editor_State *state);
 bool view_exists(View *view, Editor_State *state);
 Rect view_get_inner_rect(View *view, const Render_State *render_state);
-void view_set_rect(View *view, Rect rect, const Render_State *render_state);
+void view_set_rect(View *view, Rect rect, Editor_State *state);
+Rect view_get_bounds(View *view, const Render_State *render_state);
 void view_set_active(View *view, Editor_State *state);
 Rect view_get_resize_handle_rect(View *view, const Render_State *render_state);
+View_Cache_Key view_cache_make_key(View *view, bool is_active, Viewport canvas_viewport, const Render_State *render_state);
+void view_cache_destroy(View_Cache *cache);
 View *view_at_pos(v2 pos, Editor_State *state);
 bool view_handle_scroll(View *view, float x_offset, float y_offset, const Render_State *render_state);
 #define outer_view(child_view_ptr) ((View *)(child_view_ptr))
@@ -292,33 +451,37 @@ void image_destroy(Image image);
 Image_View *image_view_create(Image image, Rect rect, Editor_State *state);
 
 Live_Scene *live_scene_create(Editor_State *state, const char *path, float w, float h, GLuint fbo);
-void live_scene_check_hot_reload(Live_Scene *live_scene);
+void live_scene_reload(Live_Scene *live_scene);
 void live_scene_destroy(Live_Scene *live_scene, Editor_State *state);
 
 Live_Scene_View *live_scene_view_create(Gl_Framebuffer framebuffer, Live_Scene *live_scene, Rect rect, Editor_State *state);
 
 Prompt_Context prompt_create_context_open_file();
 Prompt_Context prompt_create_context_go_to_line(Buffer_View *for_buffer_view);
-Prompt_Context prompt_create_context_search_next(Buffer_View *for_buffer_view);
+Prompt_Context prompt_create_context_search_next(Buffer_View *for_buffer_view, bool is_regex);
 Prompt_Context prompt_create_context_save_as(Buffer_View *for_buffer_view);
 Prompt_Context prompt_create_context_change_working_dir();
+Prompt_Context prompt_create_context_search_everywhere();
 Prompt_Context prompt_create_context_set_action_scratch_buffer_id(Buffer_View *for_buffer_view);
 Prompt_Result prompt_parse_result(Text_Buffer text_buffer);
 bool prompt_submit(Prompt_Context context, Prompt_Result result, Rect prompt_rect, Editor_State *state);
 
 void viewport_set_outer_rect(Viewport *viewport, Rect outer_rect);
 void viewport_set_zoom(Viewport *viewport, float new_zoom);
+void viewport_get_visible_lines(Viewport viewport, float line_height, int line_count, int *out_first_line, int *out_end_line);
 
 Vert make_vert(float x, float y, float u, float v, Color c);
-void vert_buffer_add_vert(Vert_Buffer *vert_buffer, Vert vert);
 
 Render_Font load_font(const char *path, float dpi_scale);
+void font_init_advances(Render_Font *font);
 float get_font_line_height(Render_Font font);
 float get_char_width(char c, Render_Font font);
 Rect get_string_rect(const char *str, Render_Font font, float x, float y);
-Rect get_string_range_rect(const char *str, Render_Font font, int start_char, int end_char);
-Rect get_string_char_rect(const char *str, Render_Font font, int char_i);
-int get_char_i_at_pos_in_string(const char *str, Render_Font font, float x);
+const float *get_line_x_cache(Text_Line *line, Render_Font font);
+float get_line_col_x(Text_Line *line, int col, Render_Font font);
+Rect get_line_range_rect(Text_Line *line, Render_Font font, int start_col, int end_col);
+Rect get_line_char_rect(Text_Line *line, Render_Font font, int col);
+int get_line_col_at_x(Text_Line *line, Render_Font font, float x);
 Rect get_cursor_rect(Text_Buffer text_buffer, Cursor_Pos cursor_pos, const Render_State *render_state);
 
 Rect canvas_rect_to_screen_rect(Rect canvas_rect, Viewport canvas_viewport);
@@ -342,9 +505,12 @@ int text_buffer_history_whitespace_cleanup(Text_Buffer *text_buffer, History *hi
 void buffer_view_set_mark(Buffer_View *buffer_view, Cursor_Pos pos);
 void buffer_view_validate_mark(Buffer_View *buffer_view);
 void buffer_view_set_cursor_to_pixel_position(Buffer_View *buffer_view, v2 mouse_canvas_pos, const Render_State *render_state);
+bool buffer_view_jump_to_search_match(Editor_State *state, Buffer_View *buffer_view, bool backward);
+bool editor_set_search(Editor_State *state, const char *query, bool is_regex);
 
 // --------------------------------
 
+Text_Buffer text_buffer_create_from_mapped_file(const Mapped_File *file);
 bool text_buffer_read_from_file(const char *path, Text_Buffer *text_buffer);
 void text_buffer_write_to_file(Text_Buffer text_buffer, const char *path);
 
@@ -0,0 +1,238 @@
+#include "file_watch.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "util.h"
+
+static File_Watch_Entry *file_watch__find_entry(File_Watch *file_watch, int id)
+{
+    for (int i = 0; i < file_watch->entry_count; i++)
+    {
+        if (file_watch->entries[i].is_used && file_watch->entries[i].id == id) return &file_watch->entries[i];
+    }
+    return NULL;
+}
+
+static void file_watch__stat(const char *path, time_t *out_mtime, off_t *out_size)
+{
+    struct stat attr;
+    if (stat(path, &attr) == 0)
+    {
+        *out_mtime = attr.st_mtime;
+        *out_size = attr.st_size;
+    }
+    else
+    {
+        *out_mtime = 0;
+        *out_size = 0;
+    }
+}
+
+static void file_watch__push_event(File_Watch *file_watch, int id)
+{
+    // A save often comes in as several writes, one event per frame is enough
+    for (int i = file_watch->event_read_index; i < file_watch->event_count; i++)
+    {
+        if (file_watch->events[i] == id) return;
+    }
+    if (file_watch->event_count >= file_watch->event_cap)
+    {
+        file_watch->event_cap = file_watch->event_cap ? file_watch->event_cap * 2 : 16;
+        file_watch->events = xrealloc(file_watch->events, file_watch->event_cap * sizeof(file_watch->events[0]));
+    }
+    file_watch->events[file_watch->event_count++] = id;
+}
+
+#ifdef __linux__
+static void file_watch__read_inotify(File_Watch *file_watch)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;)
+    {
+        ssize_t len = read(file_watch->inotify_fd, buf, sizeof(buf));
+        if (len <= 0)
+        {
+            if (len < 0 && errno != EAGAIN) log_warning("read on inotify fd failed: %s", strerror(errno));
+            break;
+        }
+        for (char *p = buf; p < buf + len;)
+        {
+            const struct inotify_event *e = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + e->len;
+            if (e->len == 0) continue;
+            for (int i = 0; i < file_watch->entry_count; i++)
+            {
+                File_Watch_Entry *entry = &file_watch->entries[i];
+                if (entry->is_used && entry->wd == e->wd && strcmp(entry->name, e->name) == 0)
+                {
+                    file_watch__push_event(file_watch, entry->id);
+                }
+            }
+        }
+    }
+}
+#endif
+
+File_Watch file_watch_create(double poll_interval)
+{
+    File_Watch file_watch = {0};
+    file_watch.poll_interval = poll_interval;
+    file_watch.inotify_fd = -1;
+#ifdef __linux__
+    file_watch.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (file_watch.inotify_fd < 0)
+    {
+        log_warning("inotify_init1 failed, polling files every %.2fs instead: %s", poll_interval, strerror(errno));
+    }
+#endif
+    return file_watch;
+}
+
+void file_watch_destroy(File_Watch *file_watch)
+{
+    for (int i = 0; i < file_watch->entry_count; i++)
+    {
+        free(file_watch->entries[i].path);
+    }
+    if (file_watch->inotify_fd >= 0) close(file_watch->inotify_fd);
+    free(file_watch->entries);
+    free(file_watch->events);
+    *file_watch = (File_Watch){0};
+    file_watch->inotify_fd = -1;
+}
+
+int file_watch_add(File_Watch *file_watch, const char *path)
+{
+    File_Watch_Entry *entry = NULL;
+    for (int i = 0; i < file_watch->entry_count; i++)
+    {
+        if (!file_watch->entries[i].is_used)
+        {
+            entry = &file_watch->entries[i];
+            break;
+        }
+    }
+    if (!entry)
+    {
+        if (file_watch->entry_count >= file_watch->entry_cap)
+        {
+            file_watch->entry_cap = file_watch->entry_cap ? file_watch->entry_cap * 2 : 16;
+            file_watch->entries = xrealloc(file_watch->entries, file_watch->entry_cap * sizeof(file_watch->entries[0]));
+        }
+        entry = &file_watch->entries[file_watch->entry_count++];
+    }
+
+    *entry = (File_Watch_Entry){0};
+    entry->id = ++file_watch->id_seed;
+    entry->path = xstrdup(path);
+    const char *slash = strrchr(entry->path, '/');
+    entry->name = slash ? slash + 1 : entry->path;
+    entry->wd = -1;
+    entry->is_used = true;
+    file_watch__stat(path, &entry->mtime, &entry->size);
+
+#ifdef __linux__
+    if (file_watch->inotify_fd >= 0)
+    {
+        char *dir = slash ? xstrndup(entry->path, slash - entry->path + 1) : xstrdup(".");
+        entry->wd = inotify_add_watch(file_watch->inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (entry->wd < 0) log_warning("inotify_add_watch failed for %s, polling it instead: %s", dir, strerror(errno));
+        free(dir);
+    }
+#endif
+
+    return entry->id;
+}
+
+void file_watch_remove(File_Watch *file_watch, int id)
+{
+    File_Watch_Entry *entry = file_watch__find_entry(file_watch, id);
+    if (!entry) return;
+
+#ifdef __linux__
+    // Watches are per directory, other files in it may still need this one
+    if (entry->wd >= 0)
+    {
+        bool is_wd_shared = false;
+        for (int i = 0; i < file_watch->entry_count; i++)
+        {
+            File_Watch_Entry *other = &file_watch->entries[i];
+            if (other != entry && other->is_used && other->wd == entry->wd) is_wd_shared = true;
+        }
+        if (!is_wd_shared) inotify_rm_watch(file_watch->inotify_fd, entry->wd);
+    }
+#endif
+
+    free(entry->path);
+    *entry = (File_Watch_Entry){0};
+}
+
+// For files the editor writes itself: takes what's on disk now as the baseline and drops
+// the events that write already queued, so it doesn't come back as an outside change
+void file_watch_refresh(File_Watch *file_watch, int id)
+{
+    File_Watch_Entry *entry = file_watch__find_entry(file_watch, id);
+    if (!entry) return;
+
+#ifdef __linux__
+    if (file_watch->inotify_fd >= 0) file_watch__read_inotify(file_watch);
+#endif
+    file_watch__stat(entry->path, &entry->mtime, &entry->size);
+
+    int kept_count = file_watch->event_read_index;
+    for (int i = file_watch->event_read_index; i < file_watch->event_count; i++)
+    {
+        if (file_watch->events[i] != id) file_watch->events[kept_count++] = file_watch->events[i];
+    }
+    file_watch->event_count = kept_count;
+}
+
+void file_watch_update(File_Watch *file_watch, double now)
+{
+#ifdef __linux__
+    if (file_watch->inotify_fd >= 0) file_watch__read_inotify(file_watch);
+#endif
+
+    if (now - file_watch->last_poll_time < file_watch->poll_interval) return;
+    file_watch->last_poll_time = now;
+
+    for (int i = 0; i < file_watch->entry_count; i++)
+    {
+        File_Watch_Entry *entry = &file_watch->entries[i];
+        if (!entry->is_used || entry->wd >= 0) continue;
+        time_t mtime;
+        off_t size;
+        file_watch__stat(entry->path, &mtime, &size);
+        if (mtime != 0 && (mtime != entry->mtime || size != entry->size))
+        {
+            entry->mtime = mtime;
+            entry->size = size;
+            file_watch__push_event(file_watch, entry->id);
+        }
+    }
+}
+
+bool file_watch_has_events(const File_Watch *file_watch)
+{
+    return file_watch->event_read_index < file_watch->event_count;
+}
+
+bool file_watch_next_event(File_Watch *file_watch, int *out_id)
+{
+    if (!file_watch_has_events(file_watch))
+    {
+        file_watch->event_count = 0;
+        file_watch->event_read_index = 0;
+        return false;
+    }
+    *out_id = file_watch->events[file_watch->event_read_index++];
+    return true;
+}
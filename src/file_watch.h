@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+
+// Watches files for changes. On Linux it's driven by inotify, elsewhere (or if
+// inotify can't be set up) files are polled with stat at a low frequency.
+// Changes are queued as watch ids and drained once per frame, so nothing
+// has to stat its files every frame.
+
+typedef struct File_Watch_Entry {
+    int id;
+    char *path;
+    const char *name; // File name part of path, what inotify reports for the directory watch
+    int wd; // Watch on the parent dir, so files replaced by rename are still seen
+    time_t mtime;
+    off_t size;
+    bool is_used;
+} File_Watch_Entry;
+
+typedef struct File_Watch {
+    int inotify_fd; // -1 when polling
+    double poll_interval;
+    double last_poll_time;
+    File_Watch_Entry *entries;
+    int entry_count;
+    int entry_cap;
+    int id_seed;
+    int *events;
+    int event_count;
+    int event_cap;
+    int event_read_index;
+} File_Watch;
+
+File_Watch file_watch_create(double poll_interval);
+void file_watch_destroy(File_Watch *file_watch);
+int file_watch_add(File_Watch *file_watch, const char *path);
+void file_watch_remove(File_Watch *file_watch, int id);
+void file_watch_refresh(File_Watch *file_watch, int id);
+void file_watch_update(File_Watch *file_watch, double now);
+bool file_watch_has_events(const File_Watch *file_watch);
+bool file_watch_next_event(File_Watch *file_watch, int *out_id);
@@ -0,0 +1,491 @@
+#include "grep.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "misc.h"
+#include "module_loader.h"
+#include "os.h"
+#include "text_buffer.h"
+#include "util.h"
+
+static void grep__free_task(Grep_Task *task)
+{
+    free(task->path);
+    free(task->name);
+    free(task->data);
+}
+
+static bool grep__should_stop(Grep *grep)
+{
+    pthread_mutex_lock(&grep->mutex);
+    bool should_stop = grep->should_stop;
+    pthread_mutex_unlock(&grep->mutex);
+    return should_stop;
+}
+
+// Owner end of the deque
+static void grep_worker__push(Grep_Worker *worker, Grep_Task task)
+{
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->task_end >= worker->task_cap)
+    {
+        if (worker->task_begin > 0)
+        {
+            // Stolen from the front, reuse that room first
+            memmove(worker->tasks, worker->tasks + worker->task_begin, (worker->task_end - worker->task_begin) * sizeof(worker->tasks[0]));
+            worker->task_end -= worker->task_begin;
+            worker->task_begin = 0;
+        }
+        else
+        {
+            worker->task_cap = worker->task_cap ? worker->task_cap * 2 : 64;
+            worker->tasks = xrealloc(worker->tasks, worker->task_cap * sizeof(worker->tasks[0]));
+        }
+    }
+    worker->tasks[worker->task_end++] = task;
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+static bool grep_worker__pop(Grep_Worker *worker, Grep_Task *out_task)
+{
+    pthread_mutex_lock(&worker->mutex);
+    bool has_task = worker->task_end > worker->task_begin;
+    if (has_task) *out_task = worker->tasks[--worker->task_end];
+    pthread_mutex_unlock(&worker->mutex);
+    return has_task;
+}
+
+// Oldest first: near the root of the walk, so a steal tends to take a big share
+static bool grep_worker__steal_from(Grep_Worker *victim, Grep_Task *out_task)
+{
+    pthread_mutex_lock(&victim->mutex);
+    bool has_task = victim->task_end > victim->task_begin;
+    if (has_task) *out_task = victim->tasks[victim->task_begin++];
+    pthread_mutex_unlock(&victim->mutex);
+    return has_task;
+}
+
+static bool grep_worker__find_task(Grep_Worker *worker, Grep_Task *out_task)
+{
+    if (grep_worker__pop(worker, out_task)) return true;
+    Grep *grep = worker->grep;
+    for (int i = 1; i < grep->worker_count; i++)
+    {
+        if (grep_worker__steal_from(&grep->workers[(worker->index + i) % grep->worker_count], out_task))
+        {
+            worker->stats.steal_count++;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void grep_worker__flush_hits(Grep_Worker *worker)
+{
+    if (worker->hit_count == 0) return;
+    Grep *grep = worker->grep;
+    pthread_mutex_lock(&grep->mutex);
+    int room = GREP_MAX_HITS - grep->stats.hit_count;
+    int count = worker->hit_count < room ? worker->hit_count : room;
+    if (grep->hit_count + count > grep->hit_cap)
+    {
+        while (grep->hit_count + count > grep->hit_cap) grep->hit_cap = grep->hit_cap ? grep->hit_cap * 2 : 256;
+        grep->hits = xrealloc(grep->hits, grep->hit_cap * sizeof(grep->hits[0]));
+    }
+    memcpy(grep->hits + grep->hit_count, worker->hits, count * sizeof(worker->hits[0]));
+    grep->hit_count += count;
+    grep->stats.hit_count += count;
+    if (grep->stats.hit_count >= GREP_MAX_HITS)
+    {
+        grep->stats.is_truncated = true;
+        grep->should_stop = true;
+    }
+    pthread_mutex_unlock(&grep->mutex);
+    grep_free_hits(worker->hits + count, worker->hit_count - count);
+    worker->hit_count = 0;
+}
+
+static void grep_worker__add_hit(Grep_Worker *worker, const char *name, int buffer_id, int line, int col, const char *line_str, size_t line_len)
+{
+    if (worker->hit_count >= worker->hit_cap)
+    {
+        worker->hit_cap = worker->hit_cap ? worker->hit_cap * 2 : 64;
+        worker->hits = xrealloc(worker->hits, worker->hit_cap * sizeof(worker->hits[0]));
+    }
+    worker->hits[worker->hit_count++] = (Grep_Hit){
+        .name = xstrdup(name),
+        .buffer_id = buffer_id,
+        .line = line,
+        .col = col,
+        .preview = xstrndup(line_str, line_len)
+    };
+}
+
+// Line numbers are counted as the search moves on, so a file is read about once no matter the hits
+static void grep_worker__search(Grep_Worker *worker, const char *name, int buffer_id, const char *data, size_t size)
+{
+    const Search_Pattern *pattern = &worker->grep->pattern;
+    const char *end = data + size;
+    const char *counted_to = data;
+    const char *line_start = data;
+    int line = 0;
+    for (const char *chunk = data; chunk < end; chunk += GREP_CHUNK_SIZE)
+    {
+        const char *chunk_end = end - chunk > GREP_CHUNK_SIZE ? chunk + GREP_CHUNK_SIZE : end;
+        // Matches starting in the chunk may run past it
+        const char *window = end - chunk_end > pattern->len - 1 ? chunk_end + pattern->len - 1 : end;
+        const char *at = chunk;
+        while ((at = search_forward(pattern, at, window - at)) && at < chunk_end)
+        {
+            size_t newline_count = text_buffer_count_newlines(counted_to, at - counted_to);
+            if (newline_count > 0)
+            {
+                line += (int)newline_count;
+                line_start = at;
+                while (line_start[-1] != '\n') line_start--;
+            }
+            counted_to = at;
+            // Only as far as the preview keeps, a minified file's one line would be rescanned for every hit
+            size_t preview_len = end - line_start < GREP_MAX_PREVIEW_LEN ? (size_t)(end - line_start) : GREP_MAX_PREVIEW_LEN;
+            const char *line_end = memchr(line_start, '\n', preview_len);
+            if (!line_end) line_end = line_start + preview_len;
+            grep_worker__add_hit(worker, name, buffer_id, line, (int)(at - line_start), line_start, line_end - line_start);
+            if (worker->hit_count >= GREP_MAX_HITS) break;
+            at++;
+        }
+        if (worker->hit_count >= GREP_MAX_HITS || grep__should_stop(worker->grep)) break;
+    }
+    worker->stats.byte_count += size;
+    worker->stats.file_count++;
+}
+
+static bool grep__is_open_path(Grep *grep, const char *path)
+{
+    int lower = 0, upper = grep->open_path_count;
+    while (lower < upper)
+    {
+        int mid = lower + (upper - lower) / 2;
+        int cmp = strcmp(grep->open_paths[mid], path);
+        if (cmp == 0) return true;
+        if (cmp < 0) lower = mid + 1;
+        else upper = mid;
+    }
+    return false;
+}
+
+static void grep_worker__run_file(Grep_Worker *worker, const Grep_Task *task)
+{
+    if (grep__is_open_path(worker->grep, task->path))
+    {
+        worker->stats.open_count++;
+        return;
+    }
+    if (os_file_detect_kind(task->path) != FILE_KIND_TEXT)
+    {
+        worker->stats.binary_count++;
+        return;
+    }
+    Mapped_File file;
+    if (!os_file_map(task->path, &file)) return;
+    grep_worker__search(worker, task->name, 0, file.data, file.size);
+    os_file_unmap(&file);
+}
+
+// Lists the dir into tasks of this worker's own, hidden entries and symlinks left out
+static void grep_worker__run_dir(Grep_Worker *worker, const Grep_Task *task)
+{
+    DIR *d = opendir(task->path);
+    if (!d)
+    {
+        log_warning("Failed to open dir at %s", task->path);
+        return;
+    }
+    worker->stats.dir_count++;
+    int push_count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)))
+    {
+        if (entry->d_name[0] == '.') continue;
+        char *path = strf("%s/%s", task->path, entry->d_name);
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN)
+        {
+            struct stat st;
+            if (lstat(path, &st) == 0) type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type != DT_DIR && type != DT_REG)
+        {
+            free(path);
+            continue;
+        }
+        grep_worker__push(worker, (Grep_Task){
+            .kind = type == DT_DIR ? GREP_TASK_DIR : GREP_TASK_FILE,
+            .path = path,
+            .name = task->name ? strf("%s/%s", task->name, entry->d_name) : xstrdup(entry->d_name)
+        });
+        push_count++;
+    }
+    closedir(d);
+
+    if (push_count == 0) return;
+    Grep *grep = worker->grep;
+    pthread_mutex_lock(&grep->mutex);
+    grep->pending_count += push_count;
+    grep->push_seed++;
+    pthread_cond_broadcast(&grep->cond);
+    pthread_mutex_unlock(&grep->mutex);
+}
+
+static void grep_worker__run_task(Grep_Worker *worker, const Grep_Task *task)
+{
+    double start_ms = module_get_time_ms();
+    switch (task->kind)
+    {
+        case GREP_TASK_DIR:
+        {
+            grep_worker__run_dir(worker, task);
+            worker->stats.walk_ms += module_get_time_ms() - start_ms;
+        } break;
+        case GREP_TASK_FILE:
+        {
+            grep_worker__run_file(worker, task);
+            worker->stats.search_ms += module_get_time_ms() - start_ms;
+        } break;
+        case GREP_TASK_TEXT:
+        {
+            grep_worker__search(worker, task->name, task->buffer_id, task->data, task->size);
+            worker->stats.search_ms += module_get_time_ms() - start_ms;
+        } break;
+    }
+}
+
+static void *grep_worker__run(void *arg)
+{
+    Grep_Worker *worker = arg;
+    Grep *grep = worker->grep;
+    for (;;)
+    {
+        pthread_mutex_lock(&grep->mutex);
+        unsigned int seen_push_seed = grep->push_seed;
+        bool should_stop = grep->should_stop || grep->pending_count == 0;
+        pthread_mutex_unlock(&grep->mutex);
+        if (should_stop) break;
+
+        Grep_Task task;
+        if (grep_worker__find_task(worker, &task))
+        {
+            if (!grep__should_stop(grep)) grep_worker__run_task(worker, &task);
+            grep__free_task(&task);
+            grep_worker__flush_hits(worker);
+            pthread_mutex_lock(&grep->mutex);
+            if (--grep->pending_count == 0) pthread_cond_broadcast(&grep->cond);
+            pthread_mutex_unlock(&grep->mutex);
+            continue;
+        }
+
+        // Everything left is running elsewhere, wait for it to push more or finish
+        pthread_mutex_lock(&grep->mutex);
+        while (grep->push_seed == seen_push_seed && grep->pending_count > 0 && !grep->should_stop)
+        {
+            pthread_cond_wait(&grep->cond, &grep->mutex);
+        }
+        pthread_mutex_unlock(&grep->mutex);
+    }
+
+    // Stopped early, drop what's left queued here
+    Grep_Task task;
+    while (grep_worker__pop(worker, &task))
+    {
+        grep__free_task(&task);
+    }
+
+    pthread_mutex_lock(&grep->mutex);
+    Grep_Stats *total = &grep->stats;
+    total->dir_count += worker->stats.dir_count;
+    total->file_count += worker->stats.file_count;
+    total->binary_count += worker->stats.binary_count;
+    total->open_count += worker->stats.open_count;
+    total->byte_count += worker->stats.byte_count;
+    total->steal_count += worker->stats.steal_count;
+    total->walk_ms += worker->stats.walk_ms;
+    total->search_ms += worker->stats.search_ms;
+    if (--grep->running_count == 0) total->wall_ms = module_get_time_ms() - grep->run_start_ms;
+    pthread_mutex_unlock(&grep->mutex);
+    return NULL;
+}
+
+Grep *grep_create(const char *needle, bool ignore_case, int thread_count)
+{
+    if (thread_count > GREP_MAX_THREADS) thread_count = GREP_MAX_THREADS;
+    if (thread_count < 1) thread_count = 1;
+    Grep *grep = xcalloc(sizeof(*grep));
+    grep->pattern = search_pattern_create(needle, ignore_case);
+    grep->worker_count = thread_count;
+    grep->stats.thread_count = thread_count;
+    pthread_mutex_init(&grep->mutex, NULL);
+    pthread_cond_init(&grep->cond, NULL);
+    for (int i = 0; i < thread_count; i++)
+    {
+        grep->workers[i].grep = grep;
+        grep->workers[i].index = i;
+        pthread_mutex_init(&grep->workers[i].mutex, NULL);
+    }
+    return grep;
+}
+
+static void grep__add_task(Grep *grep, Grep_Task task)
+{
+    bassert(grep->running_count == 0);
+    grep_worker__push(&grep->workers[grep->next_worker], task);
+    grep->next_worker = (grep->next_worker + 1) % grep->worker_count;
+    grep->pending_count++;
+}
+
+// Hits in what the walk finds are named relative to path
+void grep_add_dir(Grep *grep, const char *path)
+{
+    grep__add_task(grep, (Grep_Task){ .kind = GREP_TASK_DIR, .path = xstrdup(path) });
+}
+
+void grep_add_file(Grep *grep, const char *path, const char *name)
+{
+    grep__add_task(grep, (Grep_Task){ .kind = GREP_TASK_FILE, .path = xstrdup(path), .name = xstrdup(name) });
+}
+
+// Takes ownership of data
+void grep_add_text(Grep *grep, const char *name, int buffer_id, char *data, size_t size)
+{
+    grep__add_task(grep, (Grep_Task){ .kind = GREP_TASK_TEXT, .name = xstrdup(name), .data = data, .size = size, .buffer_id = buffer_id });
+}
+
+static int grep__compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// The walk leaves out the file at this absolute path, its buffer is added as text instead
+void grep_skip_open_file(Grep *grep, const char *path)
+{
+    bassert(grep->running_count == 0);
+    grep->open_paths = xrealloc(grep->open_paths, (grep->open_path_count + 1) * sizeof(grep->open_paths[0]));
+    grep->open_paths[grep->open_path_count++] = xstrdup(path);
+    qsort(grep->open_paths, grep->open_path_count, sizeof(grep->open_paths[0]), grep__compare_paths);
+}
+
+bool grep_run(Grep *grep)
+{
+    grep->run_start_ms = module_get_time_ms();
+    if (grep->pattern.len == 0) grep->pending_count = 0; // Nothing to find, the workers quit right away
+    for (int i = 0; i < grep->worker_count; i++)
+    {
+        pthread_mutex_lock(&grep->mutex);
+        grep->running_count++;
+        pthread_mutex_unlock(&grep->mutex);
+        if (pthread_create(&grep->workers[i].thread, NULL, grep_worker__run, &grep->workers[i]) != 0)
+        {
+            log_warning("Failed to start grep worker thread");
+            pthread_mutex_lock(&grep->mutex);
+            grep->running_count--;
+            grep->should_stop = true;
+            pthread_cond_broadcast(&grep->cond);
+            pthread_mutex_unlock(&grep->mutex);
+            grep->worker_count = i; // Tasks queued on the rest are freed by destroy
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hits found since the last take, in the order files finished
+Grep_Hit *grep_take_hits(Grep *grep, int *out_count)
+{
+    pthread_mutex_lock(&grep->mutex);
+    Grep_Hit *hits = grep->hits;
+    *out_count = grep->hit_count;
+    grep->hits = NULL;
+    grep->hit_count = 0;
+    grep->hit_cap = 0;
+    pthread_mutex_unlock(&grep->mutex);
+    return hits;
+}
+
+void grep_free_hits(Grep_Hit *hits, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        free(hits[i].name);
+        free(hits[i].preview);
+    }
+}
+
+// Hits may still be waiting to be taken once done
+bool grep_is_done(Grep *grep, Grep_Stats *out_stats)
+{
+    pthread_mutex_lock(&grep->mutex);
+    bool is_done = grep->running_count == 0;
+    if (out_stats) *out_stats = grep->stats;
+    pthread_mutex_unlock(&grep->mutex);
+    return is_done;
+}
+
+// Stops the workers at their next check if they're still going
+void grep_destroy(Grep *grep)
+{
+    pthread_mutex_lock(&grep->mutex);
+    grep->should_stop = true;
+    pthread_cond_broadcast(&grep->cond);
+    pthread_mutex_unlock(&grep->mutex);
+    for (int i = 0; i < grep->worker_count; i++)
+    {
+        pthread_join(grep->workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < GREP_MAX_THREADS; i++)
+    {
+        Grep_Worker *worker = &grep->workers[i];
+        if (!worker->grep) continue;
+        for (int j = worker->task_begin; j < worker->task_end; j++)
+        {
+            grep__free_task(&worker->tasks[j]);
+        }
+        free(worker->tasks);
+        grep_free_hits(worker->hits, worker->hit_count);
+        free(worker->hits);
+        pthread_mutex_destroy(&worker->mutex);
+    }
+    grep_free_hits(grep->hits, grep->hit_count);
+    free(grep->hits);
+    for (int i = 0; i < grep->open_path_count; i++)
+    {
+        free(grep->open_paths[i]);
+    }
+    free(grep->open_paths);
+    search_pattern_destroy(&grep->pattern);
+    pthread_mutex_destroy(&grep->mutex);
+    pthread_cond_destroy(&grep->cond);
+    free(grep);
+}
+
+// Reads back a results line, "name:line:col: preview" with 1 based line and col
+bool grep_parse_hit_line(const char *str, char *out_name, int name_size, int *out_line, int *out_col)
+{
+    for (const char *colon = strchr(str, ':'); colon; colon = strchr(colon + 1, ':'))
+    {
+        int line, col, len = 0;
+        if (sscanf(colon, ":%d:%d:%n", &line, &col, &len) == 2 && len > 0 && line > 0 && col > 0)
+        {
+            int name_len = (int)(colon - str);
+            if (name_len == 0 || name_len >= name_size) return false;
+            memcpy(out_name, str, name_len);
+            out_name[name_len] = '\0';
+            *out_line = line - 1;
+            *out_col = col - 1;
+            return true;
+        }
+    }
+    return false;
+}
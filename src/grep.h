@@ -0,0 +1,112 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "search.h"
+
+#define GREP_MAX_THREADS 16
+#define GREP_MAX_HITS 10000 // The search stops once it has this many, nobody reads further
+#define GREP_MAX_PREVIEW_LEN 200 // Bytes of the matching line kept per hit
+#define GREP_CHUNK_SIZE (4 * 1024 * 1024) // Bytes of one file searched between checks for a stop
+
+// Search everywhere: open buffers' text and every file under a directory,
+// on a pool of worker threads. Each worker has its own deque of tasks, pushes
+// what it finds (a directory lists into file and directory tasks) and pops
+// from the back; idle workers steal from the front of the others. Files are
+// searched mapped, binaries are left out.
+//
+// Hits are handed to the main thread in batches as files finish, so results
+// come in while the walk goes on. Everything a grep is given is set up on the
+// main thread before grep_run, after that only take, is_done and destroy.
+
+typedef enum Grep_Task_Kind {
+    GREP_TASK_DIR,
+    GREP_TASK_FILE,
+    GREP_TASK_TEXT // An open buffer's text, copied
+} Grep_Task_Kind;
+
+typedef struct Grep_Task {
+    Grep_Task_Kind kind;
+    char *path; // Dirs and files, absolute
+    char *name; // Shown with hits, dir-relative for what the walk finds
+    char *data; // Text
+    size_t size;
+    int buffer_id;
+} Grep_Task;
+
+typedef struct Grep_Hit {
+    char *name;
+    int buffer_id; // Of the buffer searched, 0 for files
+    int line; // 0 based, like Cursor_Pos
+    int col;
+    char *preview; // The line, cut at GREP_MAX_PREVIEW_LEN and without its '\n'
+} Grep_Hit;
+
+typedef struct Grep_Stats {
+    int thread_count;
+    int dir_count;
+    int file_count; // Searched, text buffers included
+    int binary_count; // Skipped, not text
+    int open_count; // Files skipped because they're open, their buffer is searched instead
+    size_t byte_count;
+    int hit_count;
+    int steal_count;
+    bool is_truncated; // Stopped at GREP_MAX_HITS
+    double setup_ms; // Main thread, copying open buffers
+    double walk_ms; // Listing dirs, summed over workers
+    double search_ms; // Detecting, mapping and searching files, summed over workers
+    double wall_ms; // From grep_run until the last worker is done
+} Grep_Stats;
+
+struct Grep;
+
+typedef struct Grep_Worker {
+    struct Grep *grep;
+    pthread_t thread;
+    int index;
+    pthread_mutex_t mutex;
+    Grep_Task *tasks; // Guarded by mutex, [task_begin, task_end) are queued
+    int task_begin;
+    int task_end;
+    int task_cap;
+    Grep_Hit *hits; // Worker only, found since the last flush
+    int hit_count;
+    int hit_cap;
+    Grep_Stats stats; // Worker only, added to the total when the worker is done
+} Grep_Worker;
+
+typedef struct Grep {
+    Search_Pattern pattern;
+    char **open_paths; // Sorted, absolute
+    int open_path_count;
+    Grep_Worker workers[GREP_MAX_THREADS];
+    int worker_count;
+    int next_worker; // Setup only, tasks added before grep_run are dealt out in turn
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int pending_count; // Guarded by mutex from here on. Tasks queued or running, done at 0
+    unsigned int push_seed; // Bumped with every push, wakes idle workers to steal
+    int running_count;
+    bool should_stop;
+    Grep_Hit *hits; // Not yet taken by the main thread
+    int hit_count;
+    int hit_cap;
+    Grep_Stats stats;
+    double run_start_ms;
+} Grep;
+
+Grep *grep_create(const char *needle, bool ignore_case, int thread_count);
+void grep_add_dir(Grep *grep, const char *path);
+void grep_add_file(Grep *grep, const char *path, const char *name);
+void grep_add_text(Grep *grep, const char *name, int buffer_id, char *data, size_t size);
+void grep_skip_open_file(Grep *grep, const char *path);
+bool grep_run(Grep *grep);
+
+Grep_Hit *grep_take_hits(Grep *grep, int *out_count);
+void grep_free_hits(Grep_Hit *hits, int count);
+bool grep_is_done(Grep *grep, Grep_Stats *out_stats);
+void grep_destroy(Grep *grep);
+
+bool grep_parse_hit_line(const char *str, char *out_name, int name_size, int *out_line, int *out_col);
@@ -37,6 +37,10 @@ typedef struct Delta {
     };
 
     DeltaKind kind;
+    // Text_Buffer generation around the edit, a chain of deltas without gaps
+    // accounts for every change to the text, see editor_autosave
+    unsigned int generation_before;
+    unsigned int generation_after;
 } Delta;
 
 typedef enum Running_Command_Kind {
@@ -23,6 +23,7 @@ void input_char_view(Editor_State *state, View *view, const Platform_Event *e)
     {
         case VIEW_KIND_BUFFER:
         {
+            if (state->active_view->bv.buffer->large_file) break; // Read-only
             action_buffer_view_input_char(state, &state->active_view->bv, (char)e->character.codepoint);
         } break;
 
@@ -74,6 +75,10 @@ void input_key_global(Editor_State *state, const Platform_Event *e)
         {
             switch (e->key.key)
             {
+                case GLFW_KEY_F1:
+                {
+                    action_run_benchmarks(state);
+                } break;
                 case GLFW_KEY_F5:
                 {
                     action_reset_scratch(state);
@@ -124,6 +129,11 @@ void input_key_global(Editor_State *state, const Platform_Event *e)
                 {
                     action_reload_workspace(state);
                 } break;
+
+                case GLFW_KEY_E:
+                {
+                    action_prompt_search_everywhere(state);
+                } break;
             }
         }
     }
@@ -156,6 +166,12 @@ void input_key_view(Editor_State *state, View *view, const Platform_Event *e)
 
 void input_key_buffer_view(Editor_State *state, Buffer_View *buffer_view, const Platform_Event *e)
 {
+    if (buffer_view->buffer->large_file)
+    {
+        input_key_buffer_view_large_file(state, buffer_view, e);
+        return;
+    }
+
     if (e->key.action == GLFW_PRESS || e->key.action == GLFW_REPEAT)
     {
         if (e->key.key == GLFW_KEY_LEFT ||
@@ -182,7 +198,11 @@ void input_key_buffer_view(Editor_State *state, Buffer_View *buffer_view, const
             {
                 case GLFW_KEY_ENTER:
                 {
-                    if (buffer_view->buffer->prompt_context.kind == PROMPT_NONE)
+                    if (buffer_view->buffer->id == state->grep_buffer_id)
+                    {
+                        action_buffer_view_jump_to_grep_hit(state, buffer_view);
+                    }
+                    else if (buffer_view->buffer->prompt_context.kind == PROMPT_NONE)
                     {
                         action_buffer_view_input_char(state, buffer_view, '\n');
                     }
@@ -283,6 +303,17 @@ void input_key_buffer_view(Editor_State *state, Buffer_View *buffer_view, const
             }
         }
 
+        else if (e->key.mods == (GLFW_MOD_SUPER | GLFW_MOD_ALT))
+        {
+            switch(e->key.key)
+            {
+                case GLFW_KEY_F:
+                {
+                    action_buffer_view_prompt_regex_search_next(state, buffer_view);
+                } break;
+            }
+        }
+
         else if (e->key.mods == (GLFW_MOD_SUPER | GLFW_MOD_SHIFT))
         {
             switch(e->key.key)
@@ -295,11 +326,37 @@ void input_key_buffer_view(Editor_State *state, Buffer_View *buffer_view, const
                 {
                     action_buffer_view_repeat_search(state, buffer_view);
                 } break;
+                case GLFW_KEY_G:
+                {
+                    action_buffer_view_repeat_search_backward(state, buffer_view);
+                } break;
             }
         }
     }
 }
 
+void input_key_buffer_view_large_file(Editor_State *state, Buffer_View *buffer_view, const Platform_Event *e)
+{
+    if ((e->key.action == GLFW_PRESS || e->key.action == GLFW_REPEAT) && e->key.mods == GLFW_MOD_SUPER)
+    {
+        switch(e->key.key)
+        {
+            case GLFW_KEY_E:
+            {
+                action_buffer_view_promote_large_file(state, buffer_view);
+            } break;
+            case GLFW_KEY_EQUAL:
+            {
+                action_buffer_view_change_zoom(state, buffer_view, 0.25f);
+            } break;
+            case GLFW_KEY_MINUS:
+            {
+                action_buffer_view_change_zoom(state, buffer_view, -0.25f);
+            } break;
+        }
+    }
+}
+
 // --------------------------------
 
 void input_mouse_update(Editor_State *state, float delta_time)
@@ -328,14 +385,14 @@ void input_mouse_motion_global(Editor_State *state, const Platform_Event *e)
         Rect new_rect = m_state->dragged_view->outer_rect;
         new_rect.x += e->mouse_motion.delta.x;
         new_rect.y += e->mouse_motion.delta.y;
-        view_set_rect(m_state->dragged_view, new_rect, &state->render_state);
+        view_set_rect(m_state->dragged_view, new_rect, state);
     }
     else if (m_state->resized_view)
     {
         Rect new_rect = m_state->resized_view->outer_rect;
         new_rect.w += e->mouse_motion.delta.x;
         new_rect.h += e->mouse_motion.delta.y;
-        view_set_rect(m_state->resized_view, new_rect, &state->render_state);
+        view_set_rect(m_state->resized_view, new_rect, state);
     }
     else if (state->active_view)
     {
@@ -483,6 +540,8 @@ bool input_mouse_button_view(Editor_State *state, View *view, const Platform_Eve
 
 void input_mouse_button_buffer_view(Editor_State *state, Buffer_View *buffer_view, const Platform_Event *e)
 {
+    if (buffer_view->buffer->large_file) return; // No cursor in read-only view
+
     if (e->mouse_button.action == GLFW_PRESS)
     {
         v2 mouse_canvas_pos = screen_pos_to_canvas_pos(e->mouse_button.pos, state->canvas_viewport);
@@ -565,7 +624,7 @@ void input_mouse_scroll_buffer_view(Editor_State *state, Buffer_View *buffer_vie
     if (buffer_view->viewport.rect.x > buffer_max_x) buffer_view->viewport.rect.x = buffer_max_x;
 
     if (buffer_view->viewport.rect.y < 0.0f) buffer_view->viewport.rect.y = 0.0f;
-    float buffer_max_y = (buffer_view->buffer->text_buffer.line_count - 1) * get_font_line_height(state->render_state.font);
+    float buffer_max_y = (buffer_get_line_count(buffer_view->buffer) - 1) * get_font_line_height(state->render_state.font);
     if (buffer_view->viewport.rect.y > buffer_max_y) buffer_view->viewport.rect.y = buffer_max_y;
 }
 
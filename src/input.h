@@ -8,6 +8,7 @@ void input_char_view(Editor_State *state, View *view, const Platform_Event *e);
 void input_key_global(Editor_State *state, const Platform_Event *e);
 void input_key_view(Editor_State *state, View *view, const Platform_Event *e);
 void input_key_buffer_view(Editor_State *state, Buffer_View *buffer_view, const Platform_Event *e);
+void input_key_buffer_view_large_file(Editor_State *state, Buffer_View *buffer_view, const Platform_Event *e);
 
 void input_mouse_update(Editor_State *state, float delta_time);
 
@@ -0,0 +1,415 @@
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "module_loader.h"
+#include "util.h"
+
+#define JOURNAL_FRAME_MAGIC 0x524a3245u // "E2JR"
+#define JOURNAL_FRAME_HEADER_SIZE 16 // Magic, payload size, payload hash
+
+typedef enum Journal_Record_Kind {
+    JOURNAL_RECORD_SNAPSHOT = 'S',
+    JOURNAL_RECORD_INSERT_CHAR = 'c',
+    JOURNAL_RECORD_REMOVE_CHAR = 'x',
+    JOURNAL_RECORD_INSERT_RANGE = 'I',
+    JOURNAL_RECORD_REMOVE_RANGE = 'R'
+} Journal_Record_Kind;
+
+static void journal_batch__put(Journal_Batch *batch, const void *data, size_t size)
+{
+    if (batch->size == 0) batch->size = JOURNAL_FRAME_HEADER_SIZE; // Filled in by finish
+    if (batch->size + size > batch->cap)
+    {
+        while (batch->size + size > batch->cap)
+        {
+            batch->cap = batch->cap ? batch->cap * 2 : 256;
+        }
+        batch->data = xrealloc(batch->data, batch->cap);
+    }
+    memcpy(batch->data + batch->size, data, size);
+    batch->size += size;
+}
+
+static void journal_batch__put_kind(Journal_Batch *batch, Journal_Record_Kind kind)
+{
+    char c = (char)kind;
+    journal_batch__put(batch, &c, 1);
+}
+
+static void journal_batch__put_i32(Journal_Batch *batch, int32_t v)
+{
+    journal_batch__put(batch, &v, sizeof(v));
+}
+
+static void journal_batch__put_pos(Journal_Batch *batch, Cursor_Pos pos)
+{
+    journal_batch__put_i32(batch, pos.line);
+    journal_batch__put_i32(batch, pos.col);
+}
+
+void journal_batch_put_snapshot(Journal_Batch *batch, const Text_Buffer *text_buffer, const char *file_path)
+{
+    journal_batch__put_kind(batch, JOURNAL_RECORD_SNAPSHOT);
+    int32_t path_len = file_path ? (int32_t)strlen(file_path) : 0;
+    journal_batch__put_i32(batch, path_len);
+    if (path_len > 0) journal_batch__put(batch, file_path, path_len);
+    journal_batch__put_i32(batch, text_buffer->line_count);
+    for (int i = 0; i < text_buffer->line_count; i++)
+    {
+        journal_batch__put_i32(batch, text_buffer->lines[i].len);
+        journal_batch__put(batch, text_buffer->lines[i].str, text_buffer->lines[i].len);
+    }
+}
+
+void journal_batch_put_delta(Journal_Batch *batch, const Delta *delta)
+{
+    switch (delta->kind)
+    {
+        case DELTA_INSERT_CHAR:
+        {
+            journal_batch__put_kind(batch, JOURNAL_RECORD_INSERT_CHAR);
+            journal_batch__put_pos(batch, delta->insert_char.pos);
+            journal_batch__put(batch, &delta->insert_char.c, 1);
+        } break;
+
+        case DELTA_REMOVE_CHAR:
+        {
+            journal_batch__put_kind(batch, JOURNAL_RECORD_REMOVE_CHAR);
+            journal_batch__put_pos(batch, delta->remove_char.pos);
+        } break;
+
+        case DELTA_INSERT_RANGE:
+        {
+            int32_t len = (int32_t)strlen(delta->insert_range.range);
+            journal_batch__put_kind(batch, JOURNAL_RECORD_INSERT_RANGE);
+            journal_batch__put_pos(batch, delta->insert_range.start);
+            journal_batch__put_i32(batch, len);
+            journal_batch__put(batch, delta->insert_range.range, len);
+        } break;
+
+        case DELTA_REMOVE_RANGE:
+        {
+            journal_batch__put_kind(batch, JOURNAL_RECORD_REMOVE_RANGE);
+            journal_batch__put_pos(batch, delta->remove_range.start);
+            journal_batch__put_pos(batch, delta->remove_range.end);
+        } break;
+    }
+}
+
+char *journal_batch_finish(Journal_Batch *batch, size_t *out_size)
+{
+    if (batch->size == 0)
+    {
+        *out_size = 0;
+        return NULL;
+    }
+    uint32_t magic = JOURNAL_FRAME_MAGIC;
+    uint32_t payload_size = (uint32_t)(batch->size - JOURNAL_FRAME_HEADER_SIZE);
+    uint64_t hash = module_hash(MODULE_HASH_SEED, batch->data + JOURNAL_FRAME_HEADER_SIZE, payload_size);
+    memcpy(batch->data, &magic, 4);
+    memcpy(batch->data + 4, &payload_size, 4);
+    memcpy(batch->data + 8, &hash, 8);
+
+    char *data = batch->data;
+    *out_size = batch->size;
+    *batch = (Journal_Batch){0};
+    return data;
+}
+
+// ------------------------------------------------------------------------------------------------------------------------
+
+static bool journal__write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static void journal_writer__do_job(Journal_Writer *writer, const Journal_Job *job)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%d.journal", writer->dir, job->buffer_id);
+
+    switch (job->kind)
+    {
+        case JOURNAL_JOB_APPEND:
+        {
+            int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0 || !journal__write_all(fd, job->data, job->size) || fsync(fd) != 0)
+            {
+                log_warning("Failed to append to journal at %s: %s", path, strerror(errno));
+            }
+            if (fd >= 0) close(fd);
+        } break;
+
+        case JOURNAL_JOB_REPLACE:
+        {
+            // Old journal stays valid until the compacted one is fully on disk
+            char temp_path[1040];
+            snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+            int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            bool is_written = fd >= 0 && journal__write_all(fd, job->data, job->size) && fsync(fd) == 0;
+            if (fd >= 0) close(fd);
+            if (!is_written || rename(temp_path, path) != 0)
+            {
+                log_warning("Failed to write journal at %s: %s", path, strerror(errno));
+                unlink(temp_path);
+            }
+        } break;
+
+        case JOURNAL_JOB_REMOVE:
+        {
+            if (unlink(path) != 0 && errno != ENOENT) log_warning("Failed to remove journal at %s", path);
+        } break;
+    }
+}
+
+static void *journal_writer__run(void *arg)
+{
+    Journal_Writer *writer = arg;
+    Journal_Job *jobs = NULL;
+    int job_cap = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&writer->mutex);
+        while (writer->job_count == 0 && !writer->should_stop)
+        {
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        }
+        if (writer->job_count == 0)
+        {
+            pthread_mutex_unlock(&writer->mutex);
+            break;
+        }
+        // Swap queues, so the main thread can push while these are written
+        Journal_Job *taken = writer->jobs;
+        int taken_count = writer->job_count;
+        int taken_cap = writer->job_cap;
+        writer->jobs = jobs;
+        writer->job_cap = job_cap;
+        writer->job_count = 0;
+        pthread_mutex_unlock(&writer->mutex);
+
+        for (int i = 0; i < taken_count; i++)
+        {
+            journal_writer__do_job(writer, &taken[i]);
+            free(taken[i].data);
+        }
+        jobs = taken;
+        job_cap = taken_cap;
+    }
+    free(jobs);
+    return NULL;
+}
+
+bool journal_writer_start(Journal_Writer *writer, const char *dir)
+{
+    bassert(!writer->is_running);
+    *writer = (Journal_Writer){0};
+    writer->dir = xstrdup(dir);
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    if (pthread_create(&writer->thread, NULL, journal_writer__run, writer) != 0)
+    {
+        log_warning("Failed to start journal writer thread");
+        pthread_mutex_destroy(&writer->mutex);
+        pthread_cond_destroy(&writer->cond);
+        free(writer->dir);
+        *writer = (Journal_Writer){0};
+        return false;
+    }
+    writer->is_running = true;
+    return true;
+}
+
+// Writes everything still queued before returning
+void journal_writer_stop(Journal_Writer *writer)
+{
+    if (!writer->is_running) return;
+    pthread_mutex_lock(&writer->mutex);
+    writer->should_stop = true;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_join(writer->thread, NULL);
+
+    pthread_mutex_destroy(&writer->mutex);
+    pthread_cond_destroy(&writer->cond);
+    free(writer->jobs);
+    free(writer->dir);
+    *writer = (Journal_Writer){0};
+}
+
+// Takes ownership of data
+void journal_writer_push(Journal_Writer *writer, Journal_Job_Kind kind, int buffer_id, char *data, size_t size)
+{
+    bassert(writer->is_running);
+    pthread_mutex_lock(&writer->mutex);
+    if (writer->job_count >= writer->job_cap)
+    {
+        writer->job_cap = writer->job_cap ? writer->job_cap * 2 : 16;
+        writer->jobs = xrealloc(writer->jobs, writer->job_cap * sizeof(writer->jobs[0]));
+    }
+    writer->jobs[writer->job_count++] = (Journal_Job){ .kind = kind, .buffer_id = buffer_id, .data = data, .size = size };
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+// ------------------------------------------------------------------------------------------------------------------------
+
+typedef struct Journal_Reader {
+    const char *data;
+    size_t size;
+    size_t at;
+} Journal_Reader;
+
+static bool journal_reader__get(Journal_Reader *r, void *out, size_t size)
+{
+    if (r->size - r->at < size) return false;
+    memcpy(out, r->data + r->at, size);
+    r->at += size;
+    return true;
+}
+
+static bool journal_reader__get_pos(Journal_Reader *r, Cursor_Pos *out_pos)
+{
+    int32_t line, col;
+    if (!journal_reader__get(r, &line, 4) || !journal_reader__get(r, &col, 4)) return false;
+    *out_pos = (Cursor_Pos){line, col};
+    return true;
+}
+
+static bool journal__is_insert_pos_valid(const Text_Buffer *tb, Cursor_Pos pos)
+{
+    return pos.line >= 0 && pos.line < tb->line_count && pos.col >= 0 && pos.col < tb->lines[pos.line].len;
+}
+
+// Applies the records of one frame, false if any of them doesn't fit the text
+static bool journal__replay_payload(Journal_Reader *r, Text_Buffer *tb, bool *has_snapshot, char **out_file_path)
+{
+    while (r->at < r->size)
+    {
+        char kind;
+        journal_reader__get(r, &kind, 1);
+        if (kind != JOURNAL_RECORD_SNAPSHOT && !*has_snapshot) return false;
+        switch (kind)
+        {
+            case JOURNAL_RECORD_SNAPSHOT:
+            {
+                int32_t path_len, line_count;
+                if (!journal_reader__get(r, &path_len, 4) || path_len < 0 || r->size - r->at < (size_t)path_len) return false;
+                free(*out_file_path);
+                *out_file_path = path_len > 0 ? xstrndup(r->data + r->at, path_len) : NULL;
+                r->at += path_len;
+                if (!journal_reader__get(r, &line_count, 4) || line_count <= 0) return false;
+                text_buffer_destroy(tb);
+                for (int i = 0; i < line_count; i++)
+                {
+                    int32_t len;
+                    if (!journal_reader__get(r, &len, 4) || len <= 0 || r->size - r->at < (size_t)len) return false;
+                    text_buffer_append_line(tb, text_line_make_dup_range(r->data + r->at, 0, len));
+                    r->at += len;
+                }
+                *has_snapshot = true;
+            } break;
+
+            case JOURNAL_RECORD_INSERT_CHAR:
+            {
+                Cursor_Pos pos;
+                char c;
+                if (!journal_reader__get_pos(r, &pos) || !journal_reader__get(r, &c, 1)) return false;
+                if (!journal__is_insert_pos_valid(tb, pos)) return false;
+                text_buffer_insert_char(tb, c, pos);
+            } break;
+
+            case JOURNAL_RECORD_REMOVE_CHAR:
+            {
+                Cursor_Pos pos;
+                if (!journal_reader__get_pos(r, &pos) || !journal__is_insert_pos_valid(tb, pos)) return false;
+                text_buffer_remove_char(tb, pos);
+            } break;
+
+            case JOURNAL_RECORD_INSERT_RANGE:
+            {
+                Cursor_Pos pos;
+                int32_t len;
+                if (!journal_reader__get_pos(r, &pos) || !journal_reader__get(r, &len, 4)) return false;
+                if (len <= 0 || r->size - r->at < (size_t)len || !journal__is_insert_pos_valid(tb, pos)) return false;
+                char *range = xstrndup(r->data + r->at, len);
+                r->at += len;
+                text_buffer_insert_range(tb, range, pos);
+                free(range);
+            } break;
+
+            case JOURNAL_RECORD_REMOVE_RANGE:
+            {
+                Cursor_Pos start, end;
+                if (!journal_reader__get_pos(r, &start) || !journal_reader__get_pos(r, &end)) return false;
+                if (!journal__is_insert_pos_valid(tb, start)) return false;
+                if (end.line < 0 || end.line >= tb->line_count || end.col < 0 || end.col > tb->lines[end.line].len) return false;
+                if (!((end.line == start.line && end.col > start.col) || end.line > start.line)) return false;
+                text_buffer_remove_range(tb, start, end);
+            } break;
+
+            default: return false;
+        }
+    }
+    return true;
+}
+
+// Rebuilds the text a journal describes. Frames after a torn or corrupted one are ignored.
+bool journal_replay_file(const char *path, Text_Buffer *out_text_buffer, char **out_file_path)
+{
+    size_t size;
+    char *data = read_file(path, &size);
+    if (!data) return false;
+
+    Text_Buffer tb = {0};
+    char *file_path = NULL;
+    bool has_snapshot = false;
+    size_t at = 0;
+    while (size - at >= JOURNAL_FRAME_HEADER_SIZE)
+    {
+        uint32_t magic, payload_size;
+        uint64_t hash;
+        memcpy(&magic, data + at, 4);
+        memcpy(&payload_size, data + at + 4, 4);
+        memcpy(&hash, data + at + 8, 8);
+        if (magic != JOURNAL_FRAME_MAGIC || size - at - JOURNAL_FRAME_HEADER_SIZE < payload_size) break;
+        const char *payload = data + at + JOURNAL_FRAME_HEADER_SIZE;
+        if (module_hash(MODULE_HASH_SEED, payload, payload_size) != hash) break;
+
+        Journal_Reader reader = { .data = payload, .size = payload_size };
+        if (!journal__replay_payload(&reader, &tb, &has_snapshot, &file_path))
+        {
+            log_warning("Journal at %s has records that don't apply, recovered what came before them", path);
+            break;
+        }
+        at += JOURNAL_FRAME_HEADER_SIZE + payload_size;
+    }
+    free(data);
+
+    if (!has_snapshot)
+    {
+        text_buffer_destroy(&tb);
+        free(file_path);
+        return false;
+    }
+    *out_text_buffer = tb;
+    *out_file_path = file_path;
+    return true;
+}
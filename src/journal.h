@@ -0,0 +1,59 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "history.h"
+#include "text_buffer.h"
+
+// Crash recovery for unsaved edits. Each buffer gets a journal file that starts
+// with a snapshot of its text and grows by the history deltas made since.
+// Records are encoded on the main thread (only what's new since the last
+// autosave), all file IO happens on the writer thread.
+//
+// A journal file is a sequence of frames: magic, payload size, payload hash,
+// payload. A crash can only tear the last frame, replay stops at the first
+// frame that doesn't check out.
+
+typedef struct Journal_Batch {
+    char *data;
+    size_t size;
+    size_t cap;
+} Journal_Batch;
+
+typedef enum Journal_Job_Kind {
+    JOURNAL_JOB_APPEND,
+    JOURNAL_JOB_REPLACE, // Compaction, the batch starts with a snapshot
+    JOURNAL_JOB_REMOVE
+} Journal_Job_Kind;
+
+typedef struct Journal_Job {
+    Journal_Job_Kind kind;
+    int buffer_id;
+    char *data;
+    size_t size;
+} Journal_Job;
+
+typedef struct Journal_Writer {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    char *dir;
+    Journal_Job *jobs; // Guarded by mutex
+    int job_count;
+    int job_cap;
+    bool should_stop;
+    bool is_running;
+} Journal_Writer;
+
+void journal_batch_put_snapshot(Journal_Batch *batch, const Text_Buffer *text_buffer, const char *file_path);
+void journal_batch_put_delta(Journal_Batch *batch, const Delta *delta);
+char *journal_batch_finish(Journal_Batch *batch, size_t *out_size);
+
+bool journal_writer_start(Journal_Writer *writer, const char *dir);
+void journal_writer_stop(Journal_Writer *writer);
+void journal_writer_push(Journal_Writer *writer, Journal_Job_Kind kind, int buffer_id, char *data, size_t size);
+
+bool journal_replay_file(const char *path, Text_Buffer *out_text_buffer, char **out_file_path);
@@ -0,0 +1,91 @@
+#include "large_file.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "util.h"
+
+static void large_file__push_line_offset(Large_File *large_file, size_t offset)
+{
+    if (large_file->line_offset_count >= large_file->line_offset_cap)
+    {
+        large_file->line_offset_cap = large_file->line_offset_cap ? large_file->line_offset_cap * 2 : 64;
+        large_file->line_offsets = xrealloc(large_file->line_offsets, large_file->line_offset_cap * sizeof(large_file->line_offsets[0]));
+    }
+    large_file->line_offsets[large_file->line_offset_count++] = offset;
+}
+
+static void large_file__release_pages(Large_File *large_file, size_t start, size_t end)
+{
+    // Indexing reads every page once; drop them again so resident memory only holds what's on screen
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t aligned_start = (start + page_size - 1) / page_size * page_size;
+    size_t aligned_end = end / page_size * page_size;
+    if (aligned_end > aligned_start)
+    {
+        madvise((void *)(large_file->file.data + aligned_start), aligned_end - aligned_start, MADV_DONTNEED);
+    }
+}
+
+Large_File large_file_create(Mapped_File file)
+{
+    Large_File large_file = {0};
+    large_file.file = file;
+    large_file__push_line_offset(&large_file, 0);
+    large_file.is_fully_indexed = file.size == 0;
+    if (file.data) madvise((void *)file.data, file.size, MADV_RANDOM);
+    return large_file;
+}
+
+void large_file_destroy(Large_File *large_file)
+{
+    free(large_file->line_offsets);
+    *large_file = (Large_File){0};
+}
+
+void large_file_index_to_line(Large_File *large_file, int line)
+{
+    const char *data = large_file->file.data;
+    size_t size = large_file->file.size;
+    size_t scan_start = large_file->indexed_size;
+    while (!large_file->is_fully_indexed && large_file->indexed_line_count <= line)
+    {
+        const char *newline = memchr(data + large_file->indexed_size, '\n', size - large_file->indexed_size);
+        large_file->indexed_size = newline ? (size_t)(newline - data) + 1 : size;
+        large_file->indexed_line_count++;
+        if (large_file->indexed_size == size)
+        {
+            large_file->is_fully_indexed = true;
+        }
+        else if (large_file->indexed_line_count % LARGE_FILE_INDEX_STRIDE == 0)
+        {
+            large_file__push_line_offset(large_file, large_file->indexed_size);
+        }
+    }
+    large_file__release_pages(large_file, scan_start, large_file->indexed_size);
+}
+
+int large_file_get_line_count(const Large_File *large_file)
+{
+    return large_file->indexed_line_count;
+}
+
+bool large_file_get_line(Large_File *large_file, int line, const char **out_str, int *out_len)
+{
+    if (line < 0) return false;
+    large_file_index_to_line(large_file, line);
+    if (line >= large_file->indexed_line_count) return false;
+
+    const char *data = large_file->file.data;
+    const char *end = data + large_file->file.size;
+    const char *str = data + large_file->line_offsets[line / LARGE_FILE_INDEX_STRIDE];
+    for (int i = 0; i < line % LARGE_FILE_INDEX_STRIDE; i++)
+    {
+        str = (const char *)memchr(str, '\n', end - str) + 1;
+    }
+    const char *newline = memchr(str, '\n', end - str);
+    *out_str = str;
+    *out_len = newline ? (int)(newline - str) + 1 : (int)(end - str);
+    return true;
+}
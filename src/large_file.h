@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "os.h"
+
+// Offset of every Nth line start is kept, other lines are found by scanning from the nearest one
+#define LARGE_FILE_INDEX_STRIDE 1024
+
+// Read-only view of a mapped file that is too big to turn into Text_Lines.
+// The line index is sparse and only built as far as lines are requested.
+typedef struct Large_File {
+    Mapped_File file;
+    size_t *line_offsets; // line_offsets[i] is the start of line i * LARGE_FILE_INDEX_STRIDE
+    int line_offset_count;
+    int line_offset_cap;
+    size_t indexed_size;
+    int indexed_line_count;
+    bool is_fully_indexed;
+} Large_File;
+
+Large_File large_file_create(Mapped_File file);
+void large_file_destroy(Large_File *large_file);
+void large_file_index_to_line(Large_File *large_file, int line);
+int large_file_get_line_count(const Large_File *large_file);
+bool large_file_get_line(Large_File *large_file, int line, const char **out_str, int *out_len);
@@ -0,0 +1,206 @@
+#include "match_index.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+// First match at or after pos, match_count if there is none
+int match_index_lower_bound(const Match_Index *index, Cursor_Pos pos)
+{
+    int lo = 0;
+    int hi = index->match_count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        Cursor_Pos m = index->matches[mid];
+        if (m.line < pos.line || (m.line == pos.line && m.col < pos.col)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void match_index__set_synced(Match_Index *index, const Text_Buffer *text_buffer, const History *history)
+{
+    index->generation = text_buffer->generation;
+    index->command_index = history->command_count > 0 ? history->command_count - 1 : 0;
+    index->delta_index = history->command_count > 0 ? history->commands[history->command_count - 1].delta_count : 0;
+}
+
+void match_index_rebuild(Match_Index *index, const Text_Buffer *text_buffer, const History *history,
+    const Search_Pattern *pattern, unsigned int search_seed)
+{
+    index->match_count = 0;
+    index->search_seed = search_seed;
+    index->match_len = pattern->len;
+    index->match_line_span = 0;
+    for (int i = 0; i < pattern->len; i++)
+    {
+        if (pattern->needle[i] == '\n') index->match_line_span++;
+    }
+    text_buffer_search_all(text_buffer, pattern, 0, text_buffer->line_count, &index->matches, &index->match_count, &index->match_cap);
+    match_index__set_synced(index, text_buffer, history);
+}
+
+// Lines [first_line, first_line + old_count) were replaced by [first_line, first_line + new_count)
+static void match_index__apply_edit(Match_Index *index, int first_line, int old_count, int new_count)
+{
+    int line_delta = new_count - old_count;
+    int old_end = first_line + old_count;
+    int dirty_first = first_line - index->match_line_span;
+    if (dirty_first < 0) dirty_first = 0;
+
+    // Matches that reach into the edited lines are gone, the ones after move with their lines
+    int remove_from = match_index_lower_bound(index, (Cursor_Pos){dirty_first, INT_MIN});
+    int remove_to = match_index_lower_bound(index, (Cursor_Pos){old_end, INT_MIN});
+    memmove(&index->matches[remove_from], &index->matches[remove_to], (index->match_count - remove_to) * sizeof(index->matches[0]));
+    index->match_count -= remove_to - remove_from;
+    for (int i = remove_from; i < index->match_count; i++)
+    {
+        index->matches[i].line += line_delta;
+    }
+
+    // Ranges left by earlier edits move the same way, those touching this edit merge into its range
+    Match_Index_Range range = {dirty_first, first_line + new_count};
+    int kept_count = 0;
+    for (int i = 0; i < index->dirty_range_count; i++)
+    {
+        Match_Index_Range r = index->dirty_ranges[i];
+        if (r.end_line < dirty_first)
+        {
+            index->dirty_ranges[kept_count++] = r;
+        }
+        else if (r.first_line > old_end)
+        {
+            r.first_line += line_delta;
+            r.end_line += line_delta;
+            index->dirty_ranges[kept_count++] = r;
+        }
+        else
+        {
+            if (r.first_line < range.first_line) range.first_line = r.first_line;
+            if (r.end_line > old_end && r.end_line + line_delta > range.end_line) range.end_line = r.end_line + line_delta;
+        }
+    }
+    if (kept_count >= index->dirty_range_cap)
+    {
+        index->dirty_range_cap = index->dirty_range_cap ? index->dirty_range_cap * 2 : 8;
+        index->dirty_ranges = xrealloc(index->dirty_ranges, index->dirty_range_cap * sizeof(index->dirty_ranges[0]));
+    }
+    index->dirty_ranges[kept_count++] = range;
+    index->dirty_range_count = kept_count;
+}
+
+static void match_index__apply_delta(Match_Index *index, const Delta *delta)
+{
+    switch (delta->kind)
+    {
+        case DELTA_INSERT_CHAR:
+        {
+            match_index__apply_edit(index, delta->insert_char.pos.line, 1, delta->insert_char.c == '\n' ? 2 : 1);
+        } break;
+
+        case DELTA_REMOVE_CHAR:
+        {
+            match_index__apply_edit(index, delta->remove_char.pos.line, delta->remove_char.c == '\n' ? 2 : 1, 1);
+        } break;
+
+        case DELTA_INSERT_RANGE:
+        {
+            match_index__apply_edit(index, delta->insert_range.start.line, 1, delta->insert_range.end.line - delta->insert_range.start.line + 1);
+        } break;
+
+        case DELTA_REMOVE_RANGE:
+        {
+            match_index__apply_edit(index, delta->remove_range.start.line, delta->remove_range.end.line - delta->remove_range.start.line + 1, 1);
+        } break;
+    }
+}
+
+static int match_index__compare_range(const void *a, const void *b)
+{
+    return ((const Match_Index_Range *)a)->first_line - ((const Match_Index_Range *)b)->first_line;
+}
+
+void match_index_sync(Match_Index *index, const Text_Buffer *text_buffer, const History *history,
+    const Search_Pattern *pattern, unsigned int search_seed)
+{
+    if (index->search_seed != search_seed)
+    {
+        match_index_rebuild(index, text_buffer, history, pattern, search_seed);
+        return;
+    }
+    if (index->generation == text_buffer->generation) return;
+
+    // Same walk as the autosave journal, the deltas have to lead from the indexed text to the current one
+    index->dirty_range_count = 0;
+    unsigned int generation = index->generation;
+    bool is_chained = true;
+    for (int c = index->command_index; is_chained && c < history->command_count; c++)
+    {
+        const Command *command = &history->commands[c];
+        int first_delta = c == index->command_index ? index->delta_index : 0;
+        for (int d = first_delta; d < command->delta_count; d++)
+        {
+            const Delta *delta = &command->deltas[d];
+            if (delta->generation_before != generation)
+            {
+                is_chained = false;
+                break;
+            }
+            match_index__apply_delta(index, delta);
+            generation = delta->generation_after;
+        }
+    }
+    if (!is_chained || generation != text_buffer->generation)
+    {
+        match_index_rebuild(index, text_buffer, history, pattern, search_seed);
+        return;
+    }
+
+    qsort(index->dirty_ranges, index->dirty_range_count, sizeof(index->dirty_ranges[0]), match_index__compare_range);
+    Cursor_Pos *found = NULL;
+    int found_cap = 0;
+    for (int i = 0; i < index->dirty_range_count; i++)
+    {
+        Match_Index_Range range = index->dirty_ranges[i];
+        while (i + 1 < index->dirty_range_count && index->dirty_ranges[i + 1].first_line <= range.end_line)
+        {
+            i++;
+            if (index->dirty_ranges[i].end_line > range.end_line) range.end_line = index->dirty_ranges[i].end_line;
+        }
+
+        int found_count = 0;
+        text_buffer_search_all(text_buffer, pattern, range.first_line, range.end_line, &found, &found_count, &found_cap);
+        if (found_count == 0) continue;
+
+        int insert_at = match_index_lower_bound(index, (Cursor_Pos){range.first_line, INT_MIN});
+        if (index->match_count + found_count > index->match_cap)
+        {
+            while (index->match_count + found_count > index->match_cap)
+            {
+                index->match_cap = index->match_cap ? index->match_cap * 2 : 64;
+            }
+            index->matches = xrealloc(index->matches, index->match_cap * sizeof(index->matches[0]));
+        }
+        memmove(&index->matches[insert_at + found_count], &index->matches[insert_at], (index->match_count - insert_at) * sizeof(index->matches[0]));
+        memcpy(&index->matches[insert_at], found, found_count * sizeof(found[0]));
+        index->match_count += found_count;
+    }
+    free(found);
+    match_index__set_synced(index, text_buffer, history);
+}
+
+void match_index_clear(Match_Index *index)
+{
+    index->match_count = 0;
+    index->search_seed = 0;
+}
+
+void match_index_destroy(Match_Index *index)
+{
+    free(index->matches);
+    free(index->dirty_ranges);
+    *index = (Match_Index){0};
+}
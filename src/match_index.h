@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "history.h"
+#include "search.h"
+#include "text_buffer.h"
+
+typedef struct Match_Index_Range {
+    int first_line;
+    int end_line;
+} Match_Index_Range;
+
+// Every match of the current search in a buffer, sorted by position. Kept up
+// to date from the history deltas made since the last sync: matches on lines
+// an edit touched are dropped, later ones move with the line count, and only
+// the touched lines get searched again. Anything the deltas don't account for
+// (reload, replaced text) rebuilds the whole index.
+typedef struct Match_Index {
+    Cursor_Pos *matches;
+    int match_count;
+    int match_cap;
+    int match_len; // Needle length, for drawing
+    int match_line_span; // Line breaks in the needle, a match can reach this many lines past its start
+    unsigned int search_seed; // Search the matches are for, 0 for none
+    unsigned int generation; // Text generation the matches describe
+    int command_index; // Deltas before this history position are accounted for
+    int delta_index;
+    Match_Index_Range *dirty_ranges; // Scratch space of sync
+    int dirty_range_count;
+    int dirty_range_cap;
+} Match_Index;
+
+void match_index_sync(Match_Index *index, const Text_Buffer *text_buffer, const History *history,
+    const Search_Pattern *pattern, unsigned int search_seed);
+void match_index_rebuild(Match_Index *index, const Text_Buffer *text_buffer, const History *history,
+    const Search_Pattern *pattern, unsigned int search_seed);
+void match_index_clear(Match_Index *index);
+void match_index_destroy(Match_Index *index);
+int match_index_lower_bound(const Match_Index *index, Cursor_Pos pos);
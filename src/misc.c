@@ -61,7 +61,7 @@ GLuint gl_create_shader_program(const char *vs_src, const char *fs_src)
     return prog;
 }
 
-void gl_enable_scissor(Rect screen_rect, Render_State *render_state)
+void gl_enable_scissor(Rect screen_rect, const Render_State *render_state)
 {
     glEnable(GL_SCISSOR_TEST);
     Rect scaled_rect = {
@@ -170,6 +170,12 @@ void mat_stack_mul_r(Mat_Stack *s, m4 m)
     s->mm[s->size - 1] = mat4_mul(s->mm[s->size - 1], m);
 }
 
+void mat_stack_load(Mat_Stack *s, m4 m)
+{
+    bassert(s->size > 0);
+    s->mm[s->size - 1] = m;
+}
+
 char *strf(const char *fmt, ...)
 {
     va_list args;
@@ -0,0 +1,285 @@
+#include "module_loader.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <copyfile.h>
+#elif defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+// FNV-1a, chain calls to hash several pieces into one key
+uint64_t module_hash(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool module_hash_file(const char *path, uint64_t *out_hash)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat attr;
+    if (fstat(fd, &attr) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    uint64_t hash = MODULE_HASH_SEED;
+    if (attr.st_size > 0)
+    {
+        void *data = mmap(NULL, (size_t)attr.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+        hash = module_hash(hash, data, (size_t)attr.st_size);
+        munmap(data, (size_t)attr.st_size);
+    }
+    close(fd);
+    *out_hash = hash;
+    return true;
+}
+
+double module_get_time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static bool module__copy_file(const char *src, const char *dest)
+{
+#if defined(__APPLE__)
+    // Clones on APFS, so no bytes are copied until one of the files is written
+    if (copyfile(src, dest, NULL, COPYFILE_CLONE) != 0)
+    {
+        fprintf(stderr, "[MODULE LOADER] module__copy_file: failed to copy %s to %s: %s\n", src, dest, strerror(errno));
+        return false;
+    }
+    return true;
+#else
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+    {
+        fprintf(stderr, "[MODULE LOADER] module__copy_file: failed to open file for read at: %s\n", src);
+        return false;
+    }
+    struct stat attr;
+    if (fstat(in, &attr) != 0)
+    {
+        close(in);
+        return false;
+    }
+    int out = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, attr.st_mode & 0777);
+    if (out < 0)
+    {
+        fprintf(stderr, "[MODULE LOADER] module__copy_file: failed to open file for write at: %s\n", dest);
+        close(in);
+        return false;
+    }
+
+    off_t remaining = attr.st_size;
+#if defined(__linux__)
+    // Stays in the kernel, the bytes never pass through a user space buffer
+    while (remaining > 0)
+    {
+        ssize_t n = sendfile(out, in, NULL, (size_t)remaining);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        remaining -= n;
+    }
+#endif
+    // Whatever sendfile couldn't do (or where it doesn't exist) is copied by hand
+    char buf[65536];
+    while (remaining > 0)
+    {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n <= 0 || write(out, buf, (size_t)n) != n) break;
+        remaining -= n;
+    }
+
+    close(in);
+    close(out);
+    if (remaining != 0)
+    {
+        fprintf(stderr, "[MODULE LOADER] module__copy_file: failed to copy %s to %s\n", src, dest);
+        unlink(dest);
+        return false;
+    }
+    return true;
+#endif
+}
+
+static bool module__open_with_hash(Module *module, const char *path, uint64_t content_hash)
+{
+    // Unique per load, two loads within the same second must not share a copy
+    static unsigned int copy_seed = 0;
+    const char *dot = strrchr(path, '.');
+    size_t base_len = dot ? (size_t)(dot - path) : strlen(path);
+    char copied_path[512];
+    snprintf(copied_path, sizeof(copied_path), "%.*s_%d_%u.dylib", (int)base_len, path, (int)getpid(), ++copy_seed);
+
+    *module = (Module){0};
+    double start_ms = module_get_time_ms();
+    if (!module__copy_file(path, copied_path))
+    {
+        fprintf(stderr, "[MODULE LOADER] Failed to copy dylib from %s to %s\n", path, copied_path);
+        return false;
+    }
+    double copied_ms = module_get_time_ms();
+
+    module->handle = dlopen(copied_path, RTLD_NOW);
+    if (!module->handle)
+    {
+        fprintf(stderr, "[MODULE LOADER] Failed to open dylib: %s: %s\n", copied_path, dlerror());
+        unlink(copied_path);
+        return false;
+    }
+
+    struct stat attr;
+    module->original_path = strdup(path);
+    module->copied_path = strdup(copied_path);
+    module->timestamp = stat(path, &attr) == 0 ? attr.st_mtime : 0;
+    module->content_hash = content_hash;
+    module->copy_ms = copied_ms - start_ms;
+    module->load_ms = module_get_time_ms() - copied_ms;
+
+    printf("[MODULE LOADER] module_open: opened %s in %.2f ms (copy %.2f ms, dlopen %.2f ms)\n",
+        path, module->copy_ms + module->load_ms, module->copy_ms, module->load_ms);
+    return true;
+}
+
+bool module_open(Module *module, const char *path)
+{
+    uint64_t content_hash;
+    if (!module_hash_file(path, &content_hash))
+    {
+        fprintf(stderr, "[MODULE LOADER] module_open: failed to read %s\n", path);
+        *module = (Module){0};
+        return false;
+    }
+    return module__open_with_hash(module, path, content_hash);
+}
+
+void module_close(Module *module)
+{
+    if (!module->handle) return;
+    dlclose(module->handle);
+    if (unlink(module->copied_path) != 0)
+    {
+        fprintf(stderr, "[MODULE LOADER] module_close: failed to delete %s\n", module->copied_path);
+    }
+    printf("[MODULE LOADER] module_close: closed dylib at %s\n", module->copied_path);
+    free(module->original_path);
+    free(module->copied_path);
+    *module = (Module){0};
+}
+
+void *module_get_symbol(Module *module, const char *name)
+{
+    return dlsym(module->handle, name);
+}
+
+static void module_cache__evict_unused(Module_Cache *cache)
+{
+    for (;;)
+    {
+        int unused_count = 0;
+        int oldest = -1;
+        for (int i = 0; i < cache->entry_count; i++)
+        {
+            Module_Cache_Entry *entry = cache->entries[i];
+            if (entry->ref_count > 0) continue;
+            unused_count++;
+            if (oldest < 0 || entry->last_use < cache->entries[oldest]->last_use) oldest = i;
+        }
+        if (unused_count <= MODULE_CACHE_MAX_UNUSED) return;
+
+        module_close(&cache->entries[oldest]->module);
+        free(cache->entries[oldest]);
+        cache->entries[oldest] = cache->entries[--cache->entry_count];
+    }
+}
+
+Module *module_cache_get(Module_Cache *cache, const char *path, bool *out_was_cached)
+{
+    uint64_t content_hash;
+    if (!module_hash_file(path, &content_hash))
+    {
+        fprintf(stderr, "[MODULE LOADER] module_cache_get: failed to read %s\n", path);
+        return NULL;
+    }
+
+    for (int i = 0; i < cache->entry_count; i++)
+    {
+        Module_Cache_Entry *entry = cache->entries[i];
+        if (entry->module.content_hash == content_hash)
+        {
+            entry->ref_count++;
+            entry->last_use = ++cache->use_seed;
+            if (out_was_cached) *out_was_cached = true;
+            return &entry->module;
+        }
+    }
+
+    Module_Cache_Entry *entry = calloc(1, sizeof(*entry));
+    if (!module__open_with_hash(&entry->module, path, content_hash))
+    {
+        free(entry);
+        return NULL;
+    }
+    if (cache->entry_count >= cache->entry_cap)
+    {
+        cache->entry_cap = cache->entry_cap ? cache->entry_cap * 2 : 8;
+        cache->entries = realloc(cache->entries, cache->entry_cap * sizeof(cache->entries[0]));
+    }
+    entry->ref_count = 1;
+    entry->last_use = ++cache->use_seed;
+    cache->entries[cache->entry_count++] = entry;
+    if (out_was_cached) *out_was_cached = false;
+    return &entry->module;
+}
+
+void module_cache_release(Module_Cache *cache, Module *module)
+{
+    for (int i = 0; i < cache->entry_count; i++)
+    {
+        if (&cache->entries[i]->module == module)
+        {
+            cache->entries[i]->ref_count--;
+            break;
+        }
+    }
+    module_cache__evict_unused(cache);
+}
+
+void module_cache_destroy(Module_Cache *cache)
+{
+    for (int i = 0; i < cache->entry_count; i++)
+    {
+        module_close(&cache->entries[i]->module);
+        free(cache->entries[i]);
+    }
+    free(cache->entries);
+    *cache = (Module_Cache){0};
+}
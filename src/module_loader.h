@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define MODULE_HASH_SEED 14695981039346656037ull
+#define MODULE_CACHE_MAX_UNUSED 16 // Loaded modules nobody holds a reference to that are kept around for reuse
+
+// Dylib loaded from a private copy of the file, so the original can be
+// rebuilt while the old code is still mapped, and a rebuilt file always
+// gets a fresh image (dlopen hands back the already loaded one for a path
+// or inode it has seen).
+typedef struct Module {
+    void *handle;
+    char *original_path;
+    char *copied_path;
+    time_t timestamp;
+    uint64_t content_hash;
+    double copy_ms;
+    double load_ms; // dlopen and initializers
+} Module;
+
+typedef struct Module_Cache_Entry {
+    Module module;
+    int ref_count;
+    unsigned int last_use;
+} Module_Cache_Entry;
+
+// Loaded modules keyed by the hash of their file contents. Getting a module
+// whose bytes are already loaded returns that one without copying or dlopen.
+typedef struct Module_Cache {
+    Module_Cache_Entry **entries;
+    int entry_count;
+    int entry_cap;
+    unsigned int use_seed;
+} Module_Cache;
+
+uint64_t module_hash(uint64_t hash, const void *data, size_t size);
+bool module_hash_file(const char *path, uint64_t *out_hash);
+double module_get_time_ms();
+
+bool module_open(Module *module, const char *path);
+void module_close(Module *module);
+void *module_get_symbol(Module *module, const char *name);
+
+Module *module_cache_get(Module_Cache *cache, const char *path, bool *out_was_cached);
+void module_cache_release(Module_Cache *cache, Module *module);
+void module_cache_destroy(Module_Cache *cache);
@@ -1,7 +1,12 @@
 #include "os.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "editor.h"
 #include "util.h"
@@ -64,11 +69,56 @@ bool os_file_is_image(const char *path)
     return stbi_info(path, &x, &y, &comp) != 0;
 }
 
+// A NUL byte near the start, the same test git and grep use
+bool os_file_is_binary(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    char buf[OS_BINARY_SNIFF_SIZE];
+    ssize_t size = read(fd, buf, sizeof(buf));
+    close(fd);
+    return size > 0 && memchr(buf, '\0', size) != NULL;
+}
+
 File_Kind os_file_detect_kind(const char *path)
 {
     if (!os_file_exists(path)) return FILE_KIND_NONE;
     const char *ext = strrchr(path, '.');
     if (ext && strcmp(ext, ".dylib") == 0) return FILE_KIND_DYLIB;
     if (os_file_is_image(path)) return FILE_KIND_IMAGE;
+    if (os_file_is_binary(path)) return FILE_KIND_BINARY;
     return FILE_KIND_TEXT;
 }
+
+bool os_file_map(const char *path, Mapped_File *out_file)
+{
+    *out_file = (Mapped_File){0};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return false;
+    }
+    if (st.st_size > 0) // mmap of 0 bytes fails, an empty file is just an empty mapping
+    {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        out_file->data = data;
+        out_file->size = st.st_size;
+    }
+    close(fd);
+    return true;
+}
+
+void os_file_unmap(Mapped_File *file)
+{
+    if (file->data) munmap((void *)file->data, file->size);
+    *file = (Mapped_File){0};
+}
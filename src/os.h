@@ -4,14 +4,23 @@
 
 #include "types.h"
 
+#define OS_BINARY_SNIFF_SIZE 8192 // Bytes looked at to tell a binary file from text
+
 typedef enum File_Kind
 {
     FILE_KIND_NONE,
     FILE_KIND_TEXT,
     FILE_KIND_IMAGE,
-    FILE_KIND_DYLIB
+    FILE_KIND_DYLIB,
+    FILE_KIND_BINARY
 } File_Kind;
 
+typedef struct Mapped_File
+{
+    const char *data;
+    size_t size;
+} Mapped_File;
+
 struct Editor_State;
 
 void os_read_clipboard(char *buf, size_t buf_size);
@@ -22,4 +31,7 @@ bool os_change_working_dir(const char *dir, struct Editor_State *state);
 
 bool os_file_exists(const char *path);
 bool os_file_is_image(const char *path);
+bool os_file_is_binary(const char *path);
 File_Kind os_file_detect_kind(const char *path);
+bool os_file_map(const char *path, Mapped_File *out_file);
+void os_file_unmap(Mapped_File *file);
@@ -6,7 +6,9 @@
 #include <OpenGL/gl3.h>
 #include <GLFW/glfw3.h>
 
+#include "file_watch.h"
 #include "glfw_helpers.h"
+#include "module_loader.h"
 #include "platform_types.h"
 #include "scene_loader.h"
 
@@ -14,9 +16,12 @@
 #define INITIAL_WINDOW_WIDTH 1000
 #define INITIAL_WINDOW_HEIGHT 900
 #define FPS_MEASUREMENT_FREQ 0.1f
+#define IDLE_WAIT_MAX 0.25 // Idle scenes still get their dylib checked for hot reload this often
+#define FILE_WATCH_POLL_INTERVAL 0.5 // Only used where inotify isn't available
 
 static Scene_Dylib g_scene_dylib;
 static void *g_scene_state;
+static File_Watch g_file_watch;
 
 static v2 g_mouse_prev_pos;
 static Platform_Timing g_timing;
@@ -143,6 +148,9 @@ int main(int argc, char **argv)
     g_scene_dylib = scene_loader_dylib_open(dylib_path);
     g_scene_state = calloc(1, 4096);
 
+    g_file_watch = file_watch_create(FILE_WATCH_POLL_INTERVAL);
+    int scene_dylib_watch_id = file_watch_add(&g_file_watch, dylib_path);
+
     int window_w, window_h, window_px_w, window_px_h;
     glfwGetWindowSize(window, &window_w, &window_h);
     glfwGetFramebufferSize(window, &window_px_w, &window_px_h);
@@ -176,29 +184,64 @@ int main(int argc, char **argv)
         .input_captured.captured = true
     });
 
+    const GLFWvidmode *video_mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    const float refresh_rate = video_mode && video_mode->refreshRate > 0 ? (float)video_mode->refreshRate : 60.0f;
+
+    bool was_idle = false;
     while (!glfwWindowShouldClose(window))
     {
-        if (scene_loader_dylib_check_and_hotreload(&g_scene_dylib))
+        bool is_frame_due = false;
+        file_watch_update(&g_file_watch, glfwGetTime());
+        int changed_watch_id;
+        while (file_watch_next_event(&g_file_watch, &changed_watch_id))
         {
-            g_scene_dylib.on_reload(g_scene_state);
+            if (changed_watch_id == scene_dylib_watch_id && scene_loader_dylib_reload(&g_scene_dylib, g_scene_state))
+            {
+                g_scene_dylib.on_reload(g_scene_state);
+                is_frame_due = true;
+            }
         }
 
-        perform_timing_calculations(&g_timing);
+        double now = glfwGetTime();
+        double next_frame_time = g_scene_dylib.get_next_frame_time ? g_scene_dylib.get_next_frame_time(g_scene_state) : now;
+        if (next_frame_time <= now) is_frame_due = true;
 
-        g_scene_dylib.on_frame(g_scene_state, &g_timing);
-
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (is_frame_due)
+        {
+            perform_timing_calculations(&g_timing);
+            if (was_idle)
+            {
+                int skipped_count = (int)(g_timing.prev_delta_time * refresh_rate + 0.5f) - 1;
+                if (skipped_count > 0) g_timing.frame_skipped_count += skipped_count;
+                was_idle = false;
+            }
+
+            g_scene_dylib.on_frame(g_scene_state, &g_timing);
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        else
+        {
+            // Nothing to draw, sleep until an event comes in or the scene's next deadline
+            double timeout = next_frame_time - now;
+            if (timeout > IDLE_WAIT_MAX) timeout = IDLE_WAIT_MAX;
+            glfwWaitEventsTimeout(timeout);
+            was_idle = true;
+        }
     }
 
     g_scene_dylib.on_destroy(g_scene_state);
 
     free(g_scene_state);
     scene_loader_dylib_close(&g_scene_dylib);
+    file_watch_destroy(&g_file_watch);
 
     glfwDestroyWindow(window);
     glfwTerminate();
     return 0;
 }
 
+#include "file_watch.c"
+#include "module_loader.c"
 #include "scene_loader.c"
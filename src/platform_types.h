@@ -73,4 +73,5 @@ typedef struct Platform_Timing {
     int frame_total_count;
     float fps_avg;
     float fps_instant;
+    int frame_skipped_count; // Vsync intervals that went by without a frame, because the scene was idle
 } Platform_Timing;
@@ -1,67 +1,269 @@
 #include "renderer.h"
 
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "color.h"
 #include "common.h"
 #include "editor.h"
+#include "misc.h"
 #include "types.h"
+#include "util.h"
+
+Render_Batch *render_batch_create()
+{
+    Render_Batch *batch = xcalloc(sizeof(*batch));
+    return batch;
+}
+
+void render_batch_create_chunks(Render_Batch *batch)
+{
+    glGenVertexArrays(RENDER_BATCH_CHUNK_COUNT, batch->vaos);
+    glGenBuffers(RENDER_BATCH_CHUNK_COUNT, batch->vbos);
+    for (int i = 0; i < RENDER_BATCH_CHUNK_COUNT; i++)
+    {
+        glBindVertexArray(batch->vaos[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, batch->vbos[i]);
+        glBufferData(GL_ARRAY_BUFFER, RENDER_BATCH_CHUNK_VERTS * sizeof(Vert), NULL, GL_STREAM_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vert), (void *)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vert), (void *)offsetof(Vert, u));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vert), (void *)offsetof(Vert, c));
+        glEnableVertexAttribArray(2);
+    }
+}
+
+void render_batch_destroy(Render_Batch *batch)
+{
+    if (batch->vaos[0])
+    {
+        glDeleteVertexArrays(RENDER_BATCH_CHUNK_COUNT, batch->vaos);
+        glDeleteBuffers(RENDER_BATCH_CHUNK_COUNT, batch->vbos);
+    }
+    free(batch->cmds);
+    free(batch->mvps);
+    free(batch);
+}
+
+Vert *render_batch_push_verts(Render_Batch *batch, GLuint shader, GLuint texture, int vert_count, const Render_State *render_state)
+{
+    bassert(batch->mvp_count > 0);
+    bassert(vert_count <= RENDER_BATCH_CHUNK_VERTS);
+
+    if (batch->vert_count + vert_count > RENDER_BATCH_CHUNK_VERTS)
+    {
+        render_batch_flush(batch, render_state);
+    }
+
+    // Extend the last command if nothing changed since, its verts are right before these
+    Render_Batch_Cmd *last = batch->cmd_count > 0 ? &batch->cmds[batch->cmd_count - 1] : NULL;
+    bool can_merge = last &&
+        last->shader == shader &&
+        last->texture == texture &&
+        last->mvp_index == batch->mvp_count - 1 &&
+        last->has_scissor == batch->has_scissor &&
+        (!batch->has_scissor || memcmp(&last->scissor_rect, &batch->scissor_rect, sizeof(Rect)) == 0);
+    if (can_merge)
+    {
+        last->vert_count += vert_count;
+    }
+    else
+    {
+        if (batch->cmd_count >= batch->cmd_cap)
+        {
+            batch->cmd_cap = batch->cmd_cap ? batch->cmd_cap * 2 : 64;
+            batch->cmds = xrealloc(batch->cmds, batch->cmd_cap * sizeof(batch->cmds[0]));
+        }
+        batch->cmds[batch->cmd_count++] = (Render_Batch_Cmd){
+            .shader = shader,
+            .texture = texture,
+            .mvp_index = batch->mvp_count - 1,
+            .has_scissor = batch->has_scissor,
+            .scissor_rect = batch->scissor_rect,
+            .first_vert = batch->vert_count,
+            .vert_count = vert_count
+        };
+    }
+
+    Vert *verts = &batch->verts[batch->vert_count];
+    batch->vert_count += vert_count;
+    return verts;
+}
+
+void render_batch_set_mvp(Render_Batch *batch, m4 mvp)
+{
+    if (batch->mvp_count > 0 && memcmp(&batch->mvps[batch->mvp_count - 1], &mvp, sizeof(mvp)) == 0) return;
+    if (batch->mvp_count >= batch->mvp_cap)
+    {
+        batch->mvp_cap = batch->mvp_cap ? batch->mvp_cap * 2 : 32;
+        batch->mvps = xrealloc(batch->mvps, batch->mvp_cap * sizeof(batch->mvps[0]));
+    }
+    batch->mvps[batch->mvp_count++] = mvp;
+}
+
+void render_batch_set_scissor(Render_Batch *batch, Rect screen_rect)
+{
+    batch->has_scissor = true;
+    batch->scissor_rect = screen_rect;
+}
+
+void render_batch_clear_scissor(Render_Batch *batch)
+{
+    batch->has_scissor = false;
+    batch->scissor_rect = (Rect){0};
+}
+
+void render_batch_flush(Render_Batch *batch, const Render_State *render_state)
+{
+    if (batch->cmd_count > 0)
+    {
+        // Rotate through the chunks, so the driver doesn't have to wait for the previous draws to finish
+        int chunk_index = batch->next_chunk_index;
+        batch->next_chunk_index = (chunk_index + 1) % RENDER_BATCH_CHUNK_COUNT;
+        glBindVertexArray(batch->vaos[chunk_index]);
+        glBindBuffer(GL_ARRAY_BUFFER, batch->vbos[chunk_index]);
+        glBufferData(GL_ARRAY_BUFFER, RENDER_BATCH_CHUNK_VERTS * sizeof(Vert), NULL, GL_STREAM_DRAW); // Orphan existing buffer to stay on the fast path on mac
+        glBufferSubData(GL_ARRAY_BUFFER, 0, batch->vert_count * sizeof(batch->verts[0]), batch->verts);
+        batch->frame_stats.vert_upload_count++;
+        batch->frame_stats.vert_count += batch->vert_count;
+
+        GLuint bound_shader = 0;
+        GLuint bound_texture = 0;
+        int bound_mvp_index = -1;
+        bool is_scissor_enabled = false;
+        Rect bound_scissor_rect = {0};
+        for (int i = 0; i < batch->cmd_count; i++)
+        {
+            Render_Batch_Cmd *cmd = &batch->cmds[i];
+            if (cmd->mvp_index != bound_mvp_index)
+            {
+                glBindBuffer(GL_UNIFORM_BUFFER, render_state->mvp_ubo);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(m4), batch->mvps[cmd->mvp_index].d);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                bound_mvp_index = cmd->mvp_index;
+                batch->frame_stats.mvp_upload_count++;
+            }
+            if (cmd->shader != bound_shader)
+            {
+                glUseProgram(cmd->shader);
+                bound_shader = cmd->shader;
+            }
+            if (cmd->texture && cmd->texture != bound_texture)
+            {
+                glBindTexture(GL_TEXTURE_2D, cmd->texture);
+                bound_texture = cmd->texture;
+            }
+            if (cmd->has_scissor)
+            {
+                if (!is_scissor_enabled || memcmp(&cmd->scissor_rect, &bound_scissor_rect, sizeof(Rect)) != 0)
+                {
+                    gl_enable_scissor(cmd->scissor_rect, render_state);
+                    is_scissor_enabled = true;
+                    bound_scissor_rect = cmd->scissor_rect;
+                }
+            }
+            else if (is_scissor_enabled)
+            {
+                gl_disable_scissor();
+                is_scissor_enabled = false;
+            }
+            glDrawArrays(GL_TRIANGLES, cmd->first_vert, cmd->vert_count);
+            batch->frame_stats.draw_call_count++;
+        }
+        if (is_scissor_enabled) gl_disable_scissor();
+    }
+
+    batch->vert_count = 0;
+    batch->cmd_count = 0;
+    // Whatever transform and scissor are current carry over to the draws that come after the flush
+    if (batch->mvp_count > 0)
+    {
+        batch->mvps[0] = batch->mvps[batch->mvp_count - 1];
+        batch->mvp_count = 1;
+    }
+}
+
+void render_batch_end_frame(Render_Batch *batch, const Render_State *render_state)
+{
+    render_batch_flush(batch, render_state);
+    batch->last_frame_stats = batch->frame_stats;
+    batch->frame_stats = (Render_Batch_Stats){0};
+    batch->has_scissor = false;
+}
+
+static void renderer__push_quad(Rect q, float u0, float v0, float u1, float v1, Color c, GLuint shader, GLuint texture, const Render_State *render_state)
+{
+    Vert *v = render_batch_push_verts(render_state->batch, shader, texture, 6, render_state);
+    v[0] = make_vert(q.x,       q.y,       u0, v0, c);
+    v[1] = make_vert(q.x,       q.y + q.h, u0, v1, c);
+    v[2] = make_vert(q.x + q.w, q.y,       u1, v0, c);
+    v[3] = make_vert(q.x + q.w, q.y,       u1, v0, c);
+    v[4] = make_vert(q.x,       q.y + q.h, u0, v1, c);
+    v[5] = make_vert(q.x + q.w, q.y + q.h, u1, v1, c);
+}
 
 void draw_quad(Rect q, Color c, const Render_State *render_state)
 {
-    Vert_Buffer vert_buf = {0};
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y,       0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y + q.h, 0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y,       0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y,       0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y + q.h, 0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y + q.h, 0, 0, c));
-    glUseProgram(render_state->quad_shader);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vert_buf.vert_count * sizeof(vert_buf.verts[0]), vert_buf.verts);
-    glDrawArrays((GL_TRIANGLES), 0, vert_buf.vert_count);
+    renderer__push_quad(q, 0, 0, 0, 0, c, render_state->quad_shader, 0, render_state);
 }
 
 void draw_texture(GLuint texture, Rect q, Color c, const Render_State *render_state)
 {
-    Vert_Buffer vert_buf = {0};
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y,       0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y + q.h, 0, 1, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y,       1, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y,       1, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y + q.h, 0, 1, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y + q.h, 1, 1, c));
-    glUseProgram(render_state->tex_shader);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vert_buf.vert_count * sizeof(vert_buf.verts[0]), vert_buf.verts);
-    glDrawArrays((GL_TRIANGLES), 0, vert_buf.vert_count);
+    renderer__push_quad(q, 0, 0, 1, 1, c, render_state->tex_shader, texture, render_state);
+}
+
+void draw_flipped_texture(GLuint texture, Rect q, Color c, const Render_State *render_state)
+{
+    renderer__push_quad(q, 0, 0, 1, 1, c, render_state->flipped_quad_shader, texture, render_state);
 }
 
 void draw_string(const char *str, Render_Font font, f32 x, f32 y, Color c, const Render_State *render_state)
 {
-    // NOTE: Assumes glUseProgram(font_shader) is called outside
+    draw_string_len(str, strlen(str), font, x, y, c, render_state);
+}
+
+// Takes a length instead of a terminator, so text can be drawn straight out of a larger slice
+void draw_string_len(const char *str, int len, Render_Font font, f32 x, f32 y, Color c, const Render_State *render_state)
+{
+    // Font texture stays bound to unit 0, so glyphs don't need a texture bind
     y += font.ascent * font.i_dpi_scale;
-    Vert_Buffer vert_buf = {0};
-    while (*str)
+    const char *end = str + len;
+    while (str < end)
     {
-        if (*str >= 32)
+        // Push glyphs in runs that fit in a chunk, so long lines stream through as many chunks as they need
+        const int max_run_glyphs = RENDER_BATCH_CHUNK_VERTS / 6;
+        const char *run_end = str;
+        int run_glyphs = 0;
+        while (run_end < end && run_glyphs < max_run_glyphs)
+        {
+            if (*run_end >= 32) run_glyphs++;
+            run_end++;
+        }
+        if (run_glyphs == 0) break;
+
+        Vert *v = render_batch_push_verts(render_state->batch, render_state->font_shader, 0, run_glyphs * 6, render_state);
+        for (; str < run_end; str++)
         {
-            stbtt_aligned_quad q;
-            stbtt_GetBakedQuad(font.char_data, font.atlas_w, font.atlas_h, *str-32, &x, &y ,&q, 1, font.i_dpi_scale);
-            vert_buffer_add_vert(&vert_buf, make_vert(q.x0, q.y0, q.s0, q.t0, c));
-            vert_buffer_add_vert(&vert_buf, make_vert(q.x0, q.y1, q.s0, q.t1, c));
-            vert_buffer_add_vert(&vert_buf, make_vert(q.x1, q.y0, q.s1, q.t0, c));
-            vert_buffer_add_vert(&vert_buf, make_vert(q.x1, q.y0, q.s1, q.t0, c));
-            vert_buffer_add_vert(&vert_buf, make_vert(q.x0, q.y1, q.s0, q.t1, c));
-            vert_buffer_add_vert(&vert_buf, make_vert(q.x1, q.y1, q.s1, q.t1, c));
+            if (*str >= 32)
+            {
+                stbtt_aligned_quad q;
+                stbtt_GetBakedQuad(font.char_data, font.atlas_w, font.atlas_h, *str-32, &x, &y ,&q, 1, font.i_dpi_scale);
+                *v++ = make_vert(q.x0, q.y0, q.s0, q.t0, c);
+                *v++ = make_vert(q.x0, q.y1, q.s0, q.t1, c);
+                *v++ = make_vert(q.x1, q.y0, q.s1, q.t0, c);
+                *v++ = make_vert(q.x1, q.y0, q.s1, q.t0, c);
+                *v++ = make_vert(q.x0, q.y1, q.s0, q.t1, c);
+                *v++ = make_vert(q.x1, q.y1, q.s1, q.t1, c);
+            }
         }
-        str++;
     }
-    glBufferData(GL_ARRAY_BUFFER, VERT_MAX * sizeof(Vert), NULL, GL_DYNAMIC_DRAW); // Orphan existing buffer to stay on the fast path on mac
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vert_buf.vert_count * sizeof(vert_buf.verts[0]), vert_buf.verts);
-    glDrawArrays((GL_TRIANGLES), 0, vert_buf.vert_count);
-    glBindTexture(GL_TEXTURE_2D, render_state->white_texture);
 }
 
 void draw_grid(v2 offset, f32 spacing, const Render_State *render_state)
 {
+    // Grid is drawn once per frame, so its uniforms can be set right away
     glUseProgram(render_state->grid_shader);
     glUniform2f(render_state->grid_shader_resolution_loc, render_state->framebuffer_dim.x, render_state->framebuffer_dim.y);
     f32 scaled_offset_x = offset.x * render_state->dpi_scale;
@@ -70,14 +272,5 @@ void draw_grid(v2 offset, f32 spacing, const Render_State *render_state)
     glUniform1f(render_state->grid_shader_spacing_loc, spacing * render_state->dpi_scale);
 
     Rect q = {0, 0, render_state->window_dim.x, render_state->window_dim.y};
-    Color c = {0};
-    Vert_Buffer vert_buf = {0};
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y,       0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y + q.h, 0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y,       0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y,       0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x,       q.y + q.h, 0, 0, c));
-    vert_buffer_add_vert(&vert_buf, make_vert(q.x + q.w, q.y + q.h, 0, 0, c));
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vert_buf.vert_count * sizeof(vert_buf.verts[0]), vert_buf.verts);
-    glDrawArrays((GL_TRIANGLES), 0, vert_buf.vert_count);
+    renderer__push_quad(q, 0, 0, 0, 0, (Color){0}, render_state->grid_shader, 0, render_state);
 }
@@ -5,7 +5,19 @@
 #include "editor.h"
 #include "types.h"
 
+Render_Batch *render_batch_create();
+void render_batch_create_chunks(Render_Batch *batch);
+void render_batch_destroy(Render_Batch *batch);
+Vert *render_batch_push_verts(Render_Batch *batch, GLuint shader, GLuint texture, int vert_count, const Render_State *render_state);
+void render_batch_set_mvp(Render_Batch *batch, m4 mvp);
+void render_batch_set_scissor(Render_Batch *batch, Rect screen_rect);
+void render_batch_clear_scissor(Render_Batch *batch);
+void render_batch_flush(Render_Batch *batch, const Render_State *render_state);
+void render_batch_end_frame(Render_Batch *batch, const Render_State *render_state);
+
 void draw_quad(Rect q, Color c, const Render_State *render_state);
 void draw_texture(GLuint texture, Rect q, Color c, const Render_State *render_state);
+void draw_flipped_texture(GLuint texture, Rect q, Color c, const Render_State *render_state);
 void draw_string(const char *str, Render_Font font, f32 x, f32 y, Color c, const Render_State *render_state);
+void draw_string_len(const char *str, int len, Render_Font font, f32 x, f32 y, Color c, const Render_State *render_state);
 void draw_grid(v2 offset, f32 spacing, const Render_State *render_state);
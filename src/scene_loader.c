@@ -1,6 +1,5 @@
 #include "scene_loader.h"
 
-#include <dlfcn.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,6 +7,8 @@
 #include <sys/stat.h>
 #include <time.h>
 
+#include "module_loader.h"
+
 time_t scene_loader__get_file_timestamp(const char *path)
 {
     struct stat attr;
@@ -19,78 +20,19 @@ time_t scene_loader__get_file_timestamp(const char *path)
     return 0;
 }
 
-bool scene_loader__copy_file(const char *src, const char *dest)
-{
-    FILE *in = fopen(src, "rb");
-    if (!in)
-    {
-        fprintf(stderr, "[SCENE LOADER] scene_loader__copy_file: failed to open file for read at: %s\n", src);
-        return false;
-    }
-
-    FILE *out = fopen(dest, "wb");
-    if (!out)
-    {
-        fprintf(stderr, "[SCENE LOADER] scene_loader__copy_file: failed to open file for write at: %s\n", dest);
-        fclose(in);
-        return false;
-    }
-
-    char buf[4096];
-    size_t n;
-    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
-    {
-        fwrite(buf, 1, n, out);
-    }
-
-    fclose(in);
-    fclose(out);
-
-    printf("[SCENE LOADER] scene_loader__copy_file: copied file to %s\n", dest);
-    return true;
-}
-
-bool scene_loader__delete_file(const char *path)
-{
-    if (remove(path) == 0)
-    {
-        printf("[SCENE LOADER] scene_loader__delete_file: deleted file at %s\n", path);
-        return true;
-    }
-    else
-    {
-        fprintf(stderr,"[SCENE LOADER] scene_loader__delete_file: failed to deleted file at %s\n", path);
-        return false;
-    }
-}
-
 Scene_Dylib scene_loader_dylib_open(const char *path)
 {
-    const char *dot = strrchr(path, '.');
-    size_t base_len = dot - path;
-    time_t now = time(NULL);
-
-    char temp_path[256];
-    snprintf(temp_path, sizeof(temp_path), "%.*s_%ld.dylib", (int)base_len, path, now);
-    if (!scene_loader__copy_file(path, temp_path))
-    {
-        fprintf(stderr, "[SCENE LOADER] Failed to copy dylib from %s to %s\n", path, temp_path);
-        goto failed_open;
-    }
-
-
     Scene_Dylib dylib = {0};
-    dylib.handle = dlopen(temp_path, RTLD_NOW);
-    if (!dylib.handle)
+    if (!module_open(&dylib.module, path))
     {
-        fprintf(stderr, "[SCENE LOADER] Failed to open dylib: %s\n", temp_path);
-        goto failed_open;
+        fprintf(stderr, "[SCENE LOADER] Failed to open dylib: %s\n", path);
+        return (Scene_Dylib){0};
     }
 
-    #define X(NAME) dylib.NAME = dlsym(dylib.handle, #NAME); \
+    #define X(NAME) dylib.NAME = module_get_symbol(&dylib.module, #NAME); \
         if (!dylib.NAME) \
         { \
-            fprintf(stderr, "[SCENE LOADER] scene_loader_dylib_open: Failed to load symbol: '%s' in %s\n", #NAME, temp_path); \
+            fprintf(stderr, "[SCENE LOADER] scene_loader_dylib_open: Failed to load symbol: '%s' in %s\n", #NAME, path); \
             goto failed_open; \
         }
 
@@ -102,52 +44,55 @@ Scene_Dylib scene_loader_dylib_open(const char *path)
 
     #undef X
 
-    dylib.original_path = strdup(path);
-    dylib.copied_path = strdup(temp_path);
-    dylib.timestamp = scene_loader__get_file_timestamp(path);
-
-    printf("[SCENE LOADER] scene_loader_dylib_open: opened dylib at %s\n", temp_path);
+    dylib.get_next_frame_time = module_get_symbol(&dylib.module, "get_next_frame_time");
+    dylib.on_unload = module_get_symbol(&dylib.module, "on_unload");
 
     return dylib;
 
 failed_open:
-    if (dylib.handle) dlclose(dylib.handle);
-    scene_loader__delete_file(temp_path);
+    module_close(&dylib.module);
     return (Scene_Dylib){0};
 }
 
 void scene_loader_dylib_close(Scene_Dylib *scene_dylib)
 {
-    dlclose(scene_dylib->handle);
-    scene_loader__delete_file(scene_dylib->copied_path);
+    module_close(&scene_dylib->module);
+    *scene_dylib = (Scene_Dylib){0};
+}
 
-    printf("[SCENE LOADER] scene_loader_dylib_close: closed dylib at %s\n", scene_dylib->copied_path);
+bool scene_loader_dylib_reload(Scene_Dylib *scene_dylib, void *state)
+{
+    const char *path = scene_dylib->module.original_path;
 
-    free(scene_dylib->original_path);
-    free(scene_dylib->copied_path);
+    // Touched or rebuilt into the same bytes, the loaded image is still current
+    uint64_t content_hash;
+    if (module_hash_file(path, &content_hash) && content_hash == scene_dylib->module.content_hash)
+    {
+        scene_dylib->module.timestamp = scene_loader__get_file_timestamp(path);
+        return false;
+    }
 
-    *scene_dylib = (Scene_Dylib){0};
+    Scene_Dylib old_dylib = *scene_dylib;
+    *scene_dylib = scene_loader_dylib_open(path);
+    if (!scene_dylib->module.handle)
+    {
+        fprintf(stderr, "[SCENE LOADER] Failed to reload dylib at %s.\n", old_dylib.module.original_path);
+        *scene_dylib = old_dylib;
+        scene_dylib->module.timestamp = scene_loader__get_file_timestamp(old_dylib.module.original_path);
+        return false;
+    }
+    printf("[SCENE LOADER] Reloaded dylib at %s.\n", scene_dylib->module.original_path);
+    if (old_dylib.on_unload) old_dylib.on_unload(state);
+    scene_loader_dylib_close(&old_dylib);
+    return true;
 }
 
-bool scene_loader_dylib_check_and_hotreload(Scene_Dylib *scene_dylib)
+bool scene_loader_dylib_check_and_hotreload(Scene_Dylib *scene_dylib, void *state)
 {
-    time_t current_timestamp = scene_loader__get_file_timestamp(scene_dylib->original_path);
-    if (current_timestamp != 0 && current_timestamp != scene_dylib->timestamp)
+    time_t current_timestamp = scene_loader__get_file_timestamp(scene_dylib->module.original_path);
+    if (current_timestamp != 0 && current_timestamp != scene_dylib->module.timestamp)
     {
-        Scene_Dylib old_dylib = *scene_dylib;
-        *scene_dylib = scene_loader_dylib_open(old_dylib.original_path);
-        if (!scene_dylib->handle)
-        {
-            fprintf(stderr, "[SCENE LOADER] Failed to reload dylib at %s.\n", old_dylib.original_path);
-            *scene_dylib = old_dylib;
-            scene_dylib->timestamp = current_timestamp;
-        }
-        else
-        {
-            printf("[SCENE LOADER] Reloaded dylib at %s.\n", scene_dylib->original_path);
-            scene_loader_dylib_close(&old_dylib);
-            return true;
-        }
+        return scene_loader_dylib_reload(scene_dylib, state);
     }
     return false;
 }
@@ -7,6 +7,7 @@
 
 #include <GLFW/glfw3.h>
 
+#include "module_loader.h"
 #include "platform_types.h"
 
 // TODO: Pack all the data into a struct
@@ -15,23 +16,27 @@ typedef void (*scene_on_reload_t)(void *state);
 typedef void (*scene_on_render_t)(void *state, const Platform_Timing *t);
 typedef void (*scene_on_platform_event_t)(void *state, const Platform_Event *e);
 typedef void (*scene_on_destroy_t)(void *state);
+// Optional, returns the glfwGetTime() at which the scene wants its next frame.
+// Scenes that don't export it are redrawn every vsync.
+typedef double (*scene_get_next_frame_time_t)(void *state);
+// Optional, called on the old code right before a reload unmaps it.
+// Threads running scene code have to be stopped here.
+typedef void (*scene_on_unload_t)(void *state);
 
 typedef struct Scene_Dylib {
-    void *handle;
-    char *original_path;
-    char *copied_path;
-    time_t timestamp;
+    Module module;
     scene_on_init_t on_init;
     scene_on_reload_t on_reload;
     scene_on_render_t on_frame;
     scene_on_platform_event_t on_platform_event;
     scene_on_destroy_t on_destroy;
+    scene_get_next_frame_time_t get_next_frame_time;
+    scene_on_unload_t on_unload;
 } Scene_Dylib;
 
 time_t scene_loader__get_file_timestamp(const char *path);
-bool scene_loader__copy_file(const char *src, const char *dest);
-bool scene_loader__delete_file(const char *path);
 
 Scene_Dylib scene_loader_dylib_open(const char *path);
 void scene_loader_dylib_close(Scene_Dylib *scene_dylib);
-bool scene_loader_dylib_check_and_hotreload(Scene_Dylib *scene_dylib);
+bool scene_loader_dylib_reload(Scene_Dylib *scene_dylib, void *state);
+bool scene_loader_dylib_check_and_hotreload(Scene_Dylib *scene_dylib, void *state);
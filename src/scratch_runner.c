@@ -1,12 +1,20 @@
 #include "scratch_runner.h"
 
-#include <dlfcn.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+
+extern char **environ;
 
 time_t scratch_runner__get_file_timestamp(const char *path)
 {
@@ -19,37 +27,6 @@ time_t scratch_runner__get_file_timestamp(const char *path)
     return 0;
 }
 
-bool scratch_runner__copy_file(const char *src, const char *dest)
-{
-    FILE *in = fopen(src, "rb");
-    if (!in)
-    {
-        fprintf(stderr, "[SCRATCH RUNNER] scratch_runner__copy_file: failed to open file for read at: %s\n", src);
-        return false;
-    }
-
-    FILE *out = fopen(dest, "wb");
-    if (!out)
-    {
-        fprintf(stderr, "[SCRATCH RUNNER] scratch_runner__copy_file: failed to open file for write at: %s\n", dest);
-        fclose(in);
-        return false;
-    }
-
-    char buf[4096];
-    size_t n;
-    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
-    {
-        fwrite(buf, 1, n, out);
-    }
-
-    fclose(in);
-    fclose(out);
-
-    printf("[SCRATCH RUNNER] scratch_runner__copy_file: copied file to %s\n", dest);
-    return true;
-}
-
 bool scratch_runner__delete_file(const char *path)
 {
     if (remove(path) == 0)
@@ -64,63 +41,172 @@ bool scratch_runner__delete_file(const char *path)
     }
 }
 
-Scratch_Dylib scratch_runner_dylib_open(const char *path)
+static void scratch_build__append_output(Scratch_Build *build, const char *data, size_t len)
 {
-    const char *dot = strrchr(path, '.');
-    size_t base_len = dot - path;
-    time_t now = time(NULL);
-
-    char temp_path[256];
-    snprintf(temp_path, sizeof(temp_path), "%.*s_%ld.dylib", (int)base_len, path, now);
-    if (!scratch_runner__copy_file(path, temp_path))
+    pthread_mutex_lock(&build->mutex);
+    if (build->output_len + len + 1 > build->output_cap)
     {
-        fprintf(stderr, "[SCRATCH RUNNER] Failed to copy dylib from %s to %s\n", path, temp_path);
-        goto failed_open;
+        while (build->output_len + len + 1 > build->output_cap)
+        {
+            build->output_cap = build->output_cap ? build->output_cap * 2 : 4096;
+        }
+        build->output = xrealloc(build->output, build->output_cap);
     }
+    memcpy(build->output + build->output_len, data, len);
+    build->output_len += len;
+    build->output[build->output_len] = '\0';
+    pthread_mutex_unlock(&build->mutex);
+}
+
+static void scratch_build__finish(Scratch_Build *build, int exit_code)
+{
+    pthread_mutex_lock(&build->mutex);
+    build->exit_code = exit_code;
+    build->is_finished = true;
+    pthread_mutex_unlock(&build->mutex);
+}
 
+static void *scratch_build__run(void *arg)
+{
+    Scratch_Build *build = arg;
 
-    Scratch_Dylib dylib = {0};
-    dylib.handle = dlopen(temp_path, RTLD_NOW);
-    if (!dylib.handle)
+    int fds[2];
+    if (pipe(fds) != 0)
     {
-        fprintf(stderr, "[SCRATCH RUNNER] Failed to open dylib: %s\n", temp_path);
-        goto failed_open;
+        fprintf(stderr, "[SCRATCH RUNNER] scratch_build__run: failed to create pipe: %s\n", strerror(errno));
+        scratch_build__finish(build, -1);
+        return NULL;
     }
 
-    #define X(NAME) dylib.NAME = dlsym(dylib.handle, #NAME); \
-        if (!dylib.NAME) \
-        { \
-            fprintf(stderr, "[SCRATCH RUNNER] scratch_runner_dylib_open: Failed to load symbol: '%s' in %s\n", #NAME, temp_path); \
-            goto failed_open; \
-        }
-
-    X(on_run);
-
-    #undef X
+    // Both streams go into one pipe, so warnings and errors stay in the order clang printed them
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+    // Own process group, so cancelling also stops whatever the shell and the driver started
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+
+    char *argv[] = { "sh", "-c", build->command, NULL };
+    pid_t pid;
+    int spawn_error = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(fds[1]);
+
+    if (spawn_error != 0)
+    {
+        fprintf(stderr, "[SCRATCH RUNNER] scratch_build__run: failed to spawn compile: %s\n", strerror(spawn_error));
+        close(fds[0]);
+        scratch_build__finish(build, -1);
+        return NULL;
+    }
 
-    dylib.original_path = strdup(path);
-    dylib.copied_path = strdup(temp_path);
-    dylib.timestamp = scratch_runner__get_file_timestamp(path);
+    pthread_mutex_lock(&build->mutex);
+    build->pid = pid;
+    if (build->is_cancelled) kill(-pid, SIGTERM);
+    pthread_mutex_unlock(&build->mutex);
 
-    printf("[SCRATCH RUNNER] scratch_runner_dylib_open: opened dylib at %s\n", temp_path);
+    char buf[4096];
+    for (;;)
+    {
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        if (n > 0) scratch_build__append_output(build, buf, (size_t)n);
+        else if (n == 0 || errno != EINTR) break;
+    }
+    close(fds[0]);
+
+    // Wait without reaping first, the pid must not be reused while cancel may still signal it
+    siginfo_t info;
+    while (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOWAIT) != 0 && errno == EINTR) {}
+    pthread_mutex_lock(&build->mutex);
+    build->pid = 0;
+    pthread_mutex_unlock(&build->mutex);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    if (exit_code == 0 && rename(build->out_path, build->dylib_path) != 0)
+    {
+        fprintf(stderr, "[SCRATCH RUNNER] scratch_build__run: failed to move %s to %s: %s\n", build->out_path, build->dylib_path, strerror(errno));
+        exit_code = -1;
+    }
+    scratch_build__finish(build, exit_code);
+    return NULL;
+}
 
-    return dylib;
+Scratch_Build *scratch_build_start(const char *command, const char *src_path, const char *out_path, const char *dylib_path)
+{
+    Scratch_Build *build = xcalloc(sizeof(*build));
+    pthread_mutex_init(&build->mutex, NULL);
+    build->command = xstrdup(command);
+    build->src_path = xstrdup(src_path);
+    build->out_path = xstrdup(out_path);
+    build->dylib_path = xstrdup(dylib_path);
+    if (pthread_create(&build->thread, NULL, scratch_build__run, build) != 0)
+    {
+        fprintf(stderr, "[SCRATCH RUNNER] scratch_build_start: failed to create build thread\n");
+        pthread_mutex_destroy(&build->mutex);
+        free(build->command);
+        free(build->src_path);
+        free(build->out_path);
+        free(build->dylib_path);
+        free(build);
+        return NULL;
+    }
+    return build;
+}
 
-failed_open:
-    if (dylib.handle) dlclose(dylib.handle);
-    scratch_runner__delete_file(temp_path);
-    return (Scratch_Dylib){0};
+void scratch_build_cancel(Scratch_Build *build)
+{
+    pthread_mutex_lock(&build->mutex);
+    build->is_cancelled = true;
+    if (build->pid > 0) kill(-build->pid, SIGTERM);
+    pthread_mutex_unlock(&build->mutex);
 }
 
-void scratch_runner_dylib_close(Scratch_Dylib *dylib)
+char *scratch_build_take_output(Scratch_Build *build)
 {
-    dlclose(dylib->handle);
-    scratch_runner__delete_file(dylib->copied_path);
+    char *output = NULL;
+    pthread_mutex_lock(&build->mutex);
+    if (build->output_len > 0)
+    {
+        output = xstrndup(build->output, build->output_len);
+        build->output_len = 0;
+    }
+    pthread_mutex_unlock(&build->mutex);
+    return output;
+}
 
-    printf("[SCRATCH RUNNER] scratch_runner_dylib_close: closed dylib at %s\n", dylib->copied_path);
+bool scratch_build_is_finished(Scratch_Build *build, int *out_exit_code)
+{
+    pthread_mutex_lock(&build->mutex);
+    bool is_finished = build->is_finished;
+    if (is_finished && out_exit_code) *out_exit_code = build->exit_code;
+    pthread_mutex_unlock(&build->mutex);
+    return is_finished;
+}
 
-    free(dylib->original_path);
-    free(dylib->copied_path);
+void scratch_build_destroy(Scratch_Build *build)
+{
+    scratch_build_cancel(build);
+    pthread_join(build->thread, NULL);
+    pthread_mutex_destroy(&build->mutex);
 
-    *dylib = (Scratch_Dylib){0};
+    // Compile is gone by now, so nothing writes these after they're deleted
+    scratch_runner__delete_file(build->src_path);
+    struct stat attr;
+    if (stat(build->out_path, &attr) == 0) scratch_runner__delete_file(build->out_path);
+
+    free(build->command);
+    free(build->src_path);
+    free(build->out_path);
+    free(build->dylib_path);
+    free(build->output);
+    free(build);
 }
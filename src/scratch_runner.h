@@ -1,20 +1,41 @@
 #pragma once
 
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
 #include <time.h>
 
 typedef void (*scratch_on_run_t)(void *state);
 
-typedef struct {
-    void *handle;
-    char *original_path;
-    char *copied_path;
-    time_t timestamp;
-    scratch_on_run_t on_run;
-} Scratch_Dylib;
+// Compile command running as a child process, driven by a worker thread that
+// collects its stdout/stderr. The main thread takes the output as it arrives
+// and checks for the exit code, so the editor keeps drawing while clang runs.
+// The compile writes to out_path, which is moved to dylib_path only if it succeeds,
+// so a cancelled or failed build never leaves a half written dylib behind.
+// A build owns its source and out_path and deletes them when destroyed.
+// The worker runs code from the editor dylib, builds are discarded in on_unload.
+typedef struct Scratch_Build {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    char *command;
+    char *src_path;
+    char *out_path;
+    char *dylib_path;
+    // Guarded by mutex
+    pid_t pid; // Process group of the compile, 0 before spawn and once it has exited
+    bool is_cancelled;
+    bool is_finished;
+    int exit_code; // -1 if it couldn't be spawned or was killed
+    char *output; // Arrived since the last scratch_build_take_output
+    size_t output_len;
+    size_t output_cap;
+} Scratch_Build;
 
 time_t scratch_runner__get_file_timestamp(const char *path);
-bool scratch_runner__copy_file(const char *src, const char *dest);
 bool scratch_runner__delete_file(const char *path);
-Scratch_Dylib scratch_runner_dylib_open(const char *path);
-void scratch_runner_dylib_close(Scratch_Dylib *dylib);
+Scratch_Build *scratch_build_start(const char *command, const char *src_path, const char *out_path, const char *dylib_path);
+void scratch_build_cancel(Scratch_Build *build);
+char *scratch_build_take_output(Scratch_Build *build);
+bool scratch_build_is_finished(Scratch_Build *build, int *out_exit_code);
+void scratch_build_destroy(Scratch_Build *build);
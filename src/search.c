@@ -0,0 +1,273 @@
+#include "search.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SEARCH_VECTOR_WIDTH 32
+#define SEARCH_BITS_PER_BYTE 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SEARCH_VECTOR_WIDTH 16
+#define SEARCH_BITS_PER_BYTE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SEARCH_VECTOR_WIDTH 16
+#define SEARCH_BITS_PER_BYTE 4
+#else
+#define SEARCH_VECTOR_WIDTH 0
+#endif
+
+#include "util.h"
+
+static inline unsigned char search__fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+static inline bool search__is_letter(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+Search_Pattern search_pattern_create(const char *needle, bool ignore_case)
+{
+    Search_Pattern pattern = {0};
+    pattern.len = (int)strlen(needle);
+    pattern.needle = xmalloc(pattern.len + 1);
+    pattern.ignore_case = ignore_case;
+    pattern.newline_offset = -1;
+    for (int i = 0; i <= pattern.len; i++)
+    {
+        unsigned char c = (unsigned char)needle[i];
+        pattern.needle[i] = ignore_case ? search__fold(c) : c;
+        if (c == '\n' && pattern.newline_offset < 0) pattern.newline_offset = i;
+    }
+    if (pattern.len == 0) return pattern;
+
+    pattern.first = (unsigned char)pattern.needle[0];
+    pattern.last = (unsigned char)pattern.needle[pattern.len - 1];
+    pattern.first_fold = ignore_case && search__is_letter(pattern.first) ? 0x20 : 0;
+    pattern.last_fold = ignore_case && search__is_letter(pattern.last) ? 0x20 : 0;
+
+    for (int c = 0; c < 256; c++)
+    {
+        pattern.skip_forward[c] = pattern.len;
+        pattern.skip_backward[c] = pattern.len;
+    }
+    for (int i = 0; i < pattern.len - 1; i++)
+    {
+        unsigned char c = (unsigned char)pattern.needle[i];
+        pattern.skip_forward[c] = pattern.len - 1 - i;
+        if (ignore_case && search__is_letter(c)) pattern.skip_forward[c & ~0x20] = pattern.len - 1 - i;
+    }
+    for (int i = pattern.len - 1; i > 0; i--)
+    {
+        unsigned char c = (unsigned char)pattern.needle[i];
+        pattern.skip_backward[c] = i;
+        if (ignore_case && search__is_letter(c)) pattern.skip_backward[c & ~0x20] = i;
+    }
+    return pattern;
+}
+
+void search_pattern_destroy(Search_Pattern *pattern)
+{
+    free(pattern->needle);
+    *pattern = (Search_Pattern){0};
+}
+
+// Compares size bytes of data against the needle starting at needle_offset
+bool search_pattern_matches_at(const Search_Pattern *pattern, int needle_offset, const char *data, size_t size)
+{
+    bassert(needle_offset >= 0 && needle_offset + size <= (size_t)pattern->len);
+    const char *needle = pattern->needle + needle_offset;
+    if (!pattern->ignore_case) return memcmp(needle, data, size) == 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (search__fold((unsigned char)data[i]) != (unsigned char)needle[i]) return false;
+    }
+    return true;
+}
+
+static inline bool search__is_candidate(const Search_Pattern *pattern, const char *at)
+{
+    return ((unsigned char)at[0] | pattern->first_fold) == pattern->first &&
+           ((unsigned char)at[pattern->len - 1] | pattern->last_fold) == pattern->last;
+}
+
+#if SEARCH_VECTOR_WIDTH
+// One bit group per position in [at, at + SEARCH_VECTOR_WIDTH) whose first and last byte fit the needle
+static inline uint64_t search__candidates(const Search_Pattern *pattern, const char *at)
+{
+    const char *at_last = at + pattern->len - 1;
+#if defined(__AVX2__)
+    __m256i first = _mm256_cmpeq_epi8(
+        _mm256_or_si256(_mm256_loadu_si256((const __m256i *)at), _mm256_set1_epi8((char)pattern->first_fold)),
+        _mm256_set1_epi8((char)pattern->first));
+    __m256i last = _mm256_cmpeq_epi8(
+        _mm256_or_si256(_mm256_loadu_si256((const __m256i *)at_last), _mm256_set1_epi8((char)pattern->last_fold)),
+        _mm256_set1_epi8((char)pattern->last));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(first, last));
+#elif defined(__SSE2__)
+    __m128i first = _mm_cmpeq_epi8(
+        _mm_or_si128(_mm_loadu_si128((const __m128i *)at), _mm_set1_epi8((char)pattern->first_fold)),
+        _mm_set1_epi8((char)pattern->first));
+    __m128i last = _mm_cmpeq_epi8(
+        _mm_or_si128(_mm_loadu_si128((const __m128i *)at_last), _mm_set1_epi8((char)pattern->last_fold)),
+        _mm_set1_epi8((char)pattern->last));
+    return (uint32_t)_mm_movemask_epi8(_mm_and_si128(first, last));
+#else
+    uint8x16_t first = vceqq_u8(
+        vorrq_u8(vld1q_u8((const uint8_t *)at), vdupq_n_u8(pattern->first_fold)),
+        vdupq_n_u8(pattern->first));
+    uint8x16_t last = vceqq_u8(
+        vorrq_u8(vld1q_u8((const uint8_t *)at_last), vdupq_n_u8(pattern->last_fold)),
+        vdupq_n_u8(pattern->last));
+    // No movemask on NEON, narrowing leaves a nibble per byte
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(vandq_u8(first, last)), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x8888888888888888ull;
+#endif
+}
+#endif
+
+static const char *search__horspool_forward(const Search_Pattern *pattern, const char *data, size_t size)
+{
+    size_t last_start = size - pattern->len;
+    size_t pos = 0;
+    while (pos <= last_start)
+    {
+        unsigned char c = (unsigned char)data[pos + pattern->len - 1];
+        if ((c | pattern->last_fold) == pattern->last && search_pattern_matches_at(pattern, 0, data + pos, pattern->len))
+        {
+            return data + pos;
+        }
+        pos += pattern->skip_forward[c];
+    }
+    return NULL;
+}
+
+static const char *search__horspool_backward(const Search_Pattern *pattern, const char *data, size_t size)
+{
+    ptrdiff_t pos = (ptrdiff_t)(size - pattern->len);
+    while (pos >= 0)
+    {
+        unsigned char c = (unsigned char)data[pos];
+        if ((c | pattern->first_fold) == pattern->first && search_pattern_matches_at(pattern, 0, data + pos, pattern->len))
+        {
+            return data + pos;
+        }
+        pos -= pattern->skip_backward[c];
+    }
+    return NULL;
+}
+
+// First match in data, NULL if there is none
+const char *search_forward(const Search_Pattern *pattern, const char *data, size_t size)
+{
+    if (pattern->len == 0 || size < (size_t)pattern->len) return NULL;
+    if (pattern->len >= SEARCH_HORSPOOL_MIN_LEN) return search__horspool_forward(pattern, data, size);
+
+    size_t last_start = size - pattern->len;
+    size_t pos = 0;
+#if SEARCH_VECTOR_WIDTH
+    // Candidates are rare, so blocks are taken four at a time with a single branch for all of them
+    for (; pos + 4 * SEARCH_VECTOR_WIDTH - 1 <= last_start; pos += 4 * SEARCH_VECTOR_WIDTH)
+    {
+        uint64_t masks[4] = {
+            search__candidates(pattern, data + pos),
+            search__candidates(pattern, data + pos + SEARCH_VECTOR_WIDTH),
+            search__candidates(pattern, data + pos + 2 * SEARCH_VECTOR_WIDTH),
+            search__candidates(pattern, data + pos + 3 * SEARCH_VECTOR_WIDTH),
+        };
+        if (!(masks[0] | masks[1] | masks[2] | masks[3])) continue;
+        for (int block = 0; block < 4; block++)
+        {
+            uint64_t mask = masks[block];
+            while (mask)
+            {
+                const char *at = data + pos + block * SEARCH_VECTOR_WIDTH + __builtin_ctzll(mask) / SEARCH_BITS_PER_BYTE;
+                if (search_pattern_matches_at(pattern, 0, at, pattern->len)) return at;
+                mask &= mask - 1;
+            }
+        }
+    }
+    // Both loads of a block stay inside data as long as its last position can still start a match
+    for (; pos + SEARCH_VECTOR_WIDTH - 1 <= last_start; pos += SEARCH_VECTOR_WIDTH)
+    {
+        uint64_t mask = search__candidates(pattern, data + pos);
+        while (mask)
+        {
+            const char *at = data + pos + __builtin_ctzll(mask) / SEARCH_BITS_PER_BYTE;
+            if (search_pattern_matches_at(pattern, 0, at, pattern->len)) return at;
+            mask &= mask - 1;
+        }
+    }
+    // Rest done by one block ending at the last start, minus the positions already tested
+    if (pos <= last_start && last_start + 1 >= SEARCH_VECTOR_WIDTH)
+    {
+        size_t block = last_start + 1 - SEARCH_VECTOR_WIDTH;
+        uint64_t mask = search__candidates(pattern, data + block) >> ((pos - block) * SEARCH_BITS_PER_BYTE);
+        while (mask)
+        {
+            const char *at = data + pos + __builtin_ctzll(mask) / SEARCH_BITS_PER_BYTE;
+            if (search_pattern_matches_at(pattern, 0, at, pattern->len)) return at;
+            mask &= mask - 1;
+        }
+        return NULL;
+    }
+#endif
+    for (; pos <= last_start; pos++)
+    {
+        if (search__is_candidate(pattern, data + pos) && search_pattern_matches_at(pattern, 0, data + pos, pattern->len))
+        {
+            return data + pos;
+        }
+    }
+    return NULL;
+}
+
+// Last match in data, NULL if there is none
+const char *search_backward(const Search_Pattern *pattern, const char *data, size_t size)
+{
+    if (pattern->len == 0 || size < (size_t)pattern->len) return NULL;
+    if (pattern->len >= SEARCH_HORSPOOL_MIN_LEN) return search__horspool_backward(pattern, data, size);
+
+    // Blocks are taken from the end, the head that doesn't fill one is done by hand
+    ptrdiff_t end = (ptrdiff_t)(size - pattern->len) + 1;
+#if SEARCH_VECTOR_WIDTH
+    for (; end >= SEARCH_VECTOR_WIDTH; end -= SEARCH_VECTOR_WIDTH)
+    {
+        const char *block = data + end - SEARCH_VECTOR_WIDTH;
+        uint64_t mask = search__candidates(pattern, block);
+        while (mask)
+        {
+            int bit = 63 - __builtin_clzll(mask);
+            const char *at = block + bit / SEARCH_BITS_PER_BYTE;
+            if (search_pattern_matches_at(pattern, 0, at, pattern->len)) return at;
+            mask &= ~(1ull << bit);
+        }
+    }
+    if (end > 0 && size - pattern->len + 1 >= SEARCH_VECTOR_WIDTH)
+    {
+        // Same for the head, a block starting at 0 with the positions from end on cut off
+        uint64_t mask = search__candidates(pattern, data) & ((1ull << (end * SEARCH_BITS_PER_BYTE)) - 1);
+        while (mask)
+        {
+            int bit = 63 - __builtin_clzll(mask);
+            const char *at = data + bit / SEARCH_BITS_PER_BYTE;
+            if (search_pattern_matches_at(pattern, 0, at, pattern->len)) return at;
+            mask &= ~(1ull << bit);
+        }
+        return NULL;
+    }
+#endif
+    for (ptrdiff_t pos = end - 1; pos >= 0; pos--)
+    {
+        if (search__is_candidate(pattern, data + pos) && search_pattern_matches_at(pattern, 0, data + pos, pattern->len))
+        {
+            return data + pos;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SEARCH_HORSPOOL_MIN_LEN 32 // From this needle length on, skipping beats testing every position
+
+// Substring search over raw bytes. Candidates are found by comparing the
+// needle's first and last byte against a whole vector of positions at once,
+// only those get the full compare. Long needles use Horspool instead, which
+// can skip ahead up to the needle length per step.
+//
+// Case folding is ASCII only, the needle is stored lowercased.
+typedef struct Search_Pattern {
+    char *needle;
+    int len;
+    bool ignore_case;
+    int newline_offset; // Index of the first '\n' in the needle, -1 if it has none
+    unsigned char first, last;
+    unsigned char first_fold, last_fold; // OR-ed into a byte before comparing, 0x20 for letters when ignoring case
+    int skip_forward[256]; // Horspool shifts keyed by the byte under the needle's last position
+    int skip_backward[256]; // Same, keyed by the byte under the first position when searching backwards
+} Search_Pattern;
+
+Search_Pattern search_pattern_create(const char *needle, bool ignore_case);
+void search_pattern_destroy(Search_Pattern *pattern);
+bool search_pattern_matches_at(const Search_Pattern *pattern, int needle_offset, const char *data, size_t size);
+
+const char *search_forward(const Search_Pattern *pattern, const char *data, size_t size);
+const char *search_backward(const Search_Pattern *pattern, const char *data, size_t size);
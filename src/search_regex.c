@@ -0,0 +1,873 @@
+#include "search_regex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#define SEARCH_REGEX_AT_BOL 1
+#define SEARCH_REGEX_AT_EOL 2
+
+typedef enum Search_Regex_Node_Kind {
+    SEARCH_REGEX_NODE_EMPTY,
+    SEARCH_REGEX_NODE_CLASS,
+    SEARCH_REGEX_NODE_BOL,
+    SEARCH_REGEX_NODE_EOL,
+    SEARCH_REGEX_NODE_CONCAT,
+    SEARCH_REGEX_NODE_ALT,
+    SEARCH_REGEX_NODE_REPEAT
+} Search_Regex_Node_Kind;
+
+typedef struct Search_Regex_Node {
+    Search_Regex_Node_Kind kind;
+    int left, right; // Children, REPEAT only has left
+    int class_index;
+    int min, max; // Repeat bounds, max -1 for unbounded
+} Search_Regex_Node;
+
+typedef struct Search_Regex_Parser {
+    const char *pattern;
+    int pos;
+    bool ignore_case;
+    Search_Regex *regex;
+    Search_Regex_Node *nodes;
+    int node_count;
+    int node_cap;
+    char *error;
+    int error_size;
+    bool failed;
+} Search_Regex_Parser;
+
+static int search_regex__fail(Search_Regex_Parser *p, const char *message)
+{
+    if (!p->failed && p->error_size > 0) snprintf(p->error, p->error_size, "%s at offset %d", message, p->pos);
+    p->failed = true;
+    return -1;
+}
+
+static int search_regex__add_node(Search_Regex_Parser *p, Search_Regex_Node node)
+{
+    if (p->node_count >= p->node_cap)
+    {
+        p->node_cap = p->node_cap ? p->node_cap * 2 : 32;
+        p->nodes = xrealloc(p->nodes, p->node_cap * sizeof(p->nodes[0]));
+    }
+    p->nodes[p->node_count] = node;
+    return p->node_count++;
+}
+
+static inline void search_regex__class_set(uint8_t *class, int c)
+{
+    class[c >> 3] |= (uint8_t)(1 << (c & 7));
+}
+
+static inline bool search_regex__class_has(const uint8_t *class, int c)
+{
+    return (class[c >> 3] >> (c & 7)) & 1;
+}
+
+static int search_regex__add_class(Search_Regex_Parser *p, const uint8_t *class)
+{
+    Search_Regex *regex = p->regex;
+    regex->classes = xrealloc(regex->classes, (regex->class_count + 1) * sizeof(regex->classes[0]));
+    memcpy(regex->classes[regex->class_count], class, 32);
+    uint8_t *added = regex->classes[regex->class_count];
+    if (p->ignore_case)
+    {
+        for (int c = 'a'; c <= 'z'; c++)
+        {
+            if (search_regex__class_has(added, c) || search_regex__class_has(added, c - 0x20))
+            {
+                search_regex__class_set(added, c);
+                search_regex__class_set(added, c - 0x20);
+            }
+        }
+    }
+    int class_index = regex->class_count++;
+    return search_regex__add_node(p, (Search_Regex_Node){.kind = SEARCH_REGEX_NODE_CLASS, .class_index = class_index});
+}
+
+// \d \w \s and their negations, false for anything else
+static bool search_regex__shorthand_class(char c, uint8_t *class)
+{
+    uint8_t set[32] = {0};
+    char lower = c | 0x20;
+    if (lower == 'd')
+    {
+        for (int i = '0'; i <= '9'; i++) search_regex__class_set(set, i);
+    }
+    else if (lower == 'w')
+    {
+        for (int i = '0'; i <= '9'; i++) search_regex__class_set(set, i);
+        for (int i = 'a'; i <= 'z'; i++) search_regex__class_set(set, i);
+        for (int i = 'A'; i <= 'Z'; i++) search_regex__class_set(set, i);
+        search_regex__class_set(set, '_');
+    }
+    else if (lower == 's')
+    {
+        const char *spaces = " \t\n\r\f\v";
+        for (const char *s = spaces; *s; s++) search_regex__class_set(set, *s);
+    }
+    else
+    {
+        return false;
+    }
+    bool is_negated = c != lower;
+    for (int i = 0; i < 32; i++) class[i] |= is_negated ? (uint8_t)~set[i] : set[i];
+    return true;
+}
+
+// Byte an escape stands for, -1 if it is not a single byte
+static int search_regex__escaped_byte(char c)
+{
+    switch (c)
+    {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) return -1;
+    return (unsigned char)c;
+}
+
+static int search_regex__parse_class(Search_Regex_Parser *p)
+{
+    uint8_t class[32] = {0};
+    bool is_negated = false;
+    if (p->pattern[p->pos] == '^')
+    {
+        is_negated = true;
+        p->pos++;
+    }
+    bool is_first = true;
+    while (p->pattern[p->pos] != ']' || is_first)
+    {
+        is_first = false;
+        char c = p->pattern[p->pos];
+        if (c == '\0') return search_regex__fail(p, "Missing ]");
+        p->pos++;
+        int lo = (unsigned char)c;
+        if (c == '\\')
+        {
+            char e = p->pattern[p->pos];
+            if (e == '\0') return search_regex__fail(p, "Trailing \\");
+            p->pos++;
+            if (search_regex__shorthand_class(e, class)) continue;
+            lo = search_regex__escaped_byte(e);
+            if (lo < 0) return search_regex__fail(p, "Unknown escape");
+        }
+        int hi = lo;
+        if (p->pattern[p->pos] == '-' && p->pattern[p->pos + 1] != ']' && p->pattern[p->pos + 1] != '\0')
+        {
+            p->pos++;
+            char h = p->pattern[p->pos++];
+            hi = (unsigned char)h;
+            if (h == '\\')
+            {
+                hi = p->pattern[p->pos] ? search_regex__escaped_byte(p->pattern[p->pos++]) : -1;
+                if (hi < 0) return search_regex__fail(p, "Bad range end");
+            }
+            if (hi < lo) return search_regex__fail(p, "Reversed range");
+        }
+        for (int i = lo; i <= hi; i++) search_regex__class_set(class, i);
+    }
+    p->pos++;
+    if (is_negated)
+    {
+        for (int i = 0; i < 32; i++) class[i] = (uint8_t)~class[i];
+    }
+    return search_regex__add_class(p, class);
+}
+
+static int search_regex__parse_alt(Search_Regex_Parser *p);
+
+static int search_regex__parse_atom(Search_Regex_Parser *p)
+{
+    char c = p->pattern[p->pos];
+    uint8_t class[32] = {0};
+    switch (c)
+    {
+        case '(':
+        {
+            p->pos++;
+            int inner = search_regex__parse_alt(p);
+            if (p->failed) return -1;
+            if (p->pattern[p->pos] != ')') return search_regex__fail(p, "Missing )");
+            p->pos++;
+            return inner;
+        }
+        case '[':
+        {
+            p->pos++;
+            return search_regex__parse_class(p);
+        }
+        case '.':
+        {
+            p->pos++;
+            memset(class, 0xff, sizeof(class));
+            return search_regex__add_class(p, class);
+        }
+        case '^':
+        {
+            p->pos++;
+            return search_regex__add_node(p, (Search_Regex_Node){.kind = SEARCH_REGEX_NODE_BOL});
+        }
+        case '$':
+        {
+            p->pos++;
+            return search_regex__add_node(p, (Search_Regex_Node){.kind = SEARCH_REGEX_NODE_EOL});
+        }
+        case '*': case '+': case '?': case '{':
+        {
+            return search_regex__fail(p, "Nothing to repeat");
+        }
+        case '\\':
+        {
+            p->pos++;
+            char e = p->pattern[p->pos];
+            if (e == '\0') return search_regex__fail(p, "Trailing \\");
+            p->pos++;
+            if (search_regex__shorthand_class(e, class)) return search_regex__add_class(p, class);
+            int b = search_regex__escaped_byte(e);
+            if (b < 0) return search_regex__fail(p, "Unknown escape");
+            search_regex__class_set(class, b);
+            return search_regex__add_class(p, class);
+        }
+    }
+    p->pos++;
+    search_regex__class_set(class, (unsigned char)c);
+    return search_regex__add_class(p, class);
+}
+
+static bool search_regex__parse_count(Search_Regex_Parser *p, int *out)
+{
+    if (p->pattern[p->pos] < '0' || p->pattern[p->pos] > '9') return false;
+    int n = 0;
+    while (p->pattern[p->pos] >= '0' && p->pattern[p->pos] <= '9')
+    {
+        n = n * 10 + (p->pattern[p->pos++] - '0');
+        if (n > SEARCH_REGEX_MAX_REPEAT) n = SEARCH_REGEX_MAX_REPEAT + 1;
+    }
+    *out = n;
+    return true;
+}
+
+static int search_regex__parse_repeat(Search_Regex_Parser *p)
+{
+    int node = search_regex__parse_atom(p);
+    while (!p->failed)
+    {
+        int min, max;
+        char c = p->pattern[p->pos];
+        if (c == '*') { min = 0; max = -1; }
+        else if (c == '+') { min = 1; max = -1; }
+        else if (c == '?') { min = 0; max = 1; }
+        else if (c == '{')
+        {
+            p->pos++;
+            if (!search_regex__parse_count(p, &min)) return search_regex__fail(p, "Bad repeat count");
+            max = min;
+            if (p->pattern[p->pos] == ',')
+            {
+                p->pos++;
+                max = -1;
+                if (p->pattern[p->pos] != '}' && !search_regex__parse_count(p, &max)) return search_regex__fail(p, "Bad repeat count");
+            }
+            if (p->pattern[p->pos] != '}') return search_regex__fail(p, "Missing }");
+            if (min > SEARCH_REGEX_MAX_REPEAT || max > SEARCH_REGEX_MAX_REPEAT) return search_regex__fail(p, "Repeat count too large");
+            if (max >= 0 && max < min) return search_regex__fail(p, "Reversed repeat count");
+        }
+        else break;
+        p->pos++;
+        node = search_regex__add_node(p, (Search_Regex_Node){.kind = SEARCH_REGEX_NODE_REPEAT, .left = node, .min = min, .max = max});
+    }
+    return node;
+}
+
+static int search_regex__parse_concat(Search_Regex_Parser *p)
+{
+    int node = -1;
+    while (!p->failed)
+    {
+        char c = p->pattern[p->pos];
+        if (c == '\0' || c == '|' || c == ')') break;
+        int next = search_regex__parse_repeat(p);
+        node = node < 0 ? next : search_regex__add_node(p, (Search_Regex_Node){.kind = SEARCH_REGEX_NODE_CONCAT, .left = node, .right = next});
+    }
+    if (node < 0) node = search_regex__add_node(p, (Search_Regex_Node){.kind = SEARCH_REGEX_NODE_EMPTY});
+    return node;
+}
+
+static int search_regex__parse_alt(Search_Regex_Parser *p)
+{
+    int node = search_regex__parse_concat(p);
+    while (!p->failed && p->pattern[p->pos] == '|')
+    {
+        p->pos++;
+        int next = search_regex__parse_concat(p);
+        node = search_regex__add_node(p, (Search_Regex_Node){.kind = SEARCH_REGEX_NODE_ALT, .left = node, .right = next});
+    }
+    return node;
+}
+
+typedef struct Search_Regex_Compiler {
+    const Search_Regex_Node *nodes;
+    Search_Regex_Dfa *dfa;
+    int inst_cap;
+    bool is_reversed;
+    bool failed;
+} Search_Regex_Compiler;
+
+static int search_regex__add_inst(Search_Regex_Compiler *c, Search_Regex_Inst inst)
+{
+    Search_Regex_Dfa *dfa = c->dfa;
+    if (dfa->inst_count >= SEARCH_REGEX_MAX_INSTS)
+    {
+        c->failed = true;
+        return 0;
+    }
+    if (dfa->inst_count >= c->inst_cap)
+    {
+        c->inst_cap = c->inst_cap ? c->inst_cap * 2 : 64;
+        dfa->insts = xrealloc(dfa->insts, c->inst_cap * sizeof(dfa->insts[0]));
+    }
+    dfa->insts[dfa->inst_count] = inst;
+    return dfa->inst_count++;
+}
+
+// Instructions matching node and continuing at out, returns where they start.
+// Built back to front, so every instruction already knows where it leads.
+static int search_regex__compile_node(Search_Regex_Compiler *c, int node_index, int out)
+{
+    if (c->failed) return out;
+    const Search_Regex_Node *node = &c->nodes[node_index];
+    switch (node->kind)
+    {
+        case SEARCH_REGEX_NODE_EMPTY:
+        {
+            return out;
+        }
+        case SEARCH_REGEX_NODE_CLASS:
+        {
+            return search_regex__add_inst(c, (Search_Regex_Inst){.kind = SEARCH_REGEX_INST_CLASS, .out = out, .class_index = node->class_index});
+        }
+        case SEARCH_REGEX_NODE_BOL:
+        case SEARCH_REGEX_NODE_EOL:
+        {
+            // Checked against positions in the line, so reversing leaves them alone
+            bool is_bol = node->kind == SEARCH_REGEX_NODE_BOL;
+            return search_regex__add_inst(c, (Search_Regex_Inst){.kind = is_bol ? SEARCH_REGEX_INST_BOL : SEARCH_REGEX_INST_EOL, .out = out});
+        }
+        case SEARCH_REGEX_NODE_CONCAT:
+        {
+            if (c->is_reversed) return search_regex__compile_node(c, node->right, search_regex__compile_node(c, node->left, out));
+            return search_regex__compile_node(c, node->left, search_regex__compile_node(c, node->right, out));
+        }
+        case SEARCH_REGEX_NODE_ALT:
+        {
+            int left = search_regex__compile_node(c, node->left, out);
+            int right = search_regex__compile_node(c, node->right, out);
+            return search_regex__add_inst(c, (Search_Regex_Inst){.kind = SEARCH_REGEX_INST_SPLIT, .out = left, .out1 = right});
+        }
+        case SEARCH_REGEX_NODE_REPEAT:
+        {
+            int next = out;
+            if (node->max < 0)
+            {
+                int loop = search_regex__add_inst(c, (Search_Regex_Inst){.kind = SEARCH_REGEX_INST_SPLIT, .out1 = out});
+                int body = search_regex__compile_node(c, node->left, loop);
+                if (c->failed) return out;
+                c->dfa->insts[loop].out = body;
+                next = loop;
+            }
+            else
+            {
+                // x{0,2} is (x(x)?)?, each optional copy can end the repeat
+                for (int i = node->min; i < node->max; i++)
+                {
+                    int body = search_regex__compile_node(c, node->left, next);
+                    next = search_regex__add_inst(c, (Search_Regex_Inst){.kind = SEARCH_REGEX_INST_SPLIT, .out = body, .out1 = out});
+                }
+            }
+            for (int i = 0; i < node->min; i++)
+            {
+                next = search_regex__compile_node(c, node->left, next);
+            }
+            return next;
+        }
+    }
+    return out;
+}
+
+static bool search_regex__compile_dfa(Search_Regex_Dfa *dfa, const Search_Regex_Node *nodes, int root, bool is_reversed)
+{
+    Search_Regex_Compiler c = {.nodes = nodes, .dfa = dfa, .is_reversed = is_reversed};
+    int match = search_regex__add_inst(&c, (Search_Regex_Inst){.kind = SEARCH_REGEX_INST_MATCH});
+    dfa->start = search_regex__compile_node(&c, root, match);
+    if (c.failed) return false;
+
+    dfa->is_unanchored = is_reversed;
+    dfa->state_table_cap = SEARCH_REGEX_DFA_MAX_STATES * 2;
+    dfa->state_table = xmalloc(dfa->state_table_cap * sizeof(dfa->state_table[0]));
+    memset(dfa->state_table, 0xff, dfa->state_table_cap * sizeof(dfa->state_table[0]));
+    dfa->closure_stack = xmalloc(dfa->inst_count * sizeof(dfa->closure_stack[0]));
+    dfa->closure_marks = xcalloc(dfa->inst_count * sizeof(dfa->closure_marks[0]));
+    dfa->set_buf = xmalloc(dfa->inst_count * sizeof(dfa->set_buf[0]));
+    for (int i = 0; i < dfa->inst_count; i++)
+    {
+        if (dfa->insts[i].kind == SEARCH_REGEX_INST_BOL) dfa->assertion_flags |= SEARCH_REGEX_AT_BOL;
+        if (dfa->insts[i].kind == SEARCH_REGEX_INST_EOL) dfa->assertion_flags |= SEARCH_REGEX_AT_EOL;
+    }
+    dfa->start_state = -1;
+    return true;
+}
+
+// Literal text known about the matches of a node
+typedef struct Search_Regex_Literals {
+    bool is_exact; // Every match is exactly prefix, which then equals suffix and required
+    char *prefix; // Every match starts with this
+    char *suffix; // Every match ends with this
+    char *required; // Every match contains this
+} Search_Regex_Literals;
+
+static void search_regex__free_literals(Search_Regex_Literals *l)
+{
+    free(l->prefix);
+    free(l->suffix);
+    free(l->required);
+}
+
+static char *search_regex__concat(const char *a, const char *b)
+{
+    size_t a_len = strlen(a);
+    size_t b_len = strlen(b);
+    char *r = xmalloc(a_len + b_len + 1);
+    memcpy(r, a, a_len);
+    memcpy(r + a_len, b, b_len + 1);
+    return r;
+}
+
+static char *search_regex__longest(const char *a, const char *b, const char *c)
+{
+    const char *r = a;
+    if (strlen(b) > strlen(r)) r = b;
+    if (strlen(c) > strlen(r)) r = c;
+    return xstrdup(r);
+}
+
+// The byte a class matches, lowercased when it only differs in case. -1 if it matches more.
+static int search_regex__class_literal(const uint8_t *class, bool ignore_case)
+{
+    int found = -1;
+    for (int c = 0; c < 256; c++)
+    {
+        if (!search_regex__class_has(class, c)) continue;
+        if (ignore_case && c >= 'A' && c <= 'Z' && search_regex__class_has(class, c | 0x20)) continue;
+        if (found >= 0) return -1;
+        found = c;
+    }
+    return found;
+}
+
+static Search_Regex_Literals search_regex__literals(const Search_Regex *regex, const Search_Regex_Node *nodes, int node_index,
+    bool ignore_case)
+{
+    const Search_Regex_Node *node = &nodes[node_index];
+    Search_Regex_Literals r = {0};
+    switch (node->kind)
+    {
+        case SEARCH_REGEX_NODE_CLASS:
+        {
+            int c = search_regex__class_literal(regex->classes[node->class_index], ignore_case);
+            if (c > 0)
+            {
+                char str[2] = {(char)c, '\0'};
+                r = (Search_Regex_Literals){true, xstrdup(str), xstrdup(str), xstrdup(str)};
+                return r;
+            }
+        } break;
+
+        case SEARCH_REGEX_NODE_EMPTY:
+        case SEARCH_REGEX_NODE_BOL:
+        case SEARCH_REGEX_NODE_EOL:
+        {
+            r.is_exact = true;
+        } break;
+
+        case SEARCH_REGEX_NODE_CONCAT:
+        {
+            Search_Regex_Literals a = search_regex__literals(regex, nodes, node->left, ignore_case);
+            Search_Regex_Literals b = search_regex__literals(regex, nodes, node->right, ignore_case);
+            char *joined = search_regex__concat(a.suffix, b.prefix);
+            r.is_exact = a.is_exact && b.is_exact;
+            r.prefix = a.is_exact ? search_regex__concat(a.prefix, b.prefix) : xstrdup(a.prefix);
+            r.suffix = b.is_exact ? search_regex__concat(a.suffix, b.suffix) : xstrdup(b.suffix);
+            r.required = search_regex__longest(a.required, b.required, joined);
+            free(joined);
+            search_regex__free_literals(&a);
+            search_regex__free_literals(&b);
+            return r;
+        }
+
+        case SEARCH_REGEX_NODE_REPEAT:
+        {
+            if (node->min == 0) break;
+            Search_Regex_Literals a = search_regex__literals(regex, nodes, node->left, ignore_case);
+            a.is_exact = a.is_exact && node->max == 1;
+            return a;
+        }
+
+        case SEARCH_REGEX_NODE_ALT:
+        {
+            Search_Regex_Literals a = search_regex__literals(regex, nodes, node->left, ignore_case);
+            Search_Regex_Literals b = search_regex__literals(regex, nodes, node->right, ignore_case);
+            bool is_same = a.is_exact && b.is_exact && strcmp(a.prefix, b.prefix) == 0;
+            search_regex__free_literals(&b);
+            if (is_same) return a;
+            search_regex__free_literals(&a);
+        } break;
+    }
+    if (!r.prefix)
+    {
+        r.prefix = xstrdup("");
+        r.suffix = xstrdup("");
+        r.required = xstrdup("");
+    }
+    return r;
+}
+
+bool search_regex_compile(Search_Regex *regex, const char *pattern, bool ignore_case, char *error, int error_size)
+{
+    *regex = (Search_Regex){0};
+    Search_Regex_Parser p = {.pattern = pattern, .ignore_case = ignore_case, .regex = regex, .error = error, .error_size = error_size};
+    int root = search_regex__parse_alt(&p);
+    if (!p.failed && pattern[p.pos] != '\0') search_regex__fail(&p, "Unmatched )");
+    if (!p.failed &&
+        (!search_regex__compile_dfa(&regex->forward, p.nodes, root, false) ||
+         !search_regex__compile_dfa(&regex->reverse, p.nodes, root, true)))
+    {
+        search_regex__fail(&p, "Pattern too large");
+    }
+    if (!p.failed)
+    {
+        Search_Regex_Literals literals = search_regex__literals(regex, p.nodes, root, ignore_case);
+        regex->literal = search_pattern_create(literals.required, ignore_case);
+        regex->is_literal = literals.is_exact && regex->literal.len > 0 && regex->forward.assertion_flags == 0;
+        search_regex__free_literals(&literals);
+    }
+    free(p.nodes);
+    if (p.failed)
+    {
+        search_regex_destroy(regex);
+        return false;
+    }
+    return true;
+}
+
+static void search_regex__reset_dfa(Search_Regex_Dfa *dfa)
+{
+    for (int i = 0; i < dfa->state_count; i++)
+    {
+        free(dfa->states[i].insts);
+    }
+    dfa->state_count = 0;
+    dfa->start_state = -1;
+    if (dfa->state_table) memset(dfa->state_table, 0xff, dfa->state_table_cap * sizeof(dfa->state_table[0]));
+}
+
+static void search_regex__destroy_dfa(Search_Regex_Dfa *dfa)
+{
+    search_regex__reset_dfa(dfa);
+    free(dfa->insts);
+    free(dfa->states);
+    free(dfa->next);
+    free(dfa->state_table);
+    free(dfa->closure_stack);
+    free(dfa->closure_marks);
+    free(dfa->set_buf);
+    *dfa = (Search_Regex_Dfa){0};
+}
+
+void search_regex_destroy(Search_Regex *regex)
+{
+    search_regex__destroy_dfa(&regex->forward);
+    search_regex__destroy_dfa(&regex->reverse);
+    free(regex->classes);
+    search_pattern_destroy(&regex->literal);
+    *regex = (Search_Regex){0};
+}
+
+static inline unsigned int search_regex__next_closure_seed(Search_Regex_Dfa *dfa)
+{
+    if (++dfa->closure_seed == 0)
+    {
+        memset(dfa->closure_marks, 0, dfa->inst_count * sizeof(dfa->closure_marks[0]));
+        dfa->closure_seed = 1;
+    }
+    return dfa->closure_seed;
+}
+
+// Adds inst and everything reachable from it without consuming a byte to set.
+// Splits are followed and left out, assertions are followed where flags say
+// they hold and kept otherwise, so a later position can still follow them.
+static void search_regex__add_closure(Search_Regex_Dfa *dfa, int inst, int flags, int *set, int *set_count)
+{
+    unsigned int seed = dfa->closure_seed;
+    int stack_count = 0;
+    if (dfa->closure_marks[inst] == seed) return;
+    dfa->closure_marks[inst] = seed;
+    dfa->closure_stack[stack_count++] = inst;
+    while (stack_count > 0)
+    {
+        int i = dfa->closure_stack[--stack_count];
+        const Search_Regex_Inst *in = &dfa->insts[i];
+        int follow[2] = {-1, -1};
+        if (in->kind == SEARCH_REGEX_INST_SPLIT)
+        {
+            follow[0] = in->out;
+            follow[1] = in->out1;
+        }
+        else if ((in->kind == SEARCH_REGEX_INST_BOL && (flags & SEARCH_REGEX_AT_BOL)) ||
+                 (in->kind == SEARCH_REGEX_INST_EOL && (flags & SEARCH_REGEX_AT_EOL)))
+        {
+            follow[0] = in->out;
+        }
+        else
+        {
+            set[(*set_count)++] = i;
+        }
+        for (int f = 0; f < 2; f++)
+        {
+            if (follow[f] < 0 || dfa->closure_marks[follow[f]] == seed) continue;
+            dfa->closure_marks[follow[f]] = seed;
+            dfa->closure_stack[stack_count++] = follow[f];
+        }
+    }
+}
+
+static int search_regex__compare_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+static uint64_t search_regex__hash_set(const int *set, int count)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < count; i++)
+    {
+        hash = (hash ^ (uint64_t)set[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// The cached state for set, created if needed
+static int search_regex__intern(Search_Regex_Dfa *dfa, int *set, int count)
+{
+    qsort(set, count, sizeof(set[0]), search_regex__compare_int);
+    uint64_t hash = search_regex__hash_set(set, count);
+    int slot = (int)(hash % (uint64_t)dfa->state_table_cap);
+    while (dfa->state_table[slot] >= 0)
+    {
+        const Search_Regex_Dfa_State *state = &dfa->states[dfa->state_table[slot]];
+        if (state->hash == hash && state->inst_count == count && memcmp(state->insts, set, count * sizeof(set[0])) == 0)
+        {
+            return dfa->state_table[slot];
+        }
+        slot = (slot + 1) % dfa->state_table_cap;
+    }
+
+    if (dfa->state_count >= SEARCH_REGEX_DFA_MAX_STATES)
+    {
+        // Patterns that blow up into too many states keep going with a fresh cache
+        search_regex__reset_dfa(dfa);
+        dfa->reset_count++;
+        return search_regex__intern(dfa, set, count);
+    }
+    if (dfa->state_count >= dfa->state_cap)
+    {
+        dfa->state_cap = dfa->state_cap ? dfa->state_cap * 2 : 16;
+        dfa->states = xrealloc(dfa->states, dfa->state_cap * sizeof(dfa->states[0]));
+        dfa->next = xrealloc(dfa->next, dfa->state_cap * 256 * sizeof(dfa->next[0]));
+    }
+    Search_Regex_Dfa_State *state = &dfa->states[dfa->state_count];
+    state->insts = xmalloc((count ? count : 1) * sizeof(state->insts[0]));
+    memcpy(state->insts, set, count * sizeof(set[0]));
+    state->inst_count = count;
+    state->hash = hash;
+    state->is_match = false;
+    for (int i = 0; i < count; i++)
+    {
+        if (dfa->insts[set[i]].kind == SEARCH_REGEX_INST_MATCH) state->is_match = true;
+    }
+    memset(state->at_line_end, 0xff, sizeof(state->at_line_end));
+    state->accel = -1;
+    memset(&dfa->next[dfa->state_count * 256], 0xff, 256 * sizeof(dfa->next[0]));
+    dfa->state_table[slot] = dfa->state_count;
+    return dfa->state_count++;
+}
+
+static int search_regex__start_state(Search_Regex_Dfa *dfa)
+{
+    if (dfa->start_state < 0)
+    {
+        int count = 0;
+        search_regex__next_closure_seed(dfa);
+        search_regex__add_closure(dfa, dfa->start, 0, dfa->set_buf, &count);
+        dfa->start_state = search_regex__intern(dfa, dfa->set_buf, count);
+    }
+    return dfa->start_state;
+}
+
+// The state with the assertions that hold under flags followed. Stepping
+// from it away from the line ends is the same as stepping from the original
+// state at them, so those steps get cached too.
+static int search_regex__follow_assertions(Search_Regex_Dfa *dfa, int state_index, int flags)
+{
+    int cached = dfa->states[state_index].at_line_end[flags];
+    if (cached >= 0) return cached;
+
+    const Search_Regex_Dfa_State *state = &dfa->states[state_index];
+    int count = 0;
+    search_regex__next_closure_seed(dfa);
+    for (int i = 0; i < state->inst_count; i++)
+    {
+        search_regex__add_closure(dfa, state->insts[i], flags, dfa->set_buf, &count);
+    }
+    int cache_resets = dfa->reset_count;
+    int followed = search_regex__intern(dfa, dfa->set_buf, count);
+    // A reset dropped the original state along with everything else
+    if (cache_resets == dfa->reset_count) dfa->states[state_index].at_line_end[flags] = followed;
+    return followed;
+}
+
+static int search_regex__step_slow(Search_Regex *regex, Search_Regex_Dfa *dfa, int state_index, unsigned char byte)
+{
+    const Search_Regex_Dfa_State *state = &dfa->states[state_index];
+    int count = 0;
+    search_regex__next_closure_seed(dfa);
+    for (int i = 0; i < state->inst_count; i++)
+    {
+        const Search_Regex_Inst *in = &dfa->insts[state->insts[i]];
+        if (in->kind == SEARCH_REGEX_INST_CLASS && search_regex__class_has(regex->classes[in->class_index], byte))
+        {
+            search_regex__add_closure(dfa, in->out, 0, dfa->set_buf, &count);
+        }
+    }
+    if (dfa->is_unanchored) search_regex__add_closure(dfa, dfa->start, 0, dfa->set_buf, &count);
+
+    int cache_resets = dfa->reset_count;
+    int next = search_regex__intern(dfa, dfa->set_buf, count);
+    if (cache_resets == dfa->reset_count) dfa->next[state_index * 256 + byte] = next;
+    return next;
+}
+
+static inline int search_regex__step(Search_Regex *regex, Search_Regex_Dfa *dfa, int state_index, unsigned char byte)
+{
+    int next = dfa->next[state_index * 256 + byte];
+    if (next >= 0) return next;
+    return search_regex__step_slow(regex, dfa, state_index, byte);
+}
+
+// How the scan can skip through the state, see Search_Regex_Dfa_State.accel.
+// Worked out the first time the state steps back to itself.
+static int search_regex__accel(Search_Regex *regex, Search_Regex_Dfa *dfa, int state_index)
+{
+    if (dfa->states[state_index].accel >= 0) return dfa->states[state_index].accel;
+    dfa->states[state_index].accel = 0;
+    // All 256 steps are needed, a cache reset halfway would drop the state being checked
+    if (dfa->states[state_index].is_match || dfa->state_count + 256 > SEARCH_REGEX_DFA_MAX_STATES) return 0;
+
+    uint8_t escapes[32] = {0};
+    int escape_count = 0;
+    for (int b = 0; b < 256; b++)
+    {
+        if (search_regex__step(regex, dfa, state_index, (unsigned char)b) == state_index) continue;
+        search_regex__class_set(escapes, b);
+        if (++escape_count > SEARCH_REGEX_ACCEL_MAX_ESCAPES) return 0;
+    }
+    memcpy(dfa->states[state_index].escapes, escapes, sizeof(escapes));
+    dfa->states[state_index].accel = escape_count > 0 ? 1 : 2;
+    return dfa->states[state_index].accel;
+}
+
+static inline int search_regex__flags(const Search_Regex_Dfa *dfa, int pos, int len)
+{
+    return ((pos == 0 ? SEARCH_REGEX_AT_BOL : 0) | (pos == len ? SEARCH_REGEX_AT_EOL : 0)) & dfa->assertion_flags;
+}
+
+// Finds a match in str[0, len), which may end in a line break that is not
+// part of the text. The match starts in [min_start, max_start], the leftmost
+// such match or the rightmost one when going backward. Returns false if there
+// is none.
+bool search_regex_search_line(Search_Regex *regex, const char *str, int len, int min_start, int max_start, bool backward,
+    int *out_start, int *out_end)
+{
+    if (len > 0 && str[len - 1] == '\n') len--;
+    if (min_start < 0) min_start = 0;
+    if (max_start > len) max_start = len;
+    if (min_start > max_start) return false;
+    if (regex->is_literal)
+    {
+        int window_end = max_start + regex->literal.len < len ? max_start + regex->literal.len : len;
+        const char *found = backward ?
+            search_backward(&regex->literal, str + min_start, window_end - min_start) :
+            search_forward(&regex->literal, str + min_start, window_end - min_start);
+        if (!found) return false;
+        *out_start = (int)(found - str);
+        *out_end = *out_start + regex->literal.len;
+        return true;
+    }
+    if (regex->literal.len > 0 && !search_forward(&regex->literal, str + min_start, len - min_start)) return false;
+
+    // Reversed pattern, restarted at every position: the scan is in a match
+    // state exactly where some match starts
+    Search_Regex_Dfa *reverse = &regex->reverse;
+    int start = -1;
+    int state = search_regex__start_state(reverse);
+    int pos = len;
+    for (;;)
+    {
+        int flags = search_regex__flags(reverse, pos, len);
+        if (flags) state = search_regex__follow_assertions(reverse, state, flags);
+        if (pos <= max_start && reverse->states[state].is_match)
+        {
+            start = pos;
+            if (backward) break;
+        }
+        if (pos == min_start) break;
+        int next = search_regex__step(regex, reverse, state, (unsigned char)str[--pos]);
+        int accel = next == state && pos > min_start ? search_regex__accel(regex, reverse, state) : 0;
+        if (accel == 2)
+        {
+            pos = min_start;
+        }
+        else if (accel == 1)
+        {
+            // Nothing changes until a byte that leads out, and no match state is skipped
+            const uint8_t *escapes = reverse->states[state].escapes;
+            while (pos > min_start && !search_regex__class_has(escapes, (unsigned char)str[pos - 1])) pos--;
+        }
+        state = next;
+    }
+    if (start < 0) return false;
+
+    // Forward from the start for the longest match, until no thread is left
+    Search_Regex_Dfa *forward = &regex->forward;
+    int end = -1;
+    state = search_regex__start_state(forward);
+    for (int pos = start; ; pos++)
+    {
+        int flags = search_regex__flags(forward, pos, len);
+        if (flags) state = search_regex__follow_assertions(forward, state, flags);
+        if (forward->states[state].is_match) end = pos;
+        if (pos == len || forward->states[state].inst_count == 0) break;
+        state = search_regex__step(regex, forward, state, (unsigned char)str[pos]);
+    }
+    bassert(end >= start);
+    *out_start = start;
+    *out_end = end;
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "search.h"
+
+#define SEARCH_REGEX_MAX_INSTS 8192 // Counted repetition is expanded, this bounds how far
+#define SEARCH_REGEX_MAX_REPEAT 255
+#define SEARCH_REGEX_DFA_MAX_STATES 1024 // Cached DFA states per direction, the cache starts over once full
+#define SEARCH_REGEX_ACCEL_MAX_ESCAPES 16 // A state left by at most this many bytes is skipped through instead of stepped
+
+// Regular expressions matched by a lazily built DFA, so every search is
+// linear in the text no matter the pattern. Supported: literals, '.', [...]
+// classes with ranges and negation, \d \w \s (and negations), ^ $ anchors,
+// | alternation, ( ) grouping, * + ? and {m}, {m,}, {m,n} repetition.
+//
+// Text is matched a line at a time without its line break. The pattern is
+// compiled twice: reversed, to find where matches start by scanning a line
+// backwards, and forward, to find where the match from that start ends
+// (longest match, like POSIX). When every match has to contain some literal
+// text, lines without it are ruled out by the substring search first.
+
+typedef enum Search_Regex_Inst_Kind {
+    SEARCH_REGEX_INST_CLASS, // Consumes a byte in the class
+    SEARCH_REGEX_INST_SPLIT,
+    SEARCH_REGEX_INST_BOL,
+    SEARCH_REGEX_INST_EOL,
+    SEARCH_REGEX_INST_MATCH
+} Search_Regex_Inst_Kind;
+
+typedef struct Search_Regex_Inst {
+    Search_Regex_Inst_Kind kind;
+    int out;
+    int out1; // Second branch of a split
+    int class_index;
+} Search_Regex_Inst;
+
+typedef struct Search_Regex_Dfa_State {
+    int *insts; // Sorted NFA instructions reached by the state, assertions not yet followed
+    int inst_count;
+    uint64_t hash;
+    bool is_match;
+    int at_line_end[4]; // The state with the assertions that hold at a line end followed, keyed by which hold, -1 until computed
+    signed char accel; // 1 if the state loops on every byte but its escapes, 2 if it has none, 0 if not worth it, -1 until checked
+    uint8_t escapes[32]; // Bytes leading out of the state, set when accel is 1
+} Search_Regex_Dfa_State;
+
+typedef struct Search_Regex_Dfa {
+    Search_Regex_Inst *insts;
+    int inst_count;
+    int start;
+    bool is_unanchored; // A match can begin at every position, not just the first
+    int assertion_flags; // Line ends the pattern has anchors for, others need no special casing
+    Search_Regex_Dfa_State *states;
+    int state_count;
+    int state_cap;
+    int *next; // Cached transitions at [state * 256 + byte], -1 until computed. One flat table, so a step is one load.
+    int *state_table; // Open addressing on the instruction set hash, -1 for empty
+    int state_table_cap;
+    int start_state;
+    int *closure_stack; // Scratch space, sized by inst_count
+    unsigned int *closure_marks;
+    unsigned int closure_seed;
+    int *set_buf;
+    int reset_count; // Times the cache filled up and started over
+} Search_Regex_Dfa;
+
+typedef struct Search_Regex {
+    uint8_t (*classes)[32]; // 256 bit byte sets
+    int class_count;
+    Search_Regex_Dfa forward; // Anchored, finds where a match ends
+    Search_Regex_Dfa reverse; // Unanchored, finds where matches start
+    Search_Pattern literal; // Text every match contains, len 0 if the pattern has none
+    bool is_literal; // The pattern is nothing but the literal, the substring search does it all
+} Search_Regex;
+
+bool search_regex_compile(Search_Regex *regex, const char *pattern, bool ignore_case, char *error, int error_size);
+void search_regex_destroy(Search_Regex *regex);
+bool search_regex_search_line(Search_Regex *regex, const char *str, int len, int min_start, int max_start, bool backward,
+    int *out_start, int *out_end);
@@ -0,0 +1,323 @@
+#include "search_scanner.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "search.h"
+#include "search_regex.h"
+#include "util.h"
+
+static Search_Snapshot *search_snapshot__create(const Text_Buffer *text_buffer)
+{
+    Search_Snapshot *snapshot = xcalloc(sizeof(*snapshot));
+    size_t size = 0;
+    for (int i = 0; i < text_buffer->line_count; i++)
+    {
+        size += text_buffer->lines[i].len;
+    }
+    snapshot->data = xmalloc(size + 1);
+    snapshot->line_starts = xmalloc((text_buffer->line_count + 1) * sizeof(snapshot->line_starts[0]));
+    size_t at = 0;
+    for (int i = 0; i < text_buffer->line_count; i++)
+    {
+        snapshot->line_starts[i] = at;
+        memcpy(snapshot->data + at, text_buffer->lines[i].str, text_buffer->lines[i].len);
+        at += text_buffer->lines[i].len;
+    }
+    snapshot->line_starts[text_buffer->line_count] = at;
+    snapshot->data[at] = '\0';
+    snapshot->size = at;
+    snapshot->line_count = text_buffer->line_count;
+    snapshot->ref_count = 1;
+    return snapshot;
+}
+
+// Caller holds the scanner mutex
+static void search_snapshot__release(Search_Snapshot *snapshot)
+{
+    if (!snapshot || --snapshot->ref_count > 0) return;
+    free(snapshot->data);
+    free(snapshot->line_starts);
+    free(snapshot);
+}
+
+static Cursor_Pos search_snapshot__offset_to_pos(const Search_Snapshot *snapshot, size_t offset)
+{
+    int lower = 0, upper = snapshot->line_count - 1;
+    while (lower < upper)
+    {
+        int mid = lower + (upper - lower + 1) / 2;
+        if (snapshot->line_starts[mid] <= offset) lower = mid;
+        else upper = mid - 1;
+    }
+    return (Cursor_Pos){lower, (int)(offset - snapshot->line_starts[lower])};
+}
+
+static bool search_scanner__is_stale(Search_Scanner *scanner, unsigned int seed)
+{
+    pthread_mutex_lock(&scanner->mutex);
+    bool is_stale = scanner->should_stop || scanner->latest_seed != seed;
+    pthread_mutex_unlock(&scanner->mutex);
+    return is_stale;
+}
+
+static void search_scanner__publish_first(Search_Scanner *scanner, unsigned int seed, Cursor_Pos pos)
+{
+    pthread_mutex_lock(&scanner->mutex);
+    if (scanner->result.seed == seed)
+    {
+        scanner->result.has_first = true;
+        scanner->result.first = pos;
+    }
+    pthread_mutex_unlock(&scanner->mutex);
+}
+
+static void search_scanner__publish_count(Search_Scanner *scanner, unsigned int seed, int match_count, bool is_invalid)
+{
+    pthread_mutex_lock(&scanner->mutex);
+    if (scanner->result.seed == seed)
+    {
+        scanner->result.is_done = true;
+        scanner->result.match_count = match_count;
+        scanner->result.is_invalid = is_invalid;
+    }
+    pthread_mutex_unlock(&scanner->mutex);
+}
+
+// Counts matches starting in [begin, end), false if the query went stale on the way
+static bool search_scanner__count_literal(Search_Scanner *scanner, const Search_Scan_Query *query, const Search_Pattern *pattern,
+    size_t begin, size_t end, bool is_after_from, int *match_count)
+{
+    const Search_Snapshot *snapshot = query->snapshot;
+    for (size_t chunk = begin; chunk < end; chunk += SEARCH_SCANNER_CHUNK_SIZE)
+    {
+        size_t chunk_end = end - chunk > SEARCH_SCANNER_CHUNK_SIZE ? chunk + SEARCH_SCANNER_CHUNK_SIZE : end;
+        // Matches starting in the chunk may run past it
+        size_t window_end = chunk_end + pattern->len - 1;
+        if (window_end > snapshot->size) window_end = snapshot->size;
+        const char *at = snapshot->data + chunk;
+        const char *window = snapshot->data + window_end;
+        while ((at = search_forward(pattern, at, window - at)) && at < snapshot->data + chunk_end)
+        {
+            if (is_after_from && *match_count == 0)
+            {
+                search_scanner__publish_first(scanner, query->seed, search_snapshot__offset_to_pos(snapshot, at - snapshot->data));
+            }
+            (*match_count)++;
+            at++;
+        }
+        if (search_scanner__is_stale(scanner, query->seed)) return false;
+    }
+    return true;
+}
+
+// Counts matches on lines [first_line, end_line), the first line from min_start and the last before max_start.
+// Matches on a line don't overlap, like repeated regex searches would find them.
+static bool search_scanner__count_regex(Search_Scanner *scanner, const Search_Scan_Query *query, Search_Regex *regex,
+    int first_line, int end_line, int min_start, int max_start, bool is_after_from, int *match_count)
+{
+    const Search_Snapshot *snapshot = query->snapshot;
+    size_t checked_at = snapshot->line_starts[first_line];
+    for (int line = first_line; line < end_line; line++)
+    {
+        const char *str = snapshot->data + snapshot->line_starts[line];
+        int len = (int)(snapshot->line_starts[line + 1] - snapshot->line_starts[line]);
+        int min = line == first_line ? min_start : 0;
+        int max = line == end_line - 1 ? max_start : INT_MAX;
+        int start, end;
+        while (search_regex_search_line(regex, str, len, min, max, false, &start, &end))
+        {
+            if (is_after_from && *match_count == 0)
+            {
+                search_scanner__publish_first(scanner, query->seed, (Cursor_Pos){line, start});
+            }
+            (*match_count)++;
+            min = end > start ? end : start + 1;
+        }
+        if (snapshot->line_starts[line + 1] - checked_at >= SEARCH_SCANNER_CHUNK_SIZE)
+        {
+            if (search_scanner__is_stale(scanner, query->seed)) return false;
+            checked_at = snapshot->line_starts[line + 1];
+        }
+    }
+    return !search_scanner__is_stale(scanner, query->seed);
+}
+
+// After from first, so the first match is out early, then what comes before it to finish the count
+static void search_scanner__scan(Search_Scanner *scanner, const Search_Scan_Query *query)
+{
+    const Search_Snapshot *snapshot = query->snapshot;
+    Cursor_Pos from = query->from;
+    if (from.line >= snapshot->line_count) from = (Cursor_Pos){snapshot->line_count - 1, INT_MAX - 1};
+    int match_count = 0;
+    if (query->is_regex)
+    {
+        Search_Regex regex;
+        char error[128];
+        if (!search_regex_compile(&regex, query->needle, query->ignore_case, error, sizeof(error)))
+        {
+            search_scanner__publish_count(scanner, query->seed, 0, true);
+            return;
+        }
+        bool is_done =
+            search_scanner__count_regex(scanner, query, &regex, from.line, snapshot->line_count, from.col + 1, INT_MAX, true, &match_count) &&
+            search_scanner__count_regex(scanner, query, &regex, 0, from.line + 1, 0, from.col, false, &match_count);
+        if (is_done) search_scanner__publish_count(scanner, query->seed, match_count, false);
+        search_regex_destroy(&regex);
+    }
+    else
+    {
+        Search_Pattern pattern = search_pattern_create(query->needle, query->ignore_case);
+        size_t line_len = snapshot->line_starts[from.line + 1] - snapshot->line_starts[from.line];
+        size_t from_offset = snapshot->line_starts[from.line] + ((size_t)from.col + 1 < line_len ? (size_t)from.col + 1 : line_len);
+        if (pattern.len == 0)
+        {
+            search_scanner__publish_count(scanner, query->seed, 0, false);
+        }
+        else if (search_scanner__count_literal(scanner, query, &pattern, from_offset, snapshot->size, true, &match_count) &&
+            search_scanner__count_literal(scanner, query, &pattern, 0, from_offset, false, &match_count))
+        {
+            search_scanner__publish_count(scanner, query->seed, match_count, false);
+        }
+        search_pattern_destroy(&pattern);
+    }
+}
+
+static void *search_scanner__run(void *arg)
+{
+    Search_Scanner *scanner = arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&scanner->mutex);
+        while (!scanner->has_query && !scanner->should_stop)
+        {
+            pthread_cond_wait(&scanner->cond, &scanner->mutex);
+        }
+        if (scanner->should_stop)
+        {
+            pthread_mutex_unlock(&scanner->mutex);
+            break;
+        }
+        Search_Scan_Query query = scanner->query;
+        scanner->has_query = false;
+        scanner->result = (Search_Scan_Result){ .seed = query.seed };
+        pthread_mutex_unlock(&scanner->mutex);
+
+        search_scanner__scan(scanner, &query);
+
+        pthread_mutex_lock(&scanner->mutex);
+        search_snapshot__release(query.snapshot);
+        pthread_mutex_unlock(&scanner->mutex);
+        free(query.needle);
+    }
+    return NULL;
+}
+
+bool search_scanner_start(Search_Scanner *scanner)
+{
+    bassert(!scanner->is_running);
+    *scanner = (Search_Scanner){0};
+    pthread_mutex_init(&scanner->mutex, NULL);
+    pthread_cond_init(&scanner->cond, NULL);
+    if (pthread_create(&scanner->thread, NULL, search_scanner__run, scanner) != 0)
+    {
+        log_warning("Failed to start search scanner thread");
+        pthread_mutex_destroy(&scanner->mutex);
+        pthread_cond_destroy(&scanner->cond);
+        *scanner = (Search_Scanner){0};
+        return false;
+    }
+    scanner->is_running = true;
+    return true;
+}
+
+// The scan in progress gives up at its next check
+void search_scanner_stop(Search_Scanner *scanner)
+{
+    if (!scanner->is_running) return;
+    pthread_mutex_lock(&scanner->mutex);
+    scanner->should_stop = true;
+    pthread_cond_signal(&scanner->cond);
+    pthread_mutex_unlock(&scanner->mutex);
+    pthread_join(scanner->thread, NULL);
+
+    if (scanner->has_query)
+    {
+        search_snapshot__release(scanner->query.snapshot);
+        free(scanner->query.needle);
+    }
+    search_snapshot__release(scanner->snapshot);
+    pthread_mutex_destroy(&scanner->mutex);
+    pthread_cond_destroy(&scanner->cond);
+    *scanner = (Search_Scanner){0};
+}
+
+// Takes the snapshot queries for this text will scan, unless the one kept is still current.
+// text_id tells texts apart, a generation alone could belong to any of them.
+void search_scanner_prepare(Search_Scanner *scanner, const Text_Buffer *text_buffer, int text_id)
+{
+    bassert(scanner->is_running);
+    if (scanner->snapshot && scanner->snapshot_text_id == text_id && scanner->snapshot_generation == text_buffer->generation) return;
+    Search_Snapshot *snapshot = search_snapshot__create(text_buffer);
+    pthread_mutex_lock(&scanner->mutex);
+    search_snapshot__release(scanner->snapshot);
+    pthread_mutex_unlock(&scanner->mutex);
+    scanner->snapshot = snapshot;
+    scanner->snapshot_text_id = text_id;
+    scanner->snapshot_generation = text_buffer->generation;
+}
+
+// Returns the seed results for this query will carry
+unsigned int search_scanner_post(Search_Scanner *scanner, const Text_Buffer *text_buffer, int text_id,
+    const char *needle, bool ignore_case, bool is_regex, Cursor_Pos from)
+{
+    search_scanner_prepare(scanner, text_buffer, text_id);
+    pthread_mutex_lock(&scanner->mutex);
+    if (scanner->has_query)
+    {
+        // Superseded before the worker got to it
+        search_snapshot__release(scanner->query.snapshot);
+        free(scanner->query.needle);
+    }
+    scanner->snapshot->ref_count++;
+    scanner->query = (Search_Scan_Query){
+        .snapshot = scanner->snapshot,
+        .needle = xstrdup(needle),
+        .ignore_case = ignore_case,
+        .is_regex = is_regex,
+        .from = from,
+        .seed = ++scanner->seed
+    };
+    scanner->has_query = true;
+    scanner->has_posted = true;
+    scanner->latest_seed = scanner->seed;
+    pthread_cond_signal(&scanner->cond);
+    pthread_mutex_unlock(&scanner->mutex);
+    return scanner->seed;
+}
+
+// Drops the query in progress without posting another
+void search_scanner_cancel(Search_Scanner *scanner)
+{
+    if (!scanner->has_posted) return;
+    scanner->has_posted = false;
+    pthread_mutex_lock(&scanner->mutex);
+    if (scanner->has_query)
+    {
+        search_snapshot__release(scanner->query.snapshot);
+        free(scanner->query.needle);
+        scanner->has_query = false;
+    }
+    scanner->latest_seed = ++scanner->seed;
+    pthread_mutex_unlock(&scanner->mutex);
+}
+
+Search_Scan_Result search_scanner_poll(Search_Scanner *scanner)
+{
+    if (!scanner->is_running) return (Search_Scan_Result){0};
+    pthread_mutex_lock(&scanner->mutex);
+    Search_Scan_Result result = scanner->result;
+    pthread_mutex_unlock(&scanner->mutex);
+    return result;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "text_buffer.h"
+
+#define SEARCH_SCANNER_CHUNK_SIZE (256 * 1024) // Bytes a scan gets through between checks for a newer query
+
+// Search as you type. The text is copied into a snapshot the worker thread
+// reads while the main thread goes on, and the snapshot is reused for every
+// query until the text changes. Taking it is the one cost on the main thread,
+// prepare pays it ahead so no keystroke has to. Posting a query supersedes the
+// scan in progress, which notices within a chunk and drops its work.
+//
+// Results come in two steps: the first match after the cursor as soon as it's
+// found, then the number of matches in the whole text once it's all scanned.
+
+typedef struct Search_Snapshot {
+    char *data; // All lines back to back, each with its '\n'
+    size_t size;
+    size_t *line_starts; // line_count + 1 offsets, the last one is size
+    int line_count;
+    int ref_count; // Guarded by the scanner mutex
+} Search_Snapshot;
+
+typedef struct Search_Scan_Query {
+    Search_Snapshot *snapshot;
+    char *needle;
+    bool ignore_case;
+    bool is_regex;
+    Cursor_Pos from;
+    unsigned int seed;
+} Search_Scan_Query;
+
+typedef struct Search_Scan_Result {
+    unsigned int seed; // Query the result is for
+    bool has_first;
+    Cursor_Pos first; // First match starting after from, like text_buffer_search_next
+    bool is_done;
+    int match_count;
+    bool is_invalid; // The regex didn't compile
+} Search_Scan_Result;
+
+typedef struct Search_Scanner {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    Search_Scan_Query query; // Guarded by mutex, the newest query until the worker takes it
+    bool has_query;
+    Search_Scan_Result result; // Guarded by mutex
+    unsigned int latest_seed; // Guarded by mutex, a scan for any other seed is stale
+    bool should_stop;
+    bool is_running;
+    unsigned int seed; // Main thread only from here on
+    bool has_posted; // A query went out since the last cancel
+    Search_Snapshot *snapshot; // Kept for the next query, holds a reference
+    int snapshot_text_id;
+    unsigned int snapshot_generation;
+} Search_Scanner;
+
+bool search_scanner_start(Search_Scanner *scanner);
+void search_scanner_stop(Search_Scanner *scanner);
+void search_scanner_prepare(Search_Scanner *scanner, const Text_Buffer *text_buffer, int text_id);
+unsigned int search_scanner_post(Search_Scanner *scanner, const Text_Buffer *text_buffer, int text_id,
+    const char *needle, bool ignore_case, bool is_regex, Cursor_Pos from);
+void search_scanner_cancel(Search_Scanner *scanner);
+Search_Scan_Result search_scanner_poll(Search_Scanner *scanner);
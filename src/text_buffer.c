@@ -2,6 +2,9 @@
 
 #include <stdbool.h>
 #include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "string_builder.h"
 #include "util.h"
@@ -311,7 +314,7 @@ char cursor_iterator_get_char(Cursor_Iterator it)
 
 Text_Line text_line_make_dup(const char *str)
 {
-    Text_Line r;
+    Text_Line r = {0};
     r.str = xstrdup(str);
     r.len = strlen(r.str);
     r.buf_len = r.len + 1;
@@ -320,7 +323,7 @@ Text_Line text_line_make_dup(const char *str)
 
 Text_Line text_line_make_dup_range(const char *str, int start, int count)
 {
-    Text_Line r;
+    Text_Line r = {0};
     r.str = xstrndup(str + start, count);
     r.len = strlen(r.str);
     r.buf_len = r.len + 1;
@@ -353,7 +356,7 @@ Text_Line text_line_make_f(const char *fmt, ...)
 
 Text_Line text_line_copy(Text_Line source, int start, int end)
 {
-    Text_Line r;
+    Text_Line r = {0};
     if (end < 0) end = source.len;
     r.len = end - start;
     r.buf_len = r.len + 1;
@@ -363,14 +366,51 @@ Text_Line text_line_copy(Text_Line source, int start, int end)
     return r;
 }
 
+void text_line_reserve(Text_Line *text_line, int buf_len)
+{
+    if (buf_len <= text_line->buf_len) return;
+    int new_buf_len = text_line->buf_len ? text_line->buf_len : 16;
+    while (new_buf_len < buf_len) new_buf_len *= 2;
+    if (text_line->buf_len == 0 && text_line->str) // Borrowed from the shared block, copy out
+    {
+        char *str = xmalloc(new_buf_len);
+        memcpy(str, text_line->str, text_line->len + 1);
+        text_line->str = str;
+    }
+    else
+    {
+        text_line->str = xrealloc(text_line->str, new_buf_len);
+    }
+    text_line->buf_len = new_buf_len;
+}
+
 void text_line_resize(Text_Line *text_line, int new_size)
 {
-    text_line->str = xrealloc(text_line->str, new_size + 1);
-    text_line->buf_len = new_size + 1;
+    text_line_clear_x_cache(text_line); // Every edit goes through here
+    text_line_reserve(text_line, new_size + 1);
     text_line->len = new_size;
     text_line->str[new_size] = '\0';
 }
 
+void text_line_shrink_to_fit(Text_Line *text_line)
+{
+    if (text_line->buf_len == 0) return;
+    text_line->str = xrealloc(text_line->str, text_line->len + 1);
+    text_line->buf_len = text_line->len + 1;
+}
+
+void text_line_clear_x_cache(Text_Line *text_line)
+{
+    free(text_line->x_cache);
+    text_line->x_cache = NULL;
+}
+
+void text_line_destroy(Text_Line *text_line)
+{
+    if (text_line->buf_len) free(text_line->str);
+    text_line_clear_x_cache(text_line);
+}
+
 void text_line_insert_char(Text_Line *text_line, char c, int insert_index)
 {
     bassert(insert_index >= 0);
@@ -445,62 +485,257 @@ Text_Buffer text_buffer_create_empty()
     return text_buffer;
 }
 
+typedef struct Text_Buffer_Load_Chunk {
+    const char *data;
+    size_t start;
+    size_t end;
+    size_t newline_count;
+    bool has_newline;
+    size_t last_newline;
+    size_t first_line_index; // Lines and line starts before this chunk, from the prefix sum
+    size_t first_line_start;
+    Text_Buffer *text_buffer;
+} Text_Buffer_Load_Chunk;
+
+static void *text_buffer__index_chunk(void *arg)
+{
+    Text_Buffer_Load_Chunk *chunk = arg;
+    chunk->newline_count = text_buffer_count_newlines(chunk->data + chunk->start, chunk->end - chunk->start);
+    chunk->has_newline = chunk->newline_count > 0;
+    if (chunk->has_newline)
+    {
+        size_t i = chunk->end;
+        while (chunk->data[i - 1] != '\n') i--;
+        chunk->last_newline = i - 1;
+    }
+    return NULL;
+}
+
+static void *text_buffer__fill_chunk(void *arg)
+{
+    // Every byte before line j moves j bytes forward in the shared block, to make room for the null terminators
+    Text_Buffer_Load_Chunk *chunk = arg;
+    char *block = chunk->text_buffer->shared_block;
+    size_t line_index = chunk->first_line_index;
+    size_t line_start = chunk->first_line_start;
+    size_t pos = chunk->start;
+    const char *newline;
+    while (pos < chunk->end && (newline = memchr(chunk->data + pos, '\n', chunk->end - pos)))
+    {
+        size_t line_end = (size_t)(newline - chunk->data) + 1;
+        memcpy(block + pos + line_index, chunk->data + pos, line_end - pos);
+        block[line_end + line_index] = '\0';
+        chunk->text_buffer->lines[line_index] = (Text_Line){ .str = block + line_start + line_index, .len = (int)(line_end - line_start), .buf_len = 0 };
+        line_index++;
+        line_start = line_end;
+        pos = line_end;
+    }
+    if (pos < chunk->end) memcpy(block + pos + line_index, chunk->data + pos, chunk->end - pos);
+    return NULL;
+}
+
+static void text_buffer__run_load_chunks(Text_Buffer_Load_Chunk *chunks, int chunk_count, void *(*fn)(void *))
+{
+    pthread_t threads[TEXT_BUFFER_MAX_LOAD_THREADS];
+    for (int i = 1; i < chunk_count; i++)
+    {
+        pthread_create(&threads[i], NULL, fn, &chunks[i]);
+    }
+    fn(&chunks[0]);
+    for (int i = 1; i < chunk_count; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+Text_Buffer text_buffer_create_from_data(const char *data, size_t size)
+{
+    int thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    return text_buffer_create_from_data_threaded(data, size, thread_count);
+}
+
+Text_Buffer text_buffer_create_from_data_threaded(const char *data, size_t size, int thread_count)
+{
+    if (thread_count > TEXT_BUFFER_MAX_LOAD_THREADS) thread_count = TEXT_BUFFER_MAX_LOAD_THREADS;
+    if ((size_t)thread_count > size / TEXT_BUFFER_MIN_LOAD_CHUNK_SIZE) thread_count = (int)(size / TEXT_BUFFER_MIN_LOAD_CHUNK_SIZE);
+    if (thread_count < 1) thread_count = 1;
+
+    Text_Buffer_Load_Chunk chunks[TEXT_BUFFER_MAX_LOAD_THREADS];
+    for (int i = 0; i < thread_count; i++)
+    {
+        chunks[i] = (Text_Buffer_Load_Chunk){
+            .data = data,
+            .start = size * i / thread_count,
+            .end = size * (i + 1) / thread_count,
+        };
+    }
+    text_buffer__run_load_chunks(chunks, thread_count, text_buffer__index_chunk);
+
+    size_t line_index = 0;
+    size_t line_start = 0;
+    for (int i = 0; i < thread_count; i++)
+    {
+        chunks[i].first_line_index = line_index;
+        chunks[i].first_line_start = line_start;
+        line_index += chunks[i].newline_count;
+        if (chunks[i].has_newline) line_start = chunks[i].last_newline + 1;
+    }
+    bool missing_final_newline = size == 0 || data[size - 1] != '\n';
+    size_t line_count = line_index + (missing_final_newline ? 1 : 0);
+
+    Text_Buffer text_buffer = {0};
+    text_buffer_reserve_lines(&text_buffer, (int)line_count);
+    text_buffer.shared_block = xmalloc(size + line_count + (missing_final_newline ? 1 : 0));
+    for (int i = 0; i < thread_count; i++)
+    {
+        chunks[i].text_buffer = &text_buffer;
+    }
+    text_buffer__run_load_chunks(chunks, thread_count, text_buffer__fill_chunk);
+
+    if (missing_final_newline) // The tail was already copied by the last chunk, just terminate it
+    {
+        char *block = text_buffer.shared_block;
+        block[size + line_index] = '\n';
+        block[size + line_index + 1] = '\0';
+        text_buffer.lines[line_index] = (Text_Line){ .str = block + line_start + line_index, .len = (int)(size - line_start) + 1, .buf_len = 0 };
+    }
+    text_buffer.line_count = (int)line_count;
+    return text_buffer;
+}
+
+size_t text_buffer_count_newlines(const char *data, size_t size)
+{
+    // Compare 16 bytes at a time; matching lanes are -1, so subtracting counts them.
+    // Lane counters are flushed before they can overflow (255 blocks).
+    typedef unsigned char Byte_Vec __attribute__((vector_size(16)));
+    const Byte_Vec newline_vec = {'\n', '\n', '\n', '\n', '\n', '\n', '\n', '\n', '\n', '\n', '\n', '\n', '\n', '\n', '\n', '\n'};
+    size_t count = 0;
+    size_t i = 0;
+    while (size - i >= 16)
+    {
+        Byte_Vec lane_counts = {0};
+        size_t block_end = i + 255 * 16;
+        if (block_end > size) block_end = size;
+        for (; block_end - i >= 16; i += 16)
+        {
+            Byte_Vec v;
+            memcpy(&v, data + i, sizeof(v));
+            lane_counts -= (Byte_Vec)(v == newline_vec);
+        }
+        for (int lane = 0; lane < 16; lane++)
+        {
+            count += lane_counts[lane];
+        }
+    }
+    for (; i < size; i++)
+    {
+        if (data[i] == '\n') count++;
+    }
+    return count;
+}
+
 void text_buffer_destroy(Text_Buffer *text_buffer)
 {
     for (int i = 0; i < text_buffer->line_count; i++)
     {
-        free(text_buffer->lines[i].str);
+        text_line_destroy(&text_buffer->lines[i]);
     }
     free(text_buffer->lines);
+    free(text_buffer->shared_block);
     text_buffer->lines = NULL;
     text_buffer->line_count = 0;
+    text_buffer->line_cap = 0;
+    text_buffer->shared_block = NULL;
 }
 
 void text_buffer_validate(Text_Buffer *text_buffer)
 {
+    bassert(text_buffer->line_count <= text_buffer->line_cap);
     for (int i = 0; i < text_buffer->line_count; i++) {
         int actual_len = strlen(text_buffer->lines[i].str);
         bassert(actual_len > 0);
         bassert(actual_len == text_buffer->lines[i].len);
-        bassert(text_buffer->lines[i].buf_len == text_buffer->lines[i].len + 1);
+        bassert(text_buffer->lines[i].buf_len == 0 || text_buffer->lines[i].buf_len >= text_buffer->lines[i].len + 1);
         bassert(text_buffer->lines[i].str[actual_len] == '\0');
         bassert(text_buffer->lines[i].str[actual_len - 1] == '\n');
     }
 }
 
-void text_buffer_append_line(Text_Buffer *text_buffer, Text_Line text_line)
+void text_buffer_reserve_lines(Text_Buffer *text_buffer, int line_cap)
+{
+    if (line_cap <= text_buffer->line_cap) return;
+    int new_line_cap = text_buffer->line_cap ? text_buffer->line_cap : 16;
+    while (new_line_cap < line_cap) new_line_cap *= 2;
+    text_buffer->lines = xrealloc(text_buffer->lines, new_line_cap * sizeof(text_buffer->lines[0]));
+    text_buffer->line_cap = new_line_cap;
+}
+
+void text_buffer_shrink_to_fit(Text_Buffer *text_buffer)
 {
-    text_buffer->line_count++;
+    for (int i = 0; i < text_buffer->line_count; i++)
+    {
+        text_line_shrink_to_fit(&text_buffer->lines[i]);
+    }
     text_buffer->lines = xrealloc(text_buffer->lines, text_buffer->line_count * sizeof(text_buffer->lines[0]));
-    text_buffer->lines[text_buffer->line_count - 1] = text_line;
+    text_buffer->line_cap = text_buffer->line_count;
+}
+
+void text_buffer_append_line(Text_Buffer *text_buffer, Text_Line text_line)
+{
+    text_buffer->generation++;
+    text_buffer_reserve_lines(text_buffer, text_buffer->line_count + 1);
+    text_buffer->lines[text_buffer->line_count++] = text_line;
 }
 
 void text_buffer_insert_line(Text_Buffer *text_buffer, Text_Line new_line, int insert_at)
 {
-    text_buffer->lines = xrealloc(text_buffer->lines, (text_buffer->line_count + 1) * sizeof(text_buffer->lines[0]));
-    for (int i = text_buffer->line_count - 1; i >= insert_at ; i--) {
-        text_buffer->lines[i + 1] = text_buffer->lines[i];
-    }
-    text_buffer->line_count++;
-    text_buffer->lines[insert_at] = new_line;
+    Text_Line *slot = text_buffer_splice_lines(text_buffer, insert_at, 1);
+    *slot = new_line;
+}
+
+Text_Line *text_buffer_splice_lines(Text_Buffer *text_buffer, int insert_at, int count)
+{
+    bassert(insert_at >= 0);
+    bassert(insert_at <= text_buffer->line_count);
+    bassert(count > 0);
+    text_buffer->generation++;
+    text_buffer_reserve_lines(text_buffer, text_buffer->line_count + count);
+    memmove(&text_buffer->lines[insert_at + count],
+        &text_buffer->lines[insert_at],
+        (text_buffer->line_count - insert_at) * sizeof(text_buffer->lines[0]));
+    text_buffer->line_count += count;
+    memset(&text_buffer->lines[insert_at], 0, count * sizeof(text_buffer->lines[0]));
+    return &text_buffer->lines[insert_at];
 }
 
 void text_buffer_remove_line(Text_Buffer *text_buffer, int remove_at)
 {
-    free(text_buffer->lines[remove_at].str);
-    for (int i = remove_at + 1; i <= text_buffer->line_count - 1; i++) {
-        text_buffer->lines[i - 1] = text_buffer->lines[i];
+    text_buffer_remove_lines(text_buffer, remove_at, 1);
+}
+
+void text_buffer_remove_lines(Text_Buffer *text_buffer, int remove_at, int count)
+{
+    bassert(remove_at >= 0);
+    bassert(count > 0);
+    bassert(remove_at + count <= text_buffer->line_count);
+    text_buffer->generation++;
+    for (int i = remove_at; i < remove_at + count; i++)
+    {
+        text_line_destroy(&text_buffer->lines[i]);
     }
-    text_buffer->line_count--;
+    memmove(&text_buffer->lines[remove_at],
+        &text_buffer->lines[remove_at + count],
+        (text_buffer->line_count - remove_at - count) * sizeof(text_buffer->lines[0]));
+    text_buffer->line_count -= count;
     if (text_buffer->line_count <= 0)
     {
         text_buffer->line_count = 1;
-        text_buffer->lines = xrealloc(text_buffer->lines, text_buffer->line_count * sizeof(text_buffer->lines[0]));
         text_buffer->lines[0] = text_line_make_dup("\n");
     }
-    else
+    if (text_buffer->line_count < text_buffer->line_cap / 4) // Give memory back after large deletions, but keep room to grow
     {
-        text_buffer->lines = xrealloc(text_buffer->lines, text_buffer->line_count * sizeof(text_buffer->lines[0]));
+        text_buffer->line_cap = text_buffer->line_count * 2;
+        text_buffer->lines = xrealloc(text_buffer->lines, text_buffer->line_cap * sizeof(text_buffer->lines[0]));
     }
 }
 
@@ -515,6 +750,7 @@ void text_buffer_append_f(Text_Buffer *text_buffer, const char *fmt, ...)
 
 void text_buffer_split_line(Text_Buffer *text_buffer, Cursor_Pos pos)
 {
+    text_buffer->generation++;
     Text_Line *current_line = &text_buffer->lines[pos.line];
     int chars_moved_to_next_line = current_line->len - pos.col;
     Text_Line new_line = text_line_make_dup_range(current_line->str, pos.col, chars_moved_to_next_line);
@@ -532,6 +768,7 @@ void text_buffer_insert_char(Text_Buffer *text_buffer, char c, Cursor_Pos pos)
 {
     bassert(pos.line < text_buffer->line_count);
     bassert(pos.col < text_buffer->lines[pos.line].len);
+    text_buffer->generation++;
     if (c == '\n')
     {
         text_buffer_split_line(text_buffer, pos);
@@ -543,6 +780,7 @@ char text_buffer_remove_char(Text_Buffer *text_buffer, Cursor_Pos pos)
 {
     bassert(pos.line < text_buffer->line_count);
     bassert(pos.col < text_buffer->lines[pos.line].len);
+    text_buffer->generation++;
     bool deleting_line_break = pos.col == text_buffer->lines[pos.line].len - 1; // Valid text buffer will always have \n at len - 1
     char removed_char = text_buffer->lines[pos.line].str[pos.col];
     Text_Line *this_line = &text_buffer->lines[pos.line];
@@ -567,6 +805,7 @@ Cursor_Pos text_buffer_insert_range(Text_Buffer *text_buffer, const char *range,
 {
     bassert(pos.line < text_buffer->line_count);
     bassert(pos.col < text_buffer->lines[pos.line].len);
+    text_buffer->generation++;
     int range_len = strlen(range);
     bassert(range_len > 0);
     int segment_count = str_get_line_segment_count(range);
@@ -579,8 +818,13 @@ Cursor_Pos text_buffer_insert_range(Text_Buffer *text_buffer, const char *range,
     }
     else
     {
-        text_buffer_split_line(text_buffer, pos);
-        int dest_line_i = pos.line;
+        // Make room for all new lines at once: the part of the line after pos moves to the last one
+        Text_Line *first_line = &text_buffer->lines[pos.line];
+        int tail_len = first_line->len - pos.col;
+        Text_Line tail_line = text_line_make_dup_range(first_line->str, pos.col, tail_len);
+        text_line_remove_range(first_line, pos.col, tail_len);
+        Text_Line *new_lines = text_buffer_splice_lines(text_buffer, pos.line + 1, segment_count - 1);
+
         int segment_start = 0;
         for (int i = 0; i < segment_count; i++)
         {
@@ -589,20 +833,19 @@ Cursor_Pos text_buffer_insert_range(Text_Buffer *text_buffer, const char *range,
             int segment_len = segment_end - segment_start;
             if (i == 0) // first segment
             {
-                text_line_insert_range(&text_buffer->lines[dest_line_i], range, pos.col, segment_len);
+                text_line_insert_range(&text_buffer->lines[pos.line], range, pos.col, segment_len);
             }
             else if (i == segment_count - 1) // last segment
             {
-                text_line_insert_range(&text_buffer->lines[dest_line_i], range + segment_start, 0, segment_len);
-                end_cursor.line = dest_line_i;
+                text_line_insert_range(&tail_line, range + segment_start, 0, segment_len);
+                new_lines[i - 1] = tail_line;
+                end_cursor.line = pos.line + i;
                 end_cursor.col = segment_len;
             }
             else // middle segments
             {
-                Text_Line new_line = text_line_make_dup_range(range, segment_start, segment_len);
-                text_buffer_insert_line(text_buffer, new_line, dest_line_i);
+                new_lines[i - 1] = text_line_make_dup_range(range, segment_start, segment_len);
             }
-            dest_line_i++;
             segment_start = segment_end;
         }
     }
@@ -616,6 +859,7 @@ void text_buffer_remove_range(Text_Buffer *text_buffer, Cursor_Pos start, Cursor
     bassert(end.line < text_buffer->line_count);
     bassert(end.col <= text_buffer->lines[end.line].len);
     bassert((end.line == start.line && end.col > start.col) || end.line > start.line);
+    text_buffer->generation++;
     if (start.line == end.line)
     {
         text_line_remove_range(&text_buffer->lines[start.line], start.col, end.col - start.col);
@@ -626,11 +870,7 @@ void text_buffer_remove_range(Text_Buffer *text_buffer, Cursor_Pos start, Cursor
         Text_Line *end_text_line = &text_buffer->lines[end.line];
         text_line_remove_range(start_text_line, start.col, start_text_line->len - start.col);
         text_line_insert_range(start_text_line, end_text_line->str + end.col, start.col, end_text_line->len - end.col);
-        int lines_to_remove = end.line - start.line;
-        for (int i = 0; i < lines_to_remove; i++)
-        {
-            text_buffer_remove_line(text_buffer, start.line + 1); // Keep removing the same index, as lines get shifted up
-        }
+        text_buffer_remove_lines(text_buffer, start.line + 1, end.line - start.line);
     }
 }
 
@@ -679,24 +919,245 @@ char *text_buffer_extract_range(Text_Buffer *text_buffer, Cursor_Pos start, Curs
     return extracted_range;
 }
 
-bool text_buffer_search_next(Text_Buffer *text_buffer, const char *query, Cursor_Pos from, Cursor_Pos *out_pos)
+static bool text_buffer__search_matches_from(const Text_Buffer *text_buffer, const Search_Pattern *pattern, int line, int col)
+{
+    int needle_offset = 0;
+    while (needle_offset < pattern->len)
+    {
+        if (line >= text_buffer->line_count) return false;
+        const Text_Line *text_line = &text_buffer->lines[line];
+        int count = text_line->len - col;
+        if (count > pattern->len - needle_offset) count = pattern->len - needle_offset;
+        if (!search_pattern_matches_at(pattern, needle_offset, text_line->str + col, count)) return false;
+        needle_offset += count;
+        line++;
+        col = 0;
+    }
+    return true;
+}
+
+// Col of the first (or last) match starting in [min_col, max_col] of the line, -1 if there is none
+static int text_buffer__search_line(const Text_Buffer *text_buffer, const Search_Pattern *pattern, int line, int min_col, int max_col, bool backward)
+{
+    const Text_Line *text_line = &text_buffer->lines[line];
+    if (max_col >= text_line->len) max_col = text_line->len - 1;
+    if (min_col < 0) min_col = 0;
+    if (min_col > max_col) return -1;
+
+    if (pattern->newline_offset >= 0)
+    {
+        // Lines end in '\n', so a needle with one can only start where its head is the line's tail
+        int col = text_line->len - (pattern->newline_offset + 1);
+        if (col < min_col || col > max_col) return -1;
+        return text_buffer__search_matches_from(text_buffer, pattern, line, col) ? col : -1;
+    }
+
+    int end = max_col + pattern->len;
+    if (end > text_line->len) end = text_line->len;
+    const char *data = text_line->str + min_col;
+    const char *match = backward ? search_backward(pattern, data, end - min_col) : search_forward(pattern, data, end - min_col);
+    return match ? (int)(match - text_line->str) : -1;
+}
+
+// Loaded lines sit back to back in the shared block, each followed by its null terminator. A needle
+// without '\n' can't match across a line end, so a run of them is searched as one range instead of
+// paying for a call per (short) line. Counts the lines of the run from line on in dir, up to max_count.
+static int text_buffer__search_run_count(const Text_Buffer *text_buffer, const Search_Pattern *pattern, int line, int dir, int max_count)
 {
-    int col_offset = from.col + 1;
-    for (int i = from.line; i < text_buffer->line_count; i++)
+    if (pattern->newline_offset >= 0) return 1;
+    int count = 1;
+    size_t size = text_buffer->lines[line].len + 1;
+    while (size < TEXT_BUFFER_SEARCH_RUN_SIZE && count < max_count)
+    {
+        int lower = dir > 0 ? line + count - 1 : line - count;
+        if (lower < 0 || lower + 1 >= text_buffer->line_count) break;
+        const Text_Line *a = &text_buffer->lines[lower];
+        const Text_Line *b = &text_buffer->lines[lower + 1];
+        if (a->buf_len != 0 || b->buf_len != 0 || a->str + a->len + 1 != b->str) break;
+        size += (dir > 0 ? b : a)->len + 1;
+        count++;
+    }
+    return count;
+}
+
+// First match starting after from
+bool text_buffer_search_next(const Text_Buffer *text_buffer, const Search_Pattern *pattern, Cursor_Pos from, Cursor_Pos *out_pos)
+{
+    if (pattern->len == 0 || from.line >= text_buffer->line_count) return false;
+    int col = text_buffer__search_line(text_buffer, pattern, from.line, from.col + 1, INT_MAX, false);
+    if (col >= 0)
+    {
+        *out_pos = (Cursor_Pos){from.line, col};
+        return true;
+    }
+
+    int line = from.line + 1;
+    while (line < text_buffer->line_count)
     {
-        char *match = strstr(text_buffer->lines[i].str + col_offset, query);
+        int count = text_buffer__search_run_count(text_buffer, pattern, line, 1, INT_MAX);
+        if (count == 1)
+        {
+            col = text_buffer__search_line(text_buffer, pattern, line, 0, INT_MAX, false);
+            if (col >= 0)
+            {
+                *out_pos = (Cursor_Pos){line, col};
+                return true;
+            }
+            line++;
+            continue;
+        }
+
+        const Text_Line *last = &text_buffer->lines[line + count - 1];
+        const char *data = text_buffer->lines[line].str;
+        const char *match = search_forward(pattern, data, last->str + last->len - data);
         if (match)
         {
-            int col = match - text_buffer->lines[i].str;
-            out_pos->line = i;
-            out_pos->col = col;
+            int match_line = line;
+            while (match_line + 1 < line + count && match >= text_buffer->lines[match_line + 1].str) match_line++;
+            *out_pos = (Cursor_Pos){match_line, (int)(match - text_buffer->lines[match_line].str)};
             return true;
         }
-        col_offset = 0;
+        line += count;
     }
     return false;
 }
 
+// Last match starting before from
+bool text_buffer_search_prev(const Text_Buffer *text_buffer, const Search_Pattern *pattern, Cursor_Pos from, Cursor_Pos *out_pos)
+{
+    if (pattern->len == 0 || text_buffer->line_count == 0) return false;
+    if (from.line >= text_buffer->line_count)
+    {
+        from.line = text_buffer->line_count - 1;
+        from.col = INT_MAX;
+    }
+    int col = text_buffer__search_line(text_buffer, pattern, from.line, 0, from.col - 1, true);
+    if (col >= 0)
+    {
+        *out_pos = (Cursor_Pos){from.line, col};
+        return true;
+    }
+
+    int line = from.line - 1;
+    while (line >= 0)
+    {
+        int count = text_buffer__search_run_count(text_buffer, pattern, line, -1, INT_MAX);
+        if (count == 1)
+        {
+            col = text_buffer__search_line(text_buffer, pattern, line, 0, INT_MAX, true);
+            if (col >= 0)
+            {
+                *out_pos = (Cursor_Pos){line, col};
+                return true;
+            }
+            line--;
+            continue;
+        }
+
+        const Text_Line *last = &text_buffer->lines[line];
+        const char *data = text_buffer->lines[line - count + 1].str;
+        const char *match = search_backward(pattern, data, last->str + last->len - data);
+        if (match)
+        {
+            int match_line = line;
+            while (match < text_buffer->lines[match_line].str) match_line--;
+            *out_pos = (Cursor_Pos){match_line, (int)(match - text_buffer->lines[match_line].str)};
+            return true;
+        }
+        line -= count;
+    }
+    return false;
+}
+
+// First regex match starting after from, lines are matched one at a time in place
+bool text_buffer_regex_search_next(const Text_Buffer *text_buffer, Search_Regex *regex, Cursor_Pos from,
+    Cursor_Pos *out_start, Cursor_Pos *out_end)
+{
+    for (int line = from.line; line < text_buffer->line_count; line++)
+    {
+        const Text_Line *l = &text_buffer->lines[line];
+        int min_col = line == from.line ? from.col + 1 : 0;
+        int start, end;
+        if (search_regex_search_line(regex, l->str, l->len, min_col, INT_MAX, false, &start, &end))
+        {
+            *out_start = (Cursor_Pos){line, start};
+            *out_end = (Cursor_Pos){line, end};
+            return true;
+        }
+    }
+    return false;
+}
+
+// Last regex match starting before from
+bool text_buffer_regex_search_prev(const Text_Buffer *text_buffer, Search_Regex *regex, Cursor_Pos from,
+    Cursor_Pos *out_start, Cursor_Pos *out_end)
+{
+    if (from.line >= text_buffer->line_count)
+    {
+        from.line = text_buffer->line_count - 1;
+        from.col = INT_MAX;
+    }
+    for (int line = from.line; line >= 0; line--)
+    {
+        const Text_Line *l = &text_buffer->lines[line];
+        int max_col = line == from.line ? from.col - 1 : INT_MAX;
+        int start, end;
+        if (search_regex_search_line(regex, l->str, l->len, 0, max_col, true, &start, &end))
+        {
+            *out_start = (Cursor_Pos){line, start};
+            *out_end = (Cursor_Pos){line, end};
+            return true;
+        }
+    }
+    return false;
+}
+
+// Appends every match starting in lines [first_line, end_line), overlapping ones included, in order
+void text_buffer_search_all(const Text_Buffer *text_buffer, const Search_Pattern *pattern, int first_line, int end_line,
+    Cursor_Pos **matches, int *match_count, int *match_cap)
+{
+    if (pattern->len == 0) return;
+    if (first_line < 0) first_line = 0;
+    if (end_line > text_buffer->line_count) end_line = text_buffer->line_count;
+
+    int line = first_line;
+    while (line < end_line)
+    {
+        int count = text_buffer__search_run_count(text_buffer, pattern, line, 1, end_line - line);
+        int match_line = line;
+        const Text_Line *last = &text_buffer->lines[line + count - 1];
+        const char *data = text_buffer->lines[line].str;
+        const char *end = last->str + last->len;
+        for (;;)
+        {
+            int col;
+            if (count == 1)
+            {
+                int min_col = data - text_buffer->lines[line].str;
+                col = text_buffer__search_line(text_buffer, pattern, line, min_col, INT_MAX, false);
+                if (col < 0) break;
+                data = text_buffer->lines[line].str + col + 1;
+            }
+            else
+            {
+                const char *match = search_forward(pattern, data, end - data);
+                if (!match) break;
+                while (match_line + 1 < line + count && match >= text_buffer->lines[match_line + 1].str) match_line++;
+                col = (int)(match - text_buffer->lines[match_line].str);
+                data = match + 1;
+            }
+
+            if (*match_count >= *match_cap)
+            {
+                *match_cap = *match_cap ? *match_cap * 2 : 64;
+                *matches = xrealloc(*matches, *match_cap * sizeof((*matches)[0]));
+            }
+            (*matches)[(*match_count)++] = (Cursor_Pos){match_line, col};
+        }
+        line += count;
+    }
+}
+
 int text_buffer_line_indent_get_level(Text_Buffer *text_buffer, int line)
 {
     int spaces = 0;
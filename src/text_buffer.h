@@ -2,18 +2,33 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "search.h"
+#include "search_regex.h"
 
 #define MAX_CHARS_PER_LINE 1024
+#define TEXT_BUFFER_MAX_LOAD_THREADS 8
+#define TEXT_BUFFER_MIN_LOAD_CHUNK_SIZE (1024 * 1024)
+#define TEXT_BUFFER_SEARCH_RUN_SIZE (64 * 1024) // Most bytes of back to back lines handed to the search engine at once
 
+// buf_len == 0 means str is borrowed from Text_Buffer.shared_block;
+// the line gets its own allocation the first time it's resized.
+// x_cache[i] is the x where char i starts, filled in by the renderer for
+// proportional fonts and dropped whenever the line changes.
 typedef struct Text_Line {
     char *str;
     int len;
     int buf_len;
+    float *x_cache;
 } Text_Line;
 
 typedef struct Text_Buffer {
     Text_Line *lines;
     int line_count;
+    int line_cap;
+    char *shared_block;
+    unsigned int generation; // Bumped by every edit, so anything derived from the text can tell it's stale
 } Text_Buffer;
 
 typedef struct Cursor_Pos {
@@ -58,7 +73,11 @@ Text_Line text_line_make_dup_range(const char *str, int start, int count);
 Text_Line text_line_make_va(const char *fmt, va_list args);
 Text_Line text_line_make_f(const char *fmt, ...);
 Text_Line text_line_copy(Text_Line source, int start, int end);
+void text_line_reserve(Text_Line *text_line, int buf_len);
 void text_line_resize(Text_Line *text_line, int new_size);
+void text_line_shrink_to_fit(Text_Line *text_line);
+void text_line_clear_x_cache(Text_Line *text_line);
+void text_line_destroy(Text_Line *text_line);
 void text_line_insert_char(Text_Line *text_line, char c, int insert_index);
 void text_line_remove_char(Text_Line *text_line, int remove_index);
 void text_line_insert_range(Text_Line *text_line, const char *range, int insert_index, int insert_count);
@@ -66,11 +85,18 @@ void text_line_remove_range(Text_Line *text_line, int remove_index, int remove_c
 
 Text_Buffer text_buffer_create_from_lines(const char *first, ...);
 Text_Buffer text_buffer_create_empty();
+Text_Buffer text_buffer_create_from_data(const char *data, size_t size);
+Text_Buffer text_buffer_create_from_data_threaded(const char *data, size_t size, int thread_count);
+size_t text_buffer_count_newlines(const char *data, size_t size);
 void text_buffer_destroy(Text_Buffer *text_buffer);
 void text_buffer_validate(Text_Buffer *text_buffer);
+void text_buffer_reserve_lines(Text_Buffer *text_buffer, int line_cap);
+void text_buffer_shrink_to_fit(Text_Buffer *text_buffer);
 void text_buffer_append_line(Text_Buffer *text_buffer, Text_Line text_line);
 void text_buffer_insert_line(Text_Buffer *text_buffer, Text_Line new_line, int insert_at);
+Text_Line *text_buffer_splice_lines(Text_Buffer *text_buffer, int insert_at, int count);
 void text_buffer_remove_line(Text_Buffer *text_buffer, int remove_at);
+void text_buffer_remove_lines(Text_Buffer *text_buffer, int remove_at, int count);
 void text_buffer_append_f(Text_Buffer *text_buffer, const char *fmt, ...);
 void text_buffer_split_line(Text_Buffer *text_buffer, Cursor_Pos pos);
 void text_buffer_clear(Text_Buffer *text_buffer);
@@ -80,5 +106,12 @@ Cursor_Pos text_buffer_insert_range(Text_Buffer *text_buffer, const char *range,
 void text_buffer_remove_range(Text_Buffer *text_buffer, Cursor_Pos start, Cursor_Pos end);
 char text_buffer_get_char(Text_Buffer *text_buffer, Cursor_Pos pos);
 char *text_buffer_extract_range(Text_Buffer *text_buffer, Cursor_Pos start, Cursor_Pos end);
-bool text_buffer_search_next(Text_Buffer *text_buffer, const char *query, Cursor_Pos from, Cursor_Pos *out_pos);
+bool text_buffer_search_next(const Text_Buffer *text_buffer, const Search_Pattern *pattern, Cursor_Pos from, Cursor_Pos *out_pos);
+bool text_buffer_search_prev(const Text_Buffer *text_buffer, const Search_Pattern *pattern, Cursor_Pos from, Cursor_Pos *out_pos);
+void text_buffer_search_all(const Text_Buffer *text_buffer, const Search_Pattern *pattern, int first_line, int end_line,
+    Cursor_Pos **matches, int *match_count, int *match_cap);
+bool text_buffer_regex_search_next(const Text_Buffer *text_buffer, Search_Regex *regex, Cursor_Pos from,
+    Cursor_Pos *out_start, Cursor_Pos *out_end);
+bool text_buffer_regex_search_prev(const Text_Buffer *text_buffer, Search_Regex *regex, Cursor_Pos from,
+    Cursor_Pos *out_start, Cursor_Pos *out_end);
 int text_buffer_line_indent_get_level(Text_Buffer *text_buffer, int line);
@@ -1,12 +1,24 @@
 #include "unit_tests.h"
 
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <regex.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "editor.h"
+#include "large_file.h"
+#include "renderer.h"
 #include "string_builder.h"
 #include "text_buffer.h"
+#include "view_grid.h"
 
 typedef struct UT_State
 {
@@ -28,6 +40,25 @@ void _unit_tests_run_check(UT_State *s, const char *test_name, bool success, con
 }
 #define UNIT_TESTS_RUN_CHECK(expr) _unit_tests_run_check(s, __func__, (expr), #expr)
 
+double _unit_tests_get_time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void _unit_tests_bench_report(UT_State *s, const char *test_name, const char *fmt, ...)
+{
+    char report[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(report, sizeof(report), fmt, args);
+    va_end(args);
+    text_buffer_append_f(s->log_buffer, "[BENCH] %s:", test_name);
+    text_buffer_append_f(s->log_buffer, "    %s", report);
+}
+#define UNIT_TESTS_BENCH_REPORT(...) _unit_tests_bench_report(s, __func__, __VA_ARGS__)
+
 void _unit_tests_finish(UT_State *s)
 {
     text_buffer_append_f(s->log_buffer, "");
@@ -45,7 +76,7 @@ bool validate__text_line(Text_Line text_line, const char *str)
     bool same_str = strcmp(text_line.str, str) == 0;
     bool different_pointers = text_line.str != str;
     bool correct_len = text_line.len == len;
-    bool correct_buf_len = text_line.buf_len == len + 1;
+    bool correct_buf_len = text_line.buf_len == 0 || text_line.buf_len >= len + 1; // 0 when borrowed from a shared block
     bool null_terminator = text_line.str[text_line.len] == '\0';
     return same_str && different_pointers && correct_len && correct_buf_len && null_terminator;
 }
@@ -196,6 +227,31 @@ void test__text_line_remove_range(UT_State *s)
     free (text_line_d.str);
 }
 
+void test__text_line_resize__capacity(UT_State *s)
+{
+    Text_Line text_line = text_line_make_dup("");
+    int realloc_count = 0;
+    int prev_buf_len = text_line.buf_len;
+    for (int i = 0; i < 10000; i++)
+    {
+        text_line_insert_char(&text_line, 'a', text_line.len);
+        if (text_line.buf_len != prev_buf_len) realloc_count++;
+        prev_buf_len = text_line.buf_len;
+    }
+    bool grows_geometrically = realloc_count < 16;
+    bool fits_after_growing = text_line.len == 10000 && text_line.buf_len >= text_line.len + 1;
+
+    text_line_remove_range(&text_line, 0, 9990);
+    bool keeps_capacity_when_shrinking = text_line.len == 10 && text_line.buf_len == prev_buf_len;
+
+    text_line_shrink_to_fit(&text_line);
+    bool shrinks_to_fit = validate__text_line(text_line, "aaaaaaaaaa") && text_line.buf_len == text_line.len + 1;
+
+    UNIT_TESTS_RUN_CHECK(grows_geometrically && fits_after_growing && keeps_capacity_when_shrinking && shrinks_to_fit);
+
+    free(text_line.str);
+}
+
 bool validate__text_buffer(Text_Buffer *text_buffer, ...)
 {
     va_list args;
@@ -622,6 +678,36 @@ void test__text_buffer_insert_range(UT_State *s)
     text_buffer_destroy(&text_buffer_h);
 }
 
+void test__text_buffer_insert_range__many_lines(UT_State *s)
+{
+    Text_Buffer text_buffer = text_buffer_create_from_lines(
+        "first",
+        "abcd",
+        "last",
+        NULL);
+
+    String_Builder sb = {0};
+    for (int i = 0; i < 10000; i++)
+    {
+        string_builder_append_f(&sb, "line %d\n", i);
+    }
+    string_builder_append_f(&sb, "end");
+    char *range = string_builder_compile_and_destroy(&sb);
+
+    Cursor_Pos end_cursor = text_buffer_insert_range(&text_buffer, range, (Cursor_Pos){1, 2});
+    bool correct_line_count = text_buffer.line_count == 10003;
+    bool correct_first_segment = strcmp(text_buffer.lines[1].str, "abline 0\n") == 0;
+    bool correct_middle_segment = strcmp(text_buffer.lines[5001].str, "line 5000\n") == 0;
+    bool correct_last_segment = strcmp(text_buffer.lines[10001].str, "endcd\n") == 0;
+    bool surrounding_lines_kept = strcmp(text_buffer.lines[0].str, "first\n") == 0 && strcmp(text_buffer.lines[10002].str, "last\n") == 0;
+    bool end_cursor_correct = end_cursor.line == 10001 && end_cursor.col == 3;
+
+    UNIT_TESTS_RUN_CHECK(correct_line_count && correct_first_segment && correct_middle_segment && correct_last_segment && surrounding_lines_kept && end_cursor_correct);
+
+    free(range);
+    text_buffer_destroy(&text_buffer);
+}
+
 void test__text_buffer_remove_range(UT_State *s)
 {
     Text_Buffer text_buffer_a = text_buffer_create_from_lines(
@@ -675,6 +761,124 @@ void test__text_buffer_remove_range(UT_State *s)
     text_buffer_destroy(&text_buffer_d);
 }
 
+void test__text_buffer_shrink_to_fit(UT_State *s)
+{
+    Text_Buffer text_buffer = text_buffer_create_from_lines(
+        "abcd",
+        "efgh",
+        "ijkl",
+        NULL);
+    text_buffer_insert_range(&text_buffer, "0123456789", (Cursor_Pos){1, 0});
+    bool has_spare_capacity = text_buffer.line_cap > text_buffer.line_count && text_buffer.lines[1].buf_len > text_buffer.lines[1].len + 1;
+
+    text_buffer_shrink_to_fit(&text_buffer);
+    bool capacity_fits = text_buffer.line_cap == text_buffer.line_count && text_buffer.lines[1].buf_len == text_buffer.lines[1].len + 1;
+    bool same_lines = validate__text_buffer(&text_buffer,
+        "abcd\n",
+        "0123456789efgh\n",
+        "ijkl\n",
+        NULL);
+
+    UNIT_TESTS_RUN_CHECK(has_spare_capacity && capacity_fits && same_lines);
+
+    text_buffer_destroy(&text_buffer);
+}
+
+void test__text_buffer_create_from_data(UT_State *s)
+{
+    const char *data_a = "line 1\nline 2\n\nline 4\n";
+    Text_Buffer text_buffer_a = text_buffer_create_from_data(data_a, strlen(data_a));
+    bool regular = validate__text_buffer(&text_buffer_a,
+        "line 1\n",
+        "line 2\n",
+        "\n",
+        "line 4\n",
+        NULL);
+
+    const char *data_b = "line 1\nline 2";
+    Text_Buffer text_buffer_b = text_buffer_create_from_data(data_b, strlen(data_b));
+    bool no_final_newline = validate__text_buffer(&text_buffer_b,
+        "line 1\n",
+        "line 2\n",
+        NULL);
+
+    Text_Buffer text_buffer_c = text_buffer_create_from_data("", 0);
+    bool when_empty = validate__text_buffer(&text_buffer_c,
+        "\n",
+        NULL);
+
+    char long_line[3000];
+    memset(long_line, 'a', sizeof(long_line) - 2);
+    long_line[sizeof(long_line) - 2] = '\n';
+    long_line[sizeof(long_line) - 1] = '\0';
+    Text_Buffer text_buffer_d = text_buffer_create_from_data(long_line, strlen(long_line));
+    bool long_line_not_split = validate__text_buffer(&text_buffer_d,
+        long_line,
+        NULL);
+
+    // Lines borrowed from the shared block are copied out when edited
+    text_buffer_insert_char(&text_buffer_a, 'x', (Cursor_Pos){1, 0});
+    text_buffer_remove_line(&text_buffer_a, 2);
+    text_buffer_insert_range(&text_buffer_a, "a\nb", (Cursor_Pos){0, 0});
+    bool editable = validate__text_buffer(&text_buffer_a,
+        "a\n",
+        "bline 1\n",
+        "xline 2\n",
+        "line 4\n",
+        NULL);
+
+    UNIT_TESTS_RUN_CHECK(regular && no_final_newline && when_empty && long_line_not_split && editable);
+
+    text_buffer_destroy(&text_buffer_a);
+    text_buffer_destroy(&text_buffer_b);
+    text_buffer_destroy(&text_buffer_c);
+    text_buffer_destroy(&text_buffer_d);
+}
+
+void test__text_buffer_create_from_data_threaded(UT_State *s)
+{
+    // Long lines and a missing final newline, so lines straddle chunk boundaries
+    size_t size = 4 * TEXT_BUFFER_MIN_LOAD_CHUNK_SIZE + 123;
+    char *data = xmalloc(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = (i % 100003 == 0 || i % 7 == 0) && i < size / 2 ? '\n' : 'a' + i % 26;
+    }
+
+    Text_Buffer single_threaded = text_buffer_create_from_data_threaded(data, size, 1);
+    Text_Buffer multi_threaded = text_buffer_create_from_data_threaded(data, size, 4);
+
+    bool same_lines = single_threaded.line_count == multi_threaded.line_count;
+    for (int i = 0; i < single_threaded.line_count && same_lines; i++)
+    {
+        same_lines = single_threaded.lines[i].len == multi_threaded.lines[i].len &&
+            strcmp(single_threaded.lines[i].str, multi_threaded.lines[i].str) == 0;
+    }
+    Text_Line last_line = multi_threaded.lines[multi_threaded.line_count - 1];
+    bool last_line_terminated = last_line.str[last_line.len - 1] == '\n' && last_line.str[last_line.len] == '\0';
+
+    UNIT_TESTS_RUN_CHECK(same_lines && last_line_terminated);
+
+    text_buffer_destroy(&single_threaded);
+    text_buffer_destroy(&multi_threaded);
+    free(data);
+}
+
+void test__text_buffer_count_newlines(UT_State *s)
+{
+    char data[10000];
+    size_t expected_count = 0;
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (i * 7) % 13 == 0 ? '\n' : 'a';
+        if (data[i] == '\n') expected_count++;
+    }
+    bool whole = text_buffer_count_newlines(data, sizeof(data)) == expected_count;
+    bool unaligned_tail = text_buffer_count_newlines(data + 3, 29) == text_buffer_count_newlines(data + 3, 16) + text_buffer_count_newlines(data + 19, 13);
+    bool empty = text_buffer_count_newlines(data, 0) == 0;
+    UNIT_TESTS_RUN_CHECK(whole && unaligned_tail && empty);
+}
+
 void test__text_buffer_extract_range(UT_State *s)
 {
     Text_Buffer text_buffer = text_buffer_create_from_lines(
@@ -1385,6 +1589,877 @@ void test__cursor_pos_to_prev_start_of_paragraph__start_at_first_white_lines(UT_
     text_buffer_destroy(&text_buffer);
 }
 
+void test__large_file_get_line(UT_State *s)
+{
+    // Large files are always read through a file mapping, whose pages get released after indexing
+    char path[] = "/tmp/e2_large_file_test_XXXXXX";
+    int fd = mkstemp(path);
+    FILE *file = fdopen(fd, "w");
+    const int line_count = LARGE_FILE_INDEX_STRIDE * 3 + 10;
+    for (int i = 0; i < line_count - 1; i++)
+    {
+        fprintf(file, "line %d\n", i);
+    }
+    fprintf(file, "last line");
+    size_t size = (size_t)ftell(file);
+    fclose(file);
+    fd = open(path, O_RDONLY);
+    Mapped_File mapped = { .data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0), .size = size };
+    close(fd);
+    unlink(path);
+
+    Large_File large_file = large_file_create(mapped);
+    const char *str;
+    int len;
+    large_file_get_line(&large_file, 5, &str, &len);
+    bool indexed_lazily = !large_file.is_fully_indexed && large_file_get_line_count(&large_file) == 6;
+    bool first_line = large_file_get_line(&large_file, 0, &str, &len) && len == 7 && strncmp(str, "line 0\n", len) == 0;
+    bool across_stride = large_file_get_line(&large_file, LARGE_FILE_INDEX_STRIDE + 1, &str, &len) && strncmp(str, "line 1025\n", len) == 0;
+    bool last_line = large_file_get_line(&large_file, line_count - 1, &str, &len) && len == 9 && strncmp(str, "last line", len) == 0;
+    bool past_the_end = !large_file_get_line(&large_file, line_count, &str, &len);
+    bool fully_indexed = large_file.is_fully_indexed && large_file_get_line_count(&large_file) == line_count;
+
+    UNIT_TESTS_RUN_CHECK(indexed_lazily && first_line && across_stride && last_line && past_the_end && fully_indexed);
+
+    large_file_destroy(&large_file);
+    munmap((void *)mapped.data, mapped.size);
+}
+
+void test__font_line_metrics(UT_State *s)
+{
+    stbtt_bakedchar char_data[96] = {0};
+    for (int i = 0; i < 96; i++) char_data[i].xadvance = 4.0f + i % 3;
+    Render_Font proportional = { .char_data = char_data, .char_count = 96, .i_dpi_scale = 0.5f };
+    font_init_advances(&proportional);
+    stbtt_bakedchar mono_char_data[96] = {0};
+    for (int i = 0; i < 96; i++) mono_char_data[i].xadvance = 8.0f;
+    Render_Font mono = { .char_data = mono_char_data, .char_count = 96, .i_dpi_scale = 0.5f };
+    font_init_advances(&mono);
+    bool detects_monospace = mono.is_monospace && mono.monospace_advance == 4.0f && !proportional.is_monospace;
+
+    // At half scale 'a' is 3.0 wide, 'b' 2.0, 'c' 2.5, and the newline measures like a space (2.0)
+    Text_Line line = text_line_make_dup("abc\n");
+    bool col_x = get_line_col_x(&line, 2, proportional) == 5.0f && get_line_col_x(&line, 4, proportional) == 9.5f;
+    bool col_at_x = get_line_col_at_x(&line, proportional, -1.0f) == 0 &&
+        get_line_col_at_x(&line, proportional, 3.5f) == 1 &&
+        get_line_col_at_x(&line, proportional, 7.4f) == 2 &&
+        get_line_col_at_x(&line, proportional, 100.0f) == 4;
+    bool cached = line.x_cache != NULL;
+
+    text_line_insert_char(&line, 'c', 0);
+    bool invalidated_on_edit = line.x_cache == NULL;
+    bool remeasured = get_line_col_x(&line, 2, proportional) == 5.5f;
+
+    Text_Line mono_line = text_line_make_dup("abc\n");
+    bool mono_queries = get_line_col_x(&mono_line, 3, mono) == 12.0f &&
+        get_line_col_at_x(&mono_line, mono, 9.0f) == 2 &&
+        get_line_col_at_x(&mono_line, mono, 100.0f) == 4 &&
+        mono_line.x_cache == NULL;
+
+    UNIT_TESTS_RUN_CHECK(detects_monospace && col_x && col_at_x && cached && invalidated_on_edit && remeasured && mono_queries);
+
+    text_line_destroy(&line);
+    text_line_destroy(&mono_line);
+    free(proportional.advances);
+    free(mono.advances);
+}
+
+void test__render_batch_merge(UT_State *s)
+{
+    Render_State render_state = { .quad_shader = 1, .tex_shader = 2, .batch = render_batch_create() };
+    Render_Batch *batch = render_state.batch;
+    m4 mvp_a = {{1}};
+    m4 mvp_b = {{2}};
+    Rect r = {0, 0, 10, 10};
+    Color c = {255, 255, 255, 255};
+
+    render_batch_set_mvp(batch, mvp_a);
+    draw_quad(r, c, &render_state);
+    draw_quad(r, c, &render_state);
+    bool same_state_merged = batch->cmd_count == 1 && batch->cmds[0].vert_count == 12;
+
+    draw_texture(7, r, c, &render_state);
+    draw_texture(7, r, c, &render_state);
+    bool new_shader_splits = batch->cmd_count == 2 && batch->cmds[1].first_vert == 12 && batch->cmds[1].vert_count == 12;
+
+    render_batch_set_scissor(batch, r);
+    draw_texture(7, r, c, &render_state);
+    render_batch_clear_scissor(batch);
+    render_batch_set_mvp(batch, mvp_b);
+    draw_texture(7, r, c, &render_state);
+    render_batch_set_mvp(batch, mvp_b);
+    draw_texture(7, r, c, &render_state);
+    bool scissor_and_mvp_split = batch->cmd_count == 4 && batch->mvp_count == 2 && batch->cmds[3].vert_count == 12;
+    bool verts_contiguous = batch->vert_count == 42 && batch->cmds[3].first_vert == 30;
+
+    UNIT_TESTS_RUN_CHECK(same_state_merged && new_shader_splits && scissor_and_mvp_split && verts_contiguous);
+
+    render_batch_destroy(batch);
+}
+
+void test__render_batch_long_string(UT_State *s)
+{
+    // A line much longer than a chunk streams through several flushes instead of hitting a cap
+    stbtt_bakedchar char_data[96] = {0};
+    Render_State render_state = { .font = { .char_data = char_data, .atlas_w = 1, .atlas_h = 1, .i_dpi_scale = 1.0f }, .batch = render_batch_create() };
+    Render_Batch *batch = render_state.batch;
+    render_batch_set_mvp(batch, (m4){{1}});
+
+    int glyph_count = RENDER_BATCH_CHUNK_VERTS / 6 * 5; // Exactly 5 full chunks of glyphs
+    char *str = xmalloc(glyph_count + 1);
+    memset(str, 'a', glyph_count);
+    str[glyph_count] = '\0';
+    draw_string(str, render_state.font, 0, 0, (Color){255, 255, 255, 255}, &render_state);
+    render_batch_end_frame(batch, &render_state);
+
+    Render_Batch_Stats stats = batch->last_frame_stats;
+    bool all_verts_uploaded = stats.vert_count == glyph_count * 6;
+    bool one_upload_per_chunk = stats.vert_upload_count == 5 && stats.draw_call_count == 5;
+    bool batch_reset = batch->vert_count == 0 && batch->cmd_count == 0;
+    UNIT_TESTS_RUN_CHECK(all_verts_uploaded && one_upload_per_chunk && batch_reset);
+
+    free(str);
+    render_batch_destroy(batch);
+}
+
+void test__view_cache_key(UT_State *s)
+{
+    // Panning or moving a view reuses its texture, anything that changes what's inside it doesn't
+    Buffer buffer = { .text_buffer = text_buffer_create_from_lines("abc", "def", NULL) };
+    View view = { .kind = VIEW_KIND_BUFFER, .outer_rect = {100, 100, 400, 300} };
+    view.bv.buffer = &buffer;
+    view.bv.viewport.zoom = 1.0f;
+    Render_State render_state = { .dpi_scale = 2.0f };
+    Viewport canvas_viewport = { .rect = {0, 0, 1000, 900}, .zoom = 1.0f };
+
+    View_Cache_Key key = view_cache_make_key(&view, true, canvas_viewport, &render_state);
+    bool correct_size = key.px_w == 800 && key.px_h == 600;
+
+    canvas_viewport.rect.x += 123.5f;
+    view.outer_rect.y += 50;
+    View_Cache_Key panned_key = view_cache_make_key(&view, true, canvas_viewport, &render_state);
+    bool pan_reuses = memcmp(&key, &panned_key, sizeof(key)) == 0;
+
+    view.bv.cursor.pos.col = 1;
+    View_Cache_Key moved_cursor_key = view_cache_make_key(&view, true, canvas_viewport, &render_state);
+    bool cursor_move_redraws = memcmp(&panned_key, &moved_cursor_key, sizeof(key)) != 0;
+
+    text_buffer_insert_char(&buffer.text_buffer, 'x', (Cursor_Pos){0, 0});
+    View_Cache_Key edited_key = view_cache_make_key(&view, true, canvas_viewport, &render_state);
+    bool edit_redraws = memcmp(&moved_cursor_key, &edited_key, sizeof(key)) != 0;
+
+    view.bv.cursor.blink_time = 0.7f;
+    View_Cache_Key blinked_key = view_cache_make_key(&view, true, canvas_viewport, &render_state);
+    View_Cache_Key inactive_key = view_cache_make_key(&view, false, canvas_viewport, &render_state);
+    view.bv.cursor.blink_time = 0.2f;
+    View_Cache_Key inactive_blinked_key = view_cache_make_key(&view, false, canvas_viewport, &render_state);
+    bool blink_redraws_active_only = memcmp(&edited_key, &blinked_key, sizeof(key)) != 0 &&
+        memcmp(&inactive_key, &inactive_blinked_key, sizeof(key)) == 0;
+
+    // A different buffer in the same slot, or the same buffer under a new name, is a different picture
+    buffer.id++;
+    View_Cache_Key reused_slot_key = view_cache_make_key(&view, false, canvas_viewport, &render_state);
+    buffer.file_path_generation++;
+    View_Cache_Key renamed_key = view_cache_make_key(&view, false, canvas_viewport, &render_state);
+    bool identity_redraws = memcmp(&inactive_blinked_key, &reused_slot_key, sizeof(key)) != 0 &&
+        memcmp(&reused_slot_key, &renamed_key, sizeof(key)) != 0;
+
+    UNIT_TESTS_RUN_CHECK(correct_size && pan_reuses && cursor_move_redraws && edit_redraws && blink_redraws_active_only && identity_redraws);
+
+    text_buffer_destroy(&buffer.text_buffer);
+}
+
+bool grid_test__has_view(View **views, int count, View *view)
+{
+    for (int i = 0; i < count; i++) if (views[i] == view) return true;
+    return false;
+}
+
+void test__view_grid(UT_State *s)
+{
+    View_Grid grid = {0};
+    View a = {0}, b = {0}, far = {0}, huge = {0};
+    view_grid_insert(&grid, &a, (Rect){0, 0, 100, 100});
+    view_grid_insert(&grid, &b, (Rect){50, 50, 1000, 1000}); // Spans several cells
+    view_grid_insert(&grid, &far, (Rect){150000, -30000, 200, 200});
+    view_grid_insert(&grid, &huge, (Rect){-100000, -100000, 200000, 200000});
+
+    View **views;
+    int count = view_grid_query_point(&grid, V2(75, 75), &views);
+    bool point_in_overlap = count == 3 && grid_test__has_view(views, count, &a) && grid_test__has_view(views, count, &b) && grid_test__has_view(views, count, &huge);
+
+    count = view_grid_query_rect(&grid, (Rect){0, 0, 2000, 2000}, &views);
+    bool rect_dedups_spanning = count == 3 && grid_test__has_view(views, count, &b);
+
+    count = view_grid_query_rect(&grid, (Rect){149000, -31000, 2000, 2000}, &views);
+    bool rect_far = count == 1 && views[0] == &far;
+
+    view_grid_remove(&grid, &a);
+    view_grid_insert(&grid, &a, (Rect){5000, 5000, 100, 100});
+    view_grid_remove(&grid, &huge);
+    count = view_grid_query_point(&grid, V2(10, 10), &views);
+    int moved_count = view_grid_query_point(&grid, V2(5050, 5050), &views);
+    bool moved = count == 0 && moved_count == 1 && views[0] == &a;
+
+    UNIT_TESTS_RUN_CHECK(point_in_overlap && rect_dedups_spanning && rect_far && moved);
+
+    view_grid_destroy(&grid);
+}
+
+void test__file_watch(UT_State *s)
+{
+    char dir[] = "/tmp/e2_file_watch_test_XXXXXX";
+    mkdtemp(dir);
+    char path[64];
+    snprintf(path, sizeof(path), "%s/watched.txt", dir);
+    FILE *file = fopen(path, "w");
+    fputs("a", file);
+    fclose(file);
+
+    File_Watch file_watch = file_watch_create(0.0);
+    int id = file_watch_add(&file_watch, path);
+    file_watch_update(&file_watch, 1.0);
+    int event_id = 0;
+    bool quiet_before_change = !file_watch_next_event(&file_watch, &event_id);
+
+    // Size changes too, so the stat fallback sees it within the same mtime second
+    file = fopen(path, "w");
+    fputs("abc", file);
+    fclose(file);
+    file_watch_update(&file_watch, 2.0);
+    bool has_event = file_watch_next_event(&file_watch, &event_id) && event_id == id;
+    bool deduped = !file_watch_next_event(&file_watch, &event_id);
+
+    // Written by the editor itself and refreshed right after, nothing comes back
+    file = fopen(path, "w");
+    fputs("abcd", file);
+    fclose(file);
+    file_watch_refresh(&file_watch, id);
+    file_watch_update(&file_watch, 2.5);
+    bool quiet_after_refresh = !file_watch_next_event(&file_watch, &event_id);
+
+    file_watch_remove(&file_watch, id);
+    file = fopen(path, "w");
+    fputs("abcdef", file);
+    fclose(file);
+    file_watch_update(&file_watch, 3.0);
+    bool quiet_after_remove = !file_watch_next_event(&file_watch, &event_id);
+
+    UNIT_TESTS_RUN_CHECK(quiet_before_change && has_event && deduped && quiet_after_refresh && quiet_after_remove);
+
+    file_watch_destroy(&file_watch);
+    unlink(path);
+    rmdir(dir);
+}
+
+void test__module_hash_file(UT_State *s)
+{
+    // Keys are built from several pieces, hashing them one after the other must match hashing them joined
+    const char *content = "int on_run(void);\n";
+    uint64_t joined = module_hash(MODULE_HASH_SEED, content, strlen(content));
+    uint64_t chained = module_hash(module_hash(MODULE_HASH_SEED, content, 4), content + 4, strlen(content) - 4);
+
+    char path[] = "/tmp/e2_module_hash_test_XXXXXX";
+    int fd = mkstemp(path);
+    write(fd, content, strlen(content));
+    close(fd);
+    uint64_t file_hash = 0;
+    bool hashed = module_hash_file(path, &file_hash);
+    unlink(path);
+    bool missing = !module_hash_file(path, &file_hash);
+
+    UNIT_TESTS_RUN_CHECK(joined == chained && hashed && file_hash == joined && missing);
+}
+
+void test__journal_replay(UT_State *s)
+{
+    Text_Buffer text_buffer = text_buffer_create_from_lines("abc", "def", NULL);
+
+    Journal_Batch batch = {0};
+    journal_batch_put_snapshot(&batch, &text_buffer, "notes.txt");
+    size_t snapshot_size;
+    char *snapshot = journal_batch_finish(&batch, &snapshot_size);
+
+    char range[] = "XY\nZ";
+    Delta deltas[] = {
+        { .kind = DELTA_INSERT_CHAR, .insert_char = { .pos = {0, 1}, .c = '!' } },
+        { .kind = DELTA_INSERT_RANGE, .insert_range = { .start = {1, 0}, .range = range } },
+        { .kind = DELTA_REMOVE_RANGE, .remove_range = { .start = {0, 0}, .end = {0, 2} } },
+    };
+    for (int i = 0; i < 3; i++) journal_batch_put_delta(&batch, &deltas[i]);
+    size_t deltas_size;
+    char *appended = journal_batch_finish(&batch, &deltas_size);
+
+    // Last frame cut short the way a crash mid write would leave it
+    journal_batch_put_delta(&batch, &(Delta){ .kind = DELTA_REMOVE_CHAR, .remove_char = { .pos = {0, 0} } });
+    size_t torn_size;
+    char *torn = journal_batch_finish(&batch, &torn_size);
+
+    char path[] = "/tmp/e2_journal_test_XXXXXX";
+    int fd = mkstemp(path);
+    write(fd, snapshot, snapshot_size);
+    write(fd, appended, deltas_size);
+    write(fd, torn, torn_size - 1);
+    close(fd);
+
+    Text_Buffer replayed = {0};
+    char *file_path = NULL;
+    bool did_replay = journal_replay_file(path, &replayed, &file_path);
+    unlink(path);
+
+    bool correct_text = did_replay && validate__text_buffer(&replayed, "bc\n", "XY\n", "Zdef\n", NULL);
+    bool correct_path = file_path && strcmp(file_path, "notes.txt") == 0;
+
+    UNIT_TESTS_RUN_CHECK(correct_text && correct_path);
+
+    free(snapshot);
+    free(appended);
+    free(torn);
+    free(file_path);
+    text_buffer_destroy(&replayed);
+    text_buffer_destroy(&text_buffer);
+}
+
+const char *_unit_tests_search_naive(const char *needle, bool ignore_case, const char *data, size_t size, bool backward)
+{
+    size_t len = strlen(needle);
+    if (len == 0 || size < len) return NULL;
+    for (size_t n = 0; n <= size - len; n++)
+    {
+        size_t pos = backward ? size - len - n : n;
+        size_t i = 0;
+        while (i < len && (ignore_case ? tolower((unsigned char)data[pos + i]) == tolower((unsigned char)needle[i]) : data[pos + i] == needle[i])) i++;
+        if (i == len) return data + pos;
+    }
+    return NULL;
+}
+
+void test__search_forward_backward(UT_State *s)
+{
+    // Small alphabet so candidates are everywhere, needle lengths cover the vector and Horspool paths
+    size_t size = 4096;
+    char *data = xmalloc(size);
+    unsigned int seed = 12345;
+    const char alphabet[] = "abAB\nx";
+    for (size_t i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+    }
+
+    int needle_lens[] = {1, 2, 3, 7, 16, 33, 40};
+    bool all_match = true;
+    for (int n = 0; n < (int)(sizeof(needle_lens) / sizeof(needle_lens[0])); n++)
+    {
+        int len = needle_lens[n];
+        char needle[64];
+        for (int trial = 0; trial < 8; trial++)
+        {
+            // Taken from the data so there is something to find, with some case flipped
+            size_t from = (trial * 977 + len * 31) % (size - len);
+            memcpy(needle, data + from, len);
+            needle[len] = '\0';
+            if (trial % 2) needle[len / 2] ^= isalpha((unsigned char)needle[len / 2]) ? 0x20 : 0;
+
+            for (int ignore_case = 0; ignore_case <= 1; ignore_case++)
+            {
+                Search_Pattern pattern = search_pattern_create(needle, ignore_case);
+                for (size_t start = 0; start < 40; start += 13)
+                {
+                    for (size_t end = size; end > size - 40; end -= 7)
+                    {
+                        const char *d = data + start;
+                        size_t d_size = end - start;
+                        if (search_forward(&pattern, d, d_size) != _unit_tests_search_naive(needle, ignore_case, d, d_size, false)) all_match = false;
+                        if (search_backward(&pattern, d, d_size) != _unit_tests_search_naive(needle, ignore_case, d, d_size, true)) all_match = false;
+                    }
+                }
+                search_pattern_destroy(&pattern);
+            }
+        }
+    }
+
+    Search_Pattern empty = search_pattern_create("", false);
+    bool empty_matches_nothing = search_forward(&empty, data, size) == NULL && search_backward(&empty, data, size) == NULL;
+    search_pattern_destroy(&empty);
+
+    UNIT_TESTS_RUN_CHECK(all_match && empty_matches_nothing);
+
+    free(data);
+}
+
+void test__text_buffer_search(UT_State *s)
+{
+    Text_Buffer text_buffer = text_buffer_create_from_lines(
+        "int foo = 1;",
+        "Foo(foo);",
+        "return foo",
+        NULL);
+
+    Search_Pattern exact = search_pattern_create("foo", false);
+    Cursor_Pos pos;
+    bool next_skips_cursor = text_buffer_search_next(&text_buffer, &exact, (Cursor_Pos){0, 4}, &pos) && pos.line == 1 && pos.col == 4;
+    bool next_from_start = text_buffer_search_next(&text_buffer, &exact, (Cursor_Pos){0, -1}, &pos) && pos.line == 0 && pos.col == 4;
+    bool prev_skips_cursor = text_buffer_search_prev(&text_buffer, &exact, (Cursor_Pos){1, 4}, &pos) && pos.line == 0 && pos.col == 4;
+    bool prev_from_end = text_buffer_search_prev(&text_buffer, &exact, (Cursor_Pos){text_buffer.line_count, 0}, &pos) && pos.line == 2 && pos.col == 7;
+    bool none_before_first = !text_buffer_search_prev(&text_buffer, &exact, (Cursor_Pos){0, 4}, &pos);
+    search_pattern_destroy(&exact);
+
+    Search_Pattern folded = search_pattern_create("foo", true);
+    bool folds_case = text_buffer_search_next(&text_buffer, &folded, (Cursor_Pos){0, 4}, &pos) && pos.line == 1 && pos.col == 0;
+    search_pattern_destroy(&folded);
+
+    Search_Pattern across = search_pattern_create("1;\nfoo(", true);
+    bool spans_lines = text_buffer_search_next(&text_buffer, &across, (Cursor_Pos){0, -1}, &pos) && pos.line == 0 && pos.col == 10;
+    bool spans_lines_backward = text_buffer_search_prev(&text_buffer, &across, (Cursor_Pos){2, 0}, &pos) && pos.line == 0 && pos.col == 10;
+    search_pattern_destroy(&across);
+
+    Search_Pattern past_end = search_pattern_create("foo\nbar", false);
+    bool stops_at_last_line = !text_buffer_search_next(&text_buffer, &past_end, (Cursor_Pos){0, -1}, &pos);
+    search_pattern_destroy(&past_end);
+
+    // Loaded lines are searched in runs across the shared block, an edited line breaks the run
+    const char *data = "aaa\nbb foo\nccc\nfoo dd\neee\n";
+    Text_Buffer loaded = text_buffer_create_from_data(data, strlen(data));
+    text_buffer_insert_char(&loaded, 'x', (Cursor_Pos){2, 0});
+    Search_Pattern in_run = search_pattern_create("foo", false);
+    Cursor_Pos first, second, back_first, back_second;
+    bool finds_in_runs =
+        text_buffer_search_next(&loaded, &in_run, (Cursor_Pos){0, 0}, &first) &&
+        text_buffer_search_next(&loaded, &in_run, first, &second) &&
+        !text_buffer_search_next(&loaded, &in_run, second, &pos) &&
+        text_buffer_search_prev(&loaded, &in_run, (Cursor_Pos){4, 2}, &back_first) &&
+        text_buffer_search_prev(&loaded, &in_run, back_first, &back_second) &&
+        !text_buffer_search_prev(&loaded, &in_run, back_second, &pos);
+    bool correct_run_positions =
+        cursor_pos_eq(first, (Cursor_Pos){1, 3}) && cursor_pos_eq(second, (Cursor_Pos){3, 0}) &&
+        cursor_pos_eq(back_first, second) && cursor_pos_eq(back_second, first);
+    search_pattern_destroy(&in_run);
+    text_buffer_destroy(&loaded);
+
+    UNIT_TESTS_RUN_CHECK(next_skips_cursor && next_from_start && prev_skips_cursor && prev_from_end && none_before_first &&
+        folds_case && spans_lines && spans_lines_backward && stops_at_last_line && finds_in_runs && correct_run_positions);
+
+    text_buffer_destroy(&text_buffer);
+}
+
+// Random pattern over a small alphabet, in the syntax POSIX extended regexes share with ours
+void _unit_tests_random_regex(char *out, int depth, unsigned int *seed)
+{
+    int pieces = 1 + rand_r(seed) % 3;
+    for (int i = 0; i < pieces; i++)
+    {
+        int kind = rand_r(seed) % (depth > 0 ? 7 : 5);
+        switch (kind)
+        {
+            case 0: strcat(out, "a"); break;
+            case 1: strcat(out, "b"); break;
+            case 2: strcat(out, "."); break;
+            case 3: strcat(out, "[ab]"); break;
+            case 4: strcat(out, "[^a]"); break;
+            default:
+            {
+                strcat(out, "(");
+                _unit_tests_random_regex(out, depth - 1, seed);
+                if (kind == 6)
+                {
+                    strcat(out, "|");
+                    _unit_tests_random_regex(out, depth - 1, seed);
+                }
+                strcat(out, ")");
+            } break;
+        }
+        const char *repeats[] = {"", "", "*", "+", "?", "{1,2}", "{2}"};
+        strcat(out, repeats[rand_r(seed) % 7]);
+    }
+}
+
+void test__search_regex(UT_State *s)
+{
+    // Same leftmost longest match as POSIX regexec for random patterns and lines
+    unsigned int seed = 23;
+    int mismatches = 0;
+    for (int i = 0; i < 2000; i++)
+    {
+        char pattern[512] = {0};
+        if (rand_r(&seed) % 4 == 0) strcat(pattern, "^");
+        _unit_tests_random_regex(pattern, 2, &seed);
+        if (rand_r(&seed) % 4 == 0) strcat(pattern, "$");
+
+        regex_t posix;
+        Search_Regex regex;
+        char error[128];
+        if (regcomp(&posix, pattern, REG_EXTENDED) != 0) continue;
+        if (!search_regex_compile(&regex, pattern, false, error, sizeof(error)))
+        {
+            mismatches++;
+            regfree(&posix);
+            continue;
+        }
+        for (int j = 0; j < 10; j++)
+        {
+            char line[16];
+            int len = rand_r(&seed) % 12;
+            for (int k = 0; k < len; k++) line[k] = "abc"[rand_r(&seed) % 3];
+            line[len] = '\0';
+
+            regmatch_t posix_match;
+            bool posix_found = regexec(&posix, line, 1, &posix_match, 0) == 0;
+            int start, end;
+            bool found = search_regex_search_line(&regex, line, len, 0, INT_MAX, false, &start, &end);
+            if (found != posix_found || (found && (start != posix_match.rm_so || end != posix_match.rm_eo)))
+            {
+                mismatches++;
+            }
+        }
+        search_regex_destroy(&regex);
+        regfree(&posix);
+    }
+
+    // Start bounds, backward search and the line break, which is never part of the text
+    Search_Regex words;
+    search_regex_compile(&words, "[a-z]+\\d*", false, NULL, 0);
+    int start, end;
+    bool leftmost = search_regex_search_line(&words, "12 ab3 cd45\n", 12, 0, INT_MAX, false, &start, &end) && start == 3 && end == 6;
+    bool from_min = search_regex_search_line(&words, "12 ab3 cd45\n", 12, 4, INT_MAX, false, &start, &end) && start == 4 && end == 6;
+    bool rightmost = search_regex_search_line(&words, "12 ab3 cd45\n", 12, 0, INT_MAX, true, &start, &end) && start == 8 && end == 11;
+    bool to_max = search_regex_search_line(&words, "12 ab3 cd45\n", 12, 0, 6, true, &start, &end) && start == 4 && end == 6;
+    search_regex_destroy(&words);
+
+    Search_Regex anchored;
+    search_regex_compile(&anchored, "^\\s*(int|char) \\w+;$", false, NULL, 0);
+    bool anchors = search_regex_search_line(&anchored, "  int x;\n", 9, 0, INT_MAX, false, &start, &end) && start == 0 && end == 8 &&
+        !search_regex_search_line(&anchored, "  int x; y\n", 11, 0, INT_MAX, false, &start, &end) &&
+        !search_regex_search_line(&anchored, "  int x;\n", 9, 1, INT_MAX, false, &start, &end);
+    search_regex_destroy(&anchored);
+
+    Search_Regex folded;
+    search_regex_compile(&folded, "fo[o-q]", true, NULL, 0);
+    bool folds_case = search_regex_search_line(&folded, "xFOP", 4, 0, INT_MAX, false, &start, &end) && start == 1 && end == 4;
+    search_regex_destroy(&folded);
+
+    const char *bad[] = {"a(", "a)", "*a", "[a", "a{3,2}", "a{999}", "\\", "\\q"};
+    bool rejects_bad = true;
+    for (int i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); i++)
+    {
+        Search_Regex regex;
+        char error[128] = {0};
+        if (search_regex_compile(&regex, bad[i], false, error, sizeof(error)) || error[0] == '\0') rejects_bad = false;
+    }
+
+    UNIT_TESTS_RUN_CHECK(mismatches == 0 && leftmost && from_min && rightmost && to_max && anchors && folds_case && rejects_bad);
+}
+
+void test__text_buffer_regex_search(UT_State *s)
+{
+    Text_Buffer text_buffer = text_buffer_create_from_lines(
+        "int foo_1 = 1;",
+        "Foo(foo_22);",
+        "return foo_333",
+        NULL);
+    Search_Regex regex;
+    search_regex_compile(&regex, "foo_\\d+", false, NULL, 0);
+    Cursor_Pos start, end;
+    bool next_skips_cursor = text_buffer_regex_search_next(&text_buffer, &regex, (Cursor_Pos){0, 4}, &start, &end) &&
+        cursor_pos_eq(start, (Cursor_Pos){1, 4}) && cursor_pos_eq(end, (Cursor_Pos){1, 10});
+    bool prev_from_end = text_buffer_regex_search_prev(&text_buffer, &regex, (Cursor_Pos){text_buffer.line_count, 0}, &start, &end) &&
+        cursor_pos_eq(start, (Cursor_Pos){2, 7}) && cursor_pos_eq(end, (Cursor_Pos){2, 14});
+    bool none_before_first = !text_buffer_regex_search_prev(&text_buffer, &regex, (Cursor_Pos){0, 4}, &start, &end);
+    search_regex_destroy(&regex);
+
+    search_regex_compile(&regex, "^foo", true, NULL, 0);
+    bool anchored_folded = text_buffer_regex_search_next(&text_buffer, &regex, (Cursor_Pos){0, -1}, &start, &end) &&
+        cursor_pos_eq(start, (Cursor_Pos){1, 0}) && cursor_pos_eq(end, (Cursor_Pos){1, 3});
+    search_regex_destroy(&regex);
+
+    UNIT_TESTS_RUN_CHECK(next_skips_cursor && prev_from_end && none_before_first && anchored_folded);
+
+    text_buffer_destroy(&text_buffer);
+}
+
+// Polls until the scan for seed is done, false if that takes over a few seconds
+bool _unit_tests_search_scanner_wait(Search_Scanner *scanner, unsigned int seed, Search_Scan_Result *out_result)
+{
+    double start_time = _unit_tests_get_time_ms();
+    while (_unit_tests_get_time_ms() - start_time < 5000.0)
+    {
+        *out_result = search_scanner_poll(scanner);
+        if (out_result->seed == seed && out_result->is_done) return true;
+        usleep(100);
+    }
+    return false;
+}
+
+void test__search_scanner(UT_State *s)
+{
+    Text_Buffer text_buffer = text_buffer_create_from_lines(
+        "int foo_1 = 1;",
+        "Foo(foo_22);",
+        "return foo_333",
+        NULL);
+    Search_Scanner scanner = {0};
+    search_scanner_start(&scanner);
+    Search_Scan_Result result;
+
+    // Count takes in matches before from too, first is after it
+    unsigned int seed = search_scanner_post(&scanner, &text_buffer, 1, "foo", true, false, (Cursor_Pos){0, 4});
+    bool literal = _unit_tests_search_scanner_wait(&scanner, seed, &result) &&
+        result.has_first && cursor_pos_eq(result.first, (Cursor_Pos){1, 0}) && result.match_count == 4;
+    Search_Snapshot *snapshot = scanner.snapshot;
+
+    seed = search_scanner_post(&scanner, &text_buffer, 1, "foo_\\d+", false, true, (Cursor_Pos){1, 4});
+    bool regex = _unit_tests_search_scanner_wait(&scanner, seed, &result) &&
+        result.has_first && cursor_pos_eq(result.first, (Cursor_Pos){2, 7}) && result.match_count == 3;
+    bool reuses_snapshot = scanner.snapshot == snapshot;
+
+    seed = search_scanner_post(&scanner, &text_buffer, 1, ";\n", false, false, (Cursor_Pos){1, 0});
+    seed = search_scanner_post(&scanner, &text_buffer, 1, ";\nret", false, false, (Cursor_Pos){1, 0});
+    bool spans_lines = _unit_tests_search_scanner_wait(&scanner, seed, &result) &&
+        result.has_first && cursor_pos_eq(result.first, (Cursor_Pos){1, 11}) && result.match_count == 1;
+
+    seed = search_scanner_post(&scanner, &text_buffer, 1, "int", false, false, (Cursor_Pos){0, 0});
+    bool none_after = _unit_tests_search_scanner_wait(&scanner, seed, &result) && !result.has_first && result.match_count == 1;
+
+    seed = search_scanner_post(&scanner, &text_buffer, 1, "(foo", false, true, (Cursor_Pos){0, 0});
+    bool invalid = _unit_tests_search_scanner_wait(&scanner, seed, &result) && result.is_invalid;
+
+    text_buffer_insert_line(&text_buffer, text_line_make_f("foo"), 0);
+    seed = search_scanner_post(&scanner, &text_buffer, 1, "foo", false, false, (Cursor_Pos){0, -1});
+    bool sees_edit = _unit_tests_search_scanner_wait(&scanner, seed, &result) &&
+        cursor_pos_eq(result.first, (Cursor_Pos){0, 0}) && result.match_count == 4 && scanner.snapshot != snapshot;
+
+    UNIT_TESTS_RUN_CHECK(literal && regex && reuses_snapshot && spans_lines && none_after && invalid && sees_edit);
+
+    search_scanner_stop(&scanner);
+    text_buffer_destroy(&text_buffer);
+}
+
+void _unit_tests_write_file(const char *path, const char *data, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+void _unit_tests_remove_tree(const char *path)
+{
+    DIR *d = opendir(path);
+    if (!d)
+    {
+        unlink(path);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char *child = strf("%s/%s", path, entry->d_name);
+        _unit_tests_remove_tree(child);
+        free(child);
+    }
+    closedir(d);
+    rmdir(path);
+}
+
+// Polls until the workers are done and takes every hit, false if that takes over a few seconds
+bool _unit_tests_grep_wait(Grep *grep, Grep_Hit **out_hits, int *out_count, Grep_Stats *out_stats)
+{
+    *out_hits = NULL;
+    *out_count = 0;
+    double start_time = _unit_tests_get_time_ms();
+    bool is_done = false;
+    while (!is_done && _unit_tests_get_time_ms() - start_time < 5000.0)
+    {
+        is_done = grep_is_done(grep, out_stats);
+        int count;
+        Grep_Hit *hits = grep_take_hits(grep, &count);
+        if (count > 0)
+        {
+            *out_hits = xrealloc(*out_hits, (*out_count + count) * sizeof(hits[0]));
+            memcpy(*out_hits + *out_count, hits, count * sizeof(hits[0]));
+            *out_count += count;
+        }
+        free(hits);
+        if (!is_done) usleep(100);
+    }
+    return is_done;
+}
+
+bool _unit_tests_grep_has_hit(const Grep_Hit *hits, int count, const char *name, int buffer_id, int line, int col, const char *preview)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(hits[i].name, name) == 0 && hits[i].buffer_id == buffer_id &&
+            hits[i].line == line && hits[i].col == col && strcmp(hits[i].preview, preview) == 0) return true;
+    }
+    return false;
+}
+
+void test__grep(UT_State *s)
+{
+    char dir_template[] = "/tmp/e2_grep_test_XXXXXX";
+    mkdtemp(dir_template);
+    char dir[PATH_MAX];
+    realpath(dir_template, dir);
+    char path[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/a.txt", dir);
+    _unit_tests_write_file(path, "foo\nbar foo\n", 12);
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/b.c", dir);
+    _unit_tests_write_file(path, "int Foo;", 8);
+    snprintf(path, sizeof(path), "%s/bin.dat", dir);
+    _unit_tests_write_file(path, "foo\0foo", 7);
+    snprintf(path, sizeof(path), "%s/.hidden", dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/.hidden/c.txt", dir);
+    _unit_tests_write_file(path, "foo", 3);
+    char open_path[PATH_MAX + 32];
+    snprintf(open_path, sizeof(open_path), "%s/open.txt", dir);
+    _unit_tests_write_file(open_path, "foo foo\n", 8);
+
+    // Same hits whether one worker does it all or several steal from each other
+    bool all_found = true;
+    int thread_counts[] = {1, 4};
+    for (int t = 0; t < 2; t++)
+    {
+        Grep *grep = grep_create("foo", true, thread_counts[t]);
+        grep_skip_open_file(grep, open_path);
+        grep_add_text(grep, "<buffer 7>", 7, xstrdup("xx FOO"), 6);
+        grep_add_dir(grep, dir);
+        grep_run(grep);
+        Grep_Hit *hits;
+        int hit_count;
+        Grep_Stats stats;
+        bool is_done = _unit_tests_grep_wait(grep, &hits, &hit_count, &stats);
+        all_found &= is_done && hit_count == 4 && stats.hit_count == 4 && !stats.is_truncated &&
+            _unit_tests_grep_has_hit(hits, hit_count, "a.txt", 0, 0, 0, "foo") &&
+            _unit_tests_grep_has_hit(hits, hit_count, "a.txt", 0, 1, 4, "bar foo") &&
+            _unit_tests_grep_has_hit(hits, hit_count, "sub/b.c", 0, 0, 4, "int Foo;") &&
+            _unit_tests_grep_has_hit(hits, hit_count, "<buffer 7>", 7, 0, 3, "xx FOO") &&
+            stats.dir_count == 2 && stats.file_count == 3 && stats.binary_count == 1 && stats.open_count == 1 &&
+            stats.thread_count == thread_counts[t];
+        grep_free_hits(hits, hit_count);
+        free(hits);
+        grep_destroy(grep);
+    }
+
+    // Destroyed while running, the workers stop and nothing leaks
+    Grep *grep = grep_create("foo", false, 2);
+    grep_add_dir(grep, dir);
+    grep_run(grep);
+    grep_destroy(grep);
+
+    // One long line with more hits than the cap, previews stop at their length and the search at the cap
+    int repeat_count = GREP_MAX_HITS + 5000;
+    char *long_line = xmalloc(repeat_count * 4 + 1);
+    for (int i = 0; i < repeat_count; i++) memcpy(long_line + i * 4, "foo ", 4);
+    long_line[repeat_count * 4] = '\0';
+    grep = grep_create("foo", false, 1);
+    grep_add_text(grep, "<buffer 8>", 8, long_line, repeat_count * 4);
+    grep_run(grep);
+    Grep_Hit *hits;
+    int hit_count;
+    Grep_Stats stats;
+    bool is_capped = _unit_tests_grep_wait(grep, &hits, &hit_count, &stats) &&
+        hit_count == GREP_MAX_HITS && stats.is_truncated &&
+        hits[hit_count - 1].col == (GREP_MAX_HITS - 1) * 4 && strlen(hits[hit_count - 1].preview) == GREP_MAX_PREVIEW_LEN;
+    grep_free_hits(hits, hit_count);
+    free(hits);
+    grep_destroy(grep);
+
+    char name[64];
+    int line = -1, col = -1;
+    bool parses = grep_parse_hit_line("sub/b.c:1:5: int Foo;", name, sizeof(name), &line, &col) &&
+        strcmp(name, "sub/b.c") == 0 && line == 0 && col == 4;
+    bool parses_colon_in_name = grep_parse_hit_line("a:b:12:3: x:1:1:", name, sizeof(name), &line, &col) &&
+        strcmp(name, "a:b") == 0 && line == 11 && col == 2;
+    bool rejects = !grep_parse_hit_line("Search everywhere for \"foo\"", name, sizeof(name), &line, &col) &&
+        !grep_parse_hit_line(":1:1: no name", name, sizeof(name), &line, &col);
+
+    UNIT_TESTS_RUN_CHECK(all_found && is_capped && parses && parses_colon_in_name && rejects);
+
+    _unit_tests_remove_tree(dir);
+}
+
+bool _unit_tests_match_index_equals_rebuilt(const Match_Index *index, const Text_Buffer *text_buffer, const History *history, const Search_Pattern *pattern)
+{
+    Match_Index rebuilt = {0};
+    match_index_rebuild(&rebuilt, text_buffer, history, pattern, index->search_seed);
+    // An empty index may have no matches array at all, and memcmp must not be handed NULL
+    bool equal = rebuilt.match_count == index->match_count &&
+        (index->match_count == 0 || memcmp(rebuilt.matches, index->matches, index->match_count * sizeof(index->matches[0])) == 0);
+    match_index_destroy(&rebuilt);
+    return equal;
+}
+
+void test__match_index(UT_State *s)
+{
+    const char *needles[] = {"ab", "b\na"};
+    bool all_match = true;
+    for (int n = 0; n < 2; n++)
+    {
+        Text_Buffer text_buffer = text_buffer_create_from_lines("abab", "b", "ab", "xab", NULL);
+        History history = {0};
+        Search_Pattern pattern = search_pattern_create(needles[n], false);
+        Match_Index index = {0};
+        match_index_sync(&index, &text_buffer, &history, &pattern, 1);
+
+        // Random edits in history commands, the index follows them several at a time
+        unsigned int seed = 777;
+        const char *ranges[] = {"ab", "b\nab\n", "\n", "aab\nb"};
+        for (int step = 0; step < 400; step++)
+        {
+            history_begin_command(&history, (Cursor_Pos){0, 0}, (Text_Mark){0}, "Test edit");
+            for (int e = 0; e < 3; e++)
+            {
+                seed = seed * 1103515245u + 12345u;
+                int line = (seed >> 8) % text_buffer.line_count;
+                int col = (seed >> 4) % text_buffer.lines[line].len;
+                Cursor_Pos pos = {line, col};
+                switch ((seed >> 20) % 4)
+                {
+                    case 0: text_buffer_history_insert_char(&text_buffer, &history, "ab\n"[(seed >> 12) % 3], pos); break;
+                    case 1: if (text_buffer.line_count > 2) text_buffer_history_remove_char(&text_buffer, &history, pos); break;
+                    case 2: text_buffer_history_insert_range(&text_buffer, &history, ranges[(seed >> 12) % 4], pos); break;
+                    case 3:
+                    {
+                        Cursor_Pos end = cursor_pos_advance_char_n(text_buffer, pos, 1 + (seed >> 12) % 6, 1, true);
+                        if (text_buffer.line_count > 4 && (end.line > pos.line || end.col > pos.col)) text_buffer_history_remove_range(&text_buffer, &history, pos, end);
+                    } break;
+                }
+            }
+            history_commit_command(&history);
+            if (step % 2 == 0) continue;
+
+            match_index_sync(&index, &text_buffer, &history, &pattern, 1);
+            if (!_unit_tests_match_index_equals_rebuilt(&index, &text_buffer, &history, &pattern)) all_match = false;
+        }
+
+        // Text replaced outside the history rebuilds it
+        text_buffer_insert_range(&text_buffer, "ab\nab\n", (Cursor_Pos){0, 0});
+        match_index_sync(&index, &text_buffer, &history, &pattern, 1);
+        if (!_unit_tests_match_index_equals_rebuilt(&index, &text_buffer, &history, &pattern)) all_match = false;
+
+        match_index_destroy(&index);
+        search_pattern_destroy(&pattern);
+        for (int i = 0; i < history.command_count; i++)
+        {
+            for (int d = 0; d < history.commands[i].delta_count; d++)
+            {
+                Delta *delta = &history.commands[i].deltas[d];
+                if (delta->kind == DELTA_INSERT_RANGE) free(delta->insert_range.range);
+                if (delta->kind == DELTA_REMOVE_RANGE) free(delta->remove_range.range);
+            }
+            free(history.commands[i].deltas);
+        }
+        free(history.commands);
+        text_buffer_destroy(&text_buffer);
+    }
+
+    UNIT_TESTS_RUN_CHECK(all_match);
+}
+
 void test__string_builder(UT_State *s)
 {
     String_Builder sb = {0};
@@ -1410,6 +2485,480 @@ void test__string_builder(UT_State *s)
     free(compiled_str);
 }
 
+Text_Buffer bench__make_text_buffer(int line_count)
+{
+    Text_Buffer text_buffer = {0};
+    for (int i = 0; i < line_count; i++)
+    {
+        text_buffer_append_f(&text_buffer, "line %d", i);
+    }
+    return text_buffer;
+}
+
+double bench__text_buffer_remove_half(int line_count, bool *out_correct)
+{
+    Text_Buffer text_buffer = bench__make_text_buffer(line_count);
+    Cursor_Pos start = {line_count / 4, 2};
+    Cursor_Pos end = {line_count / 4 + line_count / 2, 2};
+    double start_time = _unit_tests_get_time_ms();
+    text_buffer_remove_range(&text_buffer, start, end);
+    double elapsed = _unit_tests_get_time_ms() - start_time;
+    char expected_joined_line[64]; // "li" from the start line, "ne N" from the end line
+    snprintf(expected_joined_line, sizeof(expected_joined_line), "line %d\n", end.line);
+    *out_correct = text_buffer.line_count == line_count - line_count / 2 &&
+        strcmp(text_buffer.lines[start.line].str, expected_joined_line) == 0;
+    text_buffer_destroy(&text_buffer);
+    return elapsed;
+}
+
+void test__bench_text_buffer_remove_range(UT_State *s)
+{
+    // Removing half of the buffer should scale linearly, 4x the lines taking about 4x the time and not ~16x
+    bool small_correct, large_correct;
+    double small_ms = bench__text_buffer_remove_half(50000, &small_correct);
+    double large_ms = bench__text_buffer_remove_half(200000, &large_correct);
+    double ratio = large_ms / (small_ms > 0.05 ? small_ms : 0.05);
+    UNIT_TESTS_BENCH_REPORT("50k lines: %.2f ms, 200k lines: %.2f ms, ratio %.1f", small_ms, large_ms, ratio);
+    UNIT_TESTS_RUN_CHECK(small_correct && large_correct);
+}
+
+double bench__buffer_text_frame(int line_count, bool *out_correct)
+{
+    // The real render_view_buffer_text into a batch of its own, which is dropped every frame instead of flushed to GL
+    stbtt_bakedchar char_data[96] = {0};
+    for (int i = 0; i < 96; i++) char_data[i].xadvance = 8.0f;
+    Render_State render_state = {0};
+    render_state.font = (Render_Font){ .char_data = char_data, .char_count = 96, .ascent = 16.0f, .descent = -4.0f, .i_dpi_scale = 1.0f };
+    font_init_advances(&render_state.font);
+    render_state.batch = render_batch_create();
+    render_batch_set_mvp(render_state.batch, (m4){0});
+    float line_height = get_font_line_height(render_state.font);
+
+    Text_Buffer text_buffer = bench__make_text_buffer(line_count);
+    Viewport viewport = { .rect = { 0, (line_count / 2) * line_height, 800, 600 }, .zoom = 1.0f };
+    int first_line, end_line;
+    viewport_get_visible_lines(viewport, line_height, text_buffer.line_count, &first_line, &end_line);
+    int visible_line_count = 0, visible_glyph_count = 0;
+    for (int i = first_line; i < end_line; i++)
+    {
+        if (i * line_height >= viewport.rect.y + viewport.rect.h) break; // Starts right at the bottom edge, not seen
+        visible_line_count++;
+        visible_glyph_count += text_buffer.lines[i].len - 1;
+    }
+
+    const int frame_count = 10000;
+    bool all_drawn = true;
+    double start_time = _unit_tests_get_time_ms();
+    for (int frame = 0; frame < frame_count; frame++)
+    {
+        render_view_buffer_text(text_buffer, viewport, &render_state);
+        all_drawn &= render_state.batch->vert_count == visible_glyph_count * 6;
+        render_state.batch->vert_count = 0;
+        render_state.batch->cmd_count = 0;
+    }
+    double elapsed = (_unit_tests_get_time_ms() - start_time) / frame_count;
+    *out_correct = all_drawn && visible_line_count == 30;
+    text_buffer_destroy(&text_buffer);
+    render_batch_destroy(render_state.batch);
+    free(render_state.font.advances);
+    return elapsed;
+}
+
+void test__bench_render_view_buffer_text(UT_State *s)
+{
+    // Frame cost should only depend on how many lines fit in the viewport, not on buffer size.
+    // The large buffer goes first, so building it warms the CPU up for both measurements.
+    bool small_correct, large_correct;
+    double large_ms = bench__buffer_text_frame(1000000, &large_correct);
+    double small_ms = bench__buffer_text_frame(1000, &small_correct);
+    UNIT_TESTS_BENCH_REPORT("1k lines: %.4f ms/frame, 1M lines: %.4f ms/frame, 30 visible lines", small_ms, large_ms);
+    UNIT_TESTS_RUN_CHECK(small_correct && large_correct);
+}
+
+void test__bench_view_grid_query(UT_State *s)
+{
+    // Culling a window sized rect from a big canvas, against checking every view
+    const int side = 100;
+    View *views = xcalloc(side * side * sizeof(View));
+    View_Grid grid = {0};
+    for (int i = 0; i < side * side; i++)
+    {
+        views[i].outer_rect = (Rect){(i % side) * 700.0f, (i / side) * 900.0f, 600, 800};
+        view_grid_insert(&grid, &views[i], views[i].outer_rect);
+    }
+
+    const int frame_count = 1000;
+    int grid_visible = 0, scan_visible = 0;
+    double start_time = _unit_tests_get_time_ms();
+    for (int frame = 0; frame < frame_count; frame++)
+    {
+        Rect window = {(frame % side) * 500.0f, (frame % side) * 600.0f, 1000, 900};
+        View **visible;
+        grid_visible += view_grid_query_rect(&grid, window, &visible);
+    }
+    double grid_ms = (_unit_tests_get_time_ms() - start_time) / frame_count;
+
+    start_time = _unit_tests_get_time_ms();
+    for (int frame = 0; frame < frame_count; frame++)
+    {
+        Rect window = {(frame % side) * 500.0f, (frame % side) * 600.0f, 1000, 900};
+        for (int i = 0; i < side * side; i++)
+        {
+            if (rect_intersect(views[i].outer_rect, window)) scan_visible++;
+        }
+    }
+    double scan_ms = (_unit_tests_get_time_ms() - start_time) / frame_count;
+
+    UNIT_TESTS_BENCH_REPORT("%d views, %d visible: grid %.4f ms/frame, scan %.4f ms/frame",
+        side * side, grid_visible / frame_count, grid_ms, scan_ms);
+    UNIT_TESTS_RUN_CHECK(grid_visible == scan_visible);
+
+    view_grid_destroy(&grid);
+    free(views);
+}
+
+void test__bench_text_buffer_create_from_data(UT_State *s)
+{
+    // ~64 MB of lines of varying length
+    size_t size = 64 * 1024 * 1024;
+    char *data = xmalloc(size);
+    size_t line_count = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        bool is_newline = (i * 2654435761u) % 61 == 0;
+        data[i] = is_newline ? '\n' : 'a' + i % 26;
+        if (is_newline) line_count++;
+    }
+    if (data[size - 1] != '\n') line_count++;
+
+    double start_time = _unit_tests_get_time_ms();
+    Text_Buffer single_threaded = text_buffer_create_from_data_threaded(data, size, 1);
+    double single_threaded_ms = _unit_tests_get_time_ms() - start_time;
+
+    start_time = _unit_tests_get_time_ms();
+    Text_Buffer multi_threaded = text_buffer_create_from_data(data, size);
+    double multi_threaded_ms = _unit_tests_get_time_ms() - start_time;
+
+    double mb = size / (1024.0 * 1024.0);
+    int thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count > TEXT_BUFFER_MAX_LOAD_THREADS) thread_count = TEXT_BUFFER_MAX_LOAD_THREADS;
+    UNIT_TESTS_BENCH_REPORT("%.0f MB, %zu lines: 1 thread %.2f ms (%.0f MB/s), %d threads %.2f ms (%.0f MB/s)",
+        mb, line_count,
+        single_threaded_ms, mb / (single_threaded_ms / 1000.0),
+        thread_count, multi_threaded_ms, mb / (multi_threaded_ms / 1000.0));
+    UNIT_TESTS_RUN_CHECK(single_threaded.line_count == (int)line_count && multi_threaded.line_count == (int)line_count);
+
+    text_buffer_destroy(&single_threaded);
+    text_buffer_destroy(&multi_threaded);
+    free(data);
+}
+
+void test__bench_text_buffer_search(UT_State *s)
+{
+    // ~100 MB of lines with the needle only on the last one
+    size_t size = 100 * 1024 * 1024;
+    char *data = xmalloc(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        bool is_newline = (i * 2654435761u) % 61 == 0;
+        data[i] = is_newline ? '\n' : 'a' + i % 26;
+    }
+    const char *needle = "needle_in_haystack";
+    memcpy(data + size - 64, needle, strlen(needle));
+    Text_Buffer text_buffer = text_buffer_create_from_data(data, size);
+    free(data);
+
+    // What text_buffer_search_next used to do
+    double start_time = _unit_tests_get_time_ms();
+    Cursor_Pos strstr_pos = {-1, -1};
+    for (int i = 0; i < text_buffer.line_count; i++)
+    {
+        char *match = strstr(text_buffer.lines[i].str, needle);
+        if (match)
+        {
+            strstr_pos = (Cursor_Pos){i, (int)(match - text_buffer.lines[i].str)};
+            break;
+        }
+    }
+    double strstr_ms = _unit_tests_get_time_ms() - start_time;
+
+    Search_Pattern exact = search_pattern_create(needle, false);
+    Search_Pattern folded = search_pattern_create(needle, true);
+    Cursor_Pos next_pos, folded_pos, prev_pos;
+
+    start_time = _unit_tests_get_time_ms();
+    bool found_next = text_buffer_search_next(&text_buffer, &exact, (Cursor_Pos){0, -1}, &next_pos);
+    double next_ms = _unit_tests_get_time_ms() - start_time;
+
+    start_time = _unit_tests_get_time_ms();
+    bool found_folded = text_buffer_search_next(&text_buffer, &folded, (Cursor_Pos){0, -1}, &folded_pos);
+    double folded_ms = _unit_tests_get_time_ms() - start_time;
+
+    // Nothing to find, backwards covers the whole buffer
+    Search_Pattern absent = search_pattern_create("needle_not_in_haystack", false);
+    start_time = _unit_tests_get_time_ms();
+    bool found_prev = text_buffer_search_prev(&text_buffer, &absent, (Cursor_Pos){text_buffer.line_count, 0}, &prev_pos);
+    double prev_ms = _unit_tests_get_time_ms() - start_time;
+    search_pattern_destroy(&absent);
+
+    // Both sides are bound by walking the line table, forward measured 0.9-1.0x of the strstr loop (SSE2, -O1)
+    double mb = size / (1024.0 * 1024.0);
+    UNIT_TESTS_BENCH_REPORT("%.0f MB: strstr loop %.2f ms, forward %.2f ms (%.1fx), case folded %.2f ms, backward %.2f ms",
+        mb, strstr_ms, next_ms, strstr_ms / next_ms, folded_ms, prev_ms);
+    UNIT_TESTS_RUN_CHECK(found_next && found_folded && !found_prev &&
+        cursor_pos_eq(next_pos, strstr_pos) && cursor_pos_eq(folded_pos, strstr_pos));
+
+    search_pattern_destroy(&exact);
+    search_pattern_destroy(&folded);
+    text_buffer_destroy(&text_buffer);
+}
+
+void test__bench_text_buffer_regex_search(UT_State *s)
+{
+    // ~32 MB of lines, every 1000th ends in an identifier the pattern looks for
+    Text_Buffer text_buffer = {0};
+    int line_count = 0;
+    size_t size = 0;
+    for (unsigned int i = 0; size < 32 * 1024 * 1024; i++)
+    {
+        Text_Line line = i % 1000 == 0 ?
+            text_line_make_f("    result = compute(value_%u) + Offset_%03u", i, i % 997) :
+            text_line_make_f("    result = compute(value_%u) + offset * %u;", i, i * 2654435761u);
+        size += line.len;
+        text_buffer_append_line(&text_buffer, line);
+        line_count++;
+    }
+    // Anchored, led by a literal, a class every line is full of, a plain word
+    const char *patterns[] = {"[A-Z][a-z]+_[0-9]{3}$", "Offset_[0-9]+", "[a-z]+_[0-9]+\\)", "compute"};
+    int pattern_count = (int)(sizeof(patterns) / sizeof(patterns[0]));
+    double posix_ms[4], regex_ms[4];
+    int posix_counts[4], counts[4];
+    for (int p = 0; p < pattern_count; p++)
+    {
+        regex_t posix;
+        regcomp(&posix, patterns[p], REG_EXTENDED | REG_NOSUB);
+        double start_time = _unit_tests_get_time_ms();
+        posix_counts[p] = 0;
+        for (int i = 0; i < text_buffer.line_count; i++)
+        {
+            // regexec wants the line break gone for $ to mean the line end
+            Text_Line *line = &text_buffer.lines[i];
+            line->str[line->len - 1] = '\0';
+            if (regexec(&posix, line->str, 0, NULL, 0) == 0) posix_counts[p]++;
+            line->str[line->len - 1] = '\n';
+        }
+        posix_ms[p] = _unit_tests_get_time_ms() - start_time;
+        regfree(&posix);
+
+        // Every line at most once, like regexec above
+        Search_Regex regex;
+        search_regex_compile(&regex, patterns[p], false, NULL, 0);
+        start_time = _unit_tests_get_time_ms();
+        counts[p] = 0;
+        Cursor_Pos pos = {0, -1}, end;
+        while (text_buffer_regex_search_next(&text_buffer, &regex, pos, &pos, &end))
+        {
+            counts[p]++;
+            pos = (Cursor_Pos){pos.line + 1, -1};
+        }
+        regex_ms[p] = _unit_tests_get_time_ms() - start_time;
+        search_regex_destroy(&regex);
+    }
+
+    // Backtracking engines go exponential on the run of x with no y after it, the DFA stays linear.
+    // The line has "xy" up front so the literal check can't rule it out.
+    Search_Regex nested;
+    search_regex_compile(&nested, "(x+x+)+y", false, NULL, 0);
+    char line[4096];
+    memset(line, 'x', sizeof(line));
+    line[1] = 'y';
+    int start, match_end;
+    double start_time = _unit_tests_get_time_ms();
+    bool found_nested = false;
+    for (int i = 0; i < 1000; i++)
+    {
+        found_nested |= search_regex_search_line(&nested, line, sizeof(line), 0, INT_MAX, false, &start, &match_end);
+    }
+    double nested_ms = _unit_tests_get_time_ms() - start_time;
+    search_regex_destroy(&nested);
+
+    double mb = size / (1024.0 * 1024.0);
+    UNIT_TESTS_BENCH_REPORT("%.0f MB, %d lines, regexec vs DFA: anchored %.1f / %.1f ms, literal led %.1f / %.1f ms, "
+        "dense class %.1f / %.1f ms, plain word %.1f / %.1f ms; nested repeats over 4 MB %.2f ms",
+        mb, line_count, posix_ms[0], regex_ms[0], posix_ms[1], regex_ms[1], posix_ms[2], regex_ms[2], posix_ms[3], regex_ms[3], nested_ms);
+    bool counts_agree = true;
+    for (int p = 0; p < pattern_count; p++)
+    {
+        if (counts[p] != posix_counts[p]) counts_agree = false;
+    }
+    UNIT_TESTS_RUN_CHECK(counts_agree && counts[0] == (line_count + 999) / 1000 && counts[3] == line_count && !found_nested);
+
+    text_buffer_destroy(&text_buffer);
+}
+
+void test__bench_search_scanner(UT_State *s)
+{
+    // A million lines, typing "needle" with the only match early on
+    Text_Buffer text_buffer = {0};
+    for (int i = 0; i < 1000000; i++)
+    {
+        text_buffer_append_line(&text_buffer, text_line_make_f("line %d of the haystack, nothing to see here", i));
+    }
+    text_buffer_insert_line(&text_buffer, text_line_make_f("the needle"), 10000);
+    Search_Scanner scanner = {0};
+    search_scanner_start(&scanner);
+    Search_Scan_Result result;
+
+    // Taken when the prompt opens
+    double start_time = _unit_tests_get_time_ms();
+    search_scanner_prepare(&scanner, &text_buffer, 1);
+    double snapshot_ms = _unit_tests_get_time_ms() - start_time;
+
+    // Every keystroke supersedes the last scan, posting costs the main thread next to nothing
+    const char *needle = "needle";
+    double post_ms = 0.0;
+    unsigned int seed = 0;
+    for (int len = 1; len <= (int)strlen(needle); len++)
+    {
+        char query[16];
+        snprintf(query, sizeof(query), "%.*s", len, needle);
+        start_time = _unit_tests_get_time_ms();
+        seed = search_scanner_post(&scanner, &text_buffer, 1, query, false, false, (Cursor_Pos){0, 0});
+        post_ms += _unit_tests_get_time_ms() - start_time;
+    }
+    start_time = _unit_tests_get_time_ms();
+    double first_ms = -1.0;
+    bool is_done = false;
+    while (!is_done && _unit_tests_get_time_ms() - start_time < 5000.0)
+    {
+        result = search_scanner_poll(&scanner);
+        if (result.seed != seed) continue;
+        if (result.has_first && first_ms < 0.0) first_ms = _unit_tests_get_time_ms() - start_time;
+        is_done = result.is_done;
+    }
+    double done_ms = _unit_tests_get_time_ms() - start_time;
+
+    // A query with nothing to find scans everything, a newer one shouldn't wait for that
+    search_scanner_post(&scanner, &text_buffer, 1, "absent", false, false, (Cursor_Pos){0, 0});
+    usleep(1000);
+    start_time = _unit_tests_get_time_ms();
+    seed = search_scanner_post(&scanner, &text_buffer, 1, "the needle", false, false, (Cursor_Pos){0, 0});
+    while (search_scanner_poll(&scanner).seed != seed && _unit_tests_get_time_ms() - start_time < 5000.0) {}
+    double cancel_ms = _unit_tests_get_time_ms() - start_time;
+    Search_Scan_Result superseding;
+    bool is_superseded = _unit_tests_search_scanner_wait(&scanner, seed, &superseding);
+
+    UNIT_TESTS_BENCH_REPORT("%d lines: snapshot %.2f ms, %d keystrokes posted in %.3f ms, first match %.2f ms, count %.2f ms, stale scan dropped in %.3f ms",
+        text_buffer.line_count, snapshot_ms, (int)strlen(needle), post_ms, first_ms, done_ms, cancel_ms);
+    UNIT_TESTS_RUN_CHECK(is_done && cursor_pos_eq(result.first, (Cursor_Pos){10000, 4}) && result.match_count == 1 &&
+        is_superseded && superseding.match_count == 1);
+
+    search_scanner_stop(&scanner);
+    text_buffer_destroy(&text_buffer);
+}
+
+void test__bench_grep(UT_State *s)
+{
+    // 64 dirs of 8 files, about 64 KB of text each, a match every 100 lines
+    char dir_template[] = "/tmp/e2_grep_bench_XXXXXX";
+    mkdtemp(dir_template);
+    char dir[PATH_MAX];
+    realpath(dir_template, dir);
+    String_Builder sb = {0};
+    for (int i = 0; i < 1500; i++)
+    {
+        string_builder_append_f(&sb, i % 100 == 0 ? "line %d with the needle in it\n" : "line %d of the haystack, nothing to see here\n", i);
+    }
+    char *text = string_builder_compile_and_destroy(&sb);
+    int hit_count_per_file = 0;
+    for (const char *at = text; (at = strstr(at, "needle")); at++) hit_count_per_file++;
+    for (int d = 0; d < 64; d++)
+    {
+        char path[PATH_MAX + 32];
+        snprintf(path, sizeof(path), "%s/dir_%d", dir, d);
+        mkdir(path, 0755);
+        for (int f = 0; f < 8; f++)
+        {
+            snprintf(path, sizeof(path), "%s/dir_%d/file_%d.txt", dir, d, f);
+            _unit_tests_write_file(path, text, strlen(text));
+        }
+    }
+
+    char report[256] = "";
+    bool all_found = true;
+    size_t byte_count = 0;
+    int thread_counts[] = {1, 2, 4, 8};
+    for (int t = 0; t < 4; t++)
+    {
+        Grep *grep = grep_create("needle", false, thread_counts[t]);
+        grep_add_dir(grep, dir);
+        double start_time = _unit_tests_get_time_ms();
+        grep_run(grep);
+        Grep_Hit *hits;
+        int hit_count;
+        Grep_Stats stats;
+        bool is_done = _unit_tests_grep_wait(grep, &hits, &hit_count, &stats);
+        double total_ms = _unit_tests_get_time_ms() - start_time;
+        all_found &= is_done && hit_count == 64 * 8 * hit_count_per_file && stats.file_count == 64 * 8;
+        byte_count = stats.byte_count;
+        size_t len = strlen(report);
+        snprintf(report + len, sizeof(report) - len, "%s%d threads %.2f ms (%d steals)",
+            t > 0 ? ", " : "", thread_counts[t], total_ms, stats.steal_count);
+        grep_free_hits(hits, hit_count);
+        free(hits);
+        grep_destroy(grep);
+    }
+
+    UNIT_TESTS_BENCH_REPORT("%zu MB in 512 files: %s", byte_count / (1024 * 1024), report);
+    UNIT_TESTS_RUN_CHECK(all_found);
+
+    free(text);
+    _unit_tests_remove_tree(dir);
+}
+
+void test__bench_match_index_sync(UT_State *s)
+{
+    // ~1M lines with a match on every 10th, then one typed character
+    int line_count = 1000000;
+    Text_Buffer text_buffer = {0};
+    for (int i = 0; i < line_count; i++)
+    {
+        text_buffer_append_line(&text_buffer, text_line_make_f(i % 10 == 0 ? "int foo_%d = bar;" : "int baz_%d = bar;", i));
+    }
+    History history = {0};
+    Search_Pattern pattern = search_pattern_create("foo", false);
+    Match_Index index = {0};
+
+    double start_time = _unit_tests_get_time_ms();
+    match_index_sync(&index, &text_buffer, &history, &pattern, 1);
+    double rebuild_ms = _unit_tests_get_time_ms() - start_time;
+    int match_count_before = index.match_count;
+
+    history_begin_command(&history, (Cursor_Pos){0, 0}, (Text_Mark){0}, "Bench edit");
+    text_buffer_history_insert_range(&text_buffer, &history, "foo\n", (Cursor_Pos){line_count / 2, 0});
+    history_commit_command(&history);
+
+    start_time = _unit_tests_get_time_ms();
+    match_index_sync(&index, &text_buffer, &history, &pattern, 1);
+    double sync_ms = _unit_tests_get_time_ms() - start_time;
+
+    start_time = _unit_tests_get_time_ms();
+    int k = match_index_lower_bound(&index, (Cursor_Pos){line_count / 2, 0});
+    double lookup_ms = _unit_tests_get_time_ms() - start_time;
+
+    UNIT_TESTS_BENCH_REPORT("%d lines, %d matches: full scan %.2f ms, sync after an edit %.3f ms, match k lookup %.4f ms",
+        line_count, index.match_count, rebuild_ms, sync_ms, lookup_ms);
+    UNIT_TESTS_RUN_CHECK(index.match_count == match_count_before + 1 && k == line_count / 20 &&
+        cursor_pos_eq(index.matches[k], (Cursor_Pos){line_count / 2, 0}));
+
+    match_index_destroy(&index);
+    search_pattern_destroy(&pattern);
+    free(history.commands[0].deltas[0].insert_range.range);
+    free(history.commands[0].deltas);
+    free(history.commands);
+    text_buffer_destroy(&text_buffer);
+}
+
 // ---------------------------------------------------------------------
 
 void unit_tests_run(Text_Buffer *log_buffer, bool break_on_failure)
@@ -1426,6 +2975,7 @@ void unit_tests_run(Text_Buffer *log_buffer, bool break_on_failure)
     test__text_line_remove_char(&s);
     test__text_line_insert_range(&s);
     test__text_line_remove_range(&s);
+    test__text_line_resize__capacity(&s);
     text_buffer_append_f(s.log_buffer, "");
 
     text_buffer_append_f(s.log_buffer, "TEXT BUFFER TESTS:");
@@ -1443,8 +2993,13 @@ void unit_tests_run(Text_Buffer *log_buffer, bool break_on_failure)
     test__text_buffer_insert_char(&s);
     test__text_buffer_remove_char(&s);
     test__text_buffer_insert_range(&s);
+    test__text_buffer_insert_range__many_lines(&s);
     test__text_buffer_remove_range(&s);
+    test__text_buffer_shrink_to_fit(&s);
     test__text_buffer_extract_range(&s);
+    test__text_buffer_create_from_data(&s);
+    test__text_buffer_create_from_data_threaded(&s);
+    test__text_buffer_count_newlines(&s);
     text_buffer_append_f(s.log_buffer, "");
 
     text_buffer_append_f(s.log_buffer, "CURSOR POS TESTS:");
@@ -1490,9 +3045,68 @@ void unit_tests_run(Text_Buffer *log_buffer, bool break_on_failure)
     test__cursor_pos_to_prev_start_of_paragraph__start_at_first_white_lines(&s);
     text_buffer_append_f(s.log_buffer, "");
 
+    text_buffer_append_f(s.log_buffer, "LARGE FILE TESTS:");
+    test__large_file_get_line(&s);
+    text_buffer_append_f(s.log_buffer, "");
+
+    text_buffer_append_f(s.log_buffer, "RENDERER TESTS:");
+    test__font_line_metrics(&s);
+    test__render_batch_merge(&s);
+    test__render_batch_long_string(&s);
+    test__view_cache_key(&s);
+    text_buffer_append_f(s.log_buffer, "");
+
+    text_buffer_append_f(s.log_buffer, "VIEW GRID TESTS:");
+    test__view_grid(&s);
+    text_buffer_append_f(s.log_buffer, "");
+
+    text_buffer_append_f(s.log_buffer, "FILE WATCH TESTS:");
+    test__file_watch(&s);
+    text_buffer_append_f(s.log_buffer, "");
+
+    text_buffer_append_f(s.log_buffer, "MODULE LOADER TESTS:");
+    test__module_hash_file(&s);
+    text_buffer_append_f(s.log_buffer, "");
+
+    text_buffer_append_f(s.log_buffer, "SEARCH TESTS:");
+    test__search_forward_backward(&s);
+    test__text_buffer_search(&s);
+    test__match_index(&s);
+    test__search_regex(&s);
+    test__text_buffer_regex_search(&s);
+    test__search_scanner(&s);
+    test__grep(&s);
+    text_buffer_append_f(s.log_buffer, "");
+
+    text_buffer_append_f(s.log_buffer, "JOURNAL TESTS:");
+    test__journal_replay(&s);
+    text_buffer_append_f(s.log_buffer, "");
+
     text_buffer_append_f(s.log_buffer, "STRING BUILDER TESTS:");
     test__string_builder(&s);
     text_buffer_append_f(s.log_buffer, "");
 
     _unit_tests_finish(&s);
 }
+
+// Kept apart from unit_tests_run, these load tens of MB and take seconds
+void unit_tests_run_benchmarks(Text_Buffer *log_buffer, bool break_on_failure)
+{
+    UT_State s = {0};
+    s.log_buffer = log_buffer;
+    s.break_on_failure = break_on_failure;
+
+    text_buffer_append_f(s.log_buffer, "BENCHMARKS:");
+    test__bench_text_buffer_remove_range(&s);
+    test__bench_text_buffer_create_from_data(&s);
+    test__bench_render_view_buffer_text(&s);
+    test__bench_view_grid_query(&s);
+    test__bench_text_buffer_search(&s);
+    test__bench_match_index_sync(&s);
+    test__bench_text_buffer_regex_search(&s);
+    test__bench_search_scanner(&s);
+    test__bench_grep(&s);
+    text_buffer_append_f(s.log_buffer, "");
+
+    _unit_tests_finish(&s);
+}
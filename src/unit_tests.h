@@ -5,3 +5,4 @@
 #include "text_buffer.h"
 
 void unit_tests_run(Text_Buffer *log_buffer, bool break_on_failure);
+void unit_tests_run_benchmarks(Text_Buffer *log_buffer, bool break_on_failure);
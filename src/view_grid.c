@@ -0,0 +1,230 @@
+#include "view_grid.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "editor.h"
+#include "util.h"
+
+static void view_grid__push_view(struct View ***views, int *count, int *cap, struct View *view)
+{
+    if (*count >= *cap)
+    {
+        *cap = *cap ? *cap * 2 : 8;
+        *views = xrealloc(*views, *cap * sizeof((*views)[0]));
+    }
+    (*views)[(*count)++] = view;
+}
+
+static void view_grid__remove_view(struct View **views, int *count, struct View *view)
+{
+    for (int i = 0; i < *count; i++)
+    {
+        if (views[i] == view)
+        {
+            views[i] = views[--(*count)];
+            return;
+        }
+    }
+    bassert(false);
+}
+
+static uint32_t view_grid__hash(int x, int y)
+{
+    return (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u;
+}
+
+static int view_grid__cell_coord(float v)
+{
+    return (int)floorf(v / VIEW_GRID_CELL_SIZE);
+}
+
+static View_Grid_Cell *view_grid__find_cell(View_Grid *grid, int x, int y)
+{
+    if (grid->cell_cap == 0) return NULL;
+    uint32_t mask = (uint32_t)grid->cell_cap - 1;
+    for (uint32_t i = view_grid__hash(x, y) & mask;; i = (i + 1) & mask)
+    {
+        View_Grid_Cell *cell = &grid->cells[i];
+        if (!cell->is_used) return NULL;
+        if (cell->x == x && cell->y == y) return cell;
+    }
+}
+
+static View_Grid_Cell *view_grid__get_or_add_cell(View_Grid *grid, int x, int y)
+{
+    View_Grid_Cell *cell = view_grid__find_cell(grid, x, y);
+    if (cell) return cell;
+
+    // Keep at most half the slots used, so probe runs stay short
+    if ((grid->used_cell_count + 1) * 2 > grid->cell_cap)
+    {
+        View_Grid_Cell *old_cells = grid->cells;
+        int old_cap = grid->cell_cap;
+        grid->cell_cap = old_cap ? old_cap * 2 : 64;
+        grid->cells = xcalloc(grid->cell_cap * sizeof(grid->cells[0]));
+        uint32_t mask = (uint32_t)grid->cell_cap - 1;
+        for (int i = 0; i < old_cap; i++)
+        {
+            if (!old_cells[i].is_used) continue;
+            uint32_t j = view_grid__hash(old_cells[i].x, old_cells[i].y) & mask;
+            while (grid->cells[j].is_used) j = (j + 1) & mask;
+            grid->cells[j] = old_cells[i];
+        }
+        free(old_cells);
+    }
+
+    uint32_t mask = (uint32_t)grid->cell_cap - 1;
+    uint32_t i = view_grid__hash(x, y) & mask;
+    while (grid->cells[i].is_used) i = (i + 1) & mask;
+    cell = &grid->cells[i];
+    *cell = (View_Grid_Cell){ .x = x, .y = y, .is_used = true };
+    grid->used_cell_count++;
+    return cell;
+}
+
+static void view_grid__add_result(View_Grid *grid, struct View *view)
+{
+    View_Grid_Item *item = &view->grid_item;
+    if (item->query_stamp == grid->query_stamp) return; // Views spanning several cells are seen more than once
+    item->query_stamp = grid->query_stamp;
+    view_grid__push_view(&grid->query_views, &grid->query_view_count, &grid->query_view_cap, view);
+}
+
+void view_grid_destroy(View_Grid *grid)
+{
+    for (int i = 0; i < grid->cell_cap; i++)
+    {
+        free(grid->cells[i].views);
+    }
+    free(grid->cells);
+    free(grid->oversized_views);
+    free(grid->query_views);
+    *grid = (View_Grid){0};
+}
+
+void view_grid_insert(View_Grid *grid, struct View *view, Rect bounds)
+{
+    View_Grid_Item *item = &view->grid_item;
+    bassert(!item->is_inserted);
+
+    item->bounds = bounds;
+    item->min_cell_x = view_grid__cell_coord(bounds.x);
+    item->min_cell_y = view_grid__cell_coord(bounds.y);
+    item->max_cell_x = view_grid__cell_coord(bounds.x + bounds.w);
+    item->max_cell_y = view_grid__cell_coord(bounds.y + bounds.h);
+    item->is_inserted = true;
+
+    long long cell_count = (long long)(item->max_cell_x - item->min_cell_x + 1) * (item->max_cell_y - item->min_cell_y + 1);
+    item->is_oversized = cell_count > VIEW_GRID_MAX_CELLS_PER_VIEW;
+    if (item->is_oversized)
+    {
+        view_grid__push_view(&grid->oversized_views, &grid->oversized_view_count, &grid->oversized_view_cap, view);
+        return;
+    }
+
+    for (int y = item->min_cell_y; y <= item->max_cell_y; y++)
+    {
+        for (int x = item->min_cell_x; x <= item->max_cell_x; x++)
+        {
+            View_Grid_Cell *cell = view_grid__get_or_add_cell(grid, x, y);
+            view_grid__push_view(&cell->views, &cell->view_count, &cell->view_cap, view);
+        }
+    }
+}
+
+void view_grid_remove(View_Grid *grid, struct View *view)
+{
+    View_Grid_Item *item = &view->grid_item;
+    if (!item->is_inserted) return;
+
+    if (item->is_oversized)
+    {
+        view_grid__remove_view(grid->oversized_views, &grid->oversized_view_count, view);
+    }
+    else
+    {
+        for (int y = item->min_cell_y; y <= item->max_cell_y; y++)
+        {
+            for (int x = item->min_cell_x; x <= item->max_cell_x; x++)
+            {
+                View_Grid_Cell *cell = view_grid__find_cell(grid, x, y);
+                bassert(cell);
+                view_grid__remove_view(cell->views, &cell->view_count, view);
+            }
+        }
+    }
+    item->is_inserted = false;
+}
+
+int view_grid_query_rect(View_Grid *grid, Rect rect, struct View ***out_views)
+{
+    grid->query_stamp++;
+    grid->query_view_count = 0;
+
+    int min_x = view_grid__cell_coord(rect.x);
+    int min_y = view_grid__cell_coord(rect.y);
+    int max_x = view_grid__cell_coord(rect.x + rect.w);
+    int max_y = view_grid__cell_coord(rect.y + rect.h);
+    long long rect_cell_count = (long long)(max_x - min_x + 1) * (max_y - min_y + 1);
+    if (rect_cell_count <= grid->used_cell_count)
+    {
+        for (int y = min_y; y <= max_y; y++)
+        {
+            for (int x = min_x; x <= max_x; x++)
+            {
+                View_Grid_Cell *cell = view_grid__find_cell(grid, x, y);
+                if (!cell) continue;
+                for (int i = 0; i < cell->view_count; i++)
+                {
+                    if (rect_intersect(cell->views[i]->grid_item.bounds, rect)) view_grid__add_result(grid, cell->views[i]);
+                }
+            }
+        }
+    }
+    else
+    {
+        // Rect covers more cells than exist, walking the table is cheaper
+        for (int c = 0; c < grid->cell_cap; c++)
+        {
+            View_Grid_Cell *cell = &grid->cells[c];
+            if (!cell->is_used) continue;
+            for (int i = 0; i < cell->view_count; i++)
+            {
+                if (rect_intersect(cell->views[i]->grid_item.bounds, rect)) view_grid__add_result(grid, cell->views[i]);
+            }
+        }
+    }
+
+    for (int i = 0; i < grid->oversized_view_count; i++)
+    {
+        if (rect_intersect(grid->oversized_views[i]->grid_item.bounds, rect)) view_grid__add_result(grid, grid->oversized_views[i]);
+    }
+
+    *out_views = grid->query_views;
+    return grid->query_view_count;
+}
+
+int view_grid_query_point(View_Grid *grid, v2 p, struct View ***out_views)
+{
+    grid->query_stamp++;
+    grid->query_view_count = 0;
+
+    View_Grid_Cell *cell = view_grid__find_cell(grid, view_grid__cell_coord(p.x), view_grid__cell_coord(p.y));
+    if (cell)
+    {
+        for (int i = 0; i < cell->view_count; i++)
+        {
+            if (rect_contains_p(p, cell->views[i]->grid_item.bounds)) view_grid__add_result(grid, cell->views[i]);
+        }
+    }
+
+    for (int i = 0; i < grid->oversized_view_count; i++)
+    {
+        if (rect_contains_p(p, grid->oversized_views[i]->grid_item.bounds)) view_grid__add_result(grid, grid->oversized_views[i]);
+    }
+
+    *out_views = grid->query_views;
+    return grid->query_view_count;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "rect.h"
+#include "types.h"
+
+// Canvas is split into square cells; a view is listed in every cell its bounds touch
+#define VIEW_GRID_CELL_SIZE 512.0f
+// Views spanning more cells than this are kept in one list that every query checks
+#define VIEW_GRID_MAX_CELLS_PER_VIEW 64
+
+struct View;
+
+// Where a view is in the grid, kept inside the view so it can be taken out again
+typedef struct View_Grid_Item {
+    Rect bounds;
+    int min_cell_x, min_cell_y;
+    int max_cell_x, max_cell_y;
+    bool is_inserted;
+    bool is_oversized;
+    unsigned int query_stamp;
+} View_Grid_Item;
+
+typedef struct View_Grid_Cell {
+    int x, y;
+    struct View **views;
+    int view_count;
+    int view_cap;
+    bool is_used;
+} View_Grid_Cell;
+
+// Uniform grid over the infinite canvas. Cells are created on demand in an
+// open addressing hash table, so only the parts of the canvas with views cost memory.
+typedef struct View_Grid {
+    View_Grid_Cell *cells;
+    int cell_cap; // Power of two
+    int used_cell_count;
+    struct View **oversized_views;
+    int oversized_view_count;
+    int oversized_view_cap;
+    struct View **query_views; // Results of the last query, owned by the grid
+    int query_view_count;
+    int query_view_cap;
+    unsigned int query_stamp;
+} View_Grid;
+
+void view_grid_destroy(View_Grid *grid);
+void view_grid_insert(View_Grid *grid, struct View *view, Rect bounds);
+void view_grid_remove(View_Grid *grid, struct View *view);
+int view_grid_query_rect(View_Grid *grid, Rect rect, struct View ***out_views);
+int view_grid_query_point(View_Grid *grid, v2 p, struct View ***out_views);